@@ -82,8 +82,8 @@ void DebugFilesystem() {
 #endif
 
 #include "mos6502/mos6502.h"
-#if defined(NDS_BUILD) && defined(ARM9)
 #include "mos6502/dynarec.h"
+#if (defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64
 #include "mos6502/dynarec_cpu.h"
 #endif
 
@@ -140,7 +140,17 @@ extern "C" void ITCM_CODE GT_AudioRamWrite(uint16_t address, uint8_t value) {
 extern "C" uint8_t ITCM_CODE GT_JoystickReadFast(uint8_t portNum) {
 	return joysticks->read(portNum, true);
 }
-SystemState system_state;
+static SystemBuffers system_buffers;
+DTCM_DATA SystemState system_state = {
+	0, false, 0, {},
+	system_buffers.ram,
+	system_buffers.vram,
+	system_buffers.vram_rgb15,
+	system_buffers.gram,
+#if GTE_TRACK_UNINIT_RAM
+	system_buffers.ram_init_bits,
+#endif
+};
 CartridgeState cartridge_state;
 
 #ifndef NDS_BUILD
@@ -278,22 +288,41 @@ const uint8_t VIA_SPI_BIT_MISO = 0b10000000;
 // Cached ram_base: updated whenever banking register ($2005) changes
 uint16_t cached_ram_base = 0;
 DTCM_BSS uint8_t* cached_ram_ptr;  // set by UpdateBankingCache()
-DTCM_BSS bool* cached_ram_init_ptr;  // set by UpdateBankingCache()
 
 static inline void UpdateBankingCache() {
 	const uint16_t base = (system_state.banking & BANK_RAM_MASK) << RAM_HIGHBITS_SHIFT;
+	if((base != cached_ram_base) && cpu_core) {
+		cpu_core->InvalidateRamCode();
+#if (defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64
+		Dynarec::InvalidateRamCode();
+#endif
+	}
 	cached_ram_base = base;
 	cached_ram_ptr = &system_state.ram[base];
-	cached_ram_init_ptr = &system_state.ram_initialized[base];
 }
 
+#if GTE_TRACK_UNINIT_RAM
+void GT_MarkRamInit(uint16_t address) {
+	const uint32_t i = cached_ram_base + address;
+	system_state.ram_init_bits[i >> 5] |= 1u << (i & 31);
+}
+
+static bool RamIsInit(uint16_t address) {
+	const uint32_t i = cached_ram_base + address;
+	return (system_state.ram_init_bits[i >> 5] >> (i & 31)) & 1;
+}
+#endif
+
 static inline void UpdateRomReadCache() {
 	if (++cached_rom_decode_epoch == 0) {
 		cached_rom_decode_epoch = 1;
 	}
-#if defined(NDS_BUILD) && defined(ARM9)
-	Dynarec::InvalidateAll();
+#if (defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64
+	Dynarec::SetCodeBank(cartridge_state.bank_mask);
 #endif
+	if(cpu_core) {
+		cpu_core->SetCodeBank(cartridge_state.bank_mask);
+	}
 	// Upper 16KB window is fixed to the flash trailer region for FLASH2M variants.
 	cached_rom_hi_ptr = &cartridge_state.rom[0x1FC000];
 	switch (loadedRomType) {
@@ -531,11 +560,11 @@ uint8_t MemoryReadResolve(const uint16_t address, bool stateful) {
 	} else if((address >= 0x2800) && (address <= 0x2FFF)) {
 		return system_state.VIA_regs[address & 0xF];
 	} else if(address < 0x2000) {
-		if(stateful) {
-			if(!cached_ram_init_ptr[address & 0x1FFF]) {
-				//printf("WARNING! Uninitialized RAM read at %x (Bank %x)\n", address, system_state.banking >> 5);
-			}
+#if GTE_TRACK_UNINIT_RAM
+		if(stateful && !RamIsInit(address & 0x1FFF)) {
+			printf("WARNING! Uninitialized RAM read at %x (Bank %x)\n", address, system_state.banking >> 6);
 		}
+#endif
 		return *GetRAM(address);
 	} else if((address == 0x2008) || (address == 0x2009)) {
 		return joysticks->read((uint8_t) address, stateful);
@@ -604,10 +633,22 @@ uint8_t MemorySync(uint16_t address) {
 #endif
 }
 
+// Flash2M bytes [lo, hi) of the ROM image were programmed or erased: drop
+// only the code the CPU tiers decoded from them. Banking and the decode
+// epoch are untouched, so the rest of the cartridge stays compiled.
+static void InvalidateFlashRange(uint32_t lo, uint32_t hi) {
+#if (defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64
+	Dynarec::InvalidateRomRange(lo, hi);
+#endif
+	if(cpu_core) {
+		cpu_core->InvalidateRomRange(lo, hi);
+	}
+}
+
 void ITCM_CODE MemoryWrite(uint16_t address, uint8_t value) {
 	// Most writes are to CPU RAM.
 	if(LIKELY(address < 0x2000)) {
-		cached_ram_init_ptr[address] = true;
+		RAM_MARK_INIT(address);
 		cached_ram_ptr[address] = value;
 		return;
 	}
@@ -617,6 +658,10 @@ void ITCM_CODE MemoryWrite(uint16_t address, uint8_t value) {
 			if(!(address & 0x4000)) {
 				if(!(cartridge_state.bank_mask & 0x80)) {
 					cartridge_state.save_ram[(address & 0x3FFF) | ((cartridge_state.bank_mask & 0x40) << 8)] = value;
+					// Save RAM mapped here can hold code we decoded
+					if(cpu_core) {
+						cpu_core->InvalidateCode();
+					}
 				}
 			}
 		}
@@ -628,7 +673,12 @@ void ITCM_CODE MemoryWrite(uint16_t address, uint8_t value) {
 				} else {
 					location = &(cartridge_state.rom[((cartridge_state.bank_mask & 0x7F) << 14) | (address & 0x3FFF)]);
 				}
-				*location &= value;
+				const uint8_t programmed = *location & value;
+				if(programmed != *location) {
+					*location = programmed;
+					const uint32_t offset = (uint32_t)(location - cartridge_state.rom);
+					InvalidateFlashRange(offset, offset + 1);
+				}
 				cartridge_state.write_mode = false;
 			} else {
 				//Skipping over details like bypass and unlock commands for now
@@ -638,42 +688,34 @@ void ITCM_CODE MemoryWrite(uint16_t address, uint8_t value) {
 					for(int i = 0; i < (1 << 21); ++i) {
 						cartridge_state.rom[i] = 0xFF;
 					}
+					InvalidateFlashRange(0, 1 << 21);
 				} else if (value == 0x30) {
 					//Sector erase
 					uint8_t sectorBits = ((address & (1 << 13)) >> 13) | ((cartridge_state.bank_mask & 0x7F) << 1);
 					uint8_t sectorNum = sectorBits >> 3;
+					uint32_t sectorStart = 0;
+					uint32_t sectorSize = 0;
 					if(sectorNum < 31) {
 						//most of the sector table
-						uint32_t x = sectorNum << 16;
-						for(uint32_t i = 0; i < (1 << 16); ++i) {
-							cartridge_state.rom[x] = 0xFF;
-							++x;
-						}
+						sectorStart = sectorNum << 16;
+						sectorSize = 1 << 16;
 					} else if((sectorBits & 4) == 0) {
-						uint32_t x = 0x1F0000;
-						for(uint32_t i = 0; i < (1 << 15); ++i) {
-							cartridge_state.rom[x] = 0xFF;
-							++x;
-						}
+						sectorStart = 0x1F0000;
+						sectorSize = 1 << 15;
 					} else if(sectorBits == 0b11111100) {
-						uint32_t x = 0x1F8000;
-						for(uint32_t i = 0; i < (1 << 13); ++i) {
-							cartridge_state.rom[x] = 0xFF;
-							++x;
-						}
+						sectorStart = 0x1F8000;
+						sectorSize = 1 << 13;
 					} else if(sectorBits == 0b11111101) {
-						uint32_t x = 0x1FA000;
-						for(uint32_t i = 0; i < (1 << 13); ++i) {
-							cartridge_state.rom[x] = 0xFF;
-							++x;
-						}
+						sectorStart = 0x1FA000;
+						sectorSize = 1 << 13;
 					} else if((sectorBits >> 1) == 0b1111111) {
-						uint32_t x = 0x1FC000;
-						for(uint32_t i = 0; i < (1 << 14); ++i) {
-							cartridge_state.rom[x] = 0xFF;
-							++x;
-						}
+						sectorStart = 0x1FC000;
+						sectorSize = 1 << 14;
 					}
+					for(uint32_t i = 0; i < sectorSize; ++i) {
+						cartridge_state.rom[sectorStart + i] = 0xFF;
+					}
+					InvalidateFlashRange(sectorStart, sectorStart + sectorSize);
 				} else if(value == 0xA0) {
 					cartridge_state.write_mode = true;
 				} else if(value == 0x90) {
@@ -787,8 +829,10 @@ void randomize_vram() {
 void randomize_memory() {
 	for(int i = 0; i < RAMSIZE; i++) {
 		system_state.ram[i] = rand() % 256;
-		system_state.ram_initialized[i] = false;
 	}
+#if GTE_TRACK_UNINIT_RAM
+	memset(system_buffers.ram_init_bits, 0, sizeof(system_buffers.ram_init_bits));
+#endif
 
 	for(int i = 0; i < VRAM_BUFFER_SIZE; i++) {
 		system_state.vram[i] = rand() % 256;	
@@ -973,6 +1017,9 @@ extern "C" {
 		fread(cartridge_state.rom, sizeof(uint8_t), cartridge_state.size, romFileP);
 		printf("Read complete.\n");
 		fclose(romFileP);
+#if (defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64
+		Dynarec::InvalidateAll();
+#endif
 
 		if(cpu_core) {
 			paused = false;
@@ -1249,6 +1296,9 @@ struct NDSPerfStats {
 static NDSPerfStats ndsPerf;
 static uint32_t ndsLastOpcodeExec[256] = {0};
 static uint64_t ndsLastOpcodeCycles[256] = {0};
+#if (defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64
+static uint64_t ndsLastTierCycles[3] = {0};  // CPU total, baseline, optimized
+#endif
 #define NDS_PERF_PRINT_INTERVAL_FRAMES 90
 #define NDS_PERF_LOG_PATH_PRIMARY "fat:/gametank_perf.log"
 #define NDS_PERF_LOG_PATH_FALLBACK "sd:/gametank_perf.log"
@@ -1368,7 +1418,7 @@ static void NDSPerfMaybePrint() {
 
 	// Keep output on a dedicated block of lines on the sub-screen console.
 	// Keep each line <= 32 chars to avoid wrap/scroll corruption.
-	printf("\x1b[18;0H");
+	printf("\x1b[16;0H");
 	printf("P:%5luus RT:%3lu%%             \n",
 		(unsigned long)avgUs,
 		(unsigned long)speedPct);
@@ -1409,14 +1459,35 @@ static void NDSPerfMaybePrint() {
 		printf("CH:%2lu%%/%2lu%% L:%lu ad:%lu     \n",
 			(unsigned long)pct_ad, (unsigned long)pct_d0,
 			(unsigned long)last_hits, (unsigned long)total_ad);
-#if defined(NDS_BUILD) && defined(ARM9)
+#if (defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64
 		{
 			Dynarec::Stats ds = Dynarec::GetStats();
-			printf("DR:c%lu x%lu f%lu op%02X    \n",
+			printf("DR:c%lu x%lu l%lu f%lu op%02X \n",
 				(unsigned long)ds.blocks_compiled,
 				(unsigned long)ds.blocks_executed,
+				(unsigned long)ds.blocks_linked,
 				(unsigned long)ds.fallback_count,
 				(unsigned int)ds.last_fail_opcode);
+
+			// Share of the CPU's cycles by tier: interpreter (micro-op
+			// cache included), baseline and optimized blocks
+			uint64_t baseCycles = 0, optCycles = 0;
+			Dynarec::GetTierCycles(baseCycles, optCycles);
+			const uint64_t cpuDelta = timekeeper.totalCyclesCount - ndsLastTierCycles[0];
+			const uint64_t baseDelta = baseCycles - ndsLastTierCycles[1];
+			const uint64_t optDelta = optCycles - ndsLastTierCycles[2];
+			ndsLastTierCycles[0] = timekeeper.totalCyclesCount;
+			ndsLastTierCycles[1] = baseCycles;
+			ndsLastTierCycles[2] = optCycles;
+			uint32_t basePct = cpuDelta ? (uint32_t)((baseDelta * 100ULL) / cpuDelta) : 0;
+			uint32_t optPct = cpuDelta ? (uint32_t)((optDelta * 100ULL) / cpuDelta) : 0;
+			if (basePct > 100) basePct = 100;
+			if (basePct + optPct > 100) optPct = 100 - basePct;
+			printf("TR:i%3lu%% b%3lu%% o%3lu%% r%-9lu\n",
+				(unsigned long)(100 - basePct - optPct),
+				(unsigned long)basePct,
+				(unsigned long)optPct,
+				(unsigned long)ds.blocks_optimized);
 		}
 #endif
 	} else {
@@ -2012,18 +2083,34 @@ EM_BOOL mainloop(double time, void* userdata) {
 					intended_cycles = 0;
 					break;
 			}
+			// MemorySync checks breakpoints and logs JSR/RTS for the profiler
+			// on every opcode fetch, and keeps the CPU off the dynarec while
+			// set: hook it in only while the stepping window (breakpoints)
+			// or the profiler is open, or the clock is being stepped.
+			cpu_core->SetSync((timekeeper.clock_mode != CLOCKMODE_NORMAL || toolTypeIsOpen<SteppingWindow>() ||
+				toolTypeIsOpen<ProfilerWindow>()) ? MemorySync : NULL);
 			if(intended_cycles) {
-				cpu_core->Run(intended_cycles, timekeeper.totalCyclesCount);
+				if(cpu_core->IsIdle()) {
+					timekeeper.totalCyclesCount += intended_cycles;
+				} else {
+					cpu_core->Run(intended_cycles, timekeeper.totalCyclesCount);
+				}
 			}
 #else
 			intended_cycles = timekeeper.cycles_per_vsync;
+			if(cpu_core->IsIdle()) {
+				// Parked in WAI with no blitter IRQ pending: only the vsync NMI
+				// below can wake it, so skip the CPU for this whole slice.
+				timekeeper.totalCyclesCount += intended_cycles;
+			} else {
 #ifdef NDS_BUILD
-			uint32_t t0 = cpuGetTiming();
+				uint32_t t0 = cpuGetTiming();
 #endif
-			cpu_core->RunOptimized(intended_cycles, timekeeper.totalCyclesCount);
+				cpu_core->RunOptimized(intended_cycles, timekeeper.totalCyclesCount);
 #ifdef NDS_BUILD
-			ndsCpuTicks += cpuGetTiming() - t0;
+				ndsCpuTicks += cpuGetTiming() - t0;
 #endif
+			}
 #endif
 			timekeeper.actual_cycles = timekeeper.totalCyclesCount - timekeeper.actual_cycles;
 			if(cpu_core->illegalOpcode) {
@@ -2443,6 +2530,8 @@ int main(int argC, char* argV[]) {
 #else
 	cpu_core = new mos6502(MemoryReadFast, MemoryWrite, CPUStopped, MemorySync);
 #endif
+	// Cartridge writes that change code call InvalidateCode/InvalidateRomRange
+	cpu_core->EnableMicroOpCache(true);
 	UpdateRomReadCache();
 	cpu_core->Reset();
 	cartridge_state.write_mode = false;
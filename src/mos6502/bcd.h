@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+
+// 65C02 decimal-mode ADC/SBC, shared by the interpreter (ADCFast/SBCFast)
+// and by compiled blocks (as a call target), so both backends produce
+// identical results and neither has to bail out when D is set.
+//
+// Branch-free: every adjustment is a compare folded into a multiply, which
+// the compiler turns into conditional ARM instructions.
+//
+// Both return  bits 0-7 = result, bit 8 = carry out, bit 9 = overflow.
+// N and Z are taken from the final result, as on the 65C02.
+
+#define BCD_RESULT_CARRY    0x100
+#define BCD_RESULT_OVERFLOW 0x200
+
+static inline uint32_t BCD_ADC(uint32_t a, uint32_t m, uint32_t carryIn)
+{
+	const uint32_t lo = (a & 0x0F) + (m & 0x0F) + carryIn;
+	uint32_t t = a + m + carryIn + (uint32_t)(lo > 9) * 0x06;
+	const uint32_t v = (~(a ^ m) & (a ^ t) & 0x80) << 2;
+	t += (uint32_t)(t > 0x99) * 0x60;
+	return (t & 0xFF) | ((uint32_t)(t > 0x99) << 8) | v;
+}
+
+static inline uint32_t BCD_SBC(uint32_t a, uint32_t m, uint32_t carryIn)
+{
+	const uint32_t borrowIn = carryIn ^ 1;
+	uint32_t t = a - m - borrowIn;
+	const uint32_t v = ((a ^ t) & (a ^ m) & 0x80) << 2;
+	t -= (uint32_t)((int32_t)((a & 0x0F) - borrowIn) < (int32_t)(m & 0x0F)) * 0x06;
+	t -= (uint32_t)(t > 0x99) * 0x60;
+	return (t & 0xFF) | ((uint32_t)(t < 0x100) << 8) | v;
+}
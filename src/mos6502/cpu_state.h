@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <type_traits>
+
+// 6502 register file shared by every backend. mos6502 derives from it, so
+// the interpreter works on these fields as plain members; compiled blocks
+// (r12) and the ARM asm loop (mos6502_run_asm) get a CpuState* to the same
+// object and read and write them in place. Nothing is copied on the way in
+// or out.
+//
+// Flags use the lazy form from lazy_flags.h. The fields after flag_nz are
+// only meaningful while a compiled block or the asm loop is running.
+//
+// Generated code and mos6502_hot_arm.s address this struct by the CS_*
+// offsets below; the static_asserts keep them in step with the layout.
+struct CpuState
+{
+	uint8_t A = 0;                  // accumulator
+	uint8_t X = 0;                  // X-index
+	uint8_t Y = 0;                  // Y-index
+	uint8_t sp = 0;                 // stack pointer
+	uint8_t status = 0x20;          // D, I, B and bit 5 only
+	uint8_t flag_c = 0;             // C, 0 or 1
+	uint8_t flag_v = 0;             // V, 0 or 1
+	uint8_t exit_reason = 0;        // asm loop: 0=deadline, 1=opcode left to the interpreter;
+	                                // dynarec: 1=an I/O access ended the run
+	uint16_t pc = 0;                // program counter
+	uint8_t exit_opcode = 0;        // asm loop: opcode it stopped at
+	uint8_t pad = 0;
+	uint32_t flag_nz = 1;           // lazy N/Z word
+
+	int32_t cycles_remaining = 0;   // distance to the next event deadline
+	uint8_t* ram = nullptr;         // RAM base (current bank)
+	const uint8_t* rom_lo = nullptr;// $8000-$BFFF window
+	const uint8_t* rom_hi = nullptr;// $C000-$FFFF window
+	const uint8_t* code_pages = nullptr; // RAM pages holding compiled code (dynarec.h)
+	void* return_stack = nullptr;   // dynarec: JSR/RTS prediction (Dynarec::ReturnStack)
+};
+
+static_assert(std::is_standard_layout<CpuState>::value, "CpuState must be standard-layout");
+
+constexpr int CS_A                = offsetof(CpuState, A);
+constexpr int CS_X                = offsetof(CpuState, X);
+constexpr int CS_Y                = offsetof(CpuState, Y);
+constexpr int CS_SP               = offsetof(CpuState, sp);
+constexpr int CS_STATUS           = offsetof(CpuState, status);
+constexpr int CS_CARRY            = offsetof(CpuState, flag_c);
+constexpr int CS_V                = offsetof(CpuState, flag_v);
+constexpr int CS_EXIT_REASON      = offsetof(CpuState, exit_reason);
+constexpr int CS_PC               = offsetof(CpuState, pc);
+constexpr int CS_EXIT_OPCODE      = offsetof(CpuState, exit_opcode);
+constexpr int CS_NZ               = offsetof(CpuState, flag_nz);
+constexpr int CS_CYCLES_REM       = offsetof(CpuState, cycles_remaining);
+constexpr int CS_RAM              = offsetof(CpuState, ram);
+constexpr int CS_ROM_LO           = offsetof(CpuState, rom_lo);
+constexpr int CS_ROM_HI           = offsetof(CpuState, rom_hi);
+constexpr int CS_CODE_PAGES       = offsetof(CpuState, code_pages);
+constexpr int CS_RETURN_STACK     = offsetof(CpuState, return_stack);
+
+// mos6502_hot_arm.s hard-codes these (tools/gen_mos6502_hot_arm.py emits
+// them as .equ; the assembler cannot include a C++ header).
+static_assert(CS_A == 0 && CS_X == 1 && CS_Y == 2 && CS_SP == 3, "asm: register offsets");
+static_assert(CS_STATUS == 4 && CS_CARRY == 5 && CS_V == 6 && CS_EXIT_REASON == 7, "asm: flag offsets");
+static_assert(CS_PC == 8 && CS_EXIT_OPCODE == 10 && CS_NZ == 12, "asm: pc/nz offsets");
+static_assert(CS_CYCLES_REM == 16, "asm: cycles_remaining offset");
+static_assert(sizeof(void*) != 4 || (CS_RAM == 20 && CS_ROM_LO == 24 && CS_ROM_HI == 28 &&
+	CS_CODE_PAGES == 32), "asm: memory pointer offsets");
+
+// Compiled blocks store pc with STRH, whose immediate offset is 8 bits.
+static_assert(CS_PC < 256, "STRH offset out of range");
@@ -1,5 +1,10 @@
 #include "dynarec.h"
+
+#if !DYNAREC_X64
+
 #include "dynarec_emitter.h"
+#include "dynarec_ir.h"
+#include "bcd.h"
 #include "../nds_platform.h"
 #include <cstring>
 #include <cstdio>
@@ -36,13 +41,34 @@ extern uint8_t loadedRomType;
 
 namespace Dynarec {
 
-// Block cache - simple hash table
-static constexpr int BLOCK_CACHE_SIZE = 256;
-static Block* block_table[BLOCK_CACHE_SIZE];
+// Block pool, indexed by PC through the block map below. Evicted blocks
+// (code == nullptr) go on a free list.
+static constexpr int BLOCK_CACHE_SIZE = 1024;
 static Block block_pool[BLOCK_CACHE_SIZE];
 static int block_pool_used = 0;
-
-// Code buffer in ITCM - linker places this in .itcm section
+static uint16_t free_blocks[BLOCK_CACHE_SIZE];
+static int free_block_count = 0;
+
+// PC -> block maps (see DYNAREC_FLAT_BLOCK_MAP): fixed_map for $C000-$FFFF,
+// one bank_maps slot per recently selected bank for $8000-$BFFF and ram_map
+// for RAM code
+static constexpr int WINDOW_SIZE = 0x4000;
+#if DYNAREC_FLAT_BLOCK_MAP
+struct WindowMap { Block* entries[WINDOW_SIZE]; };
+#else
+struct WindowMap { Block** pages[WINDOW_SIZE >> 8]; };
+static Block* block_leaves[BLOCK_MAP_LEAVES][256];
+static int block_leaves_used = 0;
+#endif
+static WindowMap fixed_map;
+static WindowMap ram_map;
+static WindowMap bank_maps[BANK_MAP_SLOTS];
+static uint32_t bank_map_tag[BANK_MAP_SLOTS];
+static int bank_maps_used = 0;
+static uint32_t code_bank = 0;          // Last bank passed to SetCodeBank
+static WindowMap* window_maps[2];       // [0]: map of code_bank, [1]: fixed_map
+
+// Hot tier in ITCM - linker places this in .itcm section
 #if defined(NDS_BUILD) && defined(ARM9)
 __attribute__((section(".itcm"), aligned(4)))
 static uint8_t dynarec_code_buffer[CODE_BUFFER_SIZE];
@@ -50,7 +76,67 @@ static uint8_t dynarec_code_buffer[CODE_BUFFER_SIZE];
 static uint8_t dynarec_code_buffer[CODE_BUFFER_SIZE];
 #endif
 
-static uint8_t* code_ptr = nullptr;
+// Cold tier in main RAM. ITCM and main RAM are well within B range of each
+// other, so links cross tiers directly.
+__attribute__((aligned(4)))
+static uint8_t dynarec_cold_buffer[COLD_BUFFER_SIZE];
+
+static uint8_t* code_ptr = nullptr;     // Cold tier: next compiled block
+static uint8_t* hot_ptr = nullptr;      // Hot tier ring: next promoted block
+
+// Static exits of every compiled block, so a newly compiled block can be
+// chained from the exits that lead to it
+struct BlockExit {
+    ExitRecord exit;
+    uint32_t bank;    // Block::bank of the block the exit is in
+};
+static constexpr int MAX_EXITS = BLOCK_CACHE_SIZE * 2;
+static BlockExit exit_table[MAX_EXITS];
+static int exit_table_used = 0;
+
+// Blocks compiled from RAM, oldest first, and how many cover each page
+static Block* ram_blocks[RAM_BLOCK_SLOTS];
+static int ram_block_count = 0;
+uint8_t ram_code_pages[RAM_CODE_PAGES];
+
+// RAM PCs whose blocks were dropped by code writes, direct-mapped
+static constexpr int REWRITE_TABLE_SIZE = 64;
+static uint16_t rewrite_pc[REWRITE_TABLE_SIZE];
+static uint8_t rewrite_count[REWRITE_TABLE_SIZE];
+
+// Compiled code addresses an entry as top << 3 (EmitReturnPush)
+ReturnStack return_stack;
+static_assert(sizeof(ReturnStack::Entry) == 8, "return stack entry size");
+static constexpr int RS_TOP = offsetof(ReturnStack, top);
+static constexpr int RS_PC = offsetof(ReturnStack, entry[0].pc);
+static constexpr int RS_CODE = offsetof(ReturnStack, entry[0].code);
+
+// Inline caches of JMP (abs) and JMP (abs,X) sites (EmitIndirectJump):
+// the last two targets taken, newest first, with the bodies of their
+// blocks. Sites are handed out round robin; a block whose site was handed
+// on shares it with the newer one, which only costs hits.
+struct IndirectSite {
+    uint32_t pc[2];         // NO_TARGET while empty
+    uint32_t body[2];       // ARM address
+    uint32_t hits;
+};
+static constexpr int INDIRECT_SITES = 64;
+static constexpr uint32_t NO_TARGET = 0xFFFFFFFF;
+static IndirectSite indirect_sites[INDIRECT_SITES];
+static int next_indirect_site = 0;
+
+// Forget every predicted return and cached jump target: the code they
+// lead to may be gone, or belong to another bank
+static void ForgetCodeAddresses() {
+    return_stack.top = 0;
+    for (int i = 0; i < RETURN_STACK_SIZE; i++) return_stack.entry[i].pc = NO_RETURN;
+    for (IndirectSite& site : indirect_sites) site.pc[0] = site.pc[1] = NO_TARGET;
+}
+
+// 16KB windows of the Flash2M image (RomOffset >> 14) blocks have been
+// compiled from since InvalidateAll, one bit each; flash writes to sectors
+// that never held compiled code skip the block scan
+static uint32_t rom_code_windows[4];
 
 // Statistics
 static Stats stats = {};
@@ -59,14 +145,20 @@ static Stats stats = {};
 static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool& block_ended);
 static uint8_t FetchByteAt(uint16_t addr);
 static uint16_t FetchWordAt(uint16_t addr);
+static void ResetBlockMaps();
+static void ResetRamCode();
 
 void Init() {
-    std::memset(block_table, 0, sizeof(block_table));
+    ResetBlockMaps();
+    ResetRamCode();
+    ForgetCodeAddresses();
     std::memset(block_pool, 0, sizeof(block_pool));
     block_pool_used = 0;
-    code_ptr = dynarec_code_buffer;
-    stats = {};
-    stats.compile_bytes_total = CODE_BUFFER_SIZE;
+    free_block_count = 0;
+    code_ptr = dynarec_cold_buffer;
+    hot_ptr = dynarec_code_buffer;
+    ResetStats();
+    stats.compile_bytes_total = COLD_BUFFER_SIZE;
 
     // Log the actual address of the code buffer
     DebugLog("DR: ==========================================\n");
@@ -87,31 +179,291 @@ void Shutdown() {
     // Nothing to free - buffer is static
 }
 
-static uint32_t ComputeHash(uint16_t pc) {
-    return ((pc * 0x9E3779B9u) >> 24) & (BLOCK_CACHE_SIZE - 1);
+// Block::bank for a block starting at pc
+static inline uint32_t BlockBank(uint16_t pc) {
+    if (!(pc & 0x8000)) return RAM_BANK;
+    return (pc & 0x4000) ? FIXED_BANK : code_bank;
+}
+
+// Map holding pc: one of the ROM windows, or ram_map below $8000
+static inline WindowMap* MapFor(uint16_t pc) {
+    return (pc & 0x8000) ? window_maps[(pc >> 14) & 1] : &ram_map;
 }
 
-static Block* FindBlock(uint16_t pc) {
-    uint32_t hash = ComputeHash(pc);
-    Block* b = block_table[hash];
-    while (b) {
-        if (b->pc == pc) return b;
-        b = b->next;
+// Blocks only start in the ROM window or in RAM; I/O has no entry
+static inline Block* FindBlock(uint16_t pc) {
+    if (pc < 0x8000 && pc >= RAM_CODE_END) return nullptr;
+    const WindowMap* map = MapFor(pc);
+#if DYNAREC_FLAT_BLOCK_MAP
+    return map->entries[pc & 0x3FFF];
+#else
+    Block** leaf = map->pages[(pc & 0x3FFF) >> 8];
+    return leaf ? leaf[pc & 0xFF] : nullptr;
+#endif
+}
+
+// Map entry for a ROM-window or RAM PC, giving its page a leaf if it has
+// none yet. Returns nullptr when all leaves are in use.
+static Block** MapSlot(uint16_t pc) {
+    WindowMap* map = MapFor(pc);
+#if DYNAREC_FLAT_BLOCK_MAP
+    return &map->entries[pc & 0x3FFF];
+#else
+    Block**& leaf = map->pages[(pc & 0x3FFF) >> 8];
+    if (!leaf) {
+        if (block_leaves_used >= BLOCK_MAP_LEAVES) return nullptr;
+        leaf = block_leaves[block_leaves_used++];
+        std::memset(leaf, 0, sizeof(block_leaves[0]));
     }
-    return nullptr;
+    return &leaf[pc & 0xFF];
+#endif
+}
+
+// Point the $8000 window at bank's map, giving the bank an empty slot if it
+// has none. Returns false when every slot belongs to another bank.
+static bool SelectBankMap(uint32_t bank) {
+    for (int i = 0; i < bank_maps_used; i++) {
+        if (bank_map_tag[i] == bank) {
+            window_maps[0] = &bank_maps[i];
+            return true;
+        }
+    }
+    if (bank_maps_used >= BANK_MAP_SLOTS) return false;
+    const int slot = bank_maps_used++;
+    bank_map_tag[slot] = bank;
+#if !DYNAREC_FLAT_BLOCK_MAP
+    std::memset(&bank_maps[slot], 0, sizeof(WindowMap));
+#endif
+    window_maps[0] = &bank_maps[slot];
+    return true;
+}
+
+// Empty every map. Flat maps are too big to clear whole on each
+// invalidation, so only the entries of compiled blocks are cleared there
+// (which leaves every map all-null for its next bank); leaf maps just drop
+// their directories.
+static void ResetBlockMaps() {
+#if DYNAREC_FLAT_BLOCK_MAP
+    for (int i = 0; i < block_pool_used; i++) {
+        if (block_pool[i].code) *block_pool[i].map_entry = nullptr;
+    }
+#else
+    std::memset(&fixed_map, 0, sizeof(fixed_map));
+    std::memset(&ram_map, 0, sizeof(ram_map));
+    block_leaves_used = 0;
+#endif
+    window_maps[1] = &fixed_map;
+    bank_maps_used = 0;
+    SelectBankMap(code_bank);
 }
 
 static Block* AllocateBlock() {
+    if (free_block_count > 0) return &block_pool[free_blocks[--free_block_count]];
     if (block_pool_used >= BLOCK_CACHE_SIZE) return nullptr;
-    Block* b = &block_pool[block_pool_used++];
-    b->next = nullptr;
-    return b;
+    return &block_pool[block_pool_used++];
+}
+
+static inline bool InHotTier(const void* p) {
+    return p >= dynarec_code_buffer && p < dynarec_code_buffer + CODE_BUFFER_SIZE;
+}
+
+static inline bool InCodeCache(const void* p) {
+    return InHotTier(p) || (p >= dynarec_cold_buffer && p < dynarec_cold_buffer + COLD_BUFFER_SIZE);
 }
 
+// The block's leaf was reserved by CompileBlock before compiling
 static void InsertBlock(Block* block) {
-    uint32_t hash = ComputeHash(block->pc);
-    block->next = block_table[hash];
-    block_table[hash] = block;
+    block->map_entry = MapSlot(block->pc);
+    *block->map_entry = block;
+}
+
+// An exit may only chain into the banked window from a block compiled in
+// the same bank: a $C000 block (or one from another bank, or RAM) would
+// otherwise keep jumping into that bank's code after the latch moves on.
+// RAM blocks are dropped whenever RAM changes under them, so anything may
+// chain into one.
+static bool CanLink(uint32_t from_bank, uint16_t target_pc) {
+    return (target_pc & 0x4000) || !(target_pc & 0x8000) || from_bank == code_bank;
+}
+
+// Add delta to the count of each page the source of RAM block b covers
+static void CountRamPages(const Block& b, int delta) {
+    const int last = (b.src_end - 1) >> 8;
+    for (int page = b.src_lo >> 8; page <= last && page < RAM_CODE_PAGES; page++) {
+        ram_code_pages[page] = (uint8_t)(ram_code_pages[page] + delta);
+    }
+}
+
+static void ForgetRamBlock(Block* b) {
+    for (int i = 0; i < ram_block_count; i++) {
+        if (ram_blocks[i] != b) continue;
+        std::memmove(&ram_blocks[i], &ram_blocks[i + 1], (ram_block_count - i - 1) * sizeof(Block*));
+        ram_block_count--;
+        CountRamPages(*b, -1);
+        return;
+    }
+}
+
+static void ResetRamCode() {
+    ram_block_count = 0;
+    // The micro-op cache's pages are its own to clear (SetUopPages)
+    for (uint8_t& count : ram_code_pages) count &= RAM_PAGE_UOP;
+}
+
+// Note the image windows holding the first and last byte of ROM block b
+static void MarkRomWindows(const Block& b) {
+    const uint16_t last = b.src_end > b.src_lo ? (uint16_t)(b.src_end - 1) : 0xFFFF;
+    const uint32_t first_window = RomOffset(b.src_lo, b.bank) >> 14;
+    const uint32_t last_window = RomOffset(last, b.bank) >> 14;
+    rom_code_windows[first_window >> 5] |= 1u << (first_window & 31);
+    rom_code_windows[last_window >> 5] |= 1u << (last_window & 31);
+}
+
+// Whether ROM block b was compiled from any of image bytes [lo, hi). A
+// block running on from $BFFF into $C000 reads two windows.
+static bool BlockReadsRom(const Block& b, uint32_t lo, uint32_t hi) {
+    const uint32_t end = b.src_end > b.src_lo ? b.src_end : 0x10000;
+    for (uint32_t pc = b.src_lo; pc < end; pc = (pc | 0x3FFF) + 1) {
+        const uint32_t window_end = (pc | 0x3FFF) + 1;
+        const uint32_t start = RomOffset((uint16_t)pc, b.bank);
+        const uint32_t stop = start + ((end < window_end ? end : window_end) - pc);
+        if (start < hi && stop > lo) return true;
+    }
+    return false;
+}
+
+// Rewrite one already-flushed instruction word of compiled code
+static void PatchWord(uint32_t* slot, uint32_t insn) {
+    *slot = insn;
+#if defined(NDS_BUILD) && defined(ARM9)
+    DC_FlushRange(slot, 4);
+    IC_InvalidateRange(slot, 4);
+#endif
+}
+
+// Chain an exit to its target: BGT past the target's prologue, so the 6502
+// registers stay in r4-r8 while the cycle budget (flags from the exit's
+// SUBS) lasts. Out of budget, the exit falls through and returns as usual.
+static inline uint32_t LinkWord(const uint32_t* slot, const void* body) {
+    return ARM_COND(COND_GT) | ARM_B((int32_t)((const uint8_t*)body - ((const uint8_t*)slot + 8)));
+}
+
+static void LinkExit(const ExitRecord& exit, const Block* target) {
+    PatchWord(exit.slot, LinkWord(exit.slot, target->body));
+    stats.blocks_linked++;
+}
+
+// Body an exit's link word branches to, or nullptr while it is unlinked
+static uint8_t* LinkTarget(const uint32_t* slot) {
+    const uint32_t insn = *slot;
+    if (insn == ARM_NOP) return nullptr;
+    return (uint8_t*)slot + 8 + ((int32_t)(insn << 8) >> 6);
+}
+
+// Drop every block whose code starts in [lo, hi): unlink the exits that
+// chain into them, forget their own exits and free their pool slots.
+// Promotion evicts room for the copy first, so it comes through here too.
+static void EvictRange(uint8_t* lo, uint8_t* hi) {
+    ForgetCodeAddresses();
+    // A block starting inside may run past hi; all of its code goes
+    for (int i = 0; i < block_pool_used; i++) {
+        const Block& b = block_pool[i];
+        uint8_t* code = (uint8_t*)b.code;
+        if (code && code >= lo && code < hi && code + b.code_size > hi) hi = code + b.code_size;
+    }
+    for (int i = 0; i < exit_table_used; ) {
+        uint32_t* slot = exit_table[i].exit.slot;
+        if ((uint8_t*)slot >= lo && (uint8_t*)slot < hi) {
+            exit_table[i] = exit_table[--exit_table_used];
+            continue;
+        }
+        uint8_t* target = LinkTarget(slot);
+        if (target >= lo && target < hi) PatchWord(slot, ARM_NOP);
+        i++;
+    }
+    for (int i = 0; i < block_pool_used; i++) {
+        Block& b = block_pool[i];
+        uint8_t* code = (uint8_t*)b.code;
+        if (code && code >= lo && code < hi) {
+            if (b.bank == RAM_BANK) ForgetRamBlock(&b);
+            *b.map_entry = nullptr;
+            b.code = nullptr;
+            free_blocks[free_block_count++] = (uint16_t)i;
+            stats.blocks_evicted++;
+        }
+    }
+}
+
+// Start the cold tier over. Blocks worth keeping were promoted out of it;
+// the rest are recompiled if they run again.
+static void CollectColdTier() {
+    EvictRange(dynarec_cold_buffer, dynarec_cold_buffer + COLD_BUFFER_SIZE);
+    code_ptr = dynarec_cold_buffer;
+}
+
+#if !DYNAREC_FLAT_BLOCK_MAP
+// Out of leaves: hand them all back and re-enter the blocks still alive
+// (after a cold-tier collection, just the hot tier). Returns false if even
+// those don't fit.
+static bool RebuildBlockMaps() {
+    ResetBlockMaps();
+    bool ok = true;
+    for (int i = 0; i < block_pool_used && ok; i++) {
+        Block& b = block_pool[i];
+        if (!b.code) continue;
+        if (b.bank != FIXED_BANK && b.bank != RAM_BANK && !SelectBankMap(b.bank)) {
+            ok = false;
+        } else if ((b.map_entry = MapSlot(b.pc)) != nullptr) {
+            *b.map_entry = &b;
+        } else {
+            ok = false;
+        }
+    }
+    SelectBankMap(code_bank);
+    return ok;
+}
+#endif
+
+// Copy a cold block into the hot tier, evicting the oldest promoted blocks
+// to make room, and carry its links over: its own exits are re-aimed from
+// their new place and links into the old copy move to the new one.
+static void PromoteBlock(Block* b) {
+    const uint32_t size = b->code_size;
+    if (size > CODE_BUFFER_SIZE) return;
+    uint8_t* const hot_end = dynarec_code_buffer + CODE_BUFFER_SIZE;
+    if (hot_ptr + size > hot_end) {
+        EvictRange(hot_ptr, hot_end);
+        hot_ptr = dynarec_code_buffer;
+    }
+    EvictRange(hot_ptr, hot_ptr + size);
+
+    uint8_t* const old_code = (uint8_t*)b->code;
+    uint8_t* const old_body = (uint8_t*)b->body;
+    uint8_t* const new_code = hot_ptr;
+    const int32_t delta = (int32_t)(new_code - old_code);
+    hot_ptr += size;
+    std::memcpy(new_code, old_code, size);
+
+    for (int i = 0; i < exit_table_used; i++) {
+        ExitRecord& e = exit_table[i].exit;
+        if ((uint8_t*)e.slot < old_code || (uint8_t*)e.slot >= old_code + size) continue;
+        uint8_t* target = LinkTarget(e.slot);
+        e.slot = (uint32_t*)((uint8_t*)e.slot + delta);
+        if (target) *e.slot = LinkWord(e.slot, target);
+    }
+    b->code = new_code;
+    b->body = old_body + delta;
+    for (int i = 0; i < exit_table_used; i++) {
+        uint32_t* slot = exit_table[i].exit.slot;
+        if (LinkTarget(slot) == old_body) PatchWord(slot, LinkWord(slot, b->body));
+    }
+
+#if defined(NDS_BUILD) && defined(ARM9)
+    DC_FlushRange(new_code, size);
+    IC_InvalidateRange(new_code, size);
+#endif
+    stats.blocks_promoted++;
+    DebugLog("DR: promoted block %04X to %p (%u bytes)\n", b->pc, new_code, (unsigned)size);
 }
 
 // Fetch a byte from ROM/RAM at compile time
@@ -139,25 +491,136 @@ static uint16_t FetchWordAt(uint16_t addr) {
 
 // Negative cache: PCs where compilation failed (don't retry)
 static constexpr int FAIL_CACHE_SIZE = 64;
-static uint16_t fail_cache[FAIL_CACHE_SIZE];
+static uint32_t fail_cache[FAIL_CACHE_SIZE];   // pc | BlockBank(pc) << 16
 static int fail_cache_count = 0;
 
 static bool IsInFailCache(uint16_t pc) {
+    const uint32_t key = pc | (BlockBank(pc) << 16);
     for (int i = 0; i < fail_cache_count; i++) {
-        if (fail_cache[i] == pc) return true;
+        if (fail_cache[i] == key) return true;
     }
     return false;
 }
 
 static void AddToFailCache(uint16_t pc) {
     if (fail_cache_count < FAIL_CACHE_SIZE) {
-        fail_cache[fail_cache_count++] = pc;
+        fail_cache[fail_cache_count++] = pc | (BlockBank(pc) << 16);
+    }
+}
+
+// Drop a RAM block whose source was overwritten. One rewritten
+// RAM_REWRITE_LIMIT times goes on the fail cache: compiling it again
+// would cost more than it saves.
+static void DropRewrittenBlock(Block* b) {
+    const uint16_t pc = b->pc;
+    const int i = (pc ^ (pc >> 6)) & (REWRITE_TABLE_SIZE - 1);
+    if (rewrite_pc[i] != pc) {
+        rewrite_pc[i] = pc;
+        rewrite_count[i] = 0;
+    }
+    if (++rewrite_count[i] >= RAM_REWRITE_LIMIT) AddToFailCache(pc);
+    EvictRange((uint8_t*)b->code, (uint8_t*)b->code + b->code_size);
+}
+
+bool NoteCodeWrite(uint16_t addr) {
+    if (ram_code_pages[addr >> 8] & RAM_PAGE_UOP) uop_page_written = true;
+    bool dropped = false;
+    for (int i = 0; i < ram_block_count; ) {
+        Block* b = ram_blocks[i];
+        if (addr >= b->src_lo && addr < b->src_end) {
+            DropRewrittenBlock(b);  // Takes it off ram_blocks
+            dropped = true;
+        } else {
+            i++;
+        }
+    }
+    return dropped;
+}
+
+// All RAM blocks at once: rather than an EvictRange each, drop their exits
+// and unlink every exit into RAM in one pass over the exit table
+void InvalidateRamCode() {
+    if (ram_block_count == 0) return;
+    ForgetCodeAddresses();
+    for (int i = 0; i < exit_table_used; ) {
+        const BlockExit& e = exit_table[i];
+        if (e.bank == RAM_BANK) {
+            exit_table[i] = exit_table[--exit_table_used];
+            continue;
+        }
+        if (!(e.exit.target_pc & 0x8000) && LinkTarget(e.exit.slot)) PatchWord(e.exit.slot, ARM_NOP);
+        i++;
+    }
+    for (int i = 0; i < ram_block_count; i++) {
+        Block* b = ram_blocks[i];
+        *b->map_entry = nullptr;
+        b->code = nullptr;
+        free_blocks[free_block_count++] = (uint16_t)(b - block_pool);
+        stats.blocks_invalidated++;
+    }
+    ResetRamCode();
+}
+
+void InvalidateRomRange(uint32_t lo, uint32_t hi) {
+    if (lo >= hi) return;
+
+    // A failed PC read its opcode and up to two operand bytes
+    for (int i = 0; i < fail_cache_count; ) {
+        const uint16_t pc = (uint16_t)fail_cache[i];
+        const uint32_t at = RomOffset(pc, fail_cache[i] >> 16);
+        if ((pc & 0x8000) && at < hi && at + 3 > lo) {
+            fail_cache[i] = fail_cache[--fail_cache_count];
+            continue;
+        }
+        i++;
+    }
+
+    bool compiled = false;
+    for (uint32_t w = lo >> 14; w <= (hi - 1) >> 14 && !compiled; w++) {
+        compiled = (rom_code_windows[w >> 5] >> (w & 31)) & 1;
+    }
+    if (!compiled) return;
+    for (int i = 0; i < block_pool_used; i++) {
+        Block& b = block_pool[i];
+        if (!b.code || b.bank == RAM_BANK || !BlockReadsRom(b, lo, hi)) continue;
+        EvictRange((uint8_t*)b.code, (uint8_t*)b.code + b.code_size);
+        stats.blocks_invalidated++;
     }
 }
 
+// Helpers: I/O through IoRead/IoWrite (dynarec.h) on the block's CpuState,
+// address in r0, passing the block's cycles before this instruction.
+// Clobber r0-r2; LowerBlock follows the instruction with an exit check
+// (IR_F_IO).
+//
+// The access can raise an IRQ there and then (ScheduleIRQ(0)), which
+// pushes pc and P straight away: the next instruction's PC, N/Z and C go
+// to CpuState first (V lives there). Clobbers r2.
+static void EmitIoSpill(Emitter& emit) {
+    emit.LoadImm16(REG_SCRATCH2, emit.next_pc);
+    emit.Emit_STRH_IMM(REG_SCRATCH2, REG_STATE, CS_PC);
+    emit.Emit_STR_IMM(REG_NZ, REG_STATE, CS_NZ);
+    emit.Emit_STRB_IMM(REG_CARRY, REG_STATE, CS_CARRY);
+}
+
+static void EmitIoRead(Emitter& emit, int dest_reg) {
+    EmitIoSpill(emit);
+    emit.LoadImm16(REG_SCRATCH1, (uint16_t)emit.cycles);
+    emit.Emit_CallStateHelper((const void*)&IoRead);
+    if (dest_reg != REG_SCRATCH0) emit.Emit_MOV(dest_reg, REG_SCRATCH0);
+}
+
+// src_reg must not be r0 or r2
+static void EmitIoWrite(Emitter& emit, int src_reg) {
+    if (src_reg != REG_SCRATCH1) emit.Emit_MOV(REG_SCRATCH1, src_reg);
+    EmitIoSpill(emit);
+    emit.LoadImm16(REG_SCRATCH2, (uint16_t)emit.cycles);
+    emit.Emit_CallStateHelper((const void*)&IoWrite);
+}
+
 // Helper: emit code to load a byte from a compile-time known 6502 address into dest_reg.
-// Uses REG_SCRATCH0 for address computation when offset > 4095.
-// Returns false if address is in I/O range (0x2000-0x7FFF).
+// Uses REG_SCRATCH0 for address computation when offset > 4095; I/O
+// (0x2000-0x7FFF) is a call to IoRead.
 static bool EmitLoadAbs(Emitter& emit, int dest_reg, uint16_t addr) {
     if (addr < 0x2000) {
         if (addr < 0x1000) {
@@ -183,50 +646,136 @@ static bool EmitLoadAbs(Emitter& emit, int dest_reg, uint16_t addr) {
             emit.Emit_LDRB_REG(dest_reg, REG_ROM_LO, REG_SCRATCH0);
         }
     } else {
-        return false;
+        emit.LoadImm16(REG_SCRATCH0, addr);
+        EmitIoRead(emit, dest_reg);
     }
     return true;
 }
 
-// Helper: emit code to store a byte to a compile-time known RAM address.
-// Returns false if address >= 0x2000 (ROM/I/O).
+// Helper: emit code to store a byte to a compile-time known RAM or I/O
+// address. Returns false if address >= 0x8000 (ROM).
 static bool EmitStoreAbs(Emitter& emit, int src_reg, uint16_t addr) {
-    if (addr >= 0x2000) return false;
-    if (addr < 0x1000) {
+    if (addr >= 0x8000) return false;
+    if (addr >= 0x2000) {
+        if (src_reg != REG_SCRATCH1) emit.Emit_MOV(REG_SCRATCH1, src_reg);
+        emit.LoadImm16(REG_SCRATCH0, addr);
+        EmitIoWrite(emit, REG_SCRATCH1);
+    } else if (addr < 0x1000) {
         emit.Emit_STRB_IMM(src_reg, REG_RAM, addr);
     } else {
-        emit.LoadImm16(REG_SCRATCH0, addr);
-        emit.Emit_STRB_REG(src_reg, REG_RAM, REG_SCRATCH0);
+        // Build the address in a scratch reg that isn't holding the value
+        const int addr_reg = (src_reg == REG_SCRATCH0) ? REG_SCRATCH1 : REG_SCRATCH0;
+        emit.LoadImm16(addr_reg, addr);
+        emit.Emit_STRB_REG(src_reg, REG_RAM, addr_reg);
     }
     return true;
 }
 
 // Helper: emit CMP-style flag update (NZ + carry) for a register compare.
 // Emits: SUBS scratch, reg, operand_reg; AND NZ, scratch, #0xFF; carry from ARM C flag
+// Nothing at all when both results are dead.
 static void EmitCompareReg(Emitter& emit, int reg, int operand_reg) {
+    if (emit.nz_dead && emit.c_dead) return;
     // SUBS r0, reg, operand_reg
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_SUB, REG_SCRATCH0, reg, operand_reg, true));
-    emit.Emit_AND_IMM(REG_NZ, REG_SCRATCH0, 0xFF);
-    emit.Emit_MOV_IMM(REG_CARRY, 0);
-    emit.Emit(ARM_COND(COND_CS) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+    emit.Emit_UpdateNZ(REG_SCRATCH0);
+    if (!emit.c_dead) {
+        emit.Emit_MOV_IMM(REG_CARRY, 0);
+        emit.Emit(ARM_COND(COND_CS) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+    }
+}
+
+// Helper: the same for a compare against an immediate.
+static void EmitCompareImm(Emitter& emit, int reg, uint8_t imm) {
+    if (emit.nz_dead && emit.c_dead) return;
+    // SUBS r0, reg, #imm (ARM C flag = borrow inverted = reg >= imm)
+    emit.Emit_SUB_IMM(REG_SCRATCH0, reg, imm, true);
+    emit.Emit_UpdateNZ(REG_SCRATCH0);
+    if (!emit.c_dead) {
+        // MOV r8, #0; MOVCS r8, #1
+        emit.Emit_MOV_IMM(REG_CARRY, 0);
+        emit.Emit(ARM_COND(COND_CS) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+    }
+}
+
+// Decimal-mode call targets for compiled blocks (see bcd.h). A, operand and
+// carry arrive in r0-r2, the CpuState* in r3. Returns A | carry << 8;
+// V is written straight into state->flag_v and the 65C02's extra decimal
+// cycle is taken off cycles_remaining.
+static uint32_t DecimalADC(uint32_t a, uint32_t m, uint32_t carry, CpuState* state) {
+    const uint32_t r = BCD_ADC(a, m, carry);
+    state->flag_v = (r & BCD_RESULT_OVERFLOW) ? 1 : 0;
+    state->cycles_remaining--;
+    return r & 0x1FF;
+}
+
+static uint32_t DecimalSBC(uint32_t a, uint32_t m, uint32_t carry, CpuState* state) {
+    const uint32_t r = BCD_SBC(a, m, carry);
+    state->flag_v = (r & BCD_RESULT_OVERFLOW) ? 1 : 0;
+    state->cycles_remaining--;
+    return r & 0x1FF;
+}
+
+// Helper: emit a runtime D-flag test. If D is set, call the decimal helper
+// and skip the binary code that follows; returns the BNE placeholder for
+// EmitDecimalEnd to patch once the binary path has been emitted.
+static uint8_t* EmitDecimalBegin(Emitter& emit, int operand_reg, const void* helper) {
+    emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
+    emit.Emit_TST_IMM(REG_SCRATCH0, 0x08);
+    uint8_t* beq_patch = emit.ptr;
+    emit.Emit(0); // placeholder for BEQ binary
+
+    // Decimal path
+    if (operand_reg != REG_SCRATCH1) emit.Emit_MOV(REG_SCRATCH1, operand_reg);
+    emit.Emit_MOV(REG_SCRATCH0, REG_A);
+    emit.Emit_MOV(REG_SCRATCH2, REG_CARRY);
+    emit.Emit_MOV(REG_SCRATCH3, REG_STATE);
+    emit.Emit_CallHelper(helper);
+    emit.Emit_AND_IMM(REG_A, REG_SCRATCH0, 0xFF);
+    emit.Emit_UpdateNZ(REG_A);
+    // MOV r8, r0, LSR #8
+    if (!emit.c_dead) {
+        emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
+                  (REG_CARRY << 12) | (8 << 7) | (1 << 5) | REG_SCRATCH0);
+    }
+    uint8_t* b_done_patch = emit.ptr;
+    emit.Emit(0); // placeholder for B done
+
+    // BEQ binary: lands right after the B done placeholder
+    int32_t beq_offset = (int32_t)(emit.ptr - beq_patch) - 8;
+    *(uint32_t*)beq_patch = ARM_COND(COND_EQ) | ARM_B(beq_offset);
+    return b_done_patch;
+}
+
+static void EmitDecimalEnd(Emitter& emit, uint8_t* b_done_patch) {
+    int32_t b_done_offset = (int32_t)(emit.ptr - b_done_patch) - 8;
+    *(uint32_t*)b_done_patch = ARM_COND(COND_AL) | ARM_B(b_done_offset);
 }
 
 // Helper: emit ADC logic. operand is already in operand_reg (8-bit value).
-// Computes A = A + operand + carry, updates NZ, carry, and V flag in status byte.
+// Computes A = A + operand + carry, updates NZ, carry, and state->flag_v,
+// leaving out the flags the IR found dead.
 static void EmitADC(Emitter& emit, int operand_reg) {
+    uint8_t* decimal_done = EmitDecimalBegin(emit, operand_reg, (const void*)&DecimalADC);
     // Save old A for overflow detection
-    emit.Emit_MOV(REG_SCRATCH3, REG_A);
+    if (!emit.v_dead) emit.Emit_MOV(REG_SCRATCH3, REG_A);
     // temp = A + operand + carry (16-bit result in r0)
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_A, operand_reg, false));
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_CARRY, false));
     // New carry = (result >> 8) & 1; since max result is 255+255+1=511, bit 8 is the carry
     // MOV r8, r0, LSR #8
-    emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
-              (REG_CARRY << 12) | (8 << 7) | (1 << 5) | REG_SCRATCH0);
+    if (!emit.c_dead) {
+        emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
+                  (REG_CARRY << 12) | (8 << 7) | (1 << 5) | REG_SCRATCH0);
+    }
     // A = result & 0xFF
     emit.Emit_AND_IMM(REG_A, REG_SCRATCH0, 0xFF);
     // NZ from A
     emit.Emit_UpdateNZ(REG_A);
+    if (emit.v_dead) {
+        EmitDecimalEnd(emit, decimal_done);
+        return;
+    }
     // Overflow: V = ~(old_A ^ operand) & (old_A ^ result) & 0x80
     // EOR r0, r3, r4 → old_A ^ new_A (= old_A ^ result)
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_EOR, REG_SCRATCH0, REG_SCRATCH3, REG_A, false));
@@ -234,53 +783,500 @@ static void EmitADC(Emitter& emit, int operand_reg) {
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_EOR, REG_SCRATCH1, REG_SCRATCH3, operand_reg, false));
     // BIC r0, r0, r1 → (old_A ^ result) & ~(old_A ^ operand)
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_BIC, REG_SCRATCH0, REG_SCRATCH0, REG_SCRATCH1, false));
-    // TST r0, #0x80
-    emit.Emit_TST_IMM(REG_SCRATCH0, 0x80);
-    // Update V in status byte
-    emit.Emit_LDRB_IMM(REG_SCRATCH1, REG_STATE, DS_STATUS);
-    // BIC r1, r1, #0x40 (clear V)
-    emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_BIC, REG_SCRATCH1, REG_SCRATCH1, 0x40, 0, false));
-    // ORRNE r1, r1, #0x40 (set V if overflow)
-    emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_ORR, REG_SCRATCH1, REG_SCRATCH1, 0x40, 0, false));
-    emit.Emit_STRB_IMM(REG_SCRATCH1, REG_STATE, DS_STATUS);
+    // r0 is 8-bit, so V = r0 >> 7: MOV r0, r0, LSR #7; STRB r0, [state->flag_v]
+    emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
+              (REG_SCRATCH0 << 12) | (7 << 7) | (1 << 5) | REG_SCRATCH0);
+    emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_V);
+    EmitDecimalEnd(emit, decimal_done);
 }
 
 // Helper: emit SBC logic. SBC = ADC with complemented operand.
 // operand_reg contains the original operand (not complemented).
 static void EmitSBC(Emitter& emit, int operand_reg) {
+    uint8_t* decimal_done = EmitDecimalBegin(emit, operand_reg, (const void*)&DecimalSBC);
     // Save old A and original operand for overflow
-    emit.Emit_MOV(REG_SCRATCH3, REG_A);
+    if (!emit.v_dead) emit.Emit_MOV(REG_SCRATCH3, REG_A);
     // Complement the operand: r2 = operand ^ 0xFF (= ~operand & 0xFF)
     emit.Emit_EOR_IMM(REG_SCRATCH2, operand_reg, 0xFF);
     // temp = A + ~operand + carry
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_A, REG_SCRATCH2, false));
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_CARRY, false));
     // Carry
-    emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
-              (REG_CARRY << 12) | (8 << 7) | (1 << 5) | REG_SCRATCH0);
+    if (!emit.c_dead) {
+        emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
+                  (REG_CARRY << 12) | (8 << 7) | (1 << 5) | REG_SCRATCH0);
+    }
     // A = result & 0xFF
     emit.Emit_AND_IMM(REG_A, REG_SCRATCH0, 0xFF);
     emit.Emit_UpdateNZ(REG_A);
+    if (emit.v_dead) {
+        EmitDecimalEnd(emit, decimal_done);
+        return;
+    }
     // Overflow for SBC: V = (old_A ^ operand) & (old_A ^ result) & 0x80
     // (note: AND not BIC, because operand was complemented for ADC)
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_EOR, REG_SCRATCH0, REG_SCRATCH3, REG_A, false));
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_EOR, REG_SCRATCH1, REG_SCRATCH3, operand_reg, false));
     emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_AND, REG_SCRATCH0, REG_SCRATCH0, REG_SCRATCH1, false));
-    emit.Emit_TST_IMM(REG_SCRATCH0, 0x80);
-    emit.Emit_LDRB_IMM(REG_SCRATCH1, REG_STATE, DS_STATUS);
-    emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_BIC, REG_SCRATCH1, REG_SCRATCH1, 0x40, 0, false));
-    emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_ORR, REG_SCRATCH1, REG_SCRATCH1, 0x40, 0, false));
-    emit.Emit_STRB_IMM(REG_SCRATCH1, REG_STATE, DS_STATUS);
+    emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
+              (REG_SCRATCH0 << 12) | (7 << 7) | (1 << 5) | REG_SCRATCH0);
+    emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_V);
+    EmitDecimalEnd(emit, decimal_done);
 }
 
-void* CompileBlock(uint16_t pc) {
-    DebugLog("DR: CompileBlock(%04X) called\n", pc);
+// Cycles a block needs left to run: the most one pass over it can take
+// (BlockBudget). Checked on entry (chained exits enter past the prologue, so they are
+// checked too) and at in-block back edges; a block that would overrun the
+// deadline leaves instead, and the interpreter runs up to it exactly.
+static int block_budget = 0;
+
+// Compare r0 (cycles_remaining) against block_budget. Clobbers r3.
+static void EmitBudgetCompare(Emitter& emit) {
+    if (block_budget <= 255) {
+        emit.Emit_CMP_IMM(REG_SCRATCH0, (uint8_t)block_budget);
+    } else {
+        emit.LoadImm16(REG_SCRATCH3, (uint16_t)block_budget);
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_CMP, 0, REG_SCRATCH0, REG_SCRATCH3, true));
+    }
+}
+
+// Baseline blocks count which way the branch that ends them goes
+// (BranchCounter); optimized ones follow its hot side. Set by CompileAt.
+static bool profile_branches = false;
+
+// Add one to a branch profile counter. Clobbers r0, r1.
+static void EmitCountBranch(Emitter& emit, uint32_t* counter) {
+    emit.LoadImm32(REG_SCRATCH1, (uint32_t)(uintptr_t)counter);
+    emit.Emit_LDR_IMM(REG_SCRATCH0, REG_SCRATCH1, 0);
+    emit.Emit_ADD_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
+    emit.Emit_STR_IMM(REG_SCRATCH0, REG_SCRATCH1, 0);
+}
+
+// Helper: emit a 6502 conditional branch whose condition the caller has
+// already put in the ARM flags (branch taken on `taken`). A backward branch
+// to an instruction in this block loops in place, and a trace branch
+// (emit.side_exit) leaves on its cold side only; anything else ends the
+// block with one exit per direction, so each can be chained separately.
+static void EmitBranch(Emitter& emit, Cond taken, uint16_t& pc, bool& block_ended) {
+    const uint16_t branch_pc = pc - 1;
+    int8_t offset = (int8_t)FetchByteAt(pc++);
+    uint16_t target = pc + offset;
+
+    if (emit.side_exit) {
+        const int taken_cycles = ((pc ^ target) & 0xFF00) ? 2 : 1;
+        emit.cycles += 2;
+        uint8_t* stay_patch = emit.ptr;
+        emit.Emit(0);  // placeholder B<hot side> past the side exit
+        if (emit.trace_taken) {
+            emit.Emit_Epilogue(pc);
+        } else {
+            emit.cycles += taken_cycles;
+            emit.Emit_Epilogue(target);
+            emit.cycles -= taken_cycles;
+        }
+        const Cond stay = emit.trace_taken ? taken : (Cond)(taken ^ 1);
+        *(uint32_t*)stay_patch = ARM_COND(stay) | ARM_B((int32_t)(emit.ptr - stay_patch) - 8);
+        if (emit.trace_taken) emit.cycles += taken_cycles;
+        return;
+    }
+
+    int32_t arm_target = emit.GetARMOffset(target);
+    if (arm_target >= 0 && offset < 0) {
+        // Backward branch within block. Taken, it charges the pass just
+        // run and goes round again while the budget still covers the
+        // block; otherwise it leaves for the loop head, charging the
+        // cycles before it. emit.cycles stays a single pass, so the exits
+        // after the loop charge the last pass (branch not taken).
+        const int taken_cycles = ((pc ^ target) & 0xFF00) ? 2 : 1;
+        const int head_cycles = emit.GetCyclesAt(target);
+        const int pass_cycles = emit.cycles + 2 + taken_cycles - head_cycles;
+        emit.cycles += 2;
+        const int block_cycles = emit.cycles;
+
+        uint8_t* skip_patch = emit.ptr;
+        emit.Emit(0);  // placeholder B<not taken> past the loop
+        emit.cycles = pass_cycles;
+        emit.Emit_ChargeCycles();
+        EmitBudgetCompare(emit);
+        emit.Emit_B(arm_target - (int32_t)emit.CurrentOffset() - 8, COND_GE);
+        emit.cycles = head_cycles;
+        emit.Emit_Epilogue(target);
+        emit.cycles = block_cycles;
+
+        int32_t skip_offset = (int32_t)(emit.ptr - skip_patch) - 8;
+        *(uint32_t*)skip_patch = ARM_COND((Cond)(taken ^ 1)) | ARM_B(skip_offset);
+        return;
+    }
+
+    block_ended = true;
+    emit.cycles += 2;
+
+    // Layout:
+    //   B<not taken> not_taken  (placeholder)
+    //   [taken exit: target PC]
+    // not_taken:
+    //   [not-taken exit: next PC]
+    uint8_t* skip_patch = emit.ptr;
+    emit.Emit(0);
+
+    // A taken branch costs one more cycle, two if it crosses a page
+    int taken_cycles = ((pc ^ target) & 0xFF00) ? 2 : 1;
+    BranchCount* count = profile_branches ? BranchCounter(branch_pc) : nullptr;
+    if (count) EmitCountBranch(emit, &count->taken);
+    emit.cycles += taken_cycles;
+    emit.Emit_Epilogue(target);
+    emit.cycles -= taken_cycles;
+
+    int32_t skip_offset = (int32_t)(emit.ptr - skip_patch) - 8;
+    *(uint32_t*)skip_patch = ARM_COND((Cond)(taken ^ 1)) | ARM_B(skip_offset);
+
+    if (count) EmitCountBranch(emit, &count->not_taken);
+    emit.Emit_Epilogue(pc);
+}
+
+// An indirect jump's inline cache missed: cache the target's block, if
+// it has one, as the site's newest. Returns the block's body, or 0 to
+// leave through the dispatcher.
+static uint32_t IndirectMiss(IndirectSite* site, uint32_t pc) {
+    stats.indirect_misses++;
+    const Block* b = FindBlock((uint16_t)pc);
+    if (!b) return 0;
+    site->pc[1] = site->pc[0];
+    site->body[1] = site->body[0];
+    site->pc[0] = pc;
+    site->body[0] = (uint32_t)(uintptr_t)b->body;
+    return site->body[0];
+}
+
+// JMP (abs) / JMP (abs,X) (IR_JMP_IND). The target PC is read into r1 and
+// looked up in the site's inline cache: a hit branches straight into the
+// target block's body, as a linked exit would. A miss asks IndirectMiss,
+// and leaves through the dispatcher only if the target has no block yet.
+static bool EmitIndirectJump(Emitter& emit, const IRInst& in, uint16_t& pc, bool& block_ended) {
+    // r1 = pointer, both bytes in RAM or one ROM window (CanLowerAccess)
+    if (in.mode == IR_ABS || (in.flags & IR_F_INDEX_KNOWN)) {
+        EmitLoadAbs(emit, REG_SCRATCH1, in.addr);
+        EmitLoadAbs(emit, REG_SCRATCH2, in.addr + 1);
+    } else {
+        const int window = in.operand < 0x2000 ? REG_RAM : (in.operand & 0x4000) ? REG_ROM_HI : REG_ROM_LO;
+        emit.LoadImm16(REG_SCRATCH0, in.operand < 0x2000 ? in.operand : in.operand & 0x3FFF);
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_X));
+        emit.Emit_LDRB_REG(REG_SCRATCH1, window, REG_SCRATCH0);
+        emit.Emit_ADD_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
+        emit.Emit_LDRB_REG(REG_SCRATCH2, window, REG_SCRATCH0);
+    }
+    // ORR r1, r1, r2, LSL #8
+    emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ORR, REG_SCRATCH1, REG_SCRATCH1, REG_SCRATCH2) | (8 << 7));
+    pc = in.pc + in.length;
+    block_ended = true;
+
+    // Charge the block; out of budget, leave as an unlinked exit would
+    emit.cycles += in.cycles;
+    const int block_cycles = emit.cycles;
+    emit.Emit_ChargeCycles();
+    uint8_t* leave_patch = emit.ptr;
+    emit.Emit(0);  // placeholder BLE leave
+
+    IndirectSite* site = &indirect_sites[next_indirect_site];
+    next_indirect_site = (next_indirect_site + 1) % INDIRECT_SITES;
+    emit.LoadImm32(REG_SCRATCH2, (uint32_t)(uintptr_t)site);
+    uint8_t* hit_patch[2];
+    for (int k = 0; k < 2; k++) {
+        emit.Emit_LDR_IMM(REG_SCRATCH3, REG_SCRATCH2, offsetof(IndirectSite, pc) + 4 * k);
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_CMP, 0, REG_SCRATCH3, REG_SCRATCH1, true));
+        emit.Emit(ARM_COND(COND_EQ) | ARM_LDR_IMM(REG_SCRATCH3, REG_SCRATCH2, offsetof(IndirectSite, body) + 4 * k));
+        hit_patch[k] = emit.ptr;
+        emit.Emit(0);  // placeholder BEQ hit
+    }
+
+    // Miss: r3 (kept across the call) holds the PC
+    emit.Emit_MOV(REG_SCRATCH0, REG_SCRATCH2);
+    emit.Emit_MOV(REG_SCRATCH3, REG_SCRATCH1);
+    emit.Emit_CallHelper((const void*)&IndirectMiss);
+    emit.Emit_CMP_IMM(REG_SCRATCH0, 0);
+    emit.Emit(ARM_COND(COND_NE) | 0x012FFF10 | REG_SCRATCH0);  // BXNE r0
+    emit.Emit_MOV(REG_SCRATCH1, REG_SCRATCH3);
+    *(uint32_t*)leave_patch = ARM_COND(COND_LE) | ARM_B((int32_t)(emit.ptr - leave_patch) - 8);
+    emit.cycles = 0;
+    emit.Emit_Epilogue_DynamicPC(REG_SCRATCH1);
+
+    // Hit: count it and go
+    for (int k = 0; k < 2; k++) {
+        *(uint32_t*)hit_patch[k] = ARM_COND(COND_EQ) | ARM_B((int32_t)(emit.ptr - hit_patch[k]) - 8);
+    }
+    emit.Emit_LDR_IMM(REG_SCRATCH0, REG_SCRATCH2, offsetof(IndirectSite, hits));
+    emit.Emit_ADD_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
+    emit.Emit_STR_IMM(REG_SCRATCH0, REG_SCRATCH2, offsetof(IndirectSite, hits));
+    emit.Emit_BX(REG_SCRATCH3);
+    emit.cycles = block_cycles;
+    return true;
+}
+
+// Lower one IR instruction. The passes' annotations are handled here;
+// everything else goes to the opcode's own case in CompileInstruction.
+// pc points past the opcode byte on entry.
+static bool LowerInstruction(Emitter& emit, const IRInst& in, uint16_t& pc, bool& block_ended) {
+    static const int arm_reg[3] = { REG_A, REG_X, REG_Y };
+
+    if (in.flags & IR_F_STORE_REDUNDANT) {
+        // Memory already holds the value
+        pc = in.pc + in.length;
+        emit.cycles += in.cycles;
+        return true;
+    }
+    if (in.flags & IR_F_LOAD_FORWARD) {
+        // The value is already in a register
+        const int dest = arm_reg[in.reg];
+        const int value = arm_reg[in.value_reg];
+        if (dest != value) emit.Emit_MOV(dest, value);
+        emit.Emit_UpdateNZ(dest);
+        pc = in.pc + in.length;
+        emit.cycles += in.cycles;
+        return true;
+    }
+    if ((in.flags & IR_F_INDEX_KNOWN) && (in.op == IR_LOAD || in.op == IR_STORE)) {
+        // Constant index: address the element directly
+        const int reg = arm_reg[in.reg];
+        if (in.op == IR_LOAD) {
+            if (!EmitLoadAbs(emit, reg, in.addr)) return false;
+            emit.Emit_UpdateNZ(reg);
+        } else if (!EmitStoreAbs(emit, reg, in.addr)) {
+            return false;
+        }
+        pc = in.pc + in.length;
+        emit.cycles += in.cycles;
+        return true;
+    }
+    if (in.op == IR_JMP_IND) return EmitIndirectJump(emit, in, pc, block_ended);
+    return CompileInstruction(emit, in.opcode, pc, block_ended);
+}
+
+// Checks that can leave the block after an instruction: code writes
+// (IR_F_CODE_WRITE) and I/O (IR_F_IO). The check after the store only
+// looks up the page, or exit_reason after an I/O access; its slow path is
+// a stub emitted after the block's last exit. A code-write stub calls
+// NoteCodeWrite and either branches back or leaves the block at the next
+// instruction; an I/O stub just leaves. A JSR's return exit (ReturnStack)
+// is a stub too.
+struct ExitStub {
+    uint8_t* branch;    // The check's branch to the stub (a return exit: the ADDs taking its address)
+    Cond cond;
+    uint16_t addr;      // Address written, unless dynamic (then in r0)
+    bool dynamic;
+    bool leave;         // Just leave: an I/O access set exit_reason, or the budget check failed
+    bool keep_pc;       // Leave for the pc in CpuState (an I/O access stored it)
+    bool ret;           // Return exit for next_pc, entered from an RTS that has charged its cycles
+    uint16_t next_pc;
+    int cycles;         // Block cycles through the instruction
+};
+static constexpr int EXIT_STUB_BYTES = 160;
+static ExitStub exit_stubs[MAX_BLOCK_SIZE * 2 + 1];
+static int exit_stub_count = 0;
+
+static void EmitCodeWriteCheck(Emitter& emit, const IRInst& in) {
+    const bool dynamic = in.mode != IR_ABS && !(in.flags & IR_F_INDEX_KNOWN);
+    if (!dynamic && in.addr < RAM_CODE_START) return;
+    if (dynamic && in.mode != IR_INDY) {
+        // (zp),Y left its address in r0; rebuild abs,X and abs,Y
+        emit.LoadImm16(REG_SCRATCH0, in.operand);
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, in.mode == IR_ABSX ? REG_X : REG_Y));
+    }
+    emit.Emit_LDR_IMM(REG_SCRATCH1, REG_STATE, CS_CODE_PAGES);
+    if (dynamic) {
+        // LDRB r1, [r1, r0, LSR #8]
+        emit.Emit(ARM_COND(COND_AL) | (0x1 << 26) | (1 << 25) | (1 << 24) | (1 << 23) | (1 << 22) | (1 << 20) |
+                  (REG_SCRATCH1 << 16) | (REG_SCRATCH1 << 12) | (8 << 7) | (1 << 5) | REG_SCRATCH0);
+    } else {
+        emit.Emit_LDRB_IMM(REG_SCRATCH1, REG_SCRATCH1, in.addr >> 8);
+    }
+    emit.Emit_CMP_IMM(REG_SCRATCH1, 0);
+    ExitStub& stub = exit_stubs[exit_stub_count++];
+    stub.branch = emit.ptr;
+    emit.Emit(0);  // placeholder BNE stub
+    stub.cond = COND_NE;
+    stub.addr = in.addr;
+    stub.dynamic = dynamic;
+    stub.leave = false;
+    stub.ret = false;
+    stub.next_pc = in.pc + in.length;
+    stub.cycles = emit.cycles;
+}
+
+// After an indexed access that may cross a page (MayCrossPage): charge the
+// extra cycle if it did, as the decimal-mode helpers charge theirs. abs,X
+// and abs,Y test the index against the base; (zp),Y the address its case
+// left in r3, which survives an I/O call. Clobbers r1, r2, leaving r0 for
+// a code-write check.
+static void EmitPageCrossCheck(Emitter& emit, const IRInst& in) {
+    if (in.mode == IR_INDY) {
+        // Crossed if the address's low byte wrapped below Y
+        emit.Emit_AND_IMM(REG_SCRATCH1, REG_SCRATCH3, 0xFF);
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_CMP, 0, REG_SCRATCH1, REG_Y, true));
+    } else {
+        const uint8_t lo = in.operand & 0xFF;
+        if (!lo) return;
+        emit.Emit_CMP_IMM(in.mode == IR_ABSX ? REG_X : REG_Y, (uint8_t)(0x100 - lo));
+    }
+    const Cond crossed = in.mode == IR_INDY ? COND_CC : COND_CS;
+    emit.Emit(ARM_COND(crossed) | ARM_LDR_IMM(REG_SCRATCH2, REG_STATE, CS_CYCLES_REM));
+    emit.Emit(ARM_COND(crossed) | ARM_DP_IMM(DP_SUB, REG_SCRATCH2, REG_SCRATCH2, 1));
+    emit.Emit(ARM_COND(crossed) | ARM_STR_IMM(REG_SCRATCH2, REG_STATE, CS_CYCLES_REM, false));
+}
+
+// After an I/O access (IR_F_IO): leave if the access moved the deadline or
+// switched banks. pc was stored before the call (EmitIoSpill) and is left
+// as it is: the next instruction, or the handler of an IRQ the access
+// raised. r0 is left alone for a code-write check after a (zp),Y store.
+static void EmitIoExitCheck(Emitter& emit, const IRInst& in) {
+    emit.Emit_LDRB_IMM(REG_SCRATCH1, REG_STATE, CS_EXIT_REASON);
+    emit.Emit_CMP_IMM(REG_SCRATCH1, 0);
+    ExitStub& stub = exit_stubs[exit_stub_count++];
+    stub.branch = emit.ptr;
+    emit.Emit(0);  // placeholder BNE stub
+    stub.cond = COND_NE;
+    stub.leave = true;
+    stub.keep_pc = true;
+    stub.ret = false;
+    stub.next_pc = in.pc + in.length;
+    stub.cycles = emit.cycles;
+}
+
+// On entry: leave at the first instruction, charging nothing, unless the
+// budget covers the whole block
+static void EmitBudgetCheck(Emitter& emit, uint16_t start_pc) {
+    emit.Emit_LDR_IMM(REG_SCRATCH0, REG_STATE, CS_CYCLES_REM);
+    EmitBudgetCompare(emit);
+    ExitStub& stub = exit_stubs[exit_stub_count++];
+    stub.branch = emit.ptr;
+    emit.Emit(0);  // placeholder BLT stub
+    stub.cond = COND_LT;
+    stub.leave = true;
+    stub.keep_pc = false;
+    stub.ret = false;
+    stub.next_pc = start_pc;
+    stub.cycles = 0;
+}
+
+// Before a JSR the block does not inline: push its return PC and the
+// address of a return exit for it onto the ReturnStack. The exit is
+// emitted with the stubs; until then two ADDs stand for its address.
+static void EmitReturnPush(Emitter& emit, uint16_t return_pc) {
+    emit.Emit_LDR_IMM(REG_SCRATCH1, REG_STATE, CS_RETURN_STACK);
+    emit.Emit_LDR_IMM(REG_SCRATCH2, REG_SCRATCH1, RS_TOP);
+    emit.Emit_ADD_IMM(REG_SCRATCH2, REG_SCRATCH2, 1);
+    emit.Emit_AND_IMM(REG_SCRATCH2, REG_SCRATCH2, RETURN_STACK_SIZE - 1);
+    emit.Emit_STR_IMM(REG_SCRATCH2, REG_SCRATCH1, RS_TOP);
+    // ADD r1, r1, r2, LSL #3
+    emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH1, REG_SCRATCH1, REG_SCRATCH2) | (3 << 7));
+    emit.LoadImm16(REG_SCRATCH2, return_pc);
+    emit.Emit_STR_IMM(REG_SCRATCH2, REG_SCRATCH1, RS_PC);
+    ExitStub& stub = exit_stubs[exit_stub_count++];
+    stub.branch = emit.ptr;
+    emit.Emit(0);  // placeholder ADD r2, pc, #lo
+    emit.Emit(0);  // placeholder ADD r2, r2, #hi
+    emit.Emit_STR_IMM(REG_SCRATCH2, REG_SCRATCH1, RS_CODE);
+    stub.leave = false;
+    stub.ret = true;
+    stub.next_pc = return_pc;
+    stub.cycles = 0;
+}
+
+static void EmitExitStubs(Emitter& emit) {
+    const int block_cycles = emit.cycles;
+    for (int i = 0; i < exit_stub_count; i++) {
+        const ExitStub& stub = exit_stubs[i];
+        if (stub.ret) {
+            // Its address, pc-relative so the block can be promoted:
+            // offset bits 2-9 and 10-17 as rotated immediates
+            const uint32_t offset = (uint32_t)(emit.ptr - stub.branch) - 8;
+            *(uint32_t*)stub.branch = ARM_COND(COND_AL) |
+                ARM_DP_IMM(DP_ADD, REG_SCRATCH2, 15, (offset >> 2) & 0xFF, 15);
+            *(uint32_t*)(stub.branch + 4) = ARM_COND(COND_AL) |
+                ARM_DP_IMM(DP_ADD, REG_SCRATCH2, REG_SCRATCH2, (offset >> 10) & 0xFF, 11);
+            // The RTS charged everything; the link word chains while
+            // cycles remain
+            emit.cycles = 0;
+            emit.Emit_Epilogue(stub.next_pc);
+            continue;
+        }
+        *(uint32_t*)stub.branch = ARM_COND(stub.cond) | ARM_B((int32_t)(emit.ptr - stub.branch) - 8);
+        if (stub.leave) {
+            if (stub.keep_pc) emit.Emit_LDRH_IMM(REG_SCRATCH1, REG_STATE, CS_PC);
+            else emit.LoadImm16(REG_SCRATCH1, stub.next_pc);
+            emit.cycles = stub.cycles;
+            emit.Emit_Epilogue_DynamicPC(REG_SCRATCH1);
+            continue;
+        }
+        if (!stub.dynamic) emit.LoadImm16(REG_SCRATCH0, stub.addr);
+        emit.Emit_CallHelper((const void*)&NoteCodeWrite);
+        // Nothing dropped: carry on after the check
+        emit.Emit_CMP_IMM(REG_SCRATCH0, 0);
+        emit.Emit_B((int32_t)(stub.branch + 4 - emit.ptr) - 8, COND_EQ);
+        emit.LoadImm16(REG_SCRATCH1, stub.next_pc);
+        emit.cycles = stub.cycles;
+        emit.Emit_Epilogue_DynamicPC(REG_SCRATCH1);
+    }
+    emit.cycles = block_cycles;
+}
+
+// Lower the block's instructions after the prologue. Returns how many were
+// lowered; fewer than ir.count means the block must end before the next.
+static int LowerBlock(Emitter& emit, const IRBlock& ir, bool& block_ended) {
+    block_ended = false;
+    exit_stub_count = 0;
+    block_budget = BlockBudget(ir);
+    EmitBudgetCheck(emit, ir.start_pc);
+    for (int i = 0; i < ir.count; i++) {
+        const IRInst& in = ir.inst[i];
+        // Inlined leaf code is never a branch target (dynarec_ir.h)
+        if (!(in.flags & IR_F_INLINED)) emit.RecordPCMap(in.pc);
+
+        if (!emit.CanEmit(256 + exit_stub_count * EXIT_STUB_BYTES)) {
+            DebugLog("DR: buffer full at %04X\n", in.pc);
+            return i;
+        }
+        uint16_t pc = in.pc + 1;
+        emit.nz_dead = (in.flags & IR_F_NZ_DEAD) != 0;
+        emit.c_dead = (in.flags & IR_F_C_DEAD) != 0;
+        emit.v_dead = (in.flags & IR_F_V_DEAD) != 0;
+        emit.side_exit = (in.flags & IR_F_SIDE_EXIT) != 0;
+        emit.trace_taken = (in.flags & IR_F_TRACE_TAKEN) != 0;
+        emit.next_pc = in.pc + in.length;
+        // An inlined leaf's RTS pops nothing off the ReturnStack
+        if (in.op == IR_JSR && !(i + 1 < ir.count && (ir.inst[i + 1].flags & IR_F_INLINED))) {
+            EmitReturnPush(emit, in.pc + in.length);
+        }
+        const bool lowered = LowerInstruction(emit, in, pc, block_ended);
+        emit.nz_dead = emit.c_dead = emit.v_dead = false;
+        emit.side_exit = emit.trace_taken = false;
+        if (!lowered) {
+            DebugLog("DR: fallback at %04X op=%02X\n", in.pc, in.opcode);
+            return i;
+        }
+        // The decoder and the lowering have to agree on where the block goes
+        const bool last = i + 1 == ir.count;
+        if (pc != in.pc + in.length || block_ended != (last && ir.ends)) {
+            DebugLog("DR: IR mismatch at %04X op=%02X\n", in.pc, in.opcode);
+            return i;
+        }
+        if (MayCrossPage(in)) EmitPageCrossCheck(emit, in);
+        if (in.flags & IR_F_IO) EmitIoExitCheck(emit, in);
+        if ((in.flags & IR_F_CODE_WRITE) && !(in.flags & IR_F_STORE_REDUNDANT)) EmitCodeWriteCheck(emit, in);
+        DebugLog("DR: compiled %04X op=%02X ptr=%p\n", in.pc, in.opcode, emit.ptr);
+    }
+    return ir.count;
+}
+
+// Compile the block at pc into the cold tier, running the IR passes of the
+// given tier over it
+static Block* CompileAt(uint16_t pc, uint8_t tier) {
+    DebugLog("DR: CompileAt(%04X, tier %d) called\n", pc, tier);
 
     // Check if already compiled
     Block* existing = FindBlock(pc);
     if (existing) {
         DebugLog("DR:  found existing block at %p\n", existing->code);
-        return existing->code;
+        return existing;
     }
 
     // Don't retry PCs that already failed
@@ -289,56 +1285,62 @@ void* CompileBlock(uint16_t pc) {
         return nullptr;
     }
 
-    // Check pool space
-    if (block_pool_used >= BLOCK_CACHE_SIZE) {
-        DebugLog("DR:  block pool full\n");
-        stats.fallback_count++;
-        return nullptr;
+    // Every RAM block slot taken: the oldest makes room
+    if (!(pc & 0x8000) && ram_block_count >= RAM_BLOCK_SLOTS) {
+        Block* oldest = ram_blocks[0];
+        EvictRange((uint8_t*)oldest->code, (uint8_t*)oldest->code + oldest->code_size);
     }
 
-    // Check code space
-    size_t remaining = CODE_BUFFER_SIZE - (code_ptr - dynarec_code_buffer);
+    // Out of block slots or cold-tier space: collect the cold tier
+    size_t remaining = COLD_BUFFER_SIZE - (code_ptr - dynarec_cold_buffer);
     DebugLog("DR:  remaining code space: %zu\n", remaining);
-    if (remaining < 512) {
-        DebugLog("DR:  invalidating all blocks\n");
-        InvalidateAll();
-        remaining = CODE_BUFFER_SIZE;
+    if (remaining < 512 || (free_block_count == 0 && block_pool_used >= BLOCK_CACHE_SIZE)) {
+        DebugLog("DR:  collecting cold tier\n");
+        CollectColdTier();
+        remaining = COLD_BUFFER_SIZE;
+    }
+
+    // Make sure the block will have a map entry. Out of leaves, collect the
+    // cold tier and rebuild the maps around what is left; start over only
+    // if that is not enough.
+#if !DYNAREC_FLAT_BLOCK_MAP
+    if (!MapSlot(pc)) {
+        DebugLog("DR:  block map full, collecting cold tier\n");
+        CollectColdTier();
+        remaining = COLD_BUFFER_SIZE;
+        if (!RebuildBlockMaps() || !MapSlot(pc)) {
+            InvalidateAll();
+            MapSlot(pc);
+        }
     }
+#endif
+
+    // Decode the block and run the IR passes over it (dynarec_ir.h)
+    static IRBlock ir;
+    DecodeBlock(ir, pc, FetchByteAt, tier == TIER_OPTIMIZED);
+    RunPasses(ir, tier);
+    profile_branches = tier == TIER_BASELINE;
 
-    // Try compilation before allocating a block
+    // Lower it before allocating a block. If an instruction turns out not
+    // to lower (or the buffer runs out), the block ends before it: cut the
+    // IR there and rerun the passes, since a flag that was dead may be live
+    // at the new end, then lower again.
     Emitter emit(code_ptr, remaining);
     void* code_start = code_ptr;
-
-    emit.Emit_Prologue();
-
-    uint16_t start_pc = pc;
-    uint16_t current_pc = pc;
-    int instructions = 0;
-    bool block_ended = false;
-
-    while (instructions < MAX_BLOCK_SIZE && emit.cycles < MAX_BLOCK_CYCLES && !block_ended) {
-        if (current_pc >= 0x2000 && current_pc < 0x8000) break;
-
-        emit.RecordPCMap(current_pc);
-
-        uint8_t opcode = FetchByteAt(current_pc);
-        uint16_t instr_pc = current_pc;
-        current_pc++;
-
-        if (!emit.CanEmit(256)) {
-            DebugLog("DR: buffer full at %04X\n", instr_pc);
-            break;
-        }
-        if (!CompileInstruction(emit, opcode, current_pc, block_ended)) {
-            // Fallback: current_pc was incremented past the opcode byte.
-            // Set it back to instr_pc so the epilogue stores the correct exit PC.
-            current_pc = instr_pc;
-            DebugLog("DR: fallback at %04X op=%02X\n", instr_pc, opcode);
-            break;
-        }
-        DebugLog("DR: compiled %04X op=%02X ptr=%p\n", instr_pc, opcode, emit.ptr);
-        instructions++;
-    }
+    void* body_start;
+    bool block_ended;
+    int instructions;
+    for (;;) {
+        emit.Emit_Prologue();
+        body_start = emit.ptr;
+        instructions = LowerBlock(emit, ir, block_ended);
+        if (instructions == ir.count || instructions == 0) break;
+        TruncateBlock(ir, instructions);
+        RunPasses(ir, tier);
+        emit.Reset();
+    }
+    const uint16_t start_pc = pc;
+    const uint16_t current_pc = ir.end_pc;
 
     // If we compiled nothing useful, record failure and bail
     if (instructions == 0) {
@@ -361,20 +1363,48 @@ void* CompileBlock(uint16_t pc) {
     if (!block_ended) {
         emit.Emit_Epilogue(current_pc);
     }
+    EmitExitStubs(emit);
 
     code_ptr = emit.ptr;
     size_t code_size = (uint8_t*)code_ptr - (uint8_t*)code_start;
 
     // Fill in block metadata
     block->pc = start_pc;
-    block->end_pc = current_pc;
+    SourceSpan(ir, block->src_lo, block->src_end);
     block->code = code_start;
+    block->body = body_start;
+    block->code_size = (uint32_t)code_size;
     block->cycles = emit.cycles;
     block->exec_count = 0;
+    block->bank = BlockBank(start_pc);
+    block->tier = tier;
 
     InsertBlock(block);
+    if (block->bank == RAM_BANK) {
+        ram_blocks[ram_block_count++] = block;
+        CountRamPages(*block, 1);
+    } else {
+        MarkRomWindows(*block);
+    }
+
+    // Chain exits that were waiting for this PC to the new block, then the
+    // new block's own exits to whatever is already compiled (itself included)
+    for (int i = 0; i < exit_table_used; i++) {
+        const BlockExit& e = exit_table[i];
+        if (e.exit.target_pc == start_pc && *e.exit.slot == ARM_NOP && CanLink(e.bank, start_pc)) {
+            LinkExit(e.exit, block);
+        }
+    }
+    for (int i = 0; i < emit.exit_count; i++) {
+        // An exit missing from the table could not be unlinked on eviction,
+        // so it stays unlinked
+        if (exit_table_used >= MAX_EXITS) break;
+        exit_table[exit_table_used++] = { emit.exits[i], block->bank };
+        Block* target = FindBlock(emit.exits[i].target_pc);
+        if (target && CanLink(block->bank, emit.exits[i].target_pc)) LinkExit(emit.exits[i], target);
+    }
     stats.blocks_compiled++;
-    stats.compile_bytes_used = code_ptr - dynarec_code_buffer;
+    stats.compile_bytes_used = code_ptr - dynarec_cold_buffer;
 
     DebugLog("DR: compiled block %04X-%04X (%d instr, %d cycles, %zu bytes) at %p\n",
            start_pc, current_pc, instructions, emit.cycles, code_size, code_start);
@@ -388,7 +1418,27 @@ void* CompileBlock(uint16_t pc) {
     __asm__ volatile ("mcr p15, 0, %0, c7, c10, 4" :: "r"(0) : "memory");
 #endif
 
-    return code_start;
+    return block;
+}
+
+void* CompileBlock(uint16_t pc) {
+    Block* block = CompileAt(pc, TIER_BASELINE);
+    return block ? block->code : nullptr;
+}
+
+// Replace a hot baseline block with an optimized one and move that into
+// ITCM. Dropping the old block unlinks everything chained into it; the new
+// one is linked back in as it is compiled. Its cold copy stays behind until
+// the cold tier is next collected.
+static Block* OptimizeBlock(Block* b) {
+    const uint16_t pc = b->pc;
+    EvictRange((uint8_t*)b->code, (uint8_t*)b->code + b->code_size);
+    Block* opt = CompileAt(pc, TIER_OPTIMIZED);
+    if (!opt) return nullptr;
+    stats.blocks_optimized++;
+    opt->exec_count = PROMOTE_THRESHOLD;
+    PromoteBlock(opt);
+    return opt;
 }
 
 // Compile a single 6502 instruction. Returns false if unsupported.
@@ -453,9 +1503,8 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
                           (REG_ROM_LO << 16) | (REG_A << 12) | REG_SCRATCH0);
             }
         } else {
-            // I/O - can't compile
-            pc -= 3; // back up
-            return false;
+            // I/O
+            EmitLoadAbs(emit, REG_A, addr);
         }
         emit.Emit_UpdateNZ(REG_A);
         emit.cycles += 4;
@@ -537,8 +1586,8 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
                           (1 << 22) | (0 << 21) | (0 << 20) |
                           (REG_RAM << 16) | (REG_A << 12) | REG_SCRATCH0);
             }
-        } else {
-            // I/O write or ROM write - exit block
+        } else if (!EmitStoreAbs(emit, REG_A, addr)) {
+            // ROM write - exit block
             pc -= 3;
             return false;
         }
@@ -575,7 +1624,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
                           (1 << 22) | (0 << 21) | (0 << 20) |
                           (REG_RAM << 16) | (REG_Y << 12) | REG_SCRATCH0);
             }
-        } else {
+        } else if (!EmitStoreAbs(emit, REG_Y, addr)) {
             pc -= 3;
             return false;
         }
@@ -743,15 +1792,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     // CMP #imm (0xC9)
     case 0xC9: {
         uint8_t imm = FetchByteAt(pc++);
-        // SUBS r0, r4, #imm (sets ARM flags)
-        emit.Emit_SUB_IMM(REG_SCRATCH0, REG_A, imm, true);
-        // NZ from low byte of result
-        emit.Emit_AND_IMM(REG_NZ, REG_SCRATCH0, 0xFF);
-        // Carry: 6502 carry = ARM carry (A >= imm → carry set)
-        // After SUBS, ARM C flag = borrow inverted = (A >= imm)
-        // MOV r8, #0; MOVCS r8, #1
-        emit.Emit_MOV_IMM(REG_CARRY, 0);
-        emit.Emit(ARM_COND(COND_CS) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        EmitCompareImm(emit, REG_A, imm);
         emit.cycles += 2;
         return true;
     }
@@ -759,10 +1800,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     // CPX #imm (0xE0)
     case 0xE0: {
         uint8_t imm = FetchByteAt(pc++);
-        emit.Emit_SUB_IMM(REG_SCRATCH0, REG_X, imm, true);
-        emit.Emit_AND_IMM(REG_NZ, REG_SCRATCH0, 0xFF);
-        emit.Emit_MOV_IMM(REG_CARRY, 0);
-        emit.Emit(ARM_COND(COND_CS) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        EmitCompareImm(emit, REG_X, imm);
         emit.cycles += 2;
         return true;
     }
@@ -770,10 +1808,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     // CPY #imm (0xC0)
     case 0xC0: {
         uint8_t imm = FetchByteAt(pc++);
-        emit.Emit_SUB_IMM(REG_SCRATCH0, REG_Y, imm, true);
-        emit.Emit_AND_IMM(REG_NZ, REG_SCRATCH0, 0xFF);
-        emit.Emit_MOV_IMM(REG_CARRY, 0);
-        emit.Emit(ARM_COND(COND_CS) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        EmitCompareImm(emit, REG_Y, imm);
         emit.cycles += 2;
         return true;
     }
@@ -817,281 +1852,43 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     // ===== BRANCHES =====
 
     // BNE (0xD0)
-    case 0xD0: {
-        int8_t offset = (int8_t)FetchByteAt(pc++);
-        uint16_t target = pc + offset;
-
+    case 0xD0:
         // TST r7, #0xFF — sets ARM Z if r7==0 (6502 Z set)
         emit.Emit_TST_IMM(REG_NZ, 0xFF);
-
-        // Check if backward branch to a compiled address
-        int32_t arm_target = emit.GetARMOffset(target);
-        if (arm_target >= 0 && offset < 0) {
-            // Backward branch within block — emit ARM branch
-            // Branch offset = target_addr - (current_addr + 8)
-            int32_t branch_offset = arm_target - (int32_t)emit.CurrentOffset() - 8;
-            emit.Emit_B(branch_offset, COND_NE);
-            emit.cycles += 3;  // taken branch
-        } else {
-            // Forward or out-of-block: exit block with target PC if taken
-            // BEQ skip (if Z set = 6502 Z set = branch NOT taken)
-            // Emit epilogue for taken branch
-            // ... but that's complex. Simpler: always end block at branch.
-            block_ended = true;
-            emit.cycles += 2;  // Add cycles BEFORE emitting epilogues
-
-            // We need TWO epilogues since block_ended skips main epilogue.
-            // Layout:
-            //   TST r7, #0xFF
-            //   BEQ not_taken  (placeholder)
-            //   [taken epilogue: exit with target PC]
-            //   B done         (placeholder)
-            // not_taken:
-            //   [not-taken epilogue: exit with current PC]
-            // done:
-
-            uint8_t* beq_patch = emit.ptr;
-            emit.Emit(0); // placeholder for BEQ not_taken
-
-            // Taken path: epilogue with target PC
-            emit.Emit_Epilogue(target);
-
-            // B done (skip not-taken epilogue)
-            uint8_t* b_done_patch = emit.ptr;
-            emit.Emit(0);
-
-            // Not-taken path: epilogue with current PC
-            emit.Emit_Epilogue(pc);
-
-            // Patch BEQ to jump to not-taken epilogue
-            // BEQ jumps over [taken epilogue] + [B done] to reach [not-taken epilogue]
-            // Target = b_done_patch + 4 (start of not-taken epilogue)
-            // PC+8 = beq_patch + 8
-            // Offset = (b_done_patch + 4) - (beq_patch + 8) = (b_done_patch - beq_patch) - 4
-            int32_t beq_offset = (int32_t)(b_done_patch - beq_patch) - 4;
-            *(uint32_t*)beq_patch = ARM_COND(COND_EQ) | ARM_B(beq_offset);
-
-            // Patch B done to skip over not-taken epilogue to done (current location)
-            int32_t b_done_offset = (int32_t)(emit.ptr - b_done_patch) - 8;
-            *(uint32_t*)b_done_patch = ARM_COND(COND_AL) | ARM_B(b_done_offset);
-        }
+        EmitBranch(emit, COND_NE, pc, block_ended);
         return true;
-    }
 
     // BEQ (0xF0)
-    case 0xF0: {
-        int8_t offset = (int8_t)FetchByteAt(pc++);
-        uint16_t target = pc + offset;
-
+    case 0xF0:
         emit.Emit_TST_IMM(REG_NZ, 0xFF);
-
-        int32_t arm_target = emit.GetARMOffset(target);
-        if (arm_target >= 0 && offset < 0) {
-            int32_t branch_offset = arm_target - (int32_t)emit.CurrentOffset() - 8;
-            emit.Emit_B(branch_offset, COND_EQ);
-            emit.cycles += 3;
-        } else {
-            block_ended = true;
-            emit.cycles += 2;  // Add cycles BEFORE emitting epilogues
-
-            uint8_t* beq_patch = emit.ptr;
-            emit.Emit(0); // placeholder for BEQ taken
-
-            // Taken path: epilogue with target PC (BEQ jumps here when Z set)
-            emit.Emit_Epilogue(target);
-
-            // B done (skip not-taken epilogue)
-            uint8_t* b_done_patch = emit.ptr;
-            emit.Emit(0);
-
-            // Not-taken path: epilogue with current PC (fall through when Z clear)
-            emit.Emit_Epilogue(pc);
-
-            // Patch BEQ to jump to taken epilogue (beq_patch + 4 = start of taken epilogue)
-            // Offset = (beq_patch + 4) - (beq_patch + 8) = -4
-            int32_t beq_offset = -4;
-            *(uint32_t*)beq_patch = ARM_COND(COND_EQ) | ARM_B(beq_offset);
-
-            // Patch B done to skip over not-taken epilogue
-            int32_t b_done_offset = (int32_t)(emit.ptr - b_done_patch) - 8;
-            *(uint32_t*)b_done_patch = ARM_COND(COND_AL) | ARM_B(b_done_offset);
-        }
+        EmitBranch(emit, COND_EQ, pc, block_ended);
         return true;
-    }
 
     // BCS (0xB0)
-    case 0xB0: {
-        int8_t offset = (int8_t)FetchByteAt(pc++);
-        uint16_t target = pc + offset;
-
+    case 0xB0:
         // CMP r8, #1 — if carry==1, ARM Z set
         emit.Emit_CMP_IMM(REG_CARRY, 1);
-
-        int32_t arm_target = emit.GetARMOffset(target);
-        if (arm_target >= 0 && offset < 0) {
-            int32_t branch_offset = arm_target - (int32_t)emit.CurrentOffset() - 8;
-            emit.Emit_B(branch_offset, COND_EQ);  // branch if carry==1
-            emit.cycles += 3;
-        } else {
-            // BCS: branch if carry set (CMP r8, #1 sets Z if carry==1)
-            // Taken when ARM Z set, not-taken when ARM Z clear
-            block_ended = true;
-            emit.cycles += 2;  // Add cycles BEFORE emitting epilogues
-
-            uint8_t* beq_patch = emit.ptr;
-            emit.Emit(0); // placeholder for BEQ taken
-
-            // Taken path: epilogue with target PC
-            emit.Emit_Epilogue(target);
-
-            // B done (skip not-taken epilogue)
-            uint8_t* b_done_patch = emit.ptr;
-            emit.Emit(0);
-
-            // Not-taken path: epilogue with current PC
-            emit.Emit_Epilogue(pc);
-
-            // Patch BEQ to jump to taken epilogue (beq_patch + 4 = start of taken epilogue)
-            // Offset = (beq_patch + 4) - (beq_patch + 8) = -4
-            int32_t beq_offset = -4;
-            *(uint32_t*)beq_patch = ARM_COND(COND_EQ) | ARM_B(beq_offset);
-
-            // Patch B done to skip over not-taken epilogue to done
-            int32_t b_done_offset = (int32_t)(emit.ptr - b_done_patch) - 8;
-            *(uint32_t*)b_done_patch = ARM_COND(COND_AL) | ARM_B(b_done_offset);
-        }
+        EmitBranch(emit, COND_EQ, pc, block_ended);
         return true;
-    }
 
     // BCC (0x90)
-    case 0x90: {
-        int8_t offset = (int8_t)FetchByteAt(pc++);
-        uint16_t target = pc + offset;
-
+    case 0x90:
         emit.Emit_CMP_IMM(REG_CARRY, 1);
-
-        int32_t arm_target = emit.GetARMOffset(target);
-        if (arm_target >= 0 && offset < 0) {
-            int32_t branch_offset = arm_target - (int32_t)emit.CurrentOffset() - 8;
-            emit.Emit_B(branch_offset, COND_NE);  // branch if carry!=1 (carry clear)
-            emit.cycles += 3;
-        } else {
-            // BCC: branch if carry clear (CMP r8, #1 sets Z if carry==1)
-            // Taken when ARM Z clear, not-taken when ARM Z set
-            block_ended = true;
-            emit.cycles += 2;  // Add cycles BEFORE emitting epilogues
-
-            uint8_t* bne_patch = emit.ptr;
-            emit.Emit(0); // placeholder for BNE taken
-
-            // Not-taken path: epilogue with current PC
-            emit.Emit_Epilogue(pc);
-
-            // B done (skip taken epilogue)
-            uint8_t* b_done_patch = emit.ptr;
-            emit.Emit(0);
-
-            // Taken path: epilogue with target PC
-            emit.Emit_Epilogue(target);
-
-            // Patch BNE to jump to taken epilogue (b_done_patch + 4)
-            // Offset = (b_done_patch + 4) - (bne_patch + 8) = (b_done_patch - bne_patch) - 4
-            int32_t bne_offset = (int32_t)(b_done_patch - bne_patch) - 4;
-            *(uint32_t*)bne_patch = ARM_COND(COND_NE) | ARM_B(bne_offset);
-
-            // Patch B done to skip over taken epilogue to done
-            int32_t b_done_offset = (int32_t)(emit.ptr - b_done_patch) - 8;
-            *(uint32_t*)b_done_patch = ARM_COND(COND_AL) | ARM_B(b_done_offset);
-        }
+        EmitBranch(emit, COND_NE, pc, block_ended);
         return true;
-    }
 
     // BMI (0x30)
-    case 0x30: {
-        int8_t offset = (int8_t)FetchByteAt(pc++);
-        uint16_t target = pc + offset;
-
-        // TST r7, #0x80 — sets ARM Z if bit 7 clear (6502 N clear)
-        emit.Emit_TST_IMM(REG_NZ, 0x80);
-
-        int32_t arm_target = emit.GetARMOffset(target);
-        if (arm_target >= 0 && offset < 0) {
-            int32_t branch_offset = arm_target - (int32_t)emit.CurrentOffset() - 8;
-            emit.Emit_B(branch_offset, COND_NE);  // branch if N set
-            emit.cycles += 3;
-        } else {
-            // BMI: branch if N set (TST r7, #0x80 sets Z if bit 7 clear)
-            // Taken when ARM Z clear (N set), not-taken when ARM Z set (N clear)
-            block_ended = true;
-            emit.cycles += 2;  // Add cycles BEFORE emitting epilogues
-
-            uint8_t* bne_patch = emit.ptr;
-            emit.Emit(0); // placeholder for BNE taken
-
-            // Not-taken path: epilogue with current PC
-            emit.Emit_Epilogue(pc);
-
-            // B done (skip taken epilogue)
-            uint8_t* b_done_patch = emit.ptr;
-            emit.Emit(0);
-
-            // Taken path: epilogue with target PC
-            emit.Emit_Epilogue(target);
-
-            // Patch BNE to jump to taken epilogue (b_done_patch + 4)
-            // Offset = (b_done_patch + 4) - (bne_patch + 8) = (b_done_patch - bne_patch) - 4
-            int32_t bne_offset = (int32_t)(b_done_patch - bne_patch) - 4;
-            *(uint32_t*)bne_patch = ARM_COND(COND_NE) | ARM_B(bne_offset);
-
-            // Patch B done to skip over taken epilogue to done
-            int32_t b_done_offset = (int32_t)(emit.ptr - b_done_patch) - 8;
-            *(uint32_t*)b_done_patch = ARM_COND(COND_AL) | ARM_B(b_done_offset);
-        }
+    case 0x30:
+        // TST r7, #0x180 — sets ARM Z if 6502 N clear (see lazy_flags.h)
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_TST, 0, REG_NZ, 0x06, 13, true));
+        EmitBranch(emit, COND_NE, pc, block_ended);
         return true;
-    }
 
     // BPL (0x10)
-    case 0x10: {
-        int8_t offset = (int8_t)FetchByteAt(pc++);
-        uint16_t target = pc + offset;
-
-        emit.Emit_TST_IMM(REG_NZ, 0x80);
-
-        int32_t arm_target = emit.GetARMOffset(target);
-        if (arm_target >= 0 && offset < 0) {
-            int32_t branch_offset = arm_target - (int32_t)emit.CurrentOffset() - 8;
-            emit.Emit_B(branch_offset, COND_EQ);  // branch if N clear
-            emit.cycles += 3;
-        } else {
-            // BPL: branch if N clear (TST r7, #0x80 sets Z if bit 7 clear)
-            // Taken when ARM Z set (N clear), not-taken when ARM Z clear (N set)
-            block_ended = true;
-            emit.cycles += 2;  // Add cycles BEFORE emitting epilogues
-
-            uint8_t* beq_patch = emit.ptr;
-            emit.Emit(0); // placeholder for BEQ taken
-
-            // Taken path: epilogue with target PC
-            emit.Emit_Epilogue(target);
-
-            // B done (skip not-taken epilogue)
-            uint8_t* b_done_patch = emit.ptr;
-            emit.Emit(0);
-
-            // Not-taken path: epilogue with current PC
-            emit.Emit_Epilogue(pc);
-
-            // Patch BEQ to jump to taken epilogue (beq_patch + 4 = start of taken epilogue)
-            // Offset = (beq_patch + 4) - (beq_patch + 8) = -4
-            int32_t beq_offset = -4;
-            *(uint32_t*)beq_patch = ARM_COND(COND_EQ) | ARM_B(beq_offset);
-
-            // Patch B done to skip over not-taken epilogue to done
-            int32_t b_done_offset = (int32_t)(emit.ptr - b_done_patch) - 8;
-            *(uint32_t*)b_done_patch = ARM_COND(COND_AL) | ARM_B(b_done_offset);
-        }
+    case 0x10:
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_TST, 0, REG_NZ, 0x06, 13, true));
+        EmitBranch(emit, COND_EQ, pc, block_ended);
         return true;
-    }
 
     // ===== CONTROL =====
 
@@ -1099,8 +1896,9 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     case 0x4C: {
         uint16_t target = FetchWordAt(pc);
         pc += 2;  // Consume the operand bytes
-        block_ended = true;
         emit.cycles += 3;
+        if (emit.trace_taken) return true;  // The trace goes on at the target
+        block_ended = true;
         // Emit epilogue with the jump target as exit PC
         emit.Emit_Epilogue(target);
         return true;
@@ -1113,13 +1911,13 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
 
     // CLC (0x18)
     case 0x18:
-        emit.Emit_MOV_IMM(REG_CARRY, 0);
+        if (!emit.c_dead) emit.Emit_MOV_IMM(REG_CARRY, 0);
         emit.cycles += 2;
         return true;
 
     // SEC (0x38)
     case 0x38:
-        emit.Emit_MOV_IMM(REG_CARRY, 1);
+        if (!emit.c_dead) emit.Emit_MOV_IMM(REG_CARRY, 1);
         emit.cycles += 2;
         return true;
 
@@ -1127,8 +1925,8 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
 
     // PHA (0x48) - Push A to stack
     case 0x48: {
-        // Load SP from DynarecState
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        // Load SP from CpuState
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
         // Stack address = 0x100 + SP: ADD r1, r0, #1 ROR 24 (= #0x100)
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_ADD, REG_SCRATCH1, REG_SCRATCH0, 1, 12, false));
         // STRB A, [RAM, r1]
@@ -1139,20 +1937,20 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         emit.Emit_SUB_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
         emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0xFF);
         // Store SP back
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
         emit.cycles += 3;
         return true;
     }
 
     // PLA (0x68) - Pull A from stack
     case 0x68: {
-        // Load SP from DynarecState
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        // Load SP from CpuState
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
         // SP++ with 8-bit wrap
         emit.Emit_ADD_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
         emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0xFF);
         // Store SP back
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
         // Stack address = 0x100 + SP
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_ADD, REG_SCRATCH1, REG_SCRATCH0, 1, 12, false));
         // LDRB A, [RAM, r1]
@@ -1166,22 +1964,24 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
 
     // PHP (0x08) - Push status to stack
     case 0x08: {
-        // Repack lazy NZ + carry into status byte in r2
-        emit.Emit_LDRB_IMM(REG_SCRATCH2, REG_STATE, DS_STATUS);
-        emit.Emit_AND_IMM(REG_SCRATCH2, REG_SCRATCH2, 0x7C);  // keep V,B,D,I
+        // Build the P byte in r2 from status (D/I/B), carry, v and lazy NZ
+        emit.Emit_LDRB_IMM(REG_SCRATCH2, REG_STATE, CS_STATUS);
         // Set C from carry register
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ORR, REG_SCRATCH2, REG_SCRATCH2, REG_CARRY, false));
-        // Set Z if NZ==0
+        // ORR r2, r2, v, LSL #6
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_V);
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ORR, REG_SCRATCH2, REG_SCRATCH2, REG_SCRATCH0, false) | (6 << 7));
+        // Set Z if NZ low byte is 0
         emit.Emit_TST_IMM(REG_NZ, 0xFF);
         emit.Emit(ARM_COND(COND_EQ) | ARM_DP_IMM(DP_ORR, REG_SCRATCH2, REG_SCRATCH2, 0x02, 0, false));
-        // Set N if NZ bit 7 set
-        emit.Emit_TST_IMM(REG_NZ, 0x80);
+        // Set N if NZ & 0x180
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_TST, 0, REG_NZ, 0x06, 13, true));
         emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_ORR, REG_SCRATCH2, REG_SCRATCH2, 0x80, 0, false));
         // PHP always sets B flag (bit 4) and unused bit 5
         emit.Emit_ORR_IMM(REG_SCRATCH2, REG_SCRATCH2, 0x30);
 
         // Load SP, push status byte
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_ADD, REG_SCRATCH1, REG_SCRATCH0, 1, 12, false));
         // STRB r2, [RAM, r1]
         emit.Emit(ARM_COND(COND_AL) | (0x1 << 26) | (1 << 25) | (1 << 24) | (1 << 23) |
@@ -1190,7 +1990,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         // SP--
         emit.Emit_SUB_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
         emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0xFF);
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
         emit.cycles += 3;
         return true;
     }
@@ -1198,33 +1998,43 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     // PLP (0x28) - Pull status from stack
     case 0x28: {
         // Load SP, increment, pull byte
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
         emit.Emit_ADD_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
         emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0xFF);
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_ADD, REG_SCRATCH1, REG_SCRATCH0, 1, 12, false));
         // LDRB r2, [RAM, r1]
         emit.Emit(ARM_COND(COND_AL) | (0x1 << 26) | (1 << 25) | (1 << 24) | (1 << 23) |
                   (1 << 22) | (0 << 21) | (1 << 20) |
                   (REG_RAM << 16) | (REG_SCRATCH2 << 12) | REG_SCRATCH1);
 
-        // Store full status to DynarecState (preserves I/D/V bits)
-        emit.Emit_STRB_IMM(REG_SCRATCH2, REG_STATE, DS_STATUS);
-        // Unpack carry: r8 = status & 1
+        // Split the P byte into the lazy form (see lazy_flags.h)
+        // status = (P & 0x3C) | 0x20
+        emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH2, 0x3C);
+        emit.Emit_ORR_IMM(REG_SCRATCH0, REG_SCRATCH0, 0x20);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
+        // carry = P & 1
         emit.Emit_AND_IMM(REG_CARRY, REG_SCRATCH2, 0x01);
-        // Unpack lazy NZ: default r7=0x01, if N: r7=0x80, if Z: r7=0x00
+        // v = (P >> 6) & 1
+        emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
+                  (REG_SCRATCH0 << 12) | (6 << 7) | (1 << 5) | REG_SCRATCH2);
+        emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0x01);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_V);
+        // nz: default 0x01, N → 0x80, Z → 0x00, N+Z → 0x100
         emit.Emit_MOV_IMM(REG_NZ, 0x01);
         emit.Emit_TST_IMM(REG_SCRATCH2, 0x80);
         emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_NZ, 0, 0x80, 0, false));
         emit.Emit_TST_IMM(REG_SCRATCH2, 0x02);
-        emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_NZ, 0, 0x00, 0, false));
+        emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_AND, REG_NZ, REG_NZ, 0x80, 0, false));
+        // MOVNE r7, r7, LSL #1
+        emit.Emit(ARM_COND(COND_NE) | ARM_DP(DP_MOV, REG_NZ, 0, REG_NZ, false) | (1 << 7));
         emit.cycles += 4;
         return true;
     }
 
     // ===== SUBROUTINE OPERATIONS =====
 
-    // JSR abs (0x20) - block-ending
+    // JSR abs (0x20) - block-ending, unless the block goes on into the callee
     case 0x20: {
         uint16_t target = FetchWordAt(pc);
         pc += 2;
@@ -1234,8 +2044,8 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         uint8_t push_hi = (push_addr >> 8) & 0xFF;
         uint8_t push_lo = push_addr & 0xFF;
 
-        // Load SP from DynarecState
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        // Load SP from CpuState
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
 
         // Push high byte first: RAM[0x100 + SP] = push_hi
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_ADD, REG_SCRATCH1, REG_SCRATCH0, 1, 12, false));
@@ -1258,18 +2068,28 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0xFF);
 
         // Store SP back
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
 
-        block_ended = true;
         emit.cycles += 6;
+        if (emit.trace_taken) return true;
+        block_ended = true;
         emit.Emit_Epilogue(target);
         return true;
     }
 
     // RTS (0x60) - block-ending, dynamic exit PC
     case 0x60: {
-        // Load SP from DynarecState
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        // Load SP from CpuState
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
+
+        if (emit.trace_taken) {
+            // Inlined leaf: the stack holds the JSR's return address, and
+            // the block goes on there
+            emit.Emit_ADD_IMM(REG_SCRATCH0, REG_SCRATCH0, 2);
+            emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
+            emit.cycles += 6;
+            return true;
+        }
 
         // SP++ (for low byte)
         emit.Emit_ADD_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
@@ -1283,8 +2103,8 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         // SP++ (for high byte)
         emit.Emit_ADD_IMM(REG_SCRATCH0, REG_SCRATCH0, 1);
         emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0xFF);
-        // Store SP back to DynarecState
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_SP);
+        // Store SP back to CpuState
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_SP);
 
         // r2 = RAM[0x100 + SP] (high byte of return addr)
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_ADD, REG_SCRATCH2, REG_SCRATCH0, 1, 12, false));
@@ -1302,6 +2122,25 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
 
         block_ended = true;
         emit.cycles += 6;
+
+        // Pop the ReturnStack: r2 = newest entry
+        emit.Emit_LDR_IMM(REG_SCRATCH0, REG_STATE, CS_RETURN_STACK);
+        emit.Emit_LDR_IMM(REG_SCRATCH3, REG_SCRATCH0, RS_TOP);
+        // ADD r2, r0, r3, LSL #3
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH2, REG_SCRATCH0, REG_SCRATCH3) | (3 << 7));
+        emit.Emit_SUB_IMM(REG_SCRATCH3, REG_SCRATCH3, 1);
+        emit.Emit_AND_IMM(REG_SCRATCH3, REG_SCRATCH3, RETURN_STACK_SIZE - 1);
+        emit.Emit_STR_IMM(REG_SCRATCH3, REG_SCRATCH0, RS_TOP);
+        // Predicted: charge the block and go to the caller's return exit
+        emit.Emit_LDR_IMM(REG_SCRATCH3, REG_SCRATCH2, RS_PC);
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_CMP, 0, REG_SCRATCH3, REG_SCRATCH1, true));
+        uint8_t* miss_patch = emit.ptr;
+        emit.Emit(0);  // placeholder BNE miss
+        emit.Emit_ChargeCycles();
+        emit.Emit(ARM_COND(COND_AL) | ARM_LDR_IMM(15, REG_SCRATCH2, RS_CODE));
+        *(uint32_t*)miss_patch = ARM_COND(COND_NE) | ARM_B((int32_t)(emit.ptr - miss_patch) - 8);
+
+        // Anything else (the stack was rewritten, or the JSR ran elsewhere):
         // r1 has the return PC — use dynamic epilogue
         emit.Emit_Epilogue_DynamicPC(REG_SCRATCH1);
         return true;
@@ -1369,9 +2208,11 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     // ASL A (0x0A)
     case 0x0A: {
         // Carry = old bit 7: TST A, #0x80; set carry accordingly
-        emit.Emit_TST_IMM(REG_A, 0x80);
-        emit.Emit_MOV_IMM(REG_CARRY, 0);
-        emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        if (!emit.c_dead) {
+            emit.Emit_TST_IMM(REG_A, 0x80);
+            emit.Emit_MOV_IMM(REG_CARRY, 0);
+            emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        }
         // A = (A << 1) & 0xFF: ADD A, A, A; AND A, A, #0xFF
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_A, REG_A, REG_A, false));
         emit.Emit_AND_IMM(REG_A, REG_A, 0xFF);
@@ -1383,7 +2224,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     // LSR A (0x4A)
     case 0x4A: {
         // Carry = old bit 0
-        emit.Emit_AND_IMM(REG_CARRY, REG_A, 0x01);
+        if (!emit.c_dead) emit.Emit_AND_IMM(REG_CARRY, REG_A, 0x01);
         // A = A >> 1: MOV A, A, LSR #1
         emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
                   (REG_A << 12) | (1 << 7) | (1 << 5) | REG_A);
@@ -1398,9 +2239,11 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_A, REG_A, false));
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ORR, REG_SCRATCH0, REG_SCRATCH0, REG_CARRY, false));
         // New carry = old bit 7 (now in bit 8 of temp)
-        emit.Emit_TST_IMM(REG_A, 0x80);
-        emit.Emit_MOV_IMM(REG_CARRY, 0);
-        emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        if (!emit.c_dead) {
+            emit.Emit_TST_IMM(REG_A, 0x80);
+            emit.Emit_MOV_IMM(REG_CARRY, 0);
+            emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        }
         // A = temp & 0xFF
         emit.Emit_AND_IMM(REG_A, REG_SCRATCH0, 0xFF);
         emit.Emit_UpdateNZ(REG_A);
@@ -1411,7 +2254,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     // ROR A (0x6A)
     case 0x6A: {
         // Save old bit 0 for new carry
-        emit.Emit_AND_IMM(REG_SCRATCH0, REG_A, 0x01);
+        if (!emit.c_dead) emit.Emit_AND_IMM(REG_SCRATCH0, REG_A, 0x01);
         // A = (A >> 1) | (carry << 7)
         // MOV A, A, LSR #1
         emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
@@ -1420,7 +2263,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_ORR << 21) |
                   (REG_A << 16) | (REG_A << 12) | (7 << 7) | REG_CARRY);
         // Carry = old bit 0
-        emit.Emit_MOV(REG_CARRY, REG_SCRATCH0);
+        if (!emit.c_dead) emit.Emit_MOV(REG_CARRY, REG_SCRATCH0);
         emit.Emit_UpdateNZ(REG_A);
         emit.cycles += 2;
         return true;
@@ -1433,9 +2276,11 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         uint8_t zp = FetchByteAt(pc++);
         emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_RAM, zp);
         // Carry = bit 7
-        emit.Emit_TST_IMM(REG_SCRATCH0, 0x80);
-        emit.Emit_MOV_IMM(REG_CARRY, 0);
-        emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        if (!emit.c_dead) {
+            emit.Emit_TST_IMM(REG_SCRATCH0, 0x80);
+            emit.Emit_MOV_IMM(REG_CARRY, 0);
+            emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        }
         // Shift left
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_SCRATCH0, false));
         emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0xFF);
@@ -1449,7 +2294,7 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     case 0x46: {
         uint8_t zp = FetchByteAt(pc++);
         emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_RAM, zp);
-        emit.Emit_AND_IMM(REG_CARRY, REG_SCRATCH0, 0x01);
+        if (!emit.c_dead) emit.Emit_AND_IMM(REG_CARRY, REG_SCRATCH0, 0x01);
         emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
                   (REG_SCRATCH0 << 12) | (1 << 7) | (1 << 5) | REG_SCRATCH0);
         emit.Emit_STRB_IMM(REG_SCRATCH0, REG_RAM, zp);
@@ -1463,13 +2308,15 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         uint8_t zp = FetchByteAt(pc++);
         emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_RAM, zp);
         // temp = (val << 1) | carry
-        emit.Emit_MOV(REG_SCRATCH1, REG_SCRATCH0); // save for carry check
+        if (!emit.c_dead) emit.Emit_MOV(REG_SCRATCH1, REG_SCRATCH0); // save for carry check
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_SCRATCH0, false));
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ORR, REG_SCRATCH0, REG_SCRATCH0, REG_CARRY, false));
         // New carry = old bit 7
-        emit.Emit_TST_IMM(REG_SCRATCH1, 0x80);
-        emit.Emit_MOV_IMM(REG_CARRY, 0);
-        emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        if (!emit.c_dead) {
+            emit.Emit_TST_IMM(REG_SCRATCH1, 0x80);
+            emit.Emit_MOV_IMM(REG_CARRY, 0);
+            emit.Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_CARRY, 0, 1, 0, false));
+        }
         emit.Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0xFF);
         emit.Emit_STRB_IMM(REG_SCRATCH0, REG_RAM, zp);
         emit.Emit_UpdateNZ(REG_SCRATCH0);
@@ -1482,13 +2329,13 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         uint8_t zp = FetchByteAt(pc++);
         emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_RAM, zp);
         // Save old bit 0
-        emit.Emit_AND_IMM(REG_SCRATCH1, REG_SCRATCH0, 0x01);
+        if (!emit.c_dead) emit.Emit_AND_IMM(REG_SCRATCH1, REG_SCRATCH0, 0x01);
         // val = (val >> 1) | (carry << 7)
         emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_MOV << 21) |
                   (REG_SCRATCH0 << 12) | (1 << 7) | (1 << 5) | REG_SCRATCH0);
         emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_ORR << 21) |
                   (REG_SCRATCH0 << 16) | (REG_SCRATCH0 << 12) | (7 << 7) | REG_CARRY);
-        emit.Emit_MOV(REG_CARRY, REG_SCRATCH1);
+        if (!emit.c_dead) emit.Emit_MOV(REG_CARRY, REG_SCRATCH1);
         emit.Emit_STRB_IMM(REG_SCRATCH0, REG_RAM, zp);
         emit.Emit_UpdateNZ(REG_SCRATCH0);
         emit.cycles += 5;
@@ -1552,6 +2399,10 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
             emit.LoadImm16(REG_SCRATCH0, base & 0x3FFF);
             emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_X, false));
             emit.Emit_LDRB_REG(REG_A, REG_ROM_HI, REG_SCRATCH0);
+        } else if (base >= 0x2000 && (base + 0xFF) < 0x8000) {
+            emit.LoadImm16(REG_SCRATCH0, base);
+            emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_X, false));
+            EmitIoRead(emit, REG_A);
         } else {
             pc -= 3; return false;
         }
@@ -1575,6 +2426,10 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
             emit.LoadImm16(REG_SCRATCH0, base & 0x3FFF);
             emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_Y, false));
             emit.Emit_LDRB_REG(REG_A, REG_ROM_HI, REG_SCRATCH0);
+        } else if (base >= 0x2000 && (base + 0xFF) < 0x8000) {
+            emit.LoadImm16(REG_SCRATCH0, base);
+            emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_Y, false));
+            EmitIoRead(emit, REG_A);
         } else {
             pc -= 3; return false;
         }
@@ -1594,8 +2449,9 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         emit.Emit(ARM_COND(COND_AL) | ((uint32_t)DP_ORR << 21) |
                   (REG_SCRATCH0 << 16) | (REG_SCRATCH0 << 12) |
                   (8 << 7) | REG_SCRATCH1);
-        // ADD r0, r0, Y
+        // ADD r0, r0, Y; r3 keeps it for the page-cross check
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_Y, false));
+        emit.Emit_MOV(REG_SCRATCH3, REG_SCRATCH0);
         // Runtime dispatch: CMP r0, #0x2000 (imm8=2, rot=10)
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_CMP, 0, REG_SCRATCH0, 0x02, 10, true));
         uint8_t* bcs_rom = emit.ptr;
@@ -1608,8 +2464,8 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         uint8_t* rom_label = emit.ptr;
         // CMP r0, #0x8000 (imm8=0x80, rot=12)
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_CMP, 0, REG_SCRATCH0, 0x80, 12, true));
-        uint8_t* bcc_bail = emit.ptr;
-        emit.Emit(0); // placeholder BCC bail (I/O range)
+        uint8_t* bcc_io = emit.ptr;
+        emit.Emit(0); // placeholder BCC io (I/O range)
         // BIC r1, r0, #0xC000 (imm8=0xC0, rot=12) → offset = addr & 0x3FFF
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_BIC, REG_SCRATCH1, REG_SCRATCH0, 0xC0, 12, false));
         // TST r0, #0x4000 (imm8=0x01, rot=9) — which bank?
@@ -1623,22 +2479,22 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
                   (REG_ROM_HI << 16) | (REG_A << 12) | REG_SCRATCH1);
         uint8_t* b_done2 = emit.ptr;
         emit.Emit(0); // placeholder B done
-        // Bail: exit to interpreter at this instruction
-        uint8_t* bail_label = emit.ptr;
-        emit.Emit_Epilogue(pc - 2);
+        // I/O path
+        uint8_t* io_label = emit.ptr;
+        EmitIoRead(emit, REG_A);
         // Done label
         uint8_t* done_label = emit.ptr;
         // Patch branches
         *(uint32_t*)bcs_rom = ARM_COND(COND_CS) | ARM_B((int32_t)(rom_label - bcs_rom) - 8);
         *(uint32_t*)b_done = ARM_COND(COND_AL) | ARM_B((int32_t)(done_label - b_done) - 8);
-        *(uint32_t*)bcc_bail = ARM_COND(COND_CC) | ARM_B((int32_t)(bail_label - bcc_bail) - 8);
+        *(uint32_t*)bcc_io = ARM_COND(COND_CC) | ARM_B((int32_t)(io_label - bcc_io) - 8);
         *(uint32_t*)b_done2 = ARM_COND(COND_AL) | ARM_B((int32_t)(done_label - b_done2) - 8);
         emit.Emit_UpdateNZ(REG_A);
         emit.cycles += 5;
         return true;
     }
 
-    // STA (zp),Y (0x91) - RAM only, bail for I/O/ROM
+    // STA (zp),Y (0x91) - RAM or I/O, bail for ROM
     case 0x91: {
         uint8_t zp = FetchByteAt(pc++);
         uint8_t zp1 = (zp + 1) & 0xFF;
@@ -1648,20 +2504,35 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
                   (REG_SCRATCH0 << 16) | (REG_SCRATCH0 << 12) |
                   (8 << 7) | REG_SCRATCH1);
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_Y, false));
+        emit.Emit_MOV(REG_SCRATCH3, REG_SCRATCH0);  // For the page-cross check
         // CMP r0, #0x2000
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_CMP, 0, REG_SCRATCH0, 0x02, 10, true));
-        uint8_t* bcs_bail = emit.ptr;
-        emit.Emit(0); // placeholder BCS bail
+        uint8_t* bcs_io = emit.ptr;
+        emit.Emit(0); // placeholder BCS io
         // RAM store
         emit.Emit_STRB_REG(REG_A, REG_RAM, REG_SCRATCH0);
         uint8_t* b_done = emit.ptr;
         emit.Emit(0); // placeholder B done
-        // Bail
+        // I/O path: CMP r0, #0x8000; ROM bails
+        uint8_t* io_label = emit.ptr;
+        emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_CMP, 0, REG_SCRATCH0, 0x80, 12, true));
+        uint8_t* bcs_bail = emit.ptr;
+        emit.Emit(0); // placeholder BCS bail
+        EmitIoWrite(emit, REG_A);
+        // Address 0 for the code-write check after: zero page holds no code
+        emit.Emit_MOV_IMM(REG_SCRATCH0, 0);
+        uint8_t* b_done2 = emit.ptr;
+        emit.Emit(0); // placeholder B done
+        // Bail to the interpreter, unlinked: chained, an exit back to the
+        // block's own start would spin without running the store
         uint8_t* bail_label = emit.ptr;
-        emit.Emit_Epilogue(pc - 2);
+        emit.LoadImm16(REG_SCRATCH1, pc - 2);
+        emit.Emit_Epilogue_DynamicPC(REG_SCRATCH1);
         uint8_t* done_label = emit.ptr;
-        *(uint32_t*)bcs_bail = ARM_COND(COND_CS) | ARM_B((int32_t)(bail_label - bcs_bail) - 8);
+        *(uint32_t*)bcs_io = ARM_COND(COND_CS) | ARM_B((int32_t)(io_label - bcs_io) - 8);
         *(uint32_t*)b_done = ARM_COND(COND_AL) | ARM_B((int32_t)(done_label - b_done) - 8);
+        *(uint32_t*)bcs_bail = ARM_COND(COND_CS) | ARM_B((int32_t)(bail_label - bcs_bail) - 8);
+        *(uint32_t*)b_done2 = ARM_COND(COND_AL) | ARM_B((int32_t)(done_label - b_done2) - 8);
         emit.cycles += 6;
         return true;
     }
@@ -1686,24 +2557,28 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
         return true;
     }
 
-    // STA abs,X (0x9D) - RAM only
+    // STA abs,X (0x9D) - RAM, or an index range wholly in I/O
     case 0x9D: {
         uint16_t base = FetchWordAt(pc); pc += 2;
-        if (base >= 0x2000 || (base + 0xFF) >= 0x2000) { pc -= 3; return false; }
+        const bool io = base >= 0x2000 && (base + 0xFF) < 0x8000;
+        if (!io && (base + 0xFF) >= 0x2000) { pc -= 3; return false; }
         emit.LoadImm16(REG_SCRATCH0, base);
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_X, false));
-        emit.Emit_STRB_REG(REG_A, REG_RAM, REG_SCRATCH0);
+        if (io) EmitIoWrite(emit, REG_A);
+        else emit.Emit_STRB_REG(REG_A, REG_RAM, REG_SCRATCH0);
         emit.cycles += 5;
         return true;
     }
 
-    // STA abs,Y (0x99) - RAM only
+    // STA abs,Y (0x99) - RAM, or an index range wholly in I/O
     case 0x99: {
         uint16_t base = FetchWordAt(pc); pc += 2;
-        if (base >= 0x2000 || (base + 0xFF) >= 0x2000) { pc -= 3; return false; }
+        const bool io = base >= 0x2000 && (base + 0xFF) < 0x8000;
+        if (!io && (base + 0xFF) >= 0x2000) { pc -= 3; return false; }
         emit.LoadImm16(REG_SCRATCH0, base);
         emit.Emit(ARM_COND(COND_AL) | ARM_DP(DP_ADD, REG_SCRATCH0, REG_SCRATCH0, REG_Y, false));
-        emit.Emit_STRB_REG(REG_A, REG_RAM, REG_SCRATCH0);
+        if (io) EmitIoWrite(emit, REG_A);
+        else emit.Emit_STRB_REG(REG_A, REG_RAM, REG_SCRATCH0);
         emit.cycles += 5;
         return true;
     }
@@ -1768,46 +2643,47 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
 
     // CLD (0xD8)
     case 0xD8: {
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
         // BIC r0, r0, #0x08 (clear D flag)
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_BIC, REG_SCRATCH0, REG_SCRATCH0, 0x08, 0, false));
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
         emit.cycles += 2;
         return true;
     }
 
     // SED (0xF8)
     case 0xF8: {
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
         emit.Emit_ORR_IMM(REG_SCRATCH0, REG_SCRATCH0, 0x08);
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
         emit.cycles += 2;
         return true;
     }
 
     // CLI (0x58)
     case 0x58: {
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
         emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_BIC, REG_SCRATCH0, REG_SCRATCH0, 0x04, 0, false));
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
         emit.cycles += 2;
         return true;
     }
 
     // SEI (0x78)
     case 0x78: {
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
         emit.Emit_ORR_IMM(REG_SCRATCH0, REG_SCRATCH0, 0x04);
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_STATUS);
         emit.cycles += 2;
         return true;
     }
 
     // CLV (0xB8)
     case 0xB8: {
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
-        emit.Emit(ARM_COND(COND_AL) | ARM_DP_IMM(DP_BIC, REG_SCRATCH0, REG_SCRATCH0, 0x40, 0, false));
-        emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+        if (!emit.v_dead) {
+            emit.Emit_MOV_IMM(REG_SCRATCH0, 0);
+            emit.Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, CS_V);
+        }
         emit.cycles += 2;
         return true;
     }
@@ -1816,14 +2692,14 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
 
     // TXS (0x9A) - no flags affected
     case 0x9A: {
-        emit.Emit_STRB_IMM(REG_X, REG_STATE, DS_SP);
+        emit.Emit_STRB_IMM(REG_X, REG_STATE, CS_SP);
         emit.cycles += 2;
         return true;
     }
 
     // TSX (0xBA)
     case 0xBA: {
-        emit.Emit_LDRB_IMM(REG_X, REG_STATE, DS_SP);
+        emit.Emit_LDRB_IMM(REG_X, REG_STATE, CS_SP);
         emit.Emit_UpdateNZ(REG_X);
         emit.cycles += 2;
         return true;
@@ -1833,59 +2709,18 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
 
     // BVC (0x50)
     case 0x50: {
-        int8_t offset = (int8_t)FetchByteAt(pc++);
-        uint16_t target = pc + offset;
-        // Load status, test V bit (0x40)
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
-        emit.Emit_TST_IMM(REG_SCRATCH0, 0x40);
-        // BVC: branch if V clear → taken when ARM Z set (TST result zero)
-        int32_t arm_target = emit.GetARMOffset(target);
-        if (arm_target >= 0 && offset < 0) {
-            int32_t branch_offset = arm_target - (int32_t)emit.CurrentOffset() - 8;
-            emit.Emit_B(branch_offset, COND_EQ);
-            emit.cycles += 3;
-        } else {
-            block_ended = true;
-            emit.cycles += 2;
-            // EQ = taken (V clear), NE = not taken (V set)
-            uint8_t* beq_patch = emit.ptr;
-            emit.Emit(0); // placeholder BEQ taken
-            // Not-taken epilogue
-            emit.Emit_Epilogue(pc);
-            // Taken epilogue
-            uint8_t* taken_label = emit.ptr;
-            emit.Emit_Epilogue(target);
-            // Patch BEQ to taken
-            *(uint32_t*)beq_patch = ARM_COND(COND_EQ) | ARM_B((int32_t)(taken_label - beq_patch) - 8);
-        }
+        // Load and test V (0 or 1); V clear → ARM Z set
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_V);
+        emit.Emit_TST_IMM(REG_SCRATCH0, 0x01);
+        EmitBranch(emit, COND_EQ, pc, block_ended);
         return true;
     }
 
     // BVS (0x70)
     case 0x70: {
-        int8_t offset = (int8_t)FetchByteAt(pc++);
-        uint16_t target = pc + offset;
-        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
-        emit.Emit_TST_IMM(REG_SCRATCH0, 0x40);
-        // BVS: branch if V set → taken when ARM Z clear (NE)
-        int32_t arm_target = emit.GetARMOffset(target);
-        if (arm_target >= 0 && offset < 0) {
-            int32_t branch_offset = arm_target - (int32_t)emit.CurrentOffset() - 8;
-            emit.Emit_B(branch_offset, COND_NE);
-            emit.cycles += 3;
-        } else {
-            block_ended = true;
-            emit.cycles += 2;
-            // NE = taken (V set), EQ = not taken (V clear)
-            uint8_t* bne_patch = emit.ptr;
-            emit.Emit(0); // placeholder BNE taken
-            // Not-taken epilogue
-            emit.Emit_Epilogue(pc);
-            // Taken epilogue
-            uint8_t* taken_label = emit.ptr;
-            emit.Emit_Epilogue(target);
-            *(uint32_t*)bne_patch = ARM_COND(COND_NE) | ARM_B((int32_t)(taken_label - bne_patch) - 8);
-        }
+        emit.Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, CS_V);
+        emit.Emit_TST_IMM(REG_SCRATCH0, 0x01);
+        EmitBranch(emit, COND_NE, pc, block_ended);
         return true;
     }
 
@@ -1894,18 +2729,19 @@ static bool CompileInstruction(Emitter& emit, uint8_t opcode, uint16_t& pc, bool
     }
 }
 
-void* GetBlock(uint16_t pc) {
+void* GetBlock(uint16_t pc, uint8_t* tier) {
     Block* b = FindBlock(pc);
     if (b) {
-        // Validate code pointer is within buffer
-        uint8_t* code = (uint8_t*)b->code;
-        if (code < dynarec_code_buffer ||
-            code >= dynarec_code_buffer + CODE_BUFFER_SIZE) {
-            DebugLog("DR: ERROR: block %04X has bad code ptr %p\n", pc, code);
-            return nullptr;
+        if (++b->exec_count == PROMOTE_THRESHOLD && !InHotTier(b->code)) {
+            if (b->tier == TIER_BASELINE) {
+                b = OptimizeBlock(b);
+                if (!b) return nullptr;
+            } else {
+                PromoteBlock(b);
+            }
         }
-        b->exec_count++;
         stats.blocks_executed++;
+        if (tier) *tier = b->tier;
         DebugLog("DR: GetBlock(%04X) -> %p\n", pc, b->code);
         return b->code;
     }
@@ -1913,22 +2749,36 @@ void* GetBlock(uint16_t pc) {
 }
 
 void InvalidateAll() {
-    std::memset(block_table, 0, sizeof(block_table));
+    ResetBlockMaps();
     block_pool_used = 0;
-    code_ptr = dynarec_code_buffer;
+    free_block_count = 0;
+    code_ptr = dynarec_cold_buffer;
+    hot_ptr = dynarec_code_buffer;
+    exit_table_used = 0;  // links go with the code they were patched into
     fail_cache_count = 0;
+    ForgetCodeAddresses();
+    ResetRamCode();
+    std::memset(rom_code_windows, 0, sizeof(rom_code_windows));
     stats.blocks_invalidated += stats.blocks_compiled;
     stats.blocks_compiled = 0;
     stats.compile_bytes_used = 0;
 }
 
-int RunBlock(void* code, DynarecState* state) {
-    // Validate code pointer is within our buffer
-    uint8_t* code_bytes = (uint8_t*)code;
-    if (code_bytes < dynarec_code_buffer ||
-        code_bytes >= dynarec_code_buffer + CODE_BUFFER_SIZE) {
-        DebugLog("DR: ERROR: code ptr %p outside buffer [%p, %p)\n",
-               code, dynarec_code_buffer, dynarec_code_buffer + CODE_BUFFER_SIZE);
+void SetCodeBank(uint32_t bank) {
+    // Return exits into $8000-$BFFF were linked, and cached targets
+    // looked up, in the old bank's map
+    if (bank != code_bank) ForgetCodeAddresses();
+    code_bank = bank;
+    if (!SelectBankMap(bank)) {
+        DebugLog("DR: no bank map slot for %02X, invalidating all blocks\n", bank);
+        InvalidateAll();
+    }
+}
+
+int RunBlock(void* code, CpuState* state) {
+    // Validate code pointer is within the code cache
+    if (!InCodeCache(code)) {
+        DebugLog("DR: ERROR: code ptr %p outside code cache\n", code);
         return 0;
     }
 
@@ -1939,21 +2789,27 @@ int RunBlock(void* code, DynarecState* state) {
         return 0;
     }
 
-    // Call compiled block: int block_func(DynarecState*)
+    // Call compiled block: int block_func(CpuState*)
     DebugLog("DR: calling block at %p (first insn %08X)\n", code, first_insn);
-    typedef int (*BlockFunc)(DynarecState*);
+    typedef int (*BlockFunc)(CpuState*);
     BlockFunc func = (BlockFunc)code;
+    const int32_t before = state->cycles_remaining;
     func(state);
-    DebugLog("DR: block returned, cycles_executed=%d\n", state->cycles_executed);
-    return state->cycles_executed;
+    DebugLog("DR: block returned, cycles_remaining=%d\n", state->cycles_remaining);
+    return before - state->cycles_remaining;
 }
 
 Stats GetStats() {
-    return stats;
+    Stats s = stats;
+    for (const IndirectSite& site : indirect_sites) s.indirect_hits += site.hits;
+    return s;
 }
 
 void ResetStats() {
     stats = {};
+    for (IndirectSite& site : indirect_sites) site.hits = 0;
 }
 
 } // namespace Dynarec
+
+#endif // !DYNAREC_X64
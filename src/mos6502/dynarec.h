@@ -1,59 +1,149 @@
 #pragma once
 #include <cstdint>
 #include <cstddef>
+#include "cpu_state.h"
 
 // NDS Dynarec for MOS 6502
 // Compiles 6502 code blocks to ARM9 code in ITCM
 
+// Backend. NDS builds use the ARM backend (dynarec.cpp). An x86-64 host
+// build uses dynarec_x64.cpp instead: the same interface and CpuState ABI,
+// compiling the same block IR to x86-64 in a W^X code cache. Build with
+// DYNAREC_X64=0 to keep the host on the interpreter.
+#ifndef DYNAREC_X64
+#if defined(__x86_64__) && !defined(NDS_BUILD)
+#define DYNAREC_X64 1
+#else
+#define DYNAREC_X64 0
+#endif
+#endif
+
 namespace Dynarec {
 
 // Configuration
-constexpr size_t CODE_BUFFER_SIZE = 4 * 1024;   // 4KB - placed in main RAM for now
+constexpr size_t CODE_BUFFER_SIZE = 4 * 1024;   // Hot tier, in ITCM
+constexpr size_t COLD_BUFFER_SIZE = 64 * 1024;  // Cold tier, in main RAM
+constexpr uint32_t COMPILE_THRESHOLD = 4;       // Dispatcher visits before a PC is compiled
+constexpr uint32_t PROMOTE_THRESHOLD = 8;       // Dispatcher entries before a block is optimized (and moves to ITCM)
 constexpr int MAX_BLOCK_SIZE = 64;              // Max instructions per block
-constexpr int MAX_BLOCK_CYCLES = 200;           // Max cycles per block
-
-// State passed between interpreter and compiled blocks
-// Lives in DTCM for fast access
-struct DynarecState {
-    uint8_t A;                  // 0: Accumulator
-    uint8_t X;                  // 1: X index
-    uint8_t Y;                  // 2: Y index
-    uint8_t SP;                 // 3: Stack pointer
-    uint8_t status;             // 4: Full 6502 status register
-    uint8_t _pad[1];            // 5: padding
-    uint16_t PC;                // 6: Program counter
-    int32_t cycles_remaining;   // 8: Cycles left to execute
-    int32_t cycles_executed;    // 12: Cycles consumed by block
-    uint8_t* ram;               // 16: RAM base pointer
-    const uint8_t* rom_lo;      // 20: ROM lo bank pointer
-    const uint8_t* rom_hi;      // 24: ROM hi bank pointer
-    uint8_t exit_reason;        // 28: 0=normal, 1=unsupported opcode, 2=I/O
-    uint8_t _pad2[3];           // 29-31: padding
+constexpr int MAX_BLOCK_CYCLES = 512;           // Max cycles per block (one pass)
+
+// PC -> block maps, one per 16KB ROM window. $C000-$FFFF is fixed and has
+// one map; $8000-$BFFF follows the Flash2M bank latch and has one map per
+// recently selected bank (BANK_MAP_SLOTS), so switching back to a bank finds
+// its blocks still compiled. By default a map is a 64-entry page directory
+// whose 256-entry leaves (1KB each) are handed out as pages get compiled
+// code, BLOCK_MAP_LEAVES of them in all. Building with
+// DYNAREC_FLAT_BLOCK_MAP=1 makes each map one 64KB array instead, one load
+// per lookup at the cost of main RAM.
+#ifndef DYNAREC_FLAT_BLOCK_MAP
+#define DYNAREC_FLAT_BLOCK_MAP 0
+#endif
+constexpr int BLOCK_MAP_LEAVES = 64;            // 64KB of leaves
+#if DYNAREC_FLAT_BLOCK_MAP
+constexpr int BANK_MAP_SLOTS = 2;               // 3 maps, 192KB
+#else
+constexpr int BANK_MAP_SLOTS = 8;
+#endif
+
+// Code cache. Blocks are compiled into the cold tier, a main-RAM buffer
+// that is collected as a whole when it fills. A block the dispatcher keeps
+// entering (each run resumes at the current PC, so entries sample where
+// time goes) is recompiled optimized and copied into the hot tier in
+// ITCM, a ring where the oldest promoted blocks make room for new ones.
+// Either way only the evicted blocks are lost, and links into them are
+// undone.
+
+// Tiers. A PC starts out in the interpreter (or the micro-op tier); once
+// RunDynarec has come to it COMPILE_THRESHOLD times it is compiled as a
+// baseline block, lowered with only the cheap IR passes; baseline blocks
+// also count which way their final branch goes. A block entered
+// PROMOTE_THRESHOLD times is recompiled with all of them, as a trace that
+// runs on through JSR, JMP and biased branches (DecodeBlock), and on the
+// ARM backend it is that copy that goes into ITCM. Code that runs once (init,
+// menus) never costs a compile or any code cache.
+enum BlockTier : uint8_t {
+    TIER_BASELINE,
+    TIER_OPTIMIZED,
 };
 
-// Offsets for assembly access (must match struct layout above)
-constexpr int DS_A              = 0;
-constexpr int DS_X              = 1;
-constexpr int DS_Y              = 2;
-constexpr int DS_SP             = 3;
-constexpr int DS_STATUS         = 4;
-constexpr int DS_PC             = 6;
-constexpr int DS_CYCLES_REM     = 8;
-constexpr int DS_CYCLES_EXEC    = 12;
-constexpr int DS_RAM            = 16;
-constexpr int DS_ROM_LO         = 20;
-constexpr int DS_ROM_HI         = 24;
-constexpr int DS_EXIT_REASON    = 28;
+// RAM code. Routines copied to $0200-$1FFF (self-modifying blit setup,
+// speed-critical loops) are compiled like ROM code; build with
+// DYNAREC_RAM_CODE=0 to leave them to the interpreter. Zero page and the
+// stack never hold compiled code, so stores there go unchecked. Any other
+// store looks up its page in ram_code_pages and, on a page with compiled
+// code, calls NoteCodeWrite, which drops only the blocks covering the byte
+// written (a compiled store that drops one leaves its block right after).
+// The interpreter's micro-op cache decodes RAM code too: its pages carry
+// RAM_PAGE_UOP in ram_code_pages, so compiled stores reach NoteCodeWrite
+// for them as well and it raises uop_page_written for mos6502::Run().
+// The asm loop makes the same check on its RAM stores. Writes nothing
+// checks (a RAM bank switch) call InvalidateRamCode instead. A RAM PC whose block is rewritten
+// RAM_REWRITE_LIMIT times (code patching itself as it loops) stays with
+// the interpreter until the next InvalidateAll.
+#ifndef DYNAREC_RAM_CODE
+#define DYNAREC_RAM_CODE 1
+#endif
+constexpr uint16_t RAM_CODE_START = 0x0200;
+constexpr uint16_t RAM_CODE_END = 0x2000;
+constexpr int RAM_CODE_PAGES = RAM_CODE_END >> 8;
+constexpr int RAM_BLOCK_SLOTS = 64;             // RAM blocks kept; the oldest makes room
+constexpr uint32_t RAM_REWRITE_LIMIT = 4;
+
+// Compiled blocks run directly on the CPU's CpuState (cpu_state.h): r12
+// holds the CpuState* and the CS_* offsets address its fields.
 
 // Compiled block metadata
 struct Block {
     uint16_t pc;           // 6502 start address
-    uint16_t end_pc;       // PC after last compiled instruction
+    uint16_t src_lo;       // 6502 source compiled: [src_lo, src_end), src_end 0 for
+    uint16_t src_end;      // code up to $FFFF (a trace may skip parts of it)
     void* code;            // ARM code pointer (in ITCM)
+    void* body;            // Past the prologue; where chained exits enter
+    uint32_t code_size;    // Bytes of ARM code
     uint32_t cycles;       // Total cycles for this block
     uint32_t exec_count;   // For hotness tracking
-    Block* next;           // Hash collision chain
+    uint32_t bank;         // Code bank it was compiled in (FIXED_BANK: $C000 window)
+    uint8_t tier;          // BlockTier
+    Block** map_entry;     // Its entry in the block map
+};
+
+// Block::bank of blocks that start in the fixed $C000-$FFFF window
+constexpr uint32_t FIXED_BANK = 0xFFFFFFFF;
+// Block::bank of blocks compiled from RAM
+constexpr uint32_t RAM_BANK = 0xFFFFFFFE;
+
+// Compiled RAM blocks covering each page of $0000-$1FFF (CpuState::code_pages),
+// plus RAM_PAGE_UOP on pages the micro-op cache has decoded blocks from
+extern uint8_t ram_code_pages[RAM_CODE_PAGES];
+constexpr uint8_t RAM_PAGE_UOP = 0x80;
+static_assert(RAM_BLOCK_SLOTS < RAM_PAGE_UOP, "block counts must stay below RAM_PAGE_UOP");
+
+// Set by NoteCodeWrite when the byte written is on a RAM_PAGE_UOP page
+extern bool uop_page_written;
+
+// Return address stack (ARM backend, CpuState::return_stack). A compiled
+// JSR pushes its return PC along with a linkable exit of its own block for
+// that PC; a compiled RTS whose popped address matches the newest entry
+// jumps to that exit, chaining into the caller's continuation, and any
+// other RTS returns to the dispatcher. It is only a prediction: entries
+// are cleared whenever compiled code is evicted or moved, or the bank at
+// $8000 changes, so a match never reaches stale code.
+constexpr int RETURN_STACK_SIZE = 8;
+struct ReturnStack {
+    uint32_t top;                       // Index of the newest entry
+    struct Entry {
+        uint32_t pc;                    // Return PC; NO_RETURN once cleared
+        uint32_t code;                  // ARM address of the exit for it
+    } entry[RETURN_STACK_SIZE];
 };
+constexpr uint32_t NO_RETURN = 0xFFFFFFFF;
+extern ReturnStack return_stack;
+
+// Offset in the Flash2M image of ROM address pc, read in the given bank
+inline uint32_t RomOffset(uint16_t pc, uint32_t bank) {
+    return ((pc & 0x4000) ? 0x1FC000u : ((bank & 0x7F) << 14)) | (pc & 0x3FFF);
+}
 
 // Initialize dynarec system
 void Init();
@@ -61,28 +151,65 @@ void Init();
 // Shutdown and free resources
 void Shutdown();
 
-// Compile a block starting at given PC
+// Compile a baseline block starting at given PC
 // Returns pointer to compiled code, or nullptr if compilation failed
 void* CompileBlock(uint16_t pc);
 
-// Invalidate all blocks (call on ROM bank switch)
+// Invalidate all blocks (call when ROM contents change)
 void InvalidateAll();
 
-// Get compiled block for PC (returns nullptr if not compiled)
-void* GetBlock(uint16_t pc);
+// A byte on a page counted in ram_code_pages was written: drop the blocks
+// compiled from it. Returns true if any were dropped.
+bool NoteCodeWrite(uint16_t addr);
+
+// Drop every block compiled from RAM (its contents changed unseen)
+void InvalidateRamCode();
+
+// Flash2M ROM bytes [lo, hi), offsets into the 2MB image, were programmed
+// or erased: drop the blocks compiled from any of them, in whichever bank,
+// and let PCs there that failed to compile be tried again
+void InvalidateRomRange(uint32_t lo, uint32_t hi);
+
+// Select the cartridge bank mapped at $8000-$BFFF. Blocks compiled there
+// are kept per bank, so this only switches maps (call on bank latch).
+void SetCodeBank(uint32_t bank);
+
+// I/O from compiled blocks ($2000-$7FFF: VIA, joystick, audio RAM, VDMA).
+// Blocks call these with their CpuState, which is the CPU they run on, and
+// the cycles run since they last charged cycles_remaining, so
+// time-coupled devices (the blitter) see the same clock as under the
+// interpreter. An access that raises or schedules an event, or switches
+// banks, sets CpuState::exit_reason and the block leaves after the
+// instruction (IR_F_IO).
+uint32_t IoRead(CpuState* state, uint32_t addr, int32_t elapsed);
+void IoWrite(CpuState* state, uint32_t addr, uint32_t value, int32_t elapsed);
+
+// Get compiled block for PC (returns nullptr if not compiled), counting
+// the entry; a block reaching PROMOTE_THRESHOLD is optimized first. If
+// tier is given it receives the block's BlockTier.
+void* GetBlock(uint16_t pc, uint8_t* tier = nullptr);
 
-// Run a compiled block with DynarecState
-// Returns cycles consumed
-int RunBlock(void* code, DynarecState* state);
+// Run a compiled block on the given CPU state. Blocks charge their cycles
+// to state->cycles_remaining and chain into each other until it runs out.
+// A block runs only while the budget covers the most one pass over it can
+// take (BlockBudget in dynarec_ir.h), checked on entry and at its in-block
+// back edges, so it never overruns the deadline. Returns cycles consumed
+int RunBlock(void* code, CpuState* state);
 
 // Statistics
 struct Stats {
     uint32_t blocks_compiled;
-    uint32_t blocks_executed;
+    uint32_t blocks_executed;     // Entries from the dispatcher (chained blocks not counted)
+    uint32_t blocks_linked;       // Exits patched to branch straight to their target
     uint32_t blocks_invalidated;
-    uint32_t compile_bytes_used;
+    uint32_t blocks_promoted;     // Copied from the cold tier into ITCM
+    uint32_t blocks_optimized;    // Recompiled at TIER_OPTIMIZED
+    uint32_t blocks_evicted;      // Dropped to make room in either tier
+    uint32_t compile_bytes_used;  // Cold tier
     uint32_t compile_bytes_total;
     uint32_t fallback_count;
+    uint32_t indirect_hits;       // JMP (ind) that found its target's block in the site's inline cache
+    uint32_t indirect_misses;     // and that did not (ARM backend)
     uint8_t  last_fail_opcode;    // Opcode that caused most recent fallback
     uint16_t last_fail_pc;        // PC where most recent fallback happened
 };
@@ -33,9 +33,6 @@ extern uint8_t* cached_ram_ptr;
 extern uint8_t* cached_rom_lo_ptr;
 extern uint8_t* cached_rom_hi_ptr;
 
-// Global active CPU pointer from mos6502.cpp
-extern mos6502* g_activeCPU;
-
 // ROM type from gte.cpp
 extern uint8_t loadedRomType;
 constexpr uint8_t ROM_TYPE_EEPROM8K = 1;
@@ -47,13 +44,6 @@ namespace Dynarec {
 
 static bool system_initialized = false;
 
-// DynarecState in DTCM for fast access
-#if defined(NDS_BUILD) && defined(ARM9)
-DTCM_BSS static DynarecState dynarec_state;
-#else
-static DynarecState dynarec_state;
-#endif
-
 void InitSystem() {
     if (!system_initialized) {
         Init();
@@ -70,18 +60,21 @@ void ShutdownSystem() {
 
 static uint32_t canuse_calls = 0;
 
-bool CanUseDynarec() {
+// PCs blocks are compiled at: the ROM windows, and RAM code (dynarec.h)
+static inline bool IsCodePC(uint16_t pc) {
+#if DYNAREC_RAM_CODE
+    if (pc >= RAM_CODE_START && pc < RAM_CODE_END) return true;
+#endif
+    return pc >= 0x8000;
+}
+
+bool CanUseDynarec(const mos6502* cpu) {
     canuse_calls++;
 
     if (!system_initialized) {
         InitSystem();
     }
 
-    if (!g_activeCPU) {
-        if ((canuse_calls & 0xFF) == 0) DebugLog("DR: CanUseDynarec false - no active CPU\n");
-        return false;
-    }
-
     // ROM pointers must be initialized
     if (!cached_ram_ptr || !cached_rom_lo_ptr || !cached_rom_hi_ptr) {
         if ((canuse_calls & 0xFF) == 0) DebugLog("DR: CanUseDynarec false - ROM ptrs not init ram=%p lo=%p hi=%p\n",
@@ -89,16 +82,10 @@ bool CanUseDynarec() {
         return false;
     }
 
-    // PC must be in ROM for block compilation
-    uint16_t pc = g_activeCPU->pc;
-    if (pc < 0x8000) {
-        if ((canuse_calls & 0xFF) == 0) DebugLog("DR: CanUseDynarec false - PC=%04X < 8000\n", pc);
-        return false;
-    }
-
-    // Decimal mode is complex - skip dynarec
-    if (g_activeCPU->status & 0x08) {
-        if ((canuse_calls & 0xFF) == 0) DebugLog("DR: CanUseDynarec false - decimal mode\n");
+    // PC must be in ROM (or RAM code) for block compilation
+    uint16_t pc = cpu->pc;
+    if (!IsCodePC(pc)) {
+        if ((canuse_calls & 0xFF) == 0) DebugLog("DR: CanUseDynarec false - PC=%04X not code\n", pc);
         return false;
     }
 
@@ -115,69 +102,100 @@ bool CanUseDynarec() {
 
 static uint32_t total_dynarec_cycles = 0;
 static uint32_t total_dynarec_invocations = 0;
+static uint64_t tier_cycles[2] = {};    // By BlockTier
+
+// Visits to PCs without a block, direct-mapped by PC; a PC is compiled on
+// its COMPILE_THRESHOLD-th. Another PC (or the same one in another bank)
+// landing on the entry starts its count over, which only delays a compile.
+static constexpr int VISIT_TABLE_SIZE = 1024;
+static uint16_t visit_pc[VISIT_TABLE_SIZE];
+static uint8_t visit_count[VISIT_TABLE_SIZE];
+
+static bool ReachedCompileThreshold(uint16_t pc) {
+    const int i = (pc ^ (pc >> 10)) & (VISIT_TABLE_SIZE - 1);
+    if (visit_pc[i] != pc) {
+        visit_pc[i] = pc;
+        visit_count[i] = 0;
+    }
+    if (visit_count[i] < COMPILE_THRESHOLD) visit_count[i]++;
+    return visit_count[i] >= COMPILE_THRESHOLD;
+}
+
+bool uop_page_written = false;
+static uint32_t uop_pages = 0;
 
-int RunDynarec(int cycles) {
-    if (!g_activeCPU) return 0;
+void SetUopPages(uint32_t pages) {
+    uop_page_written = false;
+    if (pages == uop_pages) return;
+    uop_pages = pages;
+    for (int page = 0; page < RAM_CODE_PAGES; page++) {
+        if (pages & (1u << page)) ram_code_pages[page] |= RAM_PAGE_UOP;
+        else ram_code_pages[page] &= (uint8_t)~RAM_PAGE_UOP;
+    }
+}
+
+void GetTierCycles(uint64_t& baseline, uint64_t& optimized) {
+    baseline = tier_cycles[TIER_BASELINE];
+    optimized = tier_cycles[TIER_OPTIMIZED];
+}
+
+// Blocks only run on a mos6502's own CpuState (RunDynarec)
+uint32_t IoRead(CpuState* state, uint32_t addr, int32_t elapsed) {
+    return static_cast<mos6502*>(state)->CompiledRead((uint16_t)addr, elapsed);
+}
+
+void IoWrite(CpuState* state, uint32_t addr, uint32_t value, int32_t elapsed) {
+    static_cast<mos6502*>(state)->CompiledWrite((uint16_t)addr, (uint8_t)value, elapsed);
+}
 
+int RunDynarec(mos6502* cpu, int budget) {
     total_dynarec_invocations++;
 
-    // Pack CPU state into DynarecState (once)
-    dynarec_state.A = g_activeCPU->A;
-    dynarec_state.X = g_activeCPU->X;
-    dynarec_state.Y = g_activeCPU->Y;
-    dynarec_state.SP = g_activeCPU->sp;
-    dynarec_state.status = g_activeCPU->status;
-    dynarec_state.PC = g_activeCPU->pc;
-    dynarec_state.cycles_remaining = cycles;
-    dynarec_state.cycles_executed = 0;
-    dynarec_state.ram = cached_ram_ptr;
-    dynarec_state.rom_lo = cached_rom_lo_ptr;
-    dynarec_state.rom_hi = cached_rom_hi_ptr;
-    dynarec_state.exit_reason = 0;
-
-    int total_executed = 0;
-    int remaining = cycles;
-
-    // Multi-block execution loop: stay in dynarec as long as possible
-    while (remaining > 0) {
-        uint16_t pc = dynarec_state.PC;
-
-        // Only continue if PC is in ROM space
-        if (pc < 0x8000) break;
-
-        // Find or compile block
-        void* code = GetBlock(pc);
+    // Blocks run on the CPU's own CpuState; only the per-run fields are set
+    CpuState* state = cpu;
+    state->cycles_remaining = budget;
+    state->ram = cached_ram_ptr;
+    state->rom_lo = cached_rom_lo_ptr;
+    state->rom_hi = cached_rom_hi_ptr;
+    state->code_pages = ram_code_pages;
+#if !DYNAREC_X64
+    state->return_stack = &return_stack;
+#endif
+    state->exit_reason = 0;
+
+    // Multi-block execution loop: stay in dynarec as long as possible.
+    // Blocks take their cycles off cycles_remaining themselves and jump
+    // straight into linked successors, so this only runs on unlinked exits.
+    while (state->cycles_remaining > 0) {
+        uint16_t pc = state->pc;
+
+        // Only continue if PC is in ROM space (or RAM code)
+        if (!IsCodePC(pc)) break;
+
+        // Find or compile block. A PC not seen often enough yet is left to
+        // the interpreter.
+        uint8_t tier = TIER_BASELINE;
+        void* code = GetBlock(pc, &tier);
         if (!code) {
+            if (!ReachedCompileThreshold(pc)) break;
             code = CompileBlock(pc);
             if (!code) break;  // Unsupported opcode — fall back to interpreter
         }
 
         // Execute block directly via function pointer
-        typedef int (*BlockFunc)(DynarecState*);
+        typedef int (*BlockFunc)(CpuState*);
         BlockFunc func = (BlockFunc)code;
-        func(&dynarec_state);
-
-        int block_cycles = dynarec_state.cycles_executed;
-        if (block_cycles <= 0) break;  // Safety: avoid infinite loop
-
-        total_executed += block_cycles;
-        remaining -= block_cycles;
+        const int32_t before = state->cycles_remaining;
+        func(state);
+        // Nothing charged: the block did not fit before the deadline (or
+        // made no progress); the interpreter runs up to it exactly
+        if (state->cycles_remaining >= before) break;
+        tier_cycles[tier] += (uint32_t)(before - state->cycles_remaining);
+        if (state->exit_reason) break;  // An I/O access moved the deadline or switched banks
     }
 
-    if (total_executed > 0) {
-        // Unpack DynarecState back to CPU (once)
-        uint16_t exit_pc = dynarec_state.PC;
-        bool valid_pc = (exit_pc < 0x2000) || (exit_pc >= 0x8000);
-        if (valid_pc) {
-            g_activeCPU->A = dynarec_state.A;
-            g_activeCPU->X = dynarec_state.X;
-            g_activeCPU->Y = dynarec_state.Y;
-            g_activeCPU->sp = dynarec_state.SP;
-            g_activeCPU->status = dynarec_state.status;
-            g_activeCPU->pc = dynarec_state.PC;
-        }
-        total_dynarec_cycles += total_executed;
-    }
+    int total_executed = budget - state->cycles_remaining;
+    total_dynarec_cycles += total_executed;
 
     return total_executed;
 }
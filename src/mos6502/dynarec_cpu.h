@@ -1,17 +1,30 @@
 #pragma once
 #include <cstdint>
 
+class mos6502;
+
 // Integration interface for MOS6502 to use Dynarec
 // This wraps the dynarec system for the CPU class
 
 namespace Dynarec {
 
-// Run cycles using dynarec, fallback to interpreter when needed
-// Returns actual cycles executed
-int RunDynarec(int cycles);
+// Run compiled blocks on cpu until `budget` cycles (the distance to its next
+// event deadline) have elapsed, fallback to interpreter when needed.
+// Returns actual cycles executed; may overshoot by at most one block.
+int RunDynarec(mos6502* cpu, int budget);
+
+// 6502 cycles run in compiled code, by BlockTier. A chain of linked blocks
+// counts towards the tier of the block RunDynarec entered it at; whatever
+// the CPU ran besides is the interpreter's.
+void GetTierCycles(uint64_t& baseline, uint64_t& optimized);
+
+// Before RunDynarec: the running CPU's micro-op cache RAM pages (bit n:
+// page n). They are flagged RAM_PAGE_UOP in ram_code_pages, so compiled
+// stores to them set uop_page_written, which this clears.
+void SetUopPages(uint32_t pages);
 
-// Check if we should use dynarec for current state
-bool CanUseDynarec();
+// Check if we should use dynarec for cpu's current state
+bool CanUseDynarec(const mos6502* cpu);
 
 // Initialize dynarec system (call once at startup)
 void InitSystem();
@@ -32,6 +32,14 @@ void Emitter::LoadImm16(int rd, uint16_t val) {
     }
 }
 
+// Load 32-bit immediate one byte at a time: MOV + ORR ROR #24/#16/#8
+void Emitter::LoadImm32(int rd, uint32_t val) {
+    Emit_MOV_IMM(rd, val & 0xFF);
+    if ((val >> 8) & 0xFF)  Emit_ORR_IMM(rd, rd, (val >> 8) & 0xFF, 12);
+    if ((val >> 16) & 0xFF) Emit_ORR_IMM(rd, rd, (val >> 16) & 0xFF, 8);
+    if ((val >> 24) & 0xFF) Emit_ORR_IMM(rd, rd, (val >> 24) & 0xFF, 4);
+}
+
 // LDR Rt, [Rn, #offset]
 void Emitter::Emit_LDR_IMM(int rt, int rn, uint16_t offset) {
     Emit(ARM_COND(COND_AL) | ARM_LDR_IMM(rt, rn, offset, false));
@@ -52,6 +60,18 @@ void Emitter::Emit_STRB_IMM(int rt, int rn, uint16_t offset) {
     Emit(ARM_COND(COND_AL) | ARM_STR_IMM(rt, rn, offset, true));
 }
 
+// LDRH/STRH Rt, [Rn, #offset]
+// ARM encoding: cond 000 P U 1 W L Rn Rt imm4H 1011 imm4L, P=1, U=1, W=0
+void Emitter::Emit_LDRH_IMM(int rt, int rn, uint8_t offset) {
+    Emit(ARM_COND(COND_AL) | (1 << 24) | (1 << 23) | (1 << 22) | (1 << 20) | (rn << 16) | (rt << 12) |
+         ((offset >> 4) << 8) | (0xB << 4) | (offset & 0xF));
+}
+
+void Emitter::Emit_STRH_IMM(int rt, int rn, uint8_t offset) {
+    Emit(ARM_COND(COND_AL) | (1 << 24) | (1 << 23) | (1 << 22) | (rn << 16) | (rt << 12) |
+         ((offset >> 4) << 8) | (0xB << 4) | (offset & 0xF));
+}
+
 // LDRB Rd, [Rn, Rm] - register offset
 void Emitter::Emit_LDRB_REG(int rd, int rn, int rm) {
     Emit(ARM_COND(COND_AL) | (0x1 << 26) | (1 << 25) | (1 << 24) | (1 << 23) |
@@ -111,6 +131,33 @@ void Emitter::Emit_BX(int rm) {
     Emit(0xE12FFF10 | rm);
 }
 
+// BLX Rm (ARMv5T, interworking call)
+void Emitter::Emit_BLX(int rm) {
+    // 1110 0001 0010 1111 1111 1111 0011 Rm
+    Emit(0xE12FFF30 | rm);
+}
+
+// Helper call. r12 is both REG_STATE and an AAPCS scratch register, so it
+// is saved around the call (with r3 to keep the stack 8-byte aligned) and
+// doubles as the branch target register.
+void Emitter::Emit_CallHelper(const void* fn) {
+    Emit_PUSH((1 << REG_SCRATCH3) | (1 << REG_STATE));
+    LoadImm32(REG_STATE, (uint32_t)(uintptr_t)fn);
+    Emit_BLX(REG_STATE);
+    Emit_POP((1 << REG_SCRATCH3) | (1 << REG_STATE));
+}
+
+void Emitter::Emit_CallStateHelper(const void* fn) {
+    Emit_PUSH((1 << REG_SCRATCH3) | (1 << REG_STATE));
+    Emit_MOV(REG_SCRATCH3, REG_SCRATCH2);
+    Emit_MOV(REG_SCRATCH2, REG_SCRATCH1);
+    Emit_MOV(REG_SCRATCH1, REG_SCRATCH0);
+    Emit_MOV(REG_SCRATCH0, REG_STATE);
+    LoadImm32(REG_STATE, (uint32_t)(uintptr_t)fn);
+    Emit_BLX(REG_STATE);
+    Emit_POP((1 << REG_SCRATCH3) | (1 << REG_STATE));
+}
+
 // PUSH {reg_list} = STMDB SP!, {reg_list}
 // Encoding: cond 100 1 0 0 1 0 Rn=SP reg_list
 // bits [27:25] = 100, P=1(24), U=0(23), S=0(22), W=1(21), L=0(20)
@@ -131,149 +178,101 @@ void Emitter::Emit_POP(uint16_t reg_list) {
     Emit(insn);
 }
 
-// Block prologue: save callee-saved regs, load 6502 state from DynarecState*
-// r0 = DynarecState* on entry (C calling convention)
+// Block prologue: save callee-saved regs, load 6502 state from CpuState*
+// r0 = CpuState* on entry (C calling convention)
 void Emitter::Emit_Prologue() {
     // PUSH {r4-r12, lr}
     // reg_list: r4(bit4)..r12(bit12), lr(bit14) = 0x5FF0
     Emit_PUSH(0x5FF0);
 
-    // Save DynarecState* to r12 (REG_STATE)
+    // Save CpuState* to r12 (REG_STATE)
     Emit_MOV(REG_STATE, 0);  // MOV r12, r0
 
-    // Load pointers from DynarecState
-    Emit_LDR_IMM(REG_RAM,    REG_STATE, DS_RAM);      // r9  = state->ram
-    Emit_LDR_IMM(REG_ROM_LO, REG_STATE, DS_ROM_LO);   // r10 = state->rom_lo
-    Emit_LDR_IMM(REG_ROM_HI, REG_STATE, DS_ROM_HI);   // r11 = state->rom_hi
-
-    // Load 6502 registers from DynarecState
-    Emit_LDRB_IMM(REG_A, REG_STATE, DS_A);   // r4 = state->A
-    Emit_LDRB_IMM(REG_X, REG_STATE, DS_X);   // r5 = state->X
-    Emit_LDRB_IMM(REG_Y, REG_STATE, DS_Y);   // r6 = state->Y
-
-    // Unpack lazy NZ from status register:
-    // Default: r7 = 0x01 (non-zero, non-negative)
-    // If N flag set: r7 = 0x80
-    // If Z flag set: r7 = 0x00 (overrides N)
-    Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);  // r0 = status
-
-    // Start with default value
-    Emit_MOV_IMM(REG_NZ, 0x01);
-    // If N set (bit 7): MOV r7, #0x80
-    Emit_TST_IMM(REG_SCRATCH0, 0x80);
-    Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_NZ, 0, 0x80, 0, false));
-    // If Z set (bit 1): MOV r7, #0 — this overrides N, which is correct
-    // (6502 can have both N and Z set, but Z takes priority for our lazy scheme)
-    Emit_TST_IMM(REG_SCRATCH0, 0x02);
-    Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_MOV, REG_NZ, 0, 0x00, 0, false));
-
-    // Unpack carry flag (bit 0 of status)
-    Emit_AND_IMM(REG_CARRY, REG_SCRATCH0, 0x01);  // r8 = status & 1
-}
-
-// Block epilogue: store 6502 state back to DynarecState, return
-// exit_pc = the 6502 PC to store as the exit point
-void Emitter::Emit_Epilogue(uint16_t exit_pc) {
-    // Store A, X, Y back to DynarecState
-    Emit_STRB_IMM(REG_A, REG_STATE, DS_A);
-    Emit_STRB_IMM(REG_X, REG_STATE, DS_X);
-    Emit_STRB_IMM(REG_Y, REG_STATE, DS_Y);
+    // Load pointers from CpuState
+    Emit_LDR_IMM(REG_RAM,    REG_STATE, CS_RAM);      // r9  = state->ram
+    Emit_LDR_IMM(REG_ROM_LO, REG_STATE, CS_ROM_LO);   // r10 = state->rom_lo
+    Emit_LDR_IMM(REG_ROM_HI, REG_STATE, CS_ROM_HI);   // r11 = state->rom_hi
+
+    // Load 6502 registers from CpuState
+    Emit_LDRB_IMM(REG_A, REG_STATE, CS_A);   // r4 = state->A
+    Emit_LDRB_IMM(REG_X, REG_STATE, CS_X);   // r5 = state->X
+    Emit_LDRB_IMM(REG_Y, REG_STATE, CS_Y);   // r6 = state->Y
 
-    // Repack lazy NZ + carry into 6502 status byte
-    // Load current status to preserve I/D/V/B bits
-    Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);  // r0 = old status
+    // Flags are already in lazy form (see lazy_flags.h), no unpacking
+    Emit_LDR_IMM(REG_NZ, REG_STATE, CS_NZ);         // r7 = state->flag_nz
+    Emit_LDRB_IMM(REG_CARRY, REG_STATE, CS_CARRY);  // r8 = state->flag_c
+}
 
-    // Clear N, Z, C bits: BIC r0, r0, #0x83
-    Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0x7C);  // keep bits 6-2 (V,B,D,I)
+// state->cycles_remaining -= cycles, leaving the ARM flags from the SUBS
+// so a link word can branch on GT (budget left).
+void Emitter::Emit_ChargeCycles() {
+    Emit_LDR_IMM(REG_SCRATCH0, REG_STATE, CS_CYCLES_REM);
+    if (cycles <= 255) {
+        Emit_SUB_IMM(REG_SCRATCH0, REG_SCRATCH0, (uint8_t)cycles, true);
+    } else {
+        LoadImm16(REG_SCRATCH3, (uint16_t)cycles);
+        Emit(ARM_COND(COND_AL) | ARM_DP(DP_SUB, REG_SCRATCH0, REG_SCRATCH0, REG_SCRATCH3, true));
+    }
+    Emit_STR_IMM(REG_SCRATCH0, REG_STATE, CS_CYCLES_REM);
+}
 
-    // Set C from r8 (carry is 0 or 1): ORR r0, r0, r8
-    Emit(ARM_COND(COND_AL) | ARM_DP(DP_ORR, REG_SCRATCH0, REG_SCRATCH0, REG_CARRY, false));
+// Block epilogue: charge cycles, then either continue into the next block
+// through the link word or store 6502 state back to CpuState and return.
+// exit_pc = the 6502 PC to store as the exit point
+void Emitter::Emit_Epilogue(uint16_t exit_pc) {
+    Emit_ChargeCycles();
 
-    // Set Z: if r7 == 0, set Z bit (0x02)
-    Emit_TST_IMM(REG_NZ, 0xFF);
-    // If zero: ORR r0, r0, #0x02
-    Emit(ARM_COND(COND_EQ) | ARM_DP_IMM(DP_ORR, REG_SCRATCH0, REG_SCRATCH0, 0x02, 0, false));
+    // Link word: NOP until CompileBlock chains this exit
+    if (exit_count < MAX_BLOCK_EXITS) {
+        exits[exit_count].slot = (uint32_t*)ptr;
+        exits[exit_count].target_pc = exit_pc;
+        exit_count++;
+    }
+    Emit(ARM_NOP);
 
-    // Set N: if r7 bit 7 set, set N bit (0x80)
-    // We already did TST r7, #0xFF above - check N flag from that
-    // Actually need a separate test for bit 7
-    Emit_TST_IMM(REG_NZ, 0x80);
-    Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_ORR, REG_SCRATCH0, REG_SCRATCH0, 0x80, 0, false));
+    // Store A, X, Y back to CpuState
+    Emit_STRB_IMM(REG_A, REG_STATE, CS_A);
+    Emit_STRB_IMM(REG_X, REG_STATE, CS_X);
+    Emit_STRB_IMM(REG_Y, REG_STATE, CS_Y);
 
-    // Store repacked status
-    Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
+    // Store lazy NZ + carry as is
+    Emit_STR_IMM(REG_NZ, REG_STATE, CS_NZ);
+    Emit_STRB_IMM(REG_CARRY, REG_STATE, CS_CARRY);
 
     // Store exit PC
     LoadImm16(REG_SCRATCH0, exit_pc);
-    // STRH r0, [r12, #DS_PC] - store halfword
-    // ARM encoding: cond 000 P U 1 W 0 Rn Rt imm4H 1011 imm4L
-    // P=1, U=1, W=0, L=0 (store)
-    {
-        uint8_t offset_hi = (DS_PC >> 4) & 0xF;
-        uint8_t offset_lo = DS_PC & 0xF;
-        uint32_t insn = (0xE << 28) | (0x1 << 24) | (1 << 23) | (1 << 22) |
-                        (0 << 21) | (0 << 20) |
-                        (REG_STATE << 16) | (REG_SCRATCH0 << 12) |
-                        (offset_hi << 8) | (0xB << 4) | offset_lo;
-        Emit(insn);
-    }
-
-    // Store cycles_executed
-    if (cycles <= 255) {
-        Emit_MOV_IMM(REG_SCRATCH0, (uint8_t)cycles);
-    } else {
-        LoadImm16(REG_SCRATCH0, (uint16_t)cycles);
-    }
-    Emit_STR_IMM(REG_SCRATCH0, REG_STATE, DS_CYCLES_EXEC);
+    Emit_STRH_IMM(REG_SCRATCH0, REG_STATE, CS_PC);
 
     // POP {r4-r12, pc} - return
     Emit_POP(0x9FF0);  // r4-r12(bits 4-12) + pc(bit 15) = 0x9FF0
 }
 
-// Epilogue variant: exit PC is in a register (for RTS etc)
-// IMPORTANT: pc_reg must NOT be REG_SCRATCH0 — flag repacking clobbers it
+// Epilogue variant: exit PC is in a register (for RTS etc), so it always
+// returns to the dispatcher.
+// IMPORTANT: pc_reg must NOT be REG_SCRATCH0 or REG_SCRATCH3
 void Emitter::Emit_Epilogue_DynamicPC(int pc_reg) {
-    // Store A, X, Y back to DynarecState
-    Emit_STRB_IMM(REG_A, REG_STATE, DS_A);
-    Emit_STRB_IMM(REG_X, REG_STATE, DS_X);
-    Emit_STRB_IMM(REG_Y, REG_STATE, DS_Y);
-
-    // Repack lazy NZ + carry into 6502 status byte
-    Emit_LDRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
-    Emit_AND_IMM(REG_SCRATCH0, REG_SCRATCH0, 0x7C);  // keep V,B,D,I
-    Emit(ARM_COND(COND_AL) | ARM_DP(DP_ORR, REG_SCRATCH0, REG_SCRATCH0, REG_CARRY, false));
-    Emit_TST_IMM(REG_NZ, 0xFF);
-    Emit(ARM_COND(COND_EQ) | ARM_DP_IMM(DP_ORR, REG_SCRATCH0, REG_SCRATCH0, 0x02, 0, false));
-    Emit_TST_IMM(REG_NZ, 0x80);
-    Emit(ARM_COND(COND_NE) | ARM_DP_IMM(DP_ORR, REG_SCRATCH0, REG_SCRATCH0, 0x80, 0, false));
-    Emit_STRB_IMM(REG_SCRATCH0, REG_STATE, DS_STATUS);
-
-    // Store exit PC from register (STRH pc_reg, [r12, #DS_PC])
-    {
-        uint8_t offset_hi = (DS_PC >> 4) & 0xF;
-        uint8_t offset_lo = DS_PC & 0xF;
-        uint32_t insn = (0xE << 28) | (0x1 << 24) | (1 << 23) | (1 << 22) |
-                        (0 << 21) | (0 << 20) |
-                        (REG_STATE << 16) | (pc_reg << 12) |
-                        (offset_hi << 8) | (0xB << 4) | offset_lo;
-        Emit(insn);
-    }
+    Emit_ChargeCycles();
 
-    // Store cycles_executed
-    if (cycles <= 255) {
-        Emit_MOV_IMM(REG_SCRATCH0, (uint8_t)cycles);
-    } else {
-        LoadImm16(REG_SCRATCH0, (uint16_t)cycles);
-    }
-    Emit_STR_IMM(REG_SCRATCH0, REG_STATE, DS_CYCLES_EXEC);
+    // Store A, X, Y back to CpuState
+    Emit_STRB_IMM(REG_A, REG_STATE, CS_A);
+    Emit_STRB_IMM(REG_X, REG_STATE, CS_X);
+    Emit_STRB_IMM(REG_Y, REG_STATE, CS_Y);
+
+    // Store lazy NZ + carry as is
+    Emit_STR_IMM(REG_NZ, REG_STATE, CS_NZ);
+    Emit_STRB_IMM(REG_CARRY, REG_STATE, CS_CARRY);
+
+    // Store exit PC from register
+    Emit_STRH_IMM(pc_reg, REG_STATE, CS_PC);
 
     // POP {r4-r12, pc} - return
     Emit_POP(0x9FF0);
 }
 
 // Copy result byte to NZ register for lazy flag evaluation
-// After this, N = (r7 & 0x80), Z = (r7 == 0)
+// After this, N = (r7 & 0x180) != 0, Z = (r7 & 0xFF) == 0
 void Emitter::Emit_UpdateNZ(int reg) {
+    if (nz_dead) return;
     if (reg != REG_NZ) {
         Emit_AND_IMM(REG_NZ, reg, 0xFF);
     }
@@ -7,9 +7,6 @@
 
 namespace Dynarec {
 
-// Forward declaration
-struct DynarecState;
-
 // ARM register allocation for 6502 state
 // Callee-saved registers that persist across block execution
 constexpr int REG_A      = 4;   // r4 = 6502 Accumulator
@@ -20,7 +17,7 @@ constexpr int REG_CARRY  = 8;   // r8 = carry flag (0 or 1)
 constexpr int REG_RAM    = 9;   // r9 = RAM base pointer
 constexpr int REG_ROM_LO = 10;  // r10 = ROM lo bank pointer
 constexpr int REG_ROM_HI = 11;  // r11 = ROM hi bank pointer
-constexpr int REG_STATE  = 12;  // r12 = DynarecState* pointer
+constexpr int REG_STATE  = 12;  // r12 = CpuState* pointer
 
 // Scratch registers (caller-saved, used for temporaries)
 constexpr int REG_SCRATCH0 = 0;  // r0
@@ -71,10 +68,24 @@ enum DPOpcode : uint32_t {
 struct PCMapEntry {
     uint16_t pc6502;
     uint32_t arm_offset;  // Offset from code base
+    int cycles;           // Block cycles before the instruction
 };
 
 constexpr int MAX_PC_MAP = 128;
 
+// Static block exit, recorded so the block can be chained to its target.
+// slot is the exit's link word: a NOP while unlinked, patched to a BGT
+// into the target block's body once that block exists.
+struct ExitRecord {
+    uint32_t* slot;
+    uint16_t target_pc;
+};
+
+constexpr int MAX_BLOCK_EXITS = 24;  // Traces add a side exit per branch followed, JSRs a return exit
+
+// Link word of an exit that is not chained (MOV r0, r0)
+constexpr uint32_t ARM_NOP = 0xE1A00000;
+
 class Emitter {
 public:
     uint8_t* ptr;
@@ -82,12 +93,43 @@ public:
     uint8_t* const end;
     int cycles;
 
+    // Set while lowering an instruction whose N/Z, C or V result is dead
+    // (IR_F_*_DEAD): the helpers and opcode cases then skip computing it
+    bool nz_dead;
+    bool c_dead;
+    bool v_dead;
+
+    // Set while lowering a trace instruction (IR_F_SIDE_EXIT,
+    // IR_F_TRACE_TAKEN): a branch leaves on its cold side only, and a taken
+    // branch, JSR or JMP the trace follows does not end the block
+    bool side_exit;
+    bool trace_taken;
+
+    // PC after the instruction being lowered. An I/O call stores it to
+    // CpuState first, for an IRQ the access raises to push.
+    uint16_t next_pc;
+
     // PC mapping for branch resolution
     PCMapEntry pc_map[MAX_PC_MAP];
     int pc_map_count;
 
+    // Static exits emitted so far, for block linking
+    ExitRecord exits[MAX_BLOCK_EXITS];
+    int exit_count;
+
     Emitter(uint8_t* buf, size_t size)
-        : ptr(buf), base(buf), end(buf + size), cycles(0), pc_map_count(0) {}
+        : ptr(buf), base(buf), end(buf + size), cycles(0), nz_dead(false), c_dead(false), v_dead(false),
+          side_exit(false), trace_taken(false), next_pc(0), pc_map_count(0), exit_count(0) {}
+
+    // Discard everything emitted so far
+    void Reset() {
+        ptr = base;
+        cycles = 0;
+        nz_dead = c_dead = v_dead = false;
+        side_exit = trace_taken = false;
+        pc_map_count = 0;
+        exit_count = 0;
+    }
 
     // Get current code size
     size_t Size() const { return ptr - base; }
@@ -111,6 +153,7 @@ public:
         if (pc_map_count < MAX_PC_MAP) {
             pc_map[pc_map_count].pc6502 = pc6502;
             pc_map[pc_map_count].arm_offset = CurrentOffset();
+            pc_map[pc_map_count].cycles = cycles;
             pc_map_count++;
         }
     }
@@ -125,6 +168,14 @@ public:
         return -1;
     }
 
+    // Block cycles before the instruction at a mapped 6502 PC
+    int GetCyclesAt(uint16_t pc6502) const {
+        for (int i = 0; i < pc_map_count; i++) {
+            if (pc_map[i].pc6502 == pc6502) return pc_map[i].cycles;
+        }
+        return 0;
+    }
+
     // Data processing instructions
     void Emit_MOV(int rd, int rm, bool set_flags = false);
     void Emit_MOV_IMM(int rd, uint8_t imm, bool set_flags = false);
@@ -132,12 +183,16 @@ public:
 
     // Load 16-bit immediate using MOV + ORR (ARMv5TE compatible)
     void LoadImm16(int rd, uint16_t val);
+    // Load 32-bit immediate (e.g. a helper address) using MOV + up to 3 ORR
+    void LoadImm32(int rd, uint32_t val);
 
     // Load/store with immediate offset
     void Emit_LDR_IMM(int rt, int rn, uint16_t offset);
     void Emit_LDRB_IMM(int rt, int rn, uint16_t offset);
     void Emit_STR_IMM(int rt, int rn, uint16_t offset);
     void Emit_STRB_IMM(int rt, int rn, uint16_t offset);
+    void Emit_LDRH_IMM(int rt, int rn, uint8_t offset);
+    void Emit_STRH_IMM(int rt, int rn, uint8_t offset);
 
     // Load/store with register offset
     void Emit_LDRB_REG(int rd, int rn, int rm);
@@ -157,18 +212,29 @@ public:
     // Branches
     void Emit_B(int32_t offset, Cond cond = COND_AL);
     void Emit_BX(int rm);
+    void Emit_BLX(int rm);
+
+    // Call a C helper: r0-r3 are arguments/clobbered, result in r0.
+    // Preserves REG_STATE (r12) across the call.
+    void Emit_CallHelper(const void* fn);
+    // Same, calling fn(state, r0, r1, r2): the CpuState goes first and the
+    // arguments move up a register. r3 survives.
+    void Emit_CallStateHelper(const void* fn);
 
     // Load/store multiple
     void Emit_PUSH(uint16_t reg_list);
     void Emit_POP(uint16_t reg_list);
 
-    // Block prologue/epilogue
+    // Block prologue/epilogue. Both epilogues charge the block's cycles so
+    // far to state->cycles_remaining; a static exit can then continue
+    // straight into the next block (see ExitRecord) while any remain.
     void Emit_Prologue();
     void Emit_Epilogue(uint16_t exit_pc);
-    void Emit_Epilogue_DynamicPC(int pc_reg);  // pc_reg must NOT be REG_SCRATCH0
+    void Emit_Epilogue_DynamicPC(int pc_reg);  // pc_reg must NOT be r0 or r3
+    void Emit_ChargeCycles();                  // clobbers r0, r3; sets ARM flags
 
     // Lazy flag helpers
-    void Emit_UpdateNZ(int reg);  // MOV r7, reg (just copy result to NZ register)
+    void Emit_UpdateNZ(int reg);  // AND r7, reg, #0xFF (nothing if nz_dead)
 };
 
 // Instruction encoding helpers
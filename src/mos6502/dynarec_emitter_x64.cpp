@@ -0,0 +1,269 @@
+#include "dynarec.h"
+
+#if DYNAREC_X64
+
+#include "dynarec_emitter_x64.h"
+#include <cstring>
+
+namespace Dynarec {
+
+X64Emitter::X64Emitter(uint8_t* buffer, size_t size)
+    : ptr(buffer), start(buffer), capacity(size) {
+}
+
+void X64Emitter::Word32(uint32_t w) {
+    std::memcpy(ptr, &w, 4);
+    ptr += 4;
+}
+
+// REX prefix, left out when it would be 0x40. byte_regs forces it for
+// SPL/BPL/SIL/DIL, which without one encode AH/CH/DH/BH.
+void X64Emitter::Rex(bool w, int reg, int index, int base, bool byte_regs) {
+    uint8_t rex = 0x40;
+    if (w) rex |= 0x08;
+    if (reg >= 8) rex |= 0x04;
+    if (index >= 8) rex |= 0x02;
+    if (base >= 8) rex |= 0x01;
+    if (rex != 0x40 || byte_regs) Byte(rex);
+}
+
+static inline bool NeedsRexForByte(int r) { return r >= RSP && r <= RDI; }
+
+// ModRM (and SIB/displacement) for [base + index + disp]
+void X64Emitter::ModRM(int reg, const X64Mem& m) {
+    const bool sib = m.index != X64_NO_REG || (m.base & 7) == RSP;
+    uint8_t mod;
+    if (m.disp == 0 && (m.base & 7) != RBP) mod = 0;
+    else if (m.disp >= -128 && m.disp <= 127) mod = 1;
+    else mod = 2;
+    Byte((uint8_t)((mod << 6) | ((reg & 7) << 3) | (sib ? 4 : (m.base & 7))));
+    if (sib) {
+        const int index = m.index == X64_NO_REG ? RSP : m.index;
+        Byte((uint8_t)(((index & 7) << 3) | (m.base & 7)));
+    }
+    if (mod == 1) Byte((uint8_t)m.disp);
+    else if (mod == 2) Word32((uint32_t)m.disp);
+}
+
+void X64Emitter::MovRR(int dst, int src) {
+    Rex(false, src, X64_NO_REG, dst);
+    Byte(0x89);
+    ModRMReg(src, dst);
+}
+
+void X64Emitter::MovRI(int dst, uint32_t imm) {
+    Rex(false, 0, X64_NO_REG, dst);
+    Byte((uint8_t)(0xB8 | (dst & 7)));
+    Word32(imm);
+}
+
+void X64Emitter::MovRI64(int dst, uint64_t imm) {
+    Rex(true, 0, X64_NO_REG, dst);
+    Byte((uint8_t)(0xB8 | (dst & 7)));
+    Word32((uint32_t)imm);
+    Word32((uint32_t)(imm >> 32));
+}
+
+void X64Emitter::Mov64(int dst, int src) {
+    Rex(true, src, X64_NO_REG, dst);
+    Byte(0x89);
+    ModRMReg(src, dst);
+}
+
+void X64Emitter::Zext8(int dst, int src) {
+    Rex(false, dst, X64_NO_REG, src, NeedsRexForByte(src));
+    Byte(0x0F); Byte(0xB6);
+    ModRMReg(dst, src);
+}
+
+void X64Emitter::LoadU8(int dst, const X64Mem& m) {
+    Rex(false, dst, m.index, m.base);
+    Byte(0x0F); Byte(0xB6);
+    ModRM(dst, m);
+}
+
+void X64Emitter::Load32(int dst, const X64Mem& m) {
+    Rex(false, dst, m.index, m.base);
+    Byte(0x8B);
+    ModRM(dst, m);
+}
+
+void X64Emitter::Load64(int dst, const X64Mem& m) {
+    Rex(true, dst, m.index, m.base);
+    Byte(0x8B);
+    ModRM(dst, m);
+}
+
+void X64Emitter::Store8(int src, const X64Mem& m) {
+    Rex(false, src, m.index, m.base, NeedsRexForByte(src));
+    Byte(0x88);
+    ModRM(src, m);
+}
+
+void X64Emitter::Store16(int src, const X64Mem& m) {
+    Byte(0x66);
+    Rex(false, src, m.index, m.base);
+    Byte(0x89);
+    ModRM(src, m);
+}
+
+void X64Emitter::Store32(int src, const X64Mem& m) {
+    Rex(false, src, m.index, m.base);
+    Byte(0x89);
+    ModRM(src, m);
+}
+
+void X64Emitter::StoreImm8(const X64Mem& m, uint8_t imm) {
+    Rex(false, 0, m.index, m.base);
+    Byte(0xC6);
+    ModRM(0, m);
+    Byte(imm);
+}
+
+void X64Emitter::StoreImm16(const X64Mem& m, uint16_t imm) {
+    Byte(0x66);
+    Rex(false, 0, m.index, m.base);
+    Byte(0xC7);
+    ModRM(0, m);
+    Byte((uint8_t)imm);
+    Byte((uint8_t)(imm >> 8));
+}
+
+void X64Emitter::Lea(int dst, const X64Mem& m) {
+    Rex(false, dst, m.index, m.base);
+    Byte(0x8D);
+    ModRM(dst, m);
+}
+
+void X64Emitter::AluRR(X64Alu op, int dst, int src) {
+    Rex(false, src, X64_NO_REG, dst);
+    Byte((uint8_t)((op << 3) | 0x01));
+    ModRMReg(src, dst);
+}
+
+void X64Emitter::AluRI(X64Alu op, int dst, int32_t imm) {
+    Rex(false, 0, X64_NO_REG, dst);
+    if (imm >= -128 && imm <= 127) {
+        Byte(0x83); ModRMReg(op, dst); Byte((uint8_t)imm);
+    } else {
+        Byte(0x81); ModRMReg(op, dst); Word32((uint32_t)imm);
+    }
+}
+
+void X64Emitter::AluRI64(X64Alu op, int dst, int32_t imm) {
+    Rex(true, 0, X64_NO_REG, dst);
+    if (imm >= -128 && imm <= 127) {
+        Byte(0x83); ModRMReg(op, dst); Byte((uint8_t)imm);
+    } else {
+        Byte(0x81); ModRMReg(op, dst); Word32((uint32_t)imm);
+    }
+}
+
+void X64Emitter::AluMI8(X64Alu op, const X64Mem& m, uint8_t imm) {
+    Rex(false, 0, m.index, m.base);
+    Byte(0x80);
+    ModRM(op, m);
+    Byte(imm);
+}
+
+void X64Emitter::AluMI32(X64Alu op, const X64Mem& m, int32_t imm) {
+    Rex(false, 0, m.index, m.base);
+    if (imm >= -128 && imm <= 127) {
+        Byte(0x83); ModRM(op, m); Byte((uint8_t)imm);
+    } else {
+        Byte(0x81); ModRM(op, m); Word32((uint32_t)imm);
+    }
+}
+
+void X64Emitter::Shl(int r, uint8_t count) {
+    Rex(false, 0, X64_NO_REG, r);
+    Byte(0xC1); ModRMReg(4, r); Byte(count);
+}
+
+void X64Emitter::Shr(int r, uint8_t count) {
+    Rex(false, 0, X64_NO_REG, r);
+    Byte(0xC1); ModRMReg(5, r); Byte(count);
+}
+
+void X64Emitter::TestRI(int r, uint32_t imm) {
+    Rex(false, 0, X64_NO_REG, r);
+    Byte(0xF7); ModRMReg(0, r);
+    Word32(imm);
+}
+
+void X64Emitter::TestMI8(const X64Mem& m, uint8_t imm) {
+    Rex(false, 0, m.index, m.base);
+    Byte(0xF6);
+    ModRM(0, m);
+    Byte(imm);
+}
+
+void X64Emitter::Setcc(X64Cond cc, int r) {
+    Rex(false, 0, X64_NO_REG, r, NeedsRexForByte(r));
+    Byte(0x0F); Byte((uint8_t)(0x90 | cc));
+    ModRMReg(0, r);
+}
+
+void X64Emitter::SetccM(X64Cond cc, const X64Mem& m) {
+    Rex(false, 0, m.index, m.base);
+    Byte(0x0F); Byte((uint8_t)(0x90 | cc));
+    ModRM(0, m);
+}
+
+void X64Emitter::Cmov(X64Cond cc, int dst, int src) {
+    Rex(false, dst, X64_NO_REG, src);
+    Byte(0x0F); Byte((uint8_t)(0x40 | cc));
+    ModRMReg(dst, src);
+}
+
+void X64Emitter::CmovM64(X64Cond cc, int dst, const X64Mem& m) {
+    Rex(true, dst, m.index, m.base);
+    Byte(0x0F); Byte((uint8_t)(0x40 | cc));
+    ModRM(dst, m);
+}
+
+uint8_t* X64Emitter::Jcc(X64Cond cc) {
+    Byte(0x0F); Byte((uint8_t)(0x80 | cc));
+    uint8_t* rel = ptr;
+    Word32(0);
+    return rel;
+}
+
+uint8_t* X64Emitter::Jmp() {
+    Byte(0xE9);
+    uint8_t* rel = ptr;
+    Word32(0);
+    return rel;
+}
+
+void X64Emitter::JccTo(X64Cond cc, const uint8_t* target) {
+    Patch(Jcc(cc), target);
+}
+
+void X64Emitter::JmpTo(const uint8_t* target) {
+    Patch(Jmp(), target);
+}
+
+void X64Emitter::Patch(uint8_t* rel32, const uint8_t* target) {
+    const int32_t rel = (int32_t)(target - (rel32 + 4));
+    std::memcpy(rel32, &rel, 4);
+}
+
+void X64Emitter::CallAbs(const void* fn) {
+    MovRI64(RAX, (uint64_t)(uintptr_t)fn);
+    Byte(0xFF); ModRMReg(2, RAX);
+}
+
+void X64Emitter::Push(int r) {
+    if (r >= 8) Byte(0x41);
+    Byte((uint8_t)(0x50 | (r & 7)));
+}
+
+void X64Emitter::Pop(int r) {
+    if (r >= 8) Byte(0x41);
+    Byte((uint8_t)(0x58 | (r & 7)));
+}
+
+} // namespace Dynarec
+
+#endif // DYNAREC_X64
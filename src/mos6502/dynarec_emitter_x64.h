@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// x86-64 instruction emitter for the host dynarec backend (dynarec_x64.cpp)
+// Only the encodings the block lowering needs: 32-bit ALU ops, byte and
+// word memory accesses, conditional jumps and a call to a C helper.
+
+namespace Dynarec {
+
+// x86-64 registers, by encoding
+enum X64Reg : int {
+    RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    X64_NO_REG = -1,
+};
+
+// Register allocation for 6502 state (SysV: all callee-saved, so they
+// survive a helper call)
+constexpr int X64_STATE = RBX;  // CpuState*
+constexpr int X64_RAM   = RBP;  // RAM base pointer
+constexpr int X64_A     = R12;  // 6502 accumulator
+constexpr int X64_X     = R13;  // 6502 X index
+constexpr int X64_Y     = R14;  // 6502 Y index
+constexpr int X64_NZ    = R15;  // lazy NZ word
+// Scratch: RAX, RCX, RDX, RSI, RDI (caller-saved)
+
+// Condition codes (Jcc/SETcc/CMOVcc low nibble)
+enum X64Cond : uint8_t {
+    CC_O  = 0x0,
+    CC_NO = 0x1,
+    CC_B  = 0x2,   // Below (CF set)
+    CC_AE = 0x3,   // Above or equal (CF clear)
+    CC_E  = 0x4,   // Equal (ZF set)
+    CC_NE = 0x5,   // Not equal (ZF clear)
+    CC_BE = 0x6,
+    CC_A  = 0x7,
+    CC_S  = 0x8,
+    CC_NS = 0x9,
+    CC_L  = 0xC,
+    CC_GE = 0xD,
+    CC_LE = 0xE,   // Signed less or equal
+    CC_G  = 0xF,
+};
+
+// ALU opcodes (the /digit of the 0x81 group)
+enum X64Alu : uint8_t {
+    ALU_ADD = 0,
+    ALU_OR  = 1,
+    ALU_AND = 4,
+    ALU_SUB = 5,
+    ALU_XOR = 6,
+    ALU_CMP = 7,
+};
+
+// Memory operand: [base + index + disp]. index may be X64_NO_REG.
+struct X64Mem {
+    int base;
+    int index;
+    int32_t disp;
+};
+
+inline X64Mem MemAt(int base, int32_t disp) { return { base, X64_NO_REG, disp }; }
+inline X64Mem MemAt(int base, int index, int32_t disp) { return { base, index, disp }; }
+
+class X64Emitter {
+public:
+    X64Emitter(uint8_t* buffer, size_t size);
+
+    uint8_t* ptr;
+    uint8_t* start;
+    size_t capacity;
+
+    bool CanEmit(size_t bytes) const { return (size_t)(ptr - start) + bytes <= capacity; }
+    size_t CurrentOffset() const { return ptr - start; }
+
+    void Byte(uint8_t b) { *ptr++ = b; }
+    void Word32(uint32_t w);
+
+    // Moves. 32-bit register writes zero the upper half, so the 6502
+    // registers can be used as 64-bit indexes.
+    void MovRR(int dst, int src);
+    void MovRI(int dst, uint32_t imm);
+    void MovRI64(int dst, uint64_t imm);
+    void Mov64(int dst, int src);
+    void Zext8(int dst, int src);               // movzx dst32, src8
+    void LoadU8(int dst, const X64Mem& m);      // movzx dst32, byte [m]
+    void Load32(int dst, const X64Mem& m);
+    void Load64(int dst, const X64Mem& m);
+    void Store8(int src, const X64Mem& m);
+    void Store16(int src, const X64Mem& m);
+    void Store32(int src, const X64Mem& m);
+    void StoreImm8(const X64Mem& m, uint8_t imm);
+    void StoreImm16(const X64Mem& m, uint16_t imm);
+    void Lea(int dst, const X64Mem& m);         // 32-bit result
+
+    // ALU
+    void AluRR(X64Alu op, int dst, int src);
+    void AluRI(X64Alu op, int dst, int32_t imm);
+    void AluRI64(X64Alu op, int dst, int32_t imm);
+    void AluMI8(X64Alu op, const X64Mem& m, uint8_t imm);    // byte [m]
+    void AluMI32(X64Alu op, const X64Mem& m, int32_t imm);   // dword [m]
+    void Shl(int r, uint8_t count);
+    void Shr(int r, uint8_t count);
+    void TestRI(int r, uint32_t imm);
+    void TestMI8(const X64Mem& m, uint8_t imm);
+    void Setcc(X64Cond cc, int r);              // r8 = cc
+    void SetccM(X64Cond cc, const X64Mem& m);   // byte [m] = cc
+    void Cmov(X64Cond cc, int dst, int src);
+    void CmovM64(X64Cond cc, int dst, const X64Mem& m);
+
+    // Control flow. The forward forms return the rel32 to Patch.
+    uint8_t* Jcc(X64Cond cc);
+    uint8_t* Jmp();
+    void JccTo(X64Cond cc, const uint8_t* target);
+    void JmpTo(const uint8_t* target);
+    static void Patch(uint8_t* rel32, const uint8_t* target);
+    void CallAbs(const void* fn);               // clobbers RAX
+    void Push(int r);
+    void Pop(int r);
+    void Ret() { Byte(0xC3); }
+
+private:
+    void Rex(bool w, int reg, int index, int base, bool byte_regs = false);
+    void ModRM(int reg, const X64Mem& m);
+    void ModRMReg(int reg, int rm) { Byte((uint8_t)(0xC0 | ((reg & 7) << 3) | (rm & 7))); }
+};
+
+} // namespace Dynarec
@@ -0,0 +1,926 @@
+#include "dynarec_ir.h"
+#include "bcd.h"
+
+namespace Dynarec {
+
+// ===== DECODING =====
+
+// The opcodes CompileInstruction knows how to lower. Anything else decodes
+// as IR_INVALID and ends the block before it, so add an opcode here when
+// adding its case there.
+struct IROpInfo {
+    uint8_t opcode;
+    uint8_t op;
+    uint8_t mode;
+    uint8_t reg;
+    uint8_t src;
+    uint8_t cycles;
+};
+
+static const IROpInfo op_list[] = {
+    // Loads
+    { 0xA9, IR_LOAD, IR_IMM,  IR_REG_A, IR_REG_NONE, 2 },
+    { 0xA5, IR_LOAD, IR_ZP,   IR_REG_A, IR_REG_NONE, 3 },
+    { 0xB5, IR_LOAD, IR_ZPX,  IR_REG_A, IR_REG_NONE, 4 },
+    { 0xAD, IR_LOAD, IR_ABS,  IR_REG_A, IR_REG_NONE, 4 },
+    { 0xBD, IR_LOAD, IR_ABSX, IR_REG_A, IR_REG_NONE, 4 },
+    { 0xB9, IR_LOAD, IR_ABSY, IR_REG_A, IR_REG_NONE, 4 },
+    { 0xB1, IR_LOAD, IR_INDY, IR_REG_A, IR_REG_NONE, 5 },
+    { 0xA2, IR_LOAD, IR_IMM,  IR_REG_X, IR_REG_NONE, 2 },
+    { 0xA6, IR_LOAD, IR_ZP,   IR_REG_X, IR_REG_NONE, 3 },
+    { 0xB6, IR_LOAD, IR_ZPY,  IR_REG_X, IR_REG_NONE, 4 },
+    { 0xAE, IR_LOAD, IR_ABS,  IR_REG_X, IR_REG_NONE, 4 },
+    { 0xA0, IR_LOAD, IR_IMM,  IR_REG_Y, IR_REG_NONE, 2 },
+    { 0xA4, IR_LOAD, IR_ZP,   IR_REG_Y, IR_REG_NONE, 3 },
+    { 0xB4, IR_LOAD, IR_ZPX,  IR_REG_Y, IR_REG_NONE, 4 },
+    { 0xAC, IR_LOAD, IR_ABS,  IR_REG_Y, IR_REG_NONE, 4 },
+    // Stores
+    { 0x85, IR_STORE, IR_ZP,   IR_REG_A, IR_REG_NONE, 3 },
+    { 0x95, IR_STORE, IR_ZPX,  IR_REG_A, IR_REG_NONE, 4 },
+    { 0x8D, IR_STORE, IR_ABS,  IR_REG_A, IR_REG_NONE, 4 },
+    { 0x9D, IR_STORE, IR_ABSX, IR_REG_A, IR_REG_NONE, 5 },
+    { 0x99, IR_STORE, IR_ABSY, IR_REG_A, IR_REG_NONE, 5 },
+    { 0x91, IR_STORE, IR_INDY, IR_REG_A, IR_REG_NONE, 6 },
+    { 0x86, IR_STORE, IR_ZP,   IR_REG_X, IR_REG_NONE, 3 },
+    { 0x8E, IR_STORE, IR_ABS,  IR_REG_X, IR_REG_NONE, 4 },
+    { 0x84, IR_STORE, IR_ZP,   IR_REG_Y, IR_REG_NONE, 3 },
+    { 0x8C, IR_STORE, IR_ABS,  IR_REG_Y, IR_REG_NONE, 4 },
+    // Transfers
+    { 0xAA, IR_TRANSFER, IR_IMP, IR_REG_X, IR_REG_A, 2 },
+    { 0xA8, IR_TRANSFER, IR_IMP, IR_REG_Y, IR_REG_A, 2 },
+    { 0x8A, IR_TRANSFER, IR_IMP, IR_REG_A, IR_REG_X, 2 },
+    { 0x98, IR_TRANSFER, IR_IMP, IR_REG_A, IR_REG_Y, 2 },
+    { 0x9A, IR_TRANSFER, IR_IMP, IR_REG_S, IR_REG_X, 2 },
+    { 0xBA, IR_TRANSFER, IR_IMP, IR_REG_X, IR_REG_S, 2 },
+    // Increment/decrement
+    { 0xE8, IR_INC, IR_IMP, IR_REG_X,   IR_REG_NONE, 2 },
+    { 0xC8, IR_INC, IR_IMP, IR_REG_Y,   IR_REG_NONE, 2 },
+    { 0xCA, IR_DEC, IR_IMP, IR_REG_X,   IR_REG_NONE, 2 },
+    { 0x88, IR_DEC, IR_IMP, IR_REG_Y,   IR_REG_NONE, 2 },
+    { 0xE6, IR_INC, IR_ZP,  IR_REG_MEM, IR_REG_NONE, 5 },
+    { 0xEE, IR_INC, IR_ABS, IR_REG_MEM, IR_REG_NONE, 6 },
+    { 0xC6, IR_DEC, IR_ZP,  IR_REG_MEM, IR_REG_NONE, 5 },
+    { 0xCE, IR_DEC, IR_ABS, IR_REG_MEM, IR_REG_NONE, 6 },
+    // Logic
+    { 0x29, IR_AND, IR_IMM, IR_REG_A, IR_REG_NONE, 2 },
+    { 0x25, IR_AND, IR_ZP,  IR_REG_A, IR_REG_NONE, 3 },
+    { 0x2D, IR_AND, IR_ABS, IR_REG_A, IR_REG_NONE, 4 },
+    { 0x09, IR_ORA, IR_IMM, IR_REG_A, IR_REG_NONE, 2 },
+    { 0x05, IR_ORA, IR_ZP,  IR_REG_A, IR_REG_NONE, 3 },
+    { 0x0D, IR_ORA, IR_ABS, IR_REG_A, IR_REG_NONE, 4 },
+    { 0x49, IR_EOR, IR_IMM, IR_REG_A, IR_REG_NONE, 2 },
+    { 0x45, IR_EOR, IR_ZP,  IR_REG_A, IR_REG_NONE, 3 },
+    { 0x4D, IR_EOR, IR_ABS, IR_REG_A, IR_REG_NONE, 4 },
+    // Arithmetic
+    { 0x69, IR_ADC, IR_IMM, IR_REG_A, IR_REG_NONE, 2 },
+    { 0x65, IR_ADC, IR_ZP,  IR_REG_A, IR_REG_NONE, 3 },
+    { 0x6D, IR_ADC, IR_ABS, IR_REG_A, IR_REG_NONE, 4 },
+    { 0xE9, IR_SBC, IR_IMM, IR_REG_A, IR_REG_NONE, 2 },
+    { 0xE5, IR_SBC, IR_ZP,  IR_REG_A, IR_REG_NONE, 3 },
+    { 0xED, IR_SBC, IR_ABS, IR_REG_A, IR_REG_NONE, 4 },
+    // Compare
+    { 0xC9, IR_CMP, IR_IMM, IR_REG_A, IR_REG_NONE, 2 },
+    { 0xC5, IR_CMP, IR_ZP,  IR_REG_A, IR_REG_NONE, 3 },
+    { 0xCD, IR_CMP, IR_ABS, IR_REG_A, IR_REG_NONE, 4 },
+    { 0xE0, IR_CMP, IR_IMM, IR_REG_X, IR_REG_NONE, 2 },
+    { 0xE4, IR_CMP, IR_ZP,  IR_REG_X, IR_REG_NONE, 3 },
+    { 0xC0, IR_CMP, IR_IMM, IR_REG_Y, IR_REG_NONE, 2 },
+    { 0xC4, IR_CMP, IR_ZP,  IR_REG_Y, IR_REG_NONE, 3 },
+    // Shifts
+    { 0x0A, IR_ASL, IR_IMP, IR_REG_A,   IR_REG_NONE, 2 },
+    { 0x4A, IR_LSR, IR_IMP, IR_REG_A,   IR_REG_NONE, 2 },
+    { 0x2A, IR_ROL, IR_IMP, IR_REG_A,   IR_REG_NONE, 2 },
+    { 0x6A, IR_ROR, IR_IMP, IR_REG_A,   IR_REG_NONE, 2 },
+    { 0x06, IR_ASL, IR_ZP,  IR_REG_MEM, IR_REG_NONE, 5 },
+    { 0x46, IR_LSR, IR_ZP,  IR_REG_MEM, IR_REG_NONE, 5 },
+    { 0x26, IR_ROL, IR_ZP,  IR_REG_MEM, IR_REG_NONE, 5 },
+    { 0x66, IR_ROR, IR_ZP,  IR_REG_MEM, IR_REG_NONE, 5 },
+    // Branches
+    { 0x10, IR_BRANCH, IR_REL, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0x30, IR_BRANCH, IR_REL, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0x50, IR_BRANCH, IR_REL, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0x70, IR_BRANCH, IR_REL, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0x90, IR_BRANCH, IR_REL, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0xB0, IR_BRANCH, IR_REL, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0xD0, IR_BRANCH, IR_REL, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0xF0, IR_BRANCH, IR_REL, IR_REG_NONE, IR_REG_NONE, 2 },
+    // Control
+    { 0x4C, IR_JMP, IR_ABS, IR_REG_NONE, IR_REG_NONE, 3 },
+    { 0x6C, IR_JMP_IND, IR_ABS, IR_REG_NONE, IR_REG_NONE, 5 },
+    { 0x7C, IR_JMP_IND, IR_ABSX, IR_REG_NONE, IR_REG_NONE, 6 },
+    { 0x20, IR_JSR, IR_ABS, IR_REG_NONE, IR_REG_NONE, 6 },
+    { 0x60, IR_RTS, IR_IMP, IR_REG_NONE, IR_REG_NONE, 6 },
+    { 0xEA, IR_NOP, IR_IMP, IR_REG_NONE, IR_REG_NONE, 2 },
+    // Stack
+    { 0x48, IR_PUSH, IR_IMP, IR_REG_A, IR_REG_NONE, 3 },
+    { 0x08, IR_PUSH, IR_IMP, IR_REG_P, IR_REG_NONE, 3 },
+    { 0x68, IR_PULL, IR_IMP, IR_REG_A, IR_REG_NONE, 4 },
+    { 0x28, IR_PULL, IR_IMP, IR_REG_P, IR_REG_NONE, 4 },
+    // Status flags
+    { 0x18, IR_FLAG, IR_IMP, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0x38, IR_FLAG, IR_IMP, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0xB8, IR_FLAG, IR_IMP, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0xD8, IR_FLAG, IR_IMP, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0xF8, IR_FLAG, IR_IMP, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0x58, IR_FLAG, IR_IMP, IR_REG_NONE, IR_REG_NONE, 2 },
+    { 0x78, IR_FLAG, IR_IMP, IR_REG_NONE, IR_REG_NONE, 2 },
+};
+
+static IROpInfo op_table[256];
+static bool op_table_ready = false;
+
+static void BuildOpTable() {
+    for (const IROpInfo& info : op_list) op_table[info.opcode] = info;
+    op_table_ready = true;
+}
+
+static inline bool IsIO(uint16_t addr) { return addr >= 0x2000 && addr < 0x8000; }
+
+static inline uint8_t ModeLength(uint8_t mode) {
+    switch (mode) {
+    case IR_IMP:  return 1;
+    case IR_ABS:
+    case IR_ABSX:
+    case IR_ABSY: return 3;
+    default:      return 2;
+    }
+}
+
+static inline uint8_t RegBit(uint8_t reg) {
+    return reg <= IR_REG_S ? (uint8_t)(1 << reg) : 0;
+}
+
+static inline uint8_t IndexReg(uint8_t mode) {
+    switch (mode) {
+    case IR_ZPX:
+    case IR_ABSX: return IR_REG_X;
+    case IR_ZPY:
+    case IR_ABSY:
+    case IR_INDY: return IR_REG_Y;
+    default:      return IR_REG_NONE;
+    }
+}
+
+// Registers and flags an instruction reads and writes
+static void SetUsesDefs(IRInst& in) {
+    uint8_t uses = RegBit(IndexReg(in.mode));
+    uint8_t defs = 0;
+    const uint8_t r = RegBit(in.reg);
+    switch (in.op) {
+    case IR_LOAD:     defs = r | IR_NZ; break;
+    case IR_STORE:    uses |= r; break;
+    case IR_TRANSFER: uses |= RegBit(in.src); defs = r | (in.reg != IR_REG_S ? IR_NZ : 0); break;
+    case IR_INC:
+    case IR_DEC:      uses |= r; defs = r | IR_NZ; break;
+    case IR_AND:
+    case IR_ORA:
+    case IR_EOR:      uses |= IR_A; defs = IR_A | IR_NZ; break;
+    case IR_ADC:
+    case IR_SBC:      uses |= IR_A | IR_C | IR_DI; defs = IR_A | IR_NZ | IR_C | IR_V; break;
+    case IR_CMP:      uses |= r; defs = IR_NZ | IR_C; break;
+    case IR_ROL:
+    case IR_ROR:      uses |= IR_C; // fall through
+    case IR_ASL:
+    case IR_LSR:      uses |= r; defs = r | IR_NZ | IR_C; break;
+    case IR_BRANCH:
+        switch (in.opcode) {
+        case 0x90: case 0xB0: uses = IR_C; break;
+        case 0x50: case 0x70: uses = IR_V; break;
+        default:              uses = IR_NZ; break;
+        }
+        break;
+    case IR_JSR:
+    case IR_RTS:      uses = IR_S; defs = IR_S; break;
+    case IR_PUSH:
+        uses = IR_S | (in.reg == IR_REG_A ? IR_A : IR_NZ | IR_C | IR_V | IR_DI);
+        defs = IR_S;
+        break;
+    case IR_PULL:
+        uses = IR_S;
+        defs = IR_S | (in.reg == IR_REG_A ? IR_A | IR_NZ : IR_NZ | IR_C | IR_V | IR_DI);
+        break;
+    case IR_FLAG:
+        switch (in.opcode) {
+        case 0x18: case 0x38: defs = IR_C; break;
+        case 0xB8:            defs = IR_V; break;
+        default:              defs = IR_DI; break;
+        }
+        break;
+    default:
+        break;
+    }
+    in.uses = uses;
+    in.defs = defs;
+}
+
+// Whether the lowering can handle this instruction's static address; the
+// same conditions CompileInstruction bails on.
+static bool CanLowerAccess(const IRInst& in) {
+    const bool rmw = in.reg == IR_REG_MEM;
+    const bool writes = in.op == IR_STORE || rmw;
+    if (in.op == IR_JMP_IND) {
+        // Both pointer bytes, for any X, in RAM or in one ROM window. The
+        // NMOS page wrap of the high byte is not compiled.
+#ifndef CMOS_INDIRECT_JMP_FIX
+        if (in.mode == IR_ABSX || (in.operand & 0xFF) == 0xFF) return false;
+#endif
+        const uint32_t base = in.operand;
+        const uint32_t span = in.mode == IR_ABSX ? 0x100 : 1;
+        if (base < 0x2000) return base + span < 0x2000;
+        if (base < 0x8000) return false;
+        return (base & 0x3FFF) + span < 0x4000;
+    }
+    switch (in.mode) {
+    case IR_ABS:
+        if (in.op == IR_JMP || in.op == IR_JSR) return true;
+        if (IsIO(in.operand)) return !rmw;
+        return !writes || in.operand < 0x2000;
+    case IR_ABSX:
+    case IR_ABSY: {
+        const uint32_t base = in.operand;
+        if (base < 0x2000) return base + 0xFF < 0x2000;
+        if (base < 0x8000) return !rmw && base + 0xFF < 0x8000;
+        if (writes) return false;
+        return (base & 0x3FFF) + 0xFF < 0x4000;
+    }
+    default:
+        return true;
+    }
+}
+
+// Whether an access can hit I/O, and so goes through the bus helpers. An
+// indexed one that can lies wholly inside $2000-$7FFF (CanLowerAccess).
+static bool MayAccessIO(const IRInst& in) {
+    switch (in.mode) {
+    case IR_ABS:  return IsIO(in.operand) && in.op != IR_JMP && in.op != IR_JSR;
+    case IR_ABSX:
+    case IR_ABSY: return IsIO(in.operand);
+    case IR_INDY: return true;
+    default:      return false;
+    }
+}
+
+// Whether a store (or read-modify-write) can land on RAM that may hold
+// compiled code, and so needs a code-write check after it
+static bool MayWriteCode(const IRInst& in) {
+#if DYNAREC_RAM_CODE
+    if (in.op != IR_STORE && in.reg != IR_REG_MEM) return false;
+    switch (in.mode) {
+    case IR_ABS:  return in.operand >= RAM_CODE_START && in.operand < RAM_CODE_END;
+    case IR_ABSX:
+    case IR_ABSY: return in.operand + 0xFF >= RAM_CODE_START && in.operand < RAM_CODE_END;
+    case IR_INDY: return true;
+    default:      return false;
+    }
+#else
+    (void)in;
+    return false;
+#endif
+}
+
+static BranchCount branch_profile[BRANCH_PROFILE_SIZE];
+
+BranchCount* BranchCounter(uint16_t pc) {
+    BranchCount& c = branch_profile[(pc ^ (pc >> 8)) & (BRANCH_PROFILE_SIZE - 1)];
+    if (c.pc != pc) {
+        c.pc = pc;
+        c.taken = c.not_taken = 0;
+    }
+    return &c;
+}
+
+// Which side of the branch at pc a trace follows: 1 taken, -1 not taken,
+// 0 neither (too few samples, or no side taken three times in four)
+static int BranchBias(uint16_t pc) {
+    const BranchCount& c = branch_profile[(pc ^ (pc >> 8)) & (BRANCH_PROFILE_SIZE - 1)];
+    const uint32_t total = c.taken + c.not_taken;
+    if (c.pc != pc || total < BRANCH_PROFILE_MIN) return 0;
+    if (c.taken * 4 >= total * 3) return 1;
+    if (c.not_taken * 4 >= total * 3) return -1;
+    return 0;
+}
+
+// Whether pc is in the block, inlined leaf code aside
+static bool InBlock(const IRBlock& block, uint16_t pc) {
+    for (int i = 0; i < block.count; i++) {
+        if (block.inst[i].pc == pc && !(block.inst[i].flags & IR_F_INLINED)) return true;
+    }
+    return false;
+}
+
+// Whether the block may go on at target: its map only holds it while its
+// own region's code is mapped (RAM, the banked window, or the fixed one,
+// which is always mapped)
+static bool InRegion(const IRBlock& block, uint16_t target) {
+    const uint16_t start = block.start_pc;
+    if (!(start & 0x8000)) return target >= RAM_CODE_START && target < RAM_CODE_END;
+    return (target & 0x8000) && (!(start & 0x4000) || (target & 0x4000));
+}
+
+static bool TraceMayFollow(const IRBlock& block, uint16_t target) {
+    return InRegion(block, target) && !InBlock(block, target);
+}
+
+// Instructions in the subroutine at pc, its RTS included, if it is a leaf
+// that can be inlined (DecodeBlock); 0 if not. Nothing it does may touch
+// the return address its RTS pops.
+static int LeafLength(uint16_t pc, uint8_t (*fetch)(uint16_t)) {
+    for (int n = 1; n <= LEAF_MAX_INSTRUCTIONS; n++) {
+        if (IsIO(pc)) return 0;
+        const IROpInfo& info = op_table[fetch(pc)];
+        IRInst in = IRInst();
+        in.op = info.op;
+        in.mode = info.mode;
+        in.reg = info.reg;
+        in.length = ModeLength(info.mode);
+        if (in.length == 2) in.operand = fetch(pc + 1);
+        else if (in.length == 3) in.operand = fetch(pc + 1) | (fetch(pc + 2) << 8);
+        switch (in.op) {
+        case IR_RTS:
+            return n;
+        case IR_INVALID:
+        case IR_BRANCH:
+        case IR_JMP:
+        case IR_JMP_IND:
+        case IR_JSR:
+        case IR_PUSH:
+        case IR_PULL:
+            return 0;
+        case IR_TRANSFER:
+            if (in.reg == IR_REG_S) return 0;  // TXS
+            break;
+        default:
+            break;
+        }
+        if (!CanLowerAccess(in)) return 0;
+        if (in.op == IR_STORE || in.reg == IR_REG_MEM) {
+            switch (in.mode) {
+            case IR_ABS:  if ((in.operand >> 8) == 0x01) return 0; break;
+            case IR_ABSX:
+            case IR_ABSY: if (in.operand < 0x200 && in.operand + 0xFF >= 0x100) return 0; break;
+            case IR_INDY: return 0;
+            default:      break;
+            }
+        }
+        pc += in.length;
+    }
+    return 0;
+}
+
+void DecodeBlock(IRBlock& block, uint16_t pc, uint8_t (*fetch)(uint16_t), bool trace) {
+    if (!op_table_ready) BuildOpTable();
+
+    block.count = 0;
+    block.start_pc = pc;
+    block.ends = false;
+    int cycles = 0;
+    int leaf_left = 0;        // Instructions of an inlined leaf still to come
+    uint16_t leaf_return = 0;
+
+    while (block.count < MAX_BLOCK_SIZE && cycles < MAX_BLOCK_CYCLES) {
+        if (IsIO(pc)) break;
+        if (trace && !leaf_left && InBlock(block, pc)) break;
+        const uint8_t opcode = fetch(pc);
+        const IROpInfo& info = op_table[opcode];
+        if (info.op == IR_INVALID) break;
+
+        IRInst& in = block.inst[block.count];
+        in = IRInst();
+        in.pc = pc;
+        in.opcode = opcode;
+        in.op = info.op;
+        in.mode = info.mode;
+        in.reg = info.reg;
+        in.src = info.src;
+        in.length = ModeLength(info.mode);
+        in.cycles = info.cycles;
+        in.value_reg = IR_REG_NONE;
+        if (in.length == 2) {
+            in.operand = fetch(pc + 1);
+        } else if (in.length == 3) {
+            in.operand = fetch(pc + 1) | (fetch(pc + 2) << 8);
+        }
+        if (in.mode == IR_REL) in.operand = (uint16_t)(pc + 2 + (int8_t)in.operand);
+        in.addr = in.operand;
+        if (!CanLowerAccess(in)) break;
+        if (MayAccessIO(in)) in.flags |= IR_F_IO;
+        if (in.mode == IR_INDY && in.op == IR_STORE) in.flags |= IR_F_MAY_EXIT;
+        if (MayWriteCode(in)) in.flags |= IR_F_CODE_WRITE;
+        SetUsesDefs(in);
+
+        block.count++;
+        pc += in.length;
+        cycles += in.cycles;
+
+        if (leaf_left) {
+            in.flags |= IR_F_INLINED;
+            leaf_left--;
+            if (in.op == IR_RTS) {
+                in.flags |= IR_F_TRACE_TAKEN;
+                in.operand = in.addr = leaf_return;
+                pc = leaf_return;
+                continue;
+            }
+        }
+
+        if (in.op == IR_BRANCH) {
+            // A branch back into the block loops in place; any other ends it
+            bool back_edge = false;
+            if (in.operand < pc) {
+                back_edge = InBlock(block, in.operand);
+            }
+            if (back_edge) {
+                in.flags |= IR_F_BACK_EDGE;
+                cycles++;
+                continue;
+            }
+            // A trace goes on along a forward branch's hot side (either
+            // side of a backward one that leaves the block)
+            const int bias = trace ? BranchBias(in.pc) : 0;
+            if (bias > 0 && in.operand > in.pc && TraceMayFollow(block, in.operand)) {
+                in.flags |= IR_F_SIDE_EXIT | IR_F_TRACE_TAKEN;
+                pc = in.operand;
+                cycles++;
+                continue;
+            }
+            if (bias < 0) {
+                in.flags |= IR_F_SIDE_EXIT;
+                continue;
+            }
+            block.ends = true;
+            break;
+        }
+        if (in.op == IR_JSR && InRegion(block, in.operand)) {
+            const int leaf = LeafLength(in.operand, fetch);
+            if (leaf && block.count + leaf <= MAX_BLOCK_SIZE) {
+                in.flags |= IR_F_TRACE_TAKEN;
+                leaf_left = leaf;
+                leaf_return = pc;
+                pc = in.operand;
+                continue;
+            }
+        }
+        if (trace && (in.op == IR_JMP || in.op == IR_JSR) && TraceMayFollow(block, in.operand)) {
+            in.flags |= IR_F_TRACE_TAKEN;
+            pc = in.operand;
+            continue;
+        }
+        if (in.op == IR_JMP || in.op == IR_JMP_IND || in.op == IR_JSR || in.op == IR_RTS) {
+            block.ends = true;
+            break;
+        }
+    }
+    block.end_pc = pc;
+}
+
+void SourceSpan(const IRBlock& block, uint16_t& lo, uint16_t& end) {
+    uint32_t first = 0x10000, last = 0;
+    for (int i = 0; i < block.count; i++) {
+        const IRInst& in = block.inst[i];
+        if (in.pc < first) first = in.pc;
+        if (in.pc + in.length > last) last = in.pc + in.length;
+    }
+    lo = (uint16_t)first;
+    end = (uint16_t)last;
+}
+
+void TruncateBlock(IRBlock& block, int count) {
+    if (count >= block.count) return;
+    block.end_pc = block.inst[count].pc;
+    block.count = count;
+    block.ends = false;
+}
+
+// ===== PASSES =====
+
+static inline bool IsStatic(const IRInst& in) {
+    return in.mode == IR_ZP || (in.mode == IR_ABS && in.op != IR_JMP && in.op != IR_JSR) ||
+           (in.flags & IR_F_INDEX_KNOWN);
+}
+
+// Mark instructions an in-block branch lands on. Facts from the straight-line
+// passes below do not survive past one.
+static void MarkBranchTargets(IRBlock& block) {
+    for (int i = 0; i < block.count; i++) {
+        const IRInst& in = block.inst[i];
+        if (!(in.flags & IR_F_BACK_EDGE)) continue;
+        for (int j = 0; j <= i; j++) {
+            if (block.inst[j].pc == in.operand && !(block.inst[j].flags & IR_F_INLINED)) {
+                block.inst[j].flags |= IR_F_BRANCH_TARGET;
+                break;
+            }
+        }
+    }
+}
+
+// Track constant A/X/Y through immediate loads, transfers, INX/DEX and
+// immediate logic ops. An indexed access with a known index gets its
+// effective address, so the lowering can address it directly.
+static void PropagateConstants(IRBlock& block) {
+    int known[3] = { -1, -1, -1 };
+    for (int i = 0; i < block.count; i++) {
+        IRInst& in = block.inst[i];
+        if (in.flags & IR_F_BRANCH_TARGET) known[0] = known[1] = known[2] = -1;
+
+        const uint8_t index = IndexReg(in.mode);
+        if (index != IR_REG_NONE && in.mode != IR_INDY && known[index] >= 0) {
+            in.flags |= IR_F_INDEX_KNOWN;
+            in.index = (uint8_t)known[index];
+            if (in.mode == IR_ZPX || in.mode == IR_ZPY) {
+                in.addr = (in.operand + in.index) & 0xFF;
+            } else {
+                in.addr = (uint16_t)(in.operand + in.index);
+                if (in.op != IR_JMP_IND && ((in.addr ^ in.operand) & 0xFF00)) in.cycles++;
+            }
+        }
+
+        const int r = in.reg <= IR_REG_Y ? in.reg : -1;
+        if (in.op == IR_LOAD && in.mode == IR_IMM) {
+            known[r] = in.operand;
+        } else if (in.op == IR_TRANSFER && r >= 0) {
+            known[r] = in.src <= IR_REG_Y ? known[in.src] : -1;
+        } else if ((in.op == IR_INC || in.op == IR_DEC) && r >= 0) {
+            if (known[r] >= 0) known[r] = (known[r] + (in.op == IR_INC ? 1 : -1)) & 0xFF;
+        } else if (in.mode == IR_IMM && known[IR_REG_A] >= 0 &&
+                   (in.op == IR_AND || in.op == IR_ORA || in.op == IR_EOR)) {
+            if (in.op == IR_AND) known[IR_REG_A] &= in.operand;
+            else if (in.op == IR_ORA) known[IR_REG_A] |= in.operand;
+            else known[IR_REG_A] ^= in.operand;
+        } else {
+            for (int q = 0; q < 3; q++) {
+                if (in.defs & (1 << q)) known[q] = -1;
+            }
+        }
+    }
+}
+
+// Redundant load/store elimination. holds[r] is a RAM address known to
+// contain the value of A/X/Y: a load from it becomes a register move and a
+// store of the same register back to it goes away.
+static void ForwardMemory(IRBlock& block) {
+    int holds[3] = { -1, -1, -1 };
+    auto kill = [&holds](int lo, int hi) {
+        for (int q = 0; q < 3; q++) {
+            if (holds[q] >= lo && holds[q] <= hi) holds[q] = -1;
+        }
+    };
+    // Addresses a dynamic write may hit
+    auto kill_dynamic = [&kill](const IRInst& in) {
+        if (in.mode == IR_ZPX || in.mode == IR_ZPY) kill(0x00, 0xFF);
+        else if (in.mode == IR_ABSX || in.mode == IR_ABSY) kill(in.operand, in.operand + 0xFF);
+        else kill(0x0000, 0xFFFF);
+    };
+
+    for (int i = 0; i < block.count; i++) {
+        IRInst& in = block.inst[i];
+        if (in.flags & IR_F_BRANCH_TARGET) holds[0] = holds[1] = holds[2] = -1;
+
+        const bool ram = IsStatic(in) && in.addr < 0x2000;
+        const int r = in.reg <= IR_REG_Y ? in.reg : -1;
+        switch (in.op) {
+        case IR_LOAD:
+            if (ram) {
+                for (int q = 0; q < 3; q++) {
+                    if (holds[q] == in.addr) {
+                        in.flags |= IR_F_LOAD_FORWARD;
+                        in.value_reg = (uint8_t)q;
+                        break;
+                    }
+                }
+            }
+            holds[r] = ram ? in.addr : -1;
+            break;
+        case IR_STORE:
+            if (ram) {
+                if (holds[r] == in.addr) {
+                    in.flags |= IR_F_STORE_REDUNDANT;
+                } else {
+                    kill(in.addr, in.addr);
+                    holds[r] = in.addr;
+                }
+            } else {
+                kill_dynamic(in);
+            }
+            break;
+        case IR_TRANSFER:
+            if (r >= 0) holds[r] = in.src <= IR_REG_Y ? holds[in.src] : -1;
+            break;
+        case IR_PUSH:
+        case IR_JSR:
+            kill(0x100, 0x1FF);
+            break;
+        default:
+            if (in.reg == IR_REG_MEM) {
+                if (IsStatic(in)) kill(in.addr, in.addr);
+                else kill_dynamic(in);
+            }
+            for (int q = 0; q < 3; q++) {
+                if (in.defs & (1 << q)) holds[q] = -1;
+            }
+            break;
+        }
+    }
+}
+
+// Backward liveness over the block. Everything is live where the block can
+// be left (its end, any branch, an instruction that may bail out, a store
+// whose code-write check or an I/O access that may leave after it) since
+// the next block or the interpreter may read it. ExecuteIR leaves before
+// I/O, so that counts as an exit before it too.
+static void ComputeLiveness(IRBlock& block) {
+    uint8_t live = IR_ALL;
+    for (int i = block.count - 1; i >= 0; i--) {
+        IRInst& in = block.inst[i];
+        if (in.op == IR_BRANCH || (in.flags & (IR_F_CODE_WRITE | IR_F_IO))) live = IR_ALL;
+        in.live_out = live;
+        if ((in.defs & IR_NZ) && !(live & IR_NZ)) in.flags |= IR_F_NZ_DEAD;
+        if ((in.defs & IR_C) && !(live & IR_C)) in.flags |= IR_F_C_DEAD;
+        if ((in.defs & IR_V) && !(live & IR_V)) in.flags |= IR_F_V_DEAD;
+        live = (uint8_t)((live & ~in.defs) | in.uses);
+        if (in.flags & (IR_F_MAY_EXIT | IR_F_IO)) live = IR_ALL;
+    }
+}
+
+void RunPasses(IRBlock& block, uint8_t tier) {
+    for (int i = 0; i < block.count; i++) {
+        IRInst& in = block.inst[i];
+        in.flags &= IR_F_BACK_EDGE | IR_F_MAY_EXIT | IR_F_CODE_WRITE | IR_F_IO | IR_F_SIDE_EXIT | IR_F_TRACE_TAKEN |
+                    IR_F_INLINED;
+        in.addr = in.operand;
+        in.cycles = op_table[in.opcode].cycles;
+        in.index = 0;
+        in.value_reg = IR_REG_NONE;
+    }
+    MarkBranchTargets(block);
+    if (tier == TIER_OPTIMIZED) {
+        PropagateConstants(block);
+        ForwardMemory(block);
+    }
+    ComputeLiveness(block);
+}
+
+int BlockBudget(const IRBlock& block) {
+    int budget = 0;
+    for (int i = 0; i < block.count; i++) {
+        const IRInst& in = block.inst[i];
+        budget += in.cycles;
+        if (MayCrossPage(in)) budget++;
+        if (in.op == IR_ADC || in.op == IR_SBC) budget++;
+    }
+    return budget;
+}
+
+// ===== HOST INTERPRETER =====
+
+static inline uint8_t ReadByte(const CpuState* s, uint16_t addr) {
+    if (addr < 0x2000) return s->ram[addr];
+    return (addr & 0x4000) ? s->rom_hi[addr & 0x3FFF] : s->rom_lo[addr & 0x3FFF];
+}
+
+static inline uint8_t* RegPtr(CpuState* s, uint8_t reg) {
+    switch (reg) {
+    case IR_REG_X: return &s->X;
+    case IR_REG_Y: return &s->Y;
+    case IR_REG_S: return &s->sp;
+    default:       return &s->A;
+    }
+}
+
+static uint16_t EffectiveAddress(const IRInst& in, const CpuState* s) {
+    if (in.flags & IR_F_INDEX_KNOWN) return in.addr;
+    switch (in.mode) {
+    case IR_ZPX:  return (in.operand + s->X) & 0xFF;
+    case IR_ZPY:  return (in.operand + s->Y) & 0xFF;
+    case IR_ABSX: return (uint16_t)(in.operand + s->X);
+    case IR_ABSY: return (uint16_t)(in.operand + s->Y);
+    case IR_INDY: {
+        const uint16_t ptr = s->ram[in.operand] | (s->ram[(in.operand + 1) & 0xFF] << 8);
+        return (uint16_t)(ptr + s->Y);
+    }
+    default:      return in.addr;
+    }
+}
+
+int ExecuteIR(const IRBlock& block, CpuState* s) {
+    int cycles = 0;
+    uint16_t exit_pc = block.end_pc;
+    int i = 0;
+
+    // The block runs only while the budget covers a pass over all of it
+    const int budget = BlockBudget(block);
+    if (s->cycles_remaining < budget) {
+        exit_pc = block.start_pc;
+        i = block.count;
+    }
+
+    while (i < block.count) {
+        const IRInst& in = block.inst[i];
+        const uint16_t next = in.pc + in.length;
+        const bool nz_live = !(in.flags & IR_F_NZ_DEAD);
+        const bool c_live = !(in.flags & IR_F_C_DEAD);
+        const bool v_live = !(in.flags & IR_F_V_DEAD);
+        const uint16_t addr = EffectiveAddress(in, s);
+
+        // No bus here: leave before I/O, and before a (zp),Y store to ROM
+        // as compiled code does
+        if (((in.flags & IR_F_IO) && IsIO(addr)) || (in.mode == IR_INDY && in.op == IR_STORE && addr >= 0x8000)) {
+            exit_pc = in.pc;
+            break;
+        }
+        cycles += in.cycles;
+        if (MayCrossPage(in) && (addr & 0xFF) < (in.mode == IR_ABSX ? s->X : s->Y)) cycles++;
+
+        uint8_t m = 0;
+        if (in.mode == IR_IMM) {
+            m = (uint8_t)in.operand;
+        } else if (in.flags & IR_F_LOAD_FORWARD) {
+            m = *RegPtr(s, in.value_reg);
+        } else if (in.mode != IR_IMP && in.mode != IR_REL && in.op != IR_STORE &&
+                   in.op != IR_JMP && in.op != IR_JMP_IND && in.op != IR_JSR) {
+            m = ReadByte(s, addr);
+        }
+        uint8_t* reg = RegPtr(s, in.reg);
+        if (in.reg == IR_REG_MEM) reg = &m;
+
+        bool left = false;
+        switch (in.op) {
+        case IR_LOAD:
+            *reg = m;
+            if (nz_live) s->flag_nz = m;
+            break;
+        case IR_STORE:
+            if (!(in.flags & IR_F_STORE_REDUNDANT)) s->ram[addr] = *reg;
+            break;
+        case IR_TRANSFER:
+            *reg = *RegPtr(s, in.src);
+            if (in.reg != IR_REG_S && nz_live) s->flag_nz = *reg;
+            break;
+        case IR_INC:
+        case IR_DEC:
+            *reg = (uint8_t)(*reg + (in.op == IR_INC ? 1 : -1));
+            if (in.reg == IR_REG_MEM) s->ram[addr] = m;
+            if (nz_live) s->flag_nz = *reg;
+            break;
+        case IR_AND:
+        case IR_ORA:
+        case IR_EOR:
+            if (in.op == IR_AND) s->A &= m;
+            else if (in.op == IR_ORA) s->A |= m;
+            else s->A ^= m;
+            if (nz_live) s->flag_nz = s->A;
+            break;
+        case IR_ADC:
+        case IR_SBC: {
+            uint32_t r;
+            if (s->status & 0x08) {
+                r = in.op == IR_ADC ? BCD_ADC(s->A, m, s->flag_c) : BCD_SBC(s->A, m, s->flag_c);
+                if (v_live) s->flag_v = (r & BCD_RESULT_OVERFLOW) ? 1 : 0;
+                cycles++;
+            } else {
+                const uint8_t operand = in.op == IR_ADC ? m : (uint8_t)~m;
+                r = s->A + operand + s->flag_c;
+                if (v_live) s->flag_v = (~(s->A ^ operand) & (s->A ^ r) & 0x80) ? 1 : 0;
+            }
+            s->A = (uint8_t)r;
+            if (c_live) s->flag_c = (r >> 8) & 1;
+            if (nz_live) s->flag_nz = s->A;
+            break;
+        }
+        case IR_CMP:
+            if (nz_live) s->flag_nz = (uint8_t)(*reg - m);
+            if (c_live) s->flag_c = *reg >= m;
+            break;
+        case IR_ASL:
+        case IR_LSR:
+        case IR_ROL:
+        case IR_ROR: {
+            const uint8_t v = *reg;
+            if (in.op == IR_ASL) *reg = (uint8_t)(v << 1);
+            else if (in.op == IR_LSR) *reg = v >> 1;
+            else if (in.op == IR_ROL) *reg = (uint8_t)((v << 1) | s->flag_c);
+            else *reg = (uint8_t)((v >> 1) | (s->flag_c << 7));
+            if (c_live) s->flag_c = (in.op == IR_ASL || in.op == IR_ROL) ? v >> 7 : v & 1;
+            if (in.reg == IR_REG_MEM) s->ram[addr] = m;
+            if (nz_live) s->flag_nz = *reg;
+            break;
+        }
+        case IR_BRANCH: {
+            const bool z = (s->flag_nz & 0xFF) == 0;
+            const bool n = (s->flag_nz & 0x180) != 0;
+            bool taken;
+            switch (in.opcode) {
+            case 0x10: taken = !n; break;
+            case 0x30: taken = n; break;
+            case 0x50: taken = !s->flag_v; break;
+            case 0x70: taken = s->flag_v; break;
+            case 0x90: taken = !s->flag_c; break;
+            case 0xB0: taken = s->flag_c; break;
+            case 0xD0: taken = !z; break;
+            default:   taken = z; break;
+            }
+            if (taken) cycles += ((next ^ in.operand) & 0xFF00) ? 2 : 1;
+            if (in.flags & IR_F_SIDE_EXIT) {
+                // On the trace's side the next instruction is the next one
+                if (taken != ((in.flags & IR_F_TRACE_TAKEN) != 0)) {
+                    exit_pc = taken ? in.operand : next;
+                    left = true;
+                }
+                break;
+            }
+            if (!taken) {
+                if (!(in.flags & IR_F_BACK_EDGE)) { exit_pc = next; left = true; }
+                break;
+            }
+            if (!(in.flags & IR_F_BACK_EDGE) || s->cycles_remaining - cycles < budget) {
+                exit_pc = in.operand;
+                left = true;
+                break;
+            }
+            for (int j = 0; j <= i; j++) {
+                if (block.inst[j].pc == in.operand && !(block.inst[j].flags & IR_F_INLINED)) { i = j - 1; break; }
+            }
+            break;
+        }
+        case IR_JMP:
+            if (in.flags & IR_F_TRACE_TAKEN) break;
+            exit_pc = in.operand;
+            left = true;
+            break;
+        case IR_JMP_IND:
+            exit_pc = ReadByte(s, addr) | (ReadByte(s, (uint16_t)(addr + 1)) << 8);
+            left = true;
+            break;
+        case IR_JSR: {
+            const uint16_t ret = next - 1;
+            s->ram[0x100 + s->sp] = ret >> 8;
+            s->sp--;
+            s->ram[0x100 + s->sp] = ret & 0xFF;
+            s->sp--;
+            if (in.flags & IR_F_TRACE_TAKEN) break;
+            exit_pc = in.operand;
+            left = true;
+            break;
+        }
+        case IR_RTS: {
+            if (in.flags & IR_F_TRACE_TAKEN) {
+                // Inlined: the stack holds the JSR's return address
+                s->sp += 2;
+                break;
+            }
+            s->sp++;
+            uint16_t ret = s->ram[0x100 + s->sp];
+            s->sp++;
+            ret |= s->ram[0x100 + s->sp] << 8;
+            exit_pc = ret + 1;
+            left = true;
+            break;
+        }
+        case IR_PUSH: {
+            uint8_t v = s->A;
+            if (in.reg == IR_REG_P) {
+                v = s->status | s->flag_c | (s->flag_v << 6) | 0x30;
+                if ((s->flag_nz & 0xFF) == 0) v |= 0x02;
+                if (s->flag_nz & 0x180) v |= 0x80;
+            }
+            s->ram[0x100 + s->sp] = v;
+            s->sp--;
+            break;
+        }
+        case IR_PULL: {
+            s->sp++;
+            const uint8_t v = s->ram[0x100 + s->sp];
+            if (in.reg == IR_REG_A) {
+                s->A = v;
+                if (nz_live) s->flag_nz = v;
+            } else {
+                s->status = (v & 0x3C) | 0x20;
+                s->flag_c = v & 0x01;
+                s->flag_v = (v >> 6) & 0x01;
+                s->flag_nz = (v & 0x80) ? ((v & 0x02) ? 0x100 : 0x80) : ((v & 0x02) ? 0x00 : 0x01);
+            }
+            break;
+        }
+        case IR_FLAG:
+            switch (in.opcode) {
+            case 0x18: if (c_live) s->flag_c = 0; break;
+            case 0x38: if (c_live) s->flag_c = 1; break;
+            case 0xB8: if (v_live) s->flag_v = 0; break;
+            case 0xD8: s->status &= ~0x08; break;
+            case 0xF8: s->status |= 0x08; break;
+            case 0x58: s->status &= ~0x04; break;
+            case 0x78: s->status |= 0x04; break;
+            }
+            break;
+        default:
+            break;
+        }
+        if (left) break;
+        i++;
+    }
+
+    s->pc = exit_pc;
+    s->cycles_remaining -= cycles;
+    return cycles;
+}
+
+} // namespace Dynarec
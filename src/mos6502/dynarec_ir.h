@@ -0,0 +1,202 @@
+#pragma once
+#include <cstdint>
+#include "cpu_state.h"
+#include "dynarec.h"
+
+// Block IR for the 6502 dynarec
+//
+// CompileBlock decodes a block into one IRInst per 6502 instruction, runs
+// the passes below over it, then lowers each IRInst to ARM. The passes only
+// annotate: an instruction keeps its opcode and operand, and the IR_F_*
+// flags tell the lowering what it may leave out. ExecuteIR runs a block the
+// same way on the host, annotations included, so the passes can be checked
+// against the interpreter without an ARM target.
+
+namespace Dynarec {
+
+// Operation classes. The opcode picks the exact variant (which flag a
+// branch tests, which flag CLC..SEI touch).
+enum IROp : uint8_t {
+    IR_INVALID = 0,  // Not compiled; decoding stops here
+    IR_LOAD,         // reg = M
+    IR_STORE,        // M = reg
+    IR_TRANSFER,     // reg = src
+    IR_INC,          // reg or M += 1
+    IR_DEC,          // reg or M -= 1
+    IR_AND,
+    IR_ORA,
+    IR_EOR,
+    IR_ADC,
+    IR_SBC,
+    IR_CMP,          // reg - M, flags only
+    IR_ASL,          // reg or M
+    IR_LSR,
+    IR_ROL,
+    IR_ROR,
+    IR_BRANCH,       // operand = target
+    IR_JMP,
+    IR_JMP_IND,      // JMP (abs), JMP (abs,X): operand = pointer; leaves for the PC it holds
+    IR_JSR,
+    IR_RTS,
+    IR_PUSH,         // reg: A or P
+    IR_PULL,
+    IR_FLAG,         // CLC/SEC/CLV/CLD/SED/CLI/SEI
+    IR_NOP,
+};
+
+enum IRMode : uint8_t {
+    IR_IMP,          // Implied, or the register in reg (INX, ASL A)
+    IR_IMM,
+    IR_ZP,
+    IR_ZPX,
+    IR_ZPY,
+    IR_ABS,
+    IR_ABSX,
+    IR_ABSY,
+    IR_INDY,         // (zp),Y
+    IR_REL,
+};
+
+// Operand registers (IRInst::reg, src, value_reg)
+enum IRReg : uint8_t {
+    IR_REG_A,
+    IR_REG_X,
+    IR_REG_Y,
+    IR_REG_S,
+    IR_REG_P,        // PHP/PLP
+    IR_REG_MEM,      // Read-modify-write on memory
+    IR_REG_NONE = 0xFF,
+};
+
+// Register and flag sets (IRInst::uses, defs, live_out)
+enum : uint8_t {
+    IR_A  = 1 << 0,
+    IR_X  = 1 << 1,
+    IR_Y  = 1 << 2,
+    IR_S  = 1 << 3,
+    IR_NZ = 1 << 4,
+    IR_C  = 1 << 5,
+    IR_V  = 1 << 6,
+    IR_DI = 1 << 7,  // D and I, in CpuState::status
+    IR_ALL = 0xFF,
+};
+
+// Annotations (IRInst::flags)
+enum : uint16_t {
+    IR_F_BRANCH_TARGET  = 1 << 0,  // An in-block branch lands here
+    IR_F_BACK_EDGE      = 1 << 1,  // Branch back to an earlier instruction; not an exit
+    IR_F_MAY_EXIT       = 1 << 2,  // Can leave the block before executing (runtime I/O check)
+    IR_F_INDEX_KNOWN    = 1 << 3,  // X/Y is the constant in index; addr is the effective address
+    IR_F_LOAD_FORWARD   = 1 << 4,  // value_reg already holds M; no memory access needed
+    IR_F_STORE_REDUNDANT = 1 << 5, // M already holds reg; the store can go
+    IR_F_NZ_DEAD        = 1 << 6,  // N/Z result is overwritten before anything reads it
+    IR_F_C_DEAD         = 1 << 7,  // Likewise the carry
+    IR_F_V_DEAD         = 1 << 8,  // Likewise overflow
+    IR_F_CODE_WRITE     = 1 << 9,  // Store that may hit compiled RAM code; may leave the block after it
+    IR_F_IO             = 1 << 10, // May access I/O through the bus helpers; may leave the block after it
+    IR_F_SIDE_EXIT      = 1 << 11, // Trace branch: leaves the block on one side, the trace goes on along the other
+    IR_F_TRACE_TAKEN    = 1 << 12, // The trace goes on at operand (branch taken, JSR or JMP followed, RTS inlined)
+    IR_F_INLINED        = 1 << 13, // In an inlined leaf subroutine; never a branch target
+};
+
+struct IRInst {
+    uint16_t pc;
+    uint16_t operand;      // Immediate, address, or branch target
+    uint16_t addr;         // Effective address, when known at compile time
+    uint8_t opcode;
+    uint8_t op;            // IROp
+    uint8_t mode;          // IRMode
+    uint8_t reg;           // IRReg read or written
+    uint8_t src;           // IR_TRANSFER: source IRReg
+    uint8_t length;
+    uint8_t cycles;        // Base cycles (branches: not taken), with a known index's page crossing
+    uint8_t uses;          // IR_A.. read
+    uint8_t defs;          // IR_A.. written
+    uint8_t live_out;      // IR_A.. read later (after the passes)
+    uint16_t flags;        // IR_F_*
+    uint8_t value_reg;     // IR_F_LOAD_FORWARD: register holding M
+    uint8_t index;         // IR_F_INDEX_KNOWN: value of the index register
+};
+
+struct IRBlock {
+    IRInst inst[MAX_BLOCK_SIZE];
+    int count;
+    uint16_t start_pc;
+    uint16_t end_pc;       // PC after the last instruction
+    bool ends;             // Last instruction leaves the block itself (branch/JMP/JSR/RTS)
+};
+
+// Decode the block at pc. Stops after an instruction that leaves the block,
+// before anything the lowering cannot handle (unknown opcode, a static
+// write to ROM, read-modify-write on I/O), or at the block size/cycle
+// limits. I/O accesses are compiled as calls to IoRead/IoWrite (IR_F_IO).
+//
+// With trace set (TIER_OPTIMIZED) the block is a superblock instead: it
+// goes on through JSR into the callee, through JMP, and past any branch
+// with a clear bias in the branch profile along the hot side, the cold
+// side becoming a side exit. inst[] is then in execution order and need
+// not be contiguous. A trace stays in the region it started in (RAM, or
+// ROM where the banked window may run into the fixed one but not back)
+// and never comes back to an instruction it already holds.
+//
+// Either way a JSR to a short leaf subroutine (LEAF_MAX_INSTRUCTIONS, no
+// branches, jumps or stack access, no store that could reach page 1) is
+// inlined: the JSR still pushes its return address, the callee's
+// instructions follow it (IR_F_INLINED) and its RTS, knowing what it will
+// pop, only moves SP and goes on at the return address (operand).
+void DecodeBlock(IRBlock& block, uint16_t pc, uint8_t (*fetch)(uint16_t), bool trace = false);
+constexpr int LEAF_MAX_INSTRUCTIONS = 16;  // RTS included
+
+// The 6502 bytes the block was decoded from all lie in [lo, end); end is
+// 0 for code running up to $FFFF. A trace may skip some in between.
+void SourceSpan(const IRBlock& block, uint16_t& lo, uint16_t& end);
+
+// Branch profile. Baseline blocks count which way the branch that ends
+// them goes; traces follow a branch only once it has a clear bias.
+// Direct-mapped by branch PC, so a collision (or the same PC in another
+// bank) only costs a worse trace.
+struct BranchCount {
+    uint16_t pc;
+    uint32_t taken;
+    uint32_t not_taken;
+};
+constexpr int BRANCH_PROFILE_SIZE = 256;
+constexpr uint32_t BRANCH_PROFILE_MIN = 4;  // Samples before a branch has a bias
+
+// The counters of the branch at pc, cleared if another branch had them
+BranchCount* BranchCounter(uint16_t pc);
+
+// Drop instructions from index count on; the block then falls through to
+// the PC of the first one dropped. Rerun RunPasses afterwards.
+void TruncateBlock(IRBlock& block, int count);
+
+// Annotate the block: branch targets, constant X/Y propagation, load/store
+// forwarding and N/Z, C and V liveness. Safe to run again after TruncateBlock.
+// TIER_BASELINE runs only the linear ones (branch targets, liveness).
+void RunPasses(IRBlock& block, uint8_t tier = TIER_OPTIMIZED);
+
+// An indexed access (abs,X, abs,Y, (zp),Y; not JMP (abs,X)) takes a cycle
+// more when the index carries into the high byte. With the index known,
+// PropagateConstants adds it to cycles; otherwise the lowering checks for
+// it after the access and charges it to cycles_remaining.
+inline bool MayCrossPage(const IRInst& in) {
+    return (in.mode == IR_ABSX || in.mode == IR_ABSY || in.mode == IR_INDY) &&
+           in.op != IR_JMP_IND && !(in.flags & IR_F_INDEX_KNOWN);
+}
+
+// Cycles one pass over the block may take: its base cycles and every cycle
+// a page crossing or a decimal-mode ADC/SBC can add. Compiled code runs a
+// block (or goes round an in-block loop again) only while cycles_remaining
+// covers this, so it never runs past the deadline.
+int BlockBudget(const IRBlock& block);
+
+// Host IR interpreter: run the block on state (memory through state->ram,
+// rom_lo and rom_hi, as compiled code does) honouring the annotations.
+// It has no bus: the block is left before an access that hits I/O.
+// Charges its cycles to state->cycles_remaining and returns them. Like
+// compiled code it runs only while cycles_remaining covers one pass over
+// the block: short of that it leaves on entry, or at an in-block loop's
+// back edge.
+int ExecuteIR(const IRBlock& block, CpuState* state);
+
+} // namespace Dynarec
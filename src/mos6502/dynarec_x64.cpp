@@ -0,0 +1,1147 @@
+#include "dynarec.h"
+
+#if DYNAREC_X64
+
+#include "dynarec_emitter_x64.h"
+#include "dynarec_ir.h"
+#include "bcd.h"
+#include <sys/mman.h>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+
+// x86-64 host backend. Blocks are decoded and annotated by dynarec_ir.cpp
+// exactly as for the ARM backend, then lowered here one IRInst at a time.
+// A compiled block is a SysV function taking the CpuState*: it keeps A, X,
+// Y and the lazy N/Z word in callee-saved registers, S, C and V in
+// CpuState, and returns to RunDynarec at every exit (no block linking).
+
+// #define DYNAREC_DEBUG  // Uncomment to enable dynarec logging
+
+#ifdef DYNAREC_DEBUG
+static void DebugLog(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+#else
+#define DebugLog(...) ((void)0)
+#endif
+
+// External 6502 state and memory
+extern uint8_t* cached_ram_ptr;
+extern uint8_t* cached_rom_lo_ptr;
+extern uint8_t* cached_rom_hi_ptr;
+extern uint16_t cached_rom_linear_mask;
+extern uint8_t loadedRomType;
+
+namespace Dynarec {
+
+// Host memory is plentiful: one big code cache, collected as a whole when
+// it fills, and a flat PC -> block map per window.
+static constexpr size_t X64_CODE_SIZE = 4 * 1024 * 1024;
+static constexpr size_t X64_MAX_BLOCK_BYTES = MAX_BLOCK_SIZE * 256 + 256;
+static constexpr int X64_BLOCK_POOL_SIZE = 16384;
+static constexpr int X64_BANK_MAP_SLOTS = 64;
+static constexpr int WINDOW_SIZE = 0x4000;
+
+static Block block_pool[X64_BLOCK_POOL_SIZE];
+static int block_pool_used = 0;
+
+// fixed_map for $C000-$FFFF, one bank map per bank seen at $8000-$BFFF,
+// ram_map for RAM code
+struct WindowMap { Block* entries[WINDOW_SIZE]; };
+static WindowMap fixed_map;
+static WindowMap ram_map;
+static WindowMap* bank_maps[X64_BANK_MAP_SLOTS];
+static uint32_t bank_map_tag[X64_BANK_MAP_SLOTS];
+static int bank_maps_used = 0;
+static int bank_maps_allocated = 0;
+static uint32_t code_bank = 0;
+static WindowMap* window_maps[2];       // [0]: map of code_bank, [1]: fixed_map
+
+// Code cache. It is mapped read+execute except while CompileBlock writes
+// to it, so it is never writable and executable at the same time.
+static uint8_t* code_buffer = nullptr;
+static uint8_t* code_ptr = nullptr;
+
+// Blocks compiled from RAM, oldest first, and how many cover each page
+static Block* ram_blocks[RAM_BLOCK_SLOTS];
+static int ram_block_count = 0;
+uint8_t ram_code_pages[RAM_CODE_PAGES];
+
+// RAM PCs whose blocks were dropped by code writes, direct-mapped
+static constexpr int REWRITE_TABLE_SIZE = 64;
+static uint16_t rewrite_pc[REWRITE_TABLE_SIZE];
+static uint8_t rewrite_count[REWRITE_TABLE_SIZE];
+
+// 16KB windows of the Flash2M image blocks have been compiled from since
+// InvalidateAll, one bit each (as dynarec.cpp)
+static uint32_t rom_code_windows[4];
+
+static Stats stats = {};
+
+static void ResetBlockMaps();
+static void ResetRamCode();
+
+static void ProtectCode(bool writable) {
+    mprotect(code_buffer, X64_CODE_SIZE, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC));
+}
+
+void Init() {
+    if (!code_buffer) {
+        void* p = mmap(nullptr, X64_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            DebugLog("DR: mmap of %zu byte code cache failed\n", X64_CODE_SIZE);
+            return;
+        }
+        code_buffer = (uint8_t*)p;
+        ProtectCode(false);
+    }
+    block_pool_used = 0;
+    code_ptr = code_buffer;
+    ResetBlockMaps();
+    ResetRamCode();
+    stats = {};
+    stats.compile_bytes_total = X64_CODE_SIZE;
+    DebugLog("DR: x86-64 dynarec code cache at %p (%zu bytes)\n", code_buffer, X64_CODE_SIZE);
+}
+
+void Shutdown() {
+    if (code_buffer) munmap(code_buffer, X64_CODE_SIZE);
+    code_buffer = nullptr;
+    code_ptr = nullptr;
+    for (int i = 0; i < bank_maps_allocated; i++) delete bank_maps[i];
+    bank_maps_allocated = bank_maps_used = 0;
+}
+
+static inline uint32_t BlockBank(uint16_t pc) {
+    if (!(pc & 0x8000)) return RAM_BANK;
+    return (pc & 0x4000) ? FIXED_BANK : code_bank;
+}
+
+static inline Block** MapEntry(uint16_t pc) {
+    WindowMap* map = (pc & 0x8000) ? window_maps[(pc >> 14) & 1] : &ram_map;
+    return &map->entries[pc & 0x3FFF];
+}
+
+static inline Block* FindBlock(uint16_t pc) {
+    if (pc < 0x8000 && pc >= RAM_CODE_END) return nullptr;
+    return *MapEntry(pc);
+}
+
+static bool SelectBankMap(uint32_t bank) {
+    for (int i = 0; i < bank_maps_used; i++) {
+        if (bank_map_tag[i] == bank) {
+            window_maps[0] = bank_maps[i];
+            return true;
+        }
+    }
+    if (bank_maps_used >= X64_BANK_MAP_SLOTS) return false;
+    const int slot = bank_maps_used++;
+    if (slot == bank_maps_allocated) bank_maps[bank_maps_allocated++] = new WindowMap();
+    std::memset(bank_maps[slot], 0, sizeof(WindowMap));
+    bank_map_tag[slot] = bank;
+    window_maps[0] = bank_maps[slot];
+    return true;
+}
+
+// Maps stay allocated; they are cleared when handed to a bank again
+static void ResetBlockMaps() {
+    std::memset(&fixed_map, 0, sizeof(fixed_map));
+    std::memset(&ram_map, 0, sizeof(ram_map));
+    window_maps[1] = &fixed_map;
+    bank_maps_used = 0;
+    SelectBankMap(code_bank);
+}
+
+static inline bool InCodeCache(const void* p) {
+    return code_buffer && p >= code_buffer && p < code_buffer + X64_CODE_SIZE;
+}
+
+// Fetch a byte from ROM/RAM at compile time (as dynarec.cpp)
+static uint8_t FetchByteAt(uint16_t addr) {
+    if (addr >= 0x8000) {
+        if (loadedRomType == 3 || loadedRomType == 4) {
+            return (addr & 0x4000)
+                ? cached_rom_hi_ptr[addr & 0x3FFF]
+                : cached_rom_lo_ptr[addr & 0x3FFF];
+        }
+        return cached_rom_lo_ptr[addr & cached_rom_linear_mask];
+    } else if (addr < 0x2000) {
+        return cached_ram_ptr[addr];
+    }
+    return 0; // I/O or unmapped
+}
+
+// PCs whose first instruction does not decode get a map entry pointing
+// here, so they are not decoded again until the next InvalidateAll
+static Block fail_block;
+
+// Add delta to the count of each page the source of RAM block b covers
+static void CountRamPages(const Block& b, int delta) {
+    const int last = (b.src_end - 1) >> 8;
+    for (int page = b.src_lo >> 8; page <= last && page < RAM_CODE_PAGES; page++) {
+        ram_code_pages[page] = (uint8_t)(ram_code_pages[page] + delta);
+    }
+}
+
+static void ResetRamCode() {
+    ram_block_count = 0;
+    // The micro-op cache's pages are its own to clear (SetUopPages)
+    for (uint8_t& count : ram_code_pages) count &= RAM_PAGE_UOP;
+}
+
+// Note the image windows holding the first and last byte of ROM block b
+static void MarkRomWindows(const Block& b) {
+    const uint16_t last = b.src_end > b.src_lo ? (uint16_t)(b.src_end - 1) : 0xFFFF;
+    const uint32_t first_window = RomOffset(b.src_lo, b.bank) >> 14;
+    const uint32_t last_window = RomOffset(last, b.bank) >> 14;
+    rom_code_windows[first_window >> 5] |= 1u << (first_window & 31);
+    rom_code_windows[last_window >> 5] |= 1u << (last_window & 31);
+}
+
+// Whether ROM block b was compiled from any of image bytes [lo, hi)
+static bool BlockReadsRom(const Block& b, uint32_t lo, uint32_t hi) {
+    const uint32_t end = b.src_end > b.src_lo ? b.src_end : 0x10000;
+    for (uint32_t pc = b.src_lo; pc < end; pc = (pc | 0x3FFF) + 1) {
+        const uint32_t window_end = (pc | 0x3FFF) + 1;
+        const uint32_t start = RomOffset((uint16_t)pc, b.bank);
+        const uint32_t stop = start + ((end < window_end ? end : window_end) - pc);
+        if (start < hi && stop > lo) return true;
+    }
+    return false;
+}
+
+// Take a block out of the map. Nothing links to blocks here, so its code
+// and pool slot are just left behind until the cache is next started over.
+static void DropBlock(Block* b) {
+    *b->map_entry = nullptr;
+    b->code = nullptr;
+    if (b->bank != RAM_BANK) return;
+    for (int i = 0; i < ram_block_count; i++) {
+        if (ram_blocks[i] != b) continue;
+        std::memmove(&ram_blocks[i], &ram_blocks[i + 1], (ram_block_count - i - 1) * sizeof(Block*));
+        ram_block_count--;
+        CountRamPages(*b, -1);
+        return;
+    }
+}
+
+// Drop a RAM block whose source was overwritten. One rewritten
+// RAM_REWRITE_LIMIT times gets the fail_block entry: compiling it again
+// would cost more than it saves.
+static void DropRewrittenBlock(Block* b) {
+    const uint16_t pc = b->pc;
+    const int i = (pc ^ (pc >> 6)) & (REWRITE_TABLE_SIZE - 1);
+    if (rewrite_pc[i] != pc) {
+        rewrite_pc[i] = pc;
+        rewrite_count[i] = 0;
+    }
+    Block** entry = b->map_entry;
+    DropBlock(b);
+    if (++rewrite_count[i] >= RAM_REWRITE_LIMIT) *entry = &fail_block;
+}
+
+bool NoteCodeWrite(uint16_t addr) {
+    if (ram_code_pages[addr >> 8] & RAM_PAGE_UOP) uop_page_written = true;
+    bool dropped = false;
+    for (int i = 0; i < ram_block_count; ) {
+        Block* b = ram_blocks[i];
+        if (addr >= b->src_lo && addr < b->src_end) {
+            DropRewrittenBlock(b);  // Takes it off ram_blocks
+            dropped = true;
+        } else {
+            i++;
+        }
+    }
+    return dropped;
+}
+
+void InvalidateRamCode() {
+    for (int i = 0; i < ram_block_count; i++) {
+        *ram_blocks[i]->map_entry = nullptr;
+        ram_blocks[i]->code = nullptr;
+        stats.blocks_invalidated++;
+    }
+    ResetRamCode();
+}
+
+// Clear the fail_block entries of map, which holds window base..base+3FFF
+// of the image, for PCs whose first instruction reads any of [lo, hi)
+static void ClearFailedEntries(WindowMap* map, uint32_t base, uint32_t lo, uint32_t hi) {
+    const uint32_t from = lo > base + 2 ? lo - 2 : base;
+    const uint32_t to = hi < base + WINDOW_SIZE ? hi : base + WINDOW_SIZE;
+    for (uint32_t at = from; at < to; at++) {
+        Block*& entry = map->entries[at - base];
+        if (entry == &fail_block) entry = nullptr;
+    }
+}
+
+void InvalidateRomRange(uint32_t lo, uint32_t hi) {
+    if (lo >= hi) return;
+
+    for (uint32_t w = lo >> 14; w <= (hi - 1) >> 14; w++) {
+        const uint32_t base = w << 14;
+        if (base == 0x1FC000) ClearFailedEntries(&fixed_map, base, lo, hi);
+        for (int i = 0; i < bank_maps_used; i++) {
+            if ((bank_map_tag[i] & 0x7F) == w) ClearFailedEntries(bank_maps[i], base, lo, hi);
+        }
+    }
+
+    bool compiled = false;
+    for (uint32_t w = lo >> 14; w <= (hi - 1) >> 14 && !compiled; w++) {
+        compiled = (rom_code_windows[w >> 5] >> (w & 31)) & 1;
+    }
+    if (!compiled) return;
+    for (int i = 0; i < block_pool_used; i++) {
+        Block& b = block_pool[i];
+        if (!b.code || b.bank == RAM_BANK || !BlockReadsRom(b, lo, hi)) continue;
+        DropBlock(&b);
+        stats.blocks_invalidated++;
+    }
+}
+
+// Decimal-mode call targets (see bcd.h): A, operand, carry and the
+// CpuState* in the SysV argument registers. Returns A | carry << 8; V goes
+// straight to state->flag_v and the extra decimal cycle off
+// cycles_remaining, as on ARM.
+static uint32_t DecimalADC(uint32_t a, uint32_t m, uint32_t carry, CpuState* state) {
+    const uint32_t r = BCD_ADC(a, m, carry);
+    state->flag_v = (r & BCD_RESULT_OVERFLOW) ? 1 : 0;
+    state->cycles_remaining--;
+    return r & 0x1FF;
+}
+
+static uint32_t DecimalSBC(uint32_t a, uint32_t m, uint32_t carry, CpuState* state) {
+    const uint32_t r = BCD_SBC(a, m, carry);
+    state->flag_v = (r & BCD_RESULT_OVERFLOW) ? 1 : 0;
+    state->cycles_remaining--;
+    return r & 0x1FF;
+}
+
+// ===== LOWERING =====
+
+static const int x64_reg[3] = { X64_A, X64_X, X64_Y };
+
+static inline X64Mem StateField(int offset) { return MemAt(X64_STATE, offset); }
+
+// Lowering state for one block. Cycles are counted at compile time and
+// charged to cycles_remaining in one SUB wherever the block can be left,
+// and before each in-block branch target so a loop iteration charges its
+// own cycles; a page crossing is charged on the spot (EmitPageCrossCheck).
+// The block runs only while cycles_remaining covers budget, the most one
+// pass over it can take (BlockBudget): it is checked on entry and at each
+// back edge, and a block that would overrun the deadline leaves instead
+// (the interpreter then runs up to it exactly).
+struct Lowering {
+    X64Emitter* emit;
+    const IRBlock* ir;
+    int pending;                                // Cycles run but not charged yet
+    int budget;
+    bool profile;                               // Count which way the final branch goes (TIER_BASELINE)
+    uint8_t* label[MAX_BLOCK_SIZE];             // Code of each instruction
+    uint8_t* exit_jumps[MAX_BLOCK_SIZE * 3 + 2];  // JMPs to the shared epilogue
+    int exit_count;
+};
+
+static void ChargeCycles(Lowering& lw, int cycles) {
+    if (cycles > 0) lw.emit->AluMI32(ALU_SUB, StateField(CS_CYCLES_REM), cycles);
+}
+
+// Leave the block for exit_pc, charging cycles
+static void EmitExit(Lowering& lw, uint16_t exit_pc, int cycles) {
+    lw.emit->StoreImm16(StateField(CS_PC), exit_pc);
+    ChargeCycles(lw, cycles);
+    lw.exit_jumps[lw.exit_count++] = lw.emit->Jmp();
+}
+
+static void EmitPrologue(X64Emitter& e) {
+    e.Push(RBX); e.Push(RBP); e.Push(R12); e.Push(R13); e.Push(R14); e.Push(R15);
+    e.AluRI64(ALU_SUB, RSP, 8);  // Keep RSP 16-byte aligned for helper calls
+    e.Mov64(X64_STATE, RDI);
+    e.Load64(X64_RAM, StateField(CS_RAM));
+    e.LoadU8(X64_A, StateField(CS_A));
+    e.LoadU8(X64_X, StateField(CS_X));
+    e.LoadU8(X64_Y, StateField(CS_Y));
+    e.Load32(X64_NZ, StateField(CS_NZ));
+}
+
+static void EmitEpilogue(X64Emitter& e) {
+    e.Store8(X64_A, StateField(CS_A));
+    e.Store8(X64_X, StateField(CS_X));
+    e.Store8(X64_Y, StateField(CS_Y));
+    e.Store32(X64_NZ, StateField(CS_NZ));
+    e.AluRI64(ALU_ADD, RSP, 8);
+    e.Pop(R15); e.Pop(R14); e.Pop(R13); e.Pop(R12); e.Pop(RBP); e.Pop(RBX);
+    e.Ret();
+}
+
+static inline bool IsStaticAccess(const IRInst& in) {
+    return in.mode == IR_ZP || in.mode == IR_ABS || (in.flags & IR_F_INDEX_KNOWN);
+}
+
+static inline int IndexReg(const IRInst& in) {
+    return (in.mode == IR_ZPX || in.mode == IR_ABSX) ? X64_X : X64_Y;
+}
+
+// Operand of a static read. ROM goes through scratch, which gets the
+// window pointer.
+static X64Mem StaticReadMem(X64Emitter& e, uint16_t addr, int scratch) {
+    if (addr < 0x2000) return MemAt(X64_RAM, addr);
+    e.Load64(scratch, StateField((addr & 0x4000) ? CS_ROM_HI : CS_ROM_LO));
+    return MemAt(scratch, addr & 0x3FFF);
+}
+
+// Operand of a read in any mode but (zp),Y. Clobbers RCX, RDX.
+static X64Mem ReadMem(X64Emitter& e, const IRInst& in) {
+    if (IsStaticAccess(in)) return StaticReadMem(e, in.addr, RDX);
+    if (in.mode == IR_ZPX || in.mode == IR_ZPY) {
+        e.Lea(RCX, MemAt(IndexReg(in), in.operand));
+        e.Zext8(RCX, RCX);
+        return MemAt(X64_RAM, RCX, 0);
+    }
+    // abs,X/abs,Y: the decoder only lets the indexed range stay inside RAM
+    // or inside one ROM window
+    const uint16_t base = in.operand;
+    if (base < 0x2000) return MemAt(X64_RAM, IndexReg(in), base);
+    e.Load64(RDX, StateField((base & 0x4000) ? CS_ROM_HI : CS_ROM_LO));
+    return MemAt(RDX, IndexReg(in), base & 0x3FFF);
+}
+
+// Operand of a write (always RAM). (zp),Y expects its address in RAX.
+// Clobbers RCX.
+static X64Mem WriteMem(X64Emitter& e, const IRInst& in) {
+    if (IsStaticAccess(in)) return MemAt(X64_RAM, in.addr);
+    switch (in.mode) {
+    case IR_ZPX:
+    case IR_ZPY:
+        e.Lea(RCX, MemAt(IndexReg(in), in.operand));
+        e.Zext8(RCX, RCX);
+        return MemAt(X64_RAM, RCX, 0);
+    case IR_INDY:
+        return MemAt(X64_RAM, RAX, 0);
+    default:
+        return MemAt(X64_RAM, IndexReg(in), in.operand);
+    }
+}
+
+// I/O through IoRead/IoWrite (dynarec.h) on the block's CpuState, address
+// in RSI, passing the cycles run before this instruction. LowerInstruction
+// follows the instruction with an exit check (IR_F_IO).
+//
+// The access can raise an IRQ there and then (ScheduleIRQ(0)), which
+// pushes pc and P straight away: the PC of the next instruction and the
+// N/Z word go to CpuState first, C and V being there already.
+static void EmitIoSpill(Lowering& lw, const IRInst& in) {
+    X64Emitter& e = *lw.emit;
+    e.StoreImm16(StateField(CS_PC), in.pc + in.length);
+    e.Store32(X64_NZ, StateField(CS_NZ));
+}
+
+static void EmitIoRead(Lowering& lw, const IRInst& in, int dst) {
+    X64Emitter& e = *lw.emit;
+    EmitIoSpill(lw, in);
+    e.Mov64(RDI, X64_STATE);
+    e.MovRI(RDX, lw.pending - in.cycles);
+    e.CallAbs((const void*)&IoRead);
+    if (dst != RAX) e.MovRR(dst, RAX);
+}
+
+static void EmitIoWrite(Lowering& lw, const IRInst& in, int src) {
+    X64Emitter& e = *lw.emit;
+    EmitIoSpill(lw, in);
+    e.Mov64(RDI, X64_STATE);
+    e.MovRR(RDX, src);
+    e.MovRI(RCX, lw.pending - in.cycles);
+    e.CallAbs((const void*)&IoWrite);
+}
+
+// Address of an I/O access other than (zp),Y into RSI: static, or an
+// index range wholly inside $2000-$7FFF
+static void EmitIoAddress(X64Emitter& e, const IRInst& in) {
+    if (IsStaticAccess(in)) e.MovRI(RSI, in.addr);
+    else e.Lea(RSI, MemAt(IndexReg(in), in.operand));
+}
+
+// (zp),Y: effective address into RAX, leaving the block before the
+// instruction when a store's pointer hits ROM. It is also kept in the
+// frame's alignment slot at [RSP] for EmitPageCrossCheck, since an I/O
+// call loses RAX.
+static void EmitIndirectAddress(Lowering& lw, const IRInst& in) {
+    X64Emitter& e = *lw.emit;
+    e.LoadU8(RAX, MemAt(X64_RAM, in.operand));
+    e.LoadU8(RCX, MemAt(X64_RAM, (in.operand + 1) & 0xFF));
+    e.Shl(RCX, 8);
+    e.AluRR(ALU_OR, RAX, RCX);
+    e.AluRR(ALU_ADD, RAX, X64_Y);
+    e.AluRI(ALU_AND, RAX, 0xFFFF);
+    e.Store32(RAX, MemAt(RSP, 0));
+    if (in.op != IR_STORE) return;
+    e.AluRI(ALU_CMP, RAX, 0x8000);
+    uint8_t* ok = e.Jcc(CC_B);
+    EmitExit(lw, in.pc, lw.pending);
+    X64Emitter::Patch(ok, e.ptr);
+}
+
+// After an indexed access that may cross a page (MayCrossPage): charge the
+// extra cycle if it did. The index registers survive the access, so abs,X
+// and abs,Y test the index against the base; (zp),Y tests the address it
+// kept. Clobbers RCX.
+static void EmitPageCrossCheck(Lowering& lw, const IRInst& in) {
+    X64Emitter& e = *lw.emit;
+    uint8_t* same_page;
+    if (in.mode == IR_INDY) {
+        e.LoadU8(RCX, MemAt(RSP, 0));
+        e.AluRR(ALU_CMP, RCX, X64_Y);
+        same_page = e.Jcc(CC_AE);
+    } else {
+        if (!(in.operand & 0xFF)) return;
+        e.AluRI(ALU_CMP, IndexReg(in), 0x100 - (in.operand & 0xFF));
+        same_page = e.Jcc(CC_B);
+    }
+    e.AluMI32(ALU_SUB, StateField(CS_CYCLES_REM), 1);
+    X64Emitter::Patch(same_page, e.ptr);
+}
+
+// Read the operand of a memory-mode instruction into dst (zero-extended).
+// Clobbers RCX, RDX, and the caller-saved registers on I/O.
+static void EmitLoadOperand(Lowering& lw, const IRInst& in, int dst) {
+    X64Emitter& e = *lw.emit;
+    if (in.mode != IR_INDY) {
+        if (in.flags & IR_F_IO) {
+            EmitIoAddress(e, in);
+            EmitIoRead(lw, in, dst);
+        } else {
+            e.LoadU8(dst, ReadMem(e, in));
+        }
+        return;
+    }
+    // Address in RAX: RAM, I/O, or ROM through the window bit 14 selects
+    e.AluRI(ALU_CMP, RAX, 0x2000);
+    uint8_t* not_ram = e.Jcc(CC_AE);
+    e.LoadU8(dst, MemAt(X64_RAM, RAX, 0));
+    uint8_t* done = e.Jmp();
+    X64Emitter::Patch(not_ram, e.ptr);
+    e.AluRI(ALU_CMP, RAX, 0x8000);
+    uint8_t* rom = e.Jcc(CC_AE);
+    e.MovRR(RSI, RAX);
+    EmitIoRead(lw, in, dst);
+    uint8_t* io_done = e.Jmp();
+    X64Emitter::Patch(rom, e.ptr);
+    e.MovRR(RCX, RAX);
+    e.AluRI(ALU_AND, RCX, 0x3FFF);
+    e.Load64(RDX, StateField(CS_ROM_LO));
+    e.TestRI(RAX, 0x4000);
+    e.CmovM64(CC_NE, RDX, StateField(CS_ROM_HI));
+    e.LoadU8(dst, MemAt(RDX, RCX, 0));
+    X64Emitter::Patch(done, e.ptr);
+    X64Emitter::Patch(io_done, e.ptr);
+}
+
+// Write src to the operand of a store
+static void EmitStoreOperand(Lowering& lw, const IRInst& in, int src) {
+    X64Emitter& e = *lw.emit;
+    if (in.flags & IR_F_IO) {
+        if (in.mode != IR_INDY) {
+            EmitIoAddress(e, in);
+            EmitIoWrite(lw, in, src);
+            return;
+        }
+        // (zp),Y: RAM, or I/O (ROM has left the block already)
+        e.AluRI(ALU_CMP, RAX, 0x2000);
+        uint8_t* io = e.Jcc(CC_AE);
+        e.Store8(src, WriteMem(e, in));
+        uint8_t* done = e.Jmp();
+        X64Emitter::Patch(io, e.ptr);
+        e.MovRR(RSI, RAX);
+        EmitIoWrite(lw, in, src);
+        // Address 0 for the code-write check after: zero page holds no code
+        e.MovRI(RAX, 0);
+        X64Emitter::Patch(done, e.ptr);
+        return;
+    }
+    e.Store8(src, WriteMem(e, in));
+}
+
+// Operand into RAX: the immediate, or a memory read
+static void EmitOperandToRAX(Lowering& lw, const IRInst& in) {
+    if (in.mode == IR_IMM) lw.emit->MovRI(RAX, in.operand);
+    else EmitLoadOperand(lw, in, RAX);
+}
+
+// ADC/SBC with the operand in RAX. Decimal mode calls the bcd.h helper;
+// binary mode computes A + operand + C (SBC: the operand complemented).
+static void EmitAddSub(X64Emitter& e, const IRInst& in) {
+    const bool c_live = !(in.flags & IR_F_C_DEAD);
+    const bool v_live = !(in.flags & IR_F_V_DEAD);
+
+    e.TestMI8(StateField(CS_STATUS), 0x08);
+    uint8_t* binary = e.Jcc(CC_E);
+    e.MovRR(RDI, X64_A);
+    e.MovRR(RSI, RAX);
+    e.LoadU8(RDX, StateField(CS_CARRY));
+    e.Mov64(RCX, X64_STATE);
+    e.CallAbs(in.op == IR_ADC ? (const void*)&DecimalADC : (const void*)&DecimalSBC);
+    e.Zext8(X64_A, RAX);
+    if (c_live) {
+        e.Shr(RAX, 8);
+        e.Store8(RAX, StateField(CS_CARRY));
+    }
+    uint8_t* done = e.Jmp();
+
+    X64Emitter::Patch(binary, e.ptr);
+    if (in.op == IR_SBC) e.AluRI(ALU_XOR, RAX, 0xFF);
+    // RCX = A + operand + C, at most 0x1FF
+    e.LoadU8(RCX, StateField(CS_CARRY));
+    e.AluRR(ALU_ADD, RCX, RAX);
+    e.AluRR(ALU_ADD, RCX, X64_A);
+    if (v_live) {
+        // V = ~(A ^ operand) & (A ^ result) & 0x80
+        e.MovRR(RDX, X64_A);
+        e.AluRR(ALU_XOR, RDX, RAX);
+        e.AluRI(ALU_XOR, RDX, 0xFF);
+        e.MovRR(RSI, X64_A);
+        e.AluRR(ALU_XOR, RSI, RCX);
+        e.AluRR(ALU_AND, RDX, RSI);
+        e.Shr(RDX, 7);
+        e.Store8(RDX, StateField(CS_V));
+    }
+    if (c_live) {
+        e.MovRR(RDX, RCX);
+        e.Shr(RDX, 8);
+        e.Store8(RDX, StateField(CS_CARRY));
+    }
+    e.Zext8(X64_A, RCX);
+    X64Emitter::Patch(done, e.ptr);
+}
+
+// ASL/LSR/ROL/ROR on r (A, or RAX holding a memory operand)
+static void EmitShift(X64Emitter& e, const IRInst& in, int r) {
+    const bool left = in.op == IR_ASL || in.op == IR_ROL;
+    const bool rotate = in.op == IR_ROL || in.op == IR_ROR;
+    if (rotate) e.LoadU8(RDX, StateField(CS_CARRY));
+    if (!(in.flags & IR_F_C_DEAD)) {
+        e.MovRR(RCX, r);
+        if (left) e.Shr(RCX, 7);
+        else e.AluRI(ALU_AND, RCX, 1);
+        e.Store8(RCX, StateField(CS_CARRY));
+    }
+    if (left) {
+        e.Shl(r, 1);
+        if (rotate) e.AluRR(ALU_OR, r, RDX);
+        e.Zext8(r, r);
+    } else {
+        e.Shr(r, 1);
+        if (rotate) {
+            e.Shl(RDX, 7);
+            e.AluRR(ALU_OR, r, RDX);
+        }
+    }
+}
+
+// Add one to a branch profile counter (BranchCounter). Clobbers RCX.
+static void EmitCountBranch(X64Emitter& e, uint32_t* counter) {
+    e.MovRI64(RCX, (uint64_t)(uintptr_t)counter);
+    e.AluMI32(ALU_ADD, MemAt(RCX, 0), 1);
+}
+
+// Conditional branch. Taken: an exit, or for a back edge a jump to the
+// loop head while the budget lasts. Not taken: an exit, or for a back edge
+// the next instruction. A trace branch (IR_F_SIDE_EXIT) leaves on its cold
+// side only.
+static void EmitBranch(Lowering& lw, int i) {
+    X64Emitter& e = *lw.emit;
+    const IRInst& in = lw.ir->inst[i];
+    X64Cond taken;
+    switch (in.opcode) {
+    case 0x10: e.TestRI(X64_NZ, 0x180); taken = CC_E; break;   // BPL
+    case 0x30: e.TestRI(X64_NZ, 0x180); taken = CC_NE; break;  // BMI
+    case 0x50: e.TestMI8(StateField(CS_V), 1); taken = CC_E; break;
+    case 0x70: e.TestMI8(StateField(CS_V), 1); taken = CC_NE; break;
+    case 0x90: e.TestMI8(StateField(CS_CARRY), 1); taken = CC_E; break;
+    case 0xB0: e.TestMI8(StateField(CS_CARRY), 1); taken = CC_NE; break;
+    case 0xD0: e.TestRI(X64_NZ, 0xFF); taken = CC_NE; break;   // BNE
+    default:   e.TestRI(X64_NZ, 0xFF); taken = CC_E; break;    // BEQ
+    }
+    const uint16_t next = in.pc + in.length;
+    const int taken_cycles = ((next ^ in.operand) & 0xFF00) ? 2 : 1;
+
+    if (in.flags & IR_F_SIDE_EXIT) {
+        const bool follow_taken = (in.flags & IR_F_TRACE_TAKEN) != 0;
+        uint8_t* stay = e.Jcc(follow_taken ? taken : (X64Cond)(taken ^ 1));
+        if (follow_taken) EmitExit(lw, next, lw.pending);
+        else EmitExit(lw, in.operand, lw.pending + taken_cycles);
+        X64Emitter::Patch(stay, e.ptr);
+        if (follow_taken) lw.pending += taken_cycles;
+        return;
+    }
+
+    uint8_t* not_taken = e.Jcc((X64Cond)(taken ^ 1));
+
+    if (in.flags & IR_F_BACK_EDGE) {
+        int target = i;
+        while (lw.ir->inst[target].pc != in.operand || (lw.ir->inst[target].flags & IR_F_INLINED)) target--;
+        ChargeCycles(lw, lw.pending + taken_cycles);
+        e.AluMI32(ALU_CMP, StateField(CS_CYCLES_REM), lw.budget);
+        uint8_t* out_of_budget = e.Jcc(CC_L);
+        e.JmpTo(lw.label[target]);
+        X64Emitter::Patch(out_of_budget, e.ptr);
+        EmitExit(lw, in.operand, 0);
+        X64Emitter::Patch(not_taken, e.ptr);
+        return;
+    }
+    BranchCount* count = lw.profile ? BranchCounter(in.pc) : nullptr;
+    if (count) EmitCountBranch(e, &count->taken);
+    EmitExit(lw, in.operand, lw.pending + taken_cycles);
+    X64Emitter::Patch(not_taken, e.ptr);
+    if (count) EmitCountBranch(e, &count->not_taken);
+    EmitExit(lw, next, lw.pending);
+    lw.pending = 0;
+}
+
+// After an I/O access (IR_F_IO): leave if the access moved the deadline
+// or switched banks. pc was stored before the call (EmitIoSpill) and is
+// left as it is: the next instruction, or the handler of an IRQ the
+// access raised.
+static void EmitIoExitCheck(Lowering& lw) {
+    X64Emitter& e = *lw.emit;
+    e.TestMI8(StateField(CS_EXIT_REASON), 0xFF);
+    uint8_t* stay = e.Jcc(CC_E);
+    ChargeCycles(lw, lw.pending);
+    lw.exit_jumps[lw.exit_count++] = e.Jmp();
+    X64Emitter::Patch(stay, e.ptr);
+}
+
+// Code-write check after a store (IR_F_CODE_WRITE): on a page with
+// compiled RAM code, call NoteCodeWrite and leave the block at the next
+// instruction if it dropped anything
+static void EmitCodeWriteCheck(Lowering& lw, const IRInst& in) {
+    X64Emitter& e = *lw.emit;
+    const bool dynamic = in.mode != IR_ABS && !(in.flags & IR_F_INDEX_KNOWN);
+    if (!dynamic && in.addr < RAM_CODE_START) return;
+    e.Load64(RCX, StateField(CS_CODE_PAGES));
+    if (dynamic) {
+        // (zp),Y left its address in RAX
+        if (in.mode == IR_INDY) e.MovRR(RDI, RAX);
+        else e.Lea(RDI, MemAt(IndexReg(in), in.operand));
+        e.MovRR(RDX, RDI);
+        e.Shr(RDX, 8);
+        e.LoadU8(RDX, MemAt(RCX, RDX, 0));
+    } else {
+        e.MovRI(RDI, in.addr);
+        e.LoadU8(RDX, MemAt(RCX, in.addr >> 8));
+    }
+    e.TestRI(RDX, 0xFF);
+    uint8_t* no_code = e.Jcc(CC_E);
+    e.CallAbs((const void*)&NoteCodeWrite);
+    e.TestRI(RAX, 0xFF);
+    uint8_t* kept = e.Jcc(CC_E);
+    EmitExit(lw, in.pc + in.length, lw.pending);
+    X64Emitter::Patch(no_code, e.ptr);
+    X64Emitter::Patch(kept, e.ptr);
+}
+
+static void LowerInstruction(Lowering& lw, int i) {
+    X64Emitter& e = *lw.emit;
+    const IRInst& in = lw.ir->inst[i];
+    const bool nz_live = !(in.flags & IR_F_NZ_DEAD);
+
+    if (in.mode == IR_INDY) EmitIndirectAddress(lw, in);
+    lw.pending += in.cycles;
+
+    switch (in.op) {
+    case IR_LOAD: {
+        const int dst = x64_reg[in.reg];
+        if (in.flags & IR_F_LOAD_FORWARD) {
+            if (x64_reg[in.value_reg] != dst) e.MovRR(dst, x64_reg[in.value_reg]);
+        } else if (in.mode == IR_IMM) {
+            e.MovRI(dst, in.operand);
+        } else {
+            EmitLoadOperand(lw, in, dst);
+        }
+        if (nz_live) e.MovRR(X64_NZ, dst);
+        break;
+    }
+    case IR_STORE:
+        if (!(in.flags & IR_F_STORE_REDUNDANT)) EmitStoreOperand(lw, in, x64_reg[in.reg]);
+        break;
+    case IR_TRANSFER:
+        if (in.reg == IR_REG_S) {
+            e.Store8(x64_reg[in.src], StateField(CS_SP));
+        } else {
+            const int dst = x64_reg[in.reg];
+            if (in.src == IR_REG_S) e.LoadU8(dst, StateField(CS_SP));
+            else e.MovRR(dst, x64_reg[in.src]);
+            if (nz_live) e.MovRR(X64_NZ, dst);
+        }
+        break;
+    case IR_INC:
+    case IR_DEC: {
+        const X64Alu alu = in.op == IR_INC ? ALU_ADD : ALU_SUB;
+        if (in.reg == IR_REG_MEM) {
+            const X64Mem m = WriteMem(e, in);
+            e.LoadU8(RAX, m);
+            e.AluRI(alu, RAX, 1);
+            e.Store8(RAX, m);
+            if (nz_live) e.Zext8(X64_NZ, RAX);
+        } else {
+            const int r = x64_reg[in.reg];
+            e.AluRI(alu, r, 1);
+            e.Zext8(r, r);
+            if (nz_live) e.MovRR(X64_NZ, r);
+        }
+        break;
+    }
+    case IR_AND:
+    case IR_ORA:
+    case IR_EOR: {
+        const X64Alu alu = in.op == IR_AND ? ALU_AND : in.op == IR_ORA ? ALU_OR : ALU_XOR;
+        if (in.mode == IR_IMM) {
+            e.AluRI(alu, X64_A, in.operand);
+        } else {
+            EmitLoadOperand(lw, in, RAX);
+            e.AluRR(alu, X64_A, RAX);
+        }
+        if (nz_live) e.MovRR(X64_NZ, X64_A);
+        break;
+    }
+    case IR_ADC:
+    case IR_SBC:
+        EmitOperandToRAX(lw, in);
+        EmitAddSub(e, in);
+        if (nz_live) e.MovRR(X64_NZ, X64_A);
+        break;
+    case IR_CMP: {
+        const bool c_live = !(in.flags & IR_F_C_DEAD);
+        if (!nz_live && !c_live) break;
+        const int r = x64_reg[in.reg];
+        EmitOperandToRAX(lw, in);
+        if (c_live) {
+            e.AluRR(ALU_CMP, r, RAX);
+            e.SetccM(CC_AE, StateField(CS_CARRY));
+        }
+        if (nz_live) {
+            e.MovRR(X64_NZ, r);
+            e.AluRR(ALU_SUB, X64_NZ, RAX);
+            e.Zext8(X64_NZ, X64_NZ);
+        }
+        break;
+    }
+    case IR_ASL:
+    case IR_LSR:
+    case IR_ROL:
+    case IR_ROR:
+        if (in.reg == IR_REG_MEM) {
+            const X64Mem m = WriteMem(e, in);
+            e.LoadU8(RAX, m);
+            EmitShift(e, in, RAX);
+            e.Store8(RAX, m);
+            if (nz_live) e.MovRR(X64_NZ, RAX);
+        } else {
+            EmitShift(e, in, X64_A);
+            if (nz_live) e.MovRR(X64_NZ, X64_A);
+        }
+        break;
+    case IR_BRANCH:
+        EmitBranch(lw, i);
+        break;
+    case IR_JMP:
+        if (in.flags & IR_F_TRACE_TAKEN) break;  // The trace goes on at the target
+        EmitExit(lw, in.operand, lw.pending);
+        lw.pending = 0;
+        break;
+    case IR_JMP_IND: {
+        // Both pointer bytes lie in RAM or one ROM window (CanLowerAccess)
+        X64Mem m = ReadMem(e, in);
+        e.LoadU8(RAX, m);
+        m.disp++;
+        e.LoadU8(RCX, m);
+        e.Shl(RCX, 8);
+        e.AluRR(ALU_OR, RAX, RCX);
+        e.Store16(RAX, StateField(CS_PC));
+        ChargeCycles(lw, lw.pending);
+        lw.exit_jumps[lw.exit_count++] = e.Jmp();
+        lw.pending = 0;
+        break;
+    }
+    case IR_JSR: {
+        const uint16_t ret = in.pc + 2;
+        e.LoadU8(RAX, StateField(CS_SP));
+        e.StoreImm8(MemAt(X64_RAM, RAX, 0x100), ret >> 8);
+        e.AluRI(ALU_SUB, RAX, 1);
+        e.Zext8(RAX, RAX);
+        e.StoreImm8(MemAt(X64_RAM, RAX, 0x100), ret & 0xFF);
+        e.AluRI(ALU_SUB, RAX, 1);
+        e.Store8(RAX, StateField(CS_SP));
+        if (in.flags & IR_F_TRACE_TAKEN) break;
+        EmitExit(lw, in.operand, lw.pending);
+        lw.pending = 0;
+        break;
+    }
+    case IR_RTS:
+        if (in.flags & IR_F_TRACE_TAKEN) {
+            // Inlined leaf: the stack holds the JSR's return address
+            e.AluMI8(ALU_ADD, StateField(CS_SP), 2);
+            break;
+        }
+        e.LoadU8(RAX, StateField(CS_SP));
+        e.AluRI(ALU_ADD, RAX, 1);
+        e.Zext8(RAX, RAX);
+        e.LoadU8(RCX, MemAt(X64_RAM, RAX, 0x100));
+        e.AluRI(ALU_ADD, RAX, 1);
+        e.Zext8(RAX, RAX);
+        e.LoadU8(RDX, MemAt(X64_RAM, RAX, 0x100));
+        e.Store8(RAX, StateField(CS_SP));
+        e.Shl(RDX, 8);
+        e.AluRR(ALU_OR, RCX, RDX);
+        e.AluRI(ALU_ADD, RCX, 1);
+        e.Store16(RCX, StateField(CS_PC));
+        ChargeCycles(lw, lw.pending);
+        lw.exit_jumps[lw.exit_count++] = e.Jmp();
+        lw.pending = 0;
+        break;
+    case IR_PUSH:
+        if (in.reg == IR_REG_P) {
+            // P = status | B | bit 5 | N V Z C from the lazy flags
+            e.LoadU8(RCX, StateField(CS_STATUS));
+            e.AluRI(ALU_OR, RCX, 0x30);
+            e.LoadU8(RDX, StateField(CS_CARRY));
+            e.AluRR(ALU_OR, RCX, RDX);
+            e.LoadU8(RDX, StateField(CS_V));
+            e.Shl(RDX, 6);
+            e.AluRR(ALU_OR, RCX, RDX);
+            e.TestRI(X64_NZ, 0xFF);
+            e.Setcc(CC_E, RDX);
+            e.Zext8(RDX, RDX);
+            e.Shl(RDX, 1);
+            e.AluRR(ALU_OR, RCX, RDX);
+            e.TestRI(X64_NZ, 0x180);
+            e.Setcc(CC_NE, RDX);
+            e.Zext8(RDX, RDX);
+            e.Shl(RDX, 7);
+            e.AluRR(ALU_OR, RCX, RDX);
+        } else {
+            e.MovRR(RCX, X64_A);
+        }
+        e.LoadU8(RAX, StateField(CS_SP));
+        e.Store8(RCX, MemAt(X64_RAM, RAX, 0x100));
+        e.AluRI(ALU_SUB, RAX, 1);
+        e.Store8(RAX, StateField(CS_SP));
+        break;
+    case IR_PULL:
+        e.LoadU8(RAX, StateField(CS_SP));
+        e.AluRI(ALU_ADD, RAX, 1);
+        e.Zext8(RAX, RAX);
+        e.Store8(RAX, StateField(CS_SP));
+        if (in.reg == IR_REG_A) {
+            e.LoadU8(X64_A, MemAt(X64_RAM, RAX, 0x100));
+            if (nz_live) e.MovRR(X64_NZ, X64_A);
+            break;
+        }
+        e.LoadU8(RAX, MemAt(X64_RAM, RAX, 0x100));
+        e.MovRR(RCX, RAX);
+        e.AluRI(ALU_AND, RCX, 0x3C);
+        e.AluRI(ALU_OR, RCX, 0x20);
+        e.Store8(RCX, StateField(CS_STATUS));
+        e.MovRR(RCX, RAX);
+        e.AluRI(ALU_AND, RCX, 1);
+        e.Store8(RCX, StateField(CS_CARRY));
+        e.MovRR(RCX, RAX);
+        e.Shr(RCX, 6);
+        e.AluRI(ALU_AND, RCX, 1);
+        e.Store8(RCX, StateField(CS_V));
+        // Lazy N/Z (lazy_flags.h): 1, 0x80, 0 or 0x100
+        e.MovRR(RCX, RAX);
+        e.AluRI(ALU_AND, RCX, 0x80);
+        e.MovRR(RDX, RCX);
+        e.Shl(RDX, 1);
+        e.MovRI(X64_NZ, 1);
+        e.TestRI(RAX, 0x80);
+        e.Cmov(CC_NE, X64_NZ, RCX);
+        e.TestRI(RAX, 0x02);
+        e.Cmov(CC_NE, X64_NZ, RDX);
+        break;
+    case IR_FLAG:
+        switch (in.opcode) {
+        case 0x18: if (!(in.flags & IR_F_C_DEAD)) e.StoreImm8(StateField(CS_CARRY), 0); break;
+        case 0x38: if (!(in.flags & IR_F_C_DEAD)) e.StoreImm8(StateField(CS_CARRY), 1); break;
+        case 0xB8: if (!(in.flags & IR_F_V_DEAD)) e.StoreImm8(StateField(CS_V), 0); break;
+        case 0xD8: e.AluMI8(ALU_AND, StateField(CS_STATUS), (uint8_t)~0x08); break;
+        case 0xF8: e.AluMI8(ALU_OR, StateField(CS_STATUS), 0x08); break;
+        case 0x58: e.AluMI8(ALU_AND, StateField(CS_STATUS), (uint8_t)~0x04); break;
+        case 0x78: e.AluMI8(ALU_OR, StateField(CS_STATUS), 0x04); break;
+        }
+        break;
+    default:
+        break;
+    }
+    if (MayCrossPage(in)) EmitPageCrossCheck(lw, in);
+    if (in.flags & IR_F_IO) EmitIoExitCheck(lw);
+    if ((in.flags & IR_F_CODE_WRITE) && !(in.flags & IR_F_STORE_REDUNDANT)) EmitCodeWriteCheck(lw, in);
+}
+
+// Lower a decoded block: prologue, body, then the epilogue every exit
+// jumps to
+static void LowerBlock(X64Emitter& e, const IRBlock& ir, uint8_t tier) {
+    static Lowering lw;
+    lw.emit = &e;
+    lw.ir = &ir;
+    lw.pending = 0;
+    lw.profile = tier == TIER_BASELINE;
+    lw.exit_count = 0;
+    lw.budget = BlockBudget(ir);
+
+    EmitPrologue(e);
+    e.AluMI32(ALU_CMP, StateField(CS_CYCLES_REM), lw.budget);
+    uint8_t* fits = e.Jcc(CC_GE);
+    EmitExit(lw, ir.start_pc, 0);
+    X64Emitter::Patch(fits, e.ptr);
+    for (int i = 0; i < ir.count; i++) {
+        if (ir.inst[i].flags & IR_F_BRANCH_TARGET) {
+            ChargeCycles(lw, lw.pending);
+            lw.pending = 0;
+        }
+        lw.label[i] = e.ptr;
+        LowerInstruction(lw, i);
+    }
+    if (!ir.ends) EmitExit(lw, ir.end_pc, lw.pending);
+
+    for (int i = 0; i < lw.exit_count; i++) X64Emitter::Patch(lw.exit_jumps[i], e.ptr);
+    EmitEpilogue(e);
+}
+
+// Compile the block at pc, running the IR passes of the given tier over it
+static Block* CompileAt(uint16_t pc, uint8_t tier) {
+    if (!code_buffer) return nullptr;
+
+    Block* existing = FindBlock(pc);
+    if (existing) return existing == &fail_block ? nullptr : existing;
+
+    // Out of code space or block slots: start over
+    if ((size_t)(code_buffer + X64_CODE_SIZE - code_ptr) < X64_MAX_BLOCK_BYTES ||
+        block_pool_used >= X64_BLOCK_POOL_SIZE) {
+        DebugLog("DR: code cache full, invalidating all blocks\n");
+        InvalidateAll();
+    }
+
+    // Every RAM block slot taken: the oldest makes room
+    if (!(pc & 0x8000) && ram_block_count >= RAM_BLOCK_SLOTS) DropBlock(ram_blocks[0]);
+
+    static IRBlock ir;
+    DecodeBlock(ir, pc, FetchByteAt, tier == TIER_OPTIMIZED);
+    if (ir.count == 0) {
+        stats.last_fail_opcode = FetchByteAt(pc);
+        stats.last_fail_pc = pc;
+        stats.fallback_count++;
+        *MapEntry(pc) = &fail_block;
+        return nullptr;
+    }
+    RunPasses(ir, tier);
+
+    ProtectCode(true);
+    X64Emitter emit(code_ptr, code_buffer + X64_CODE_SIZE - code_ptr);
+    LowerBlock(emit, ir, tier);
+    ProtectCode(false);
+    __builtin___clear_cache((char*)code_ptr, (char*)emit.ptr);
+
+    Block* block = &block_pool[block_pool_used++];
+    block->pc = pc;
+    SourceSpan(ir, block->src_lo, block->src_end);
+    block->code = code_ptr;
+    block->body = code_ptr;
+    block->code_size = (uint32_t)(emit.ptr - code_ptr);
+    block->cycles = 0;
+    for (int i = 0; i < ir.count; i++) block->cycles += ir.inst[i].cycles;
+    block->exec_count = 0;
+    block->bank = BlockBank(pc);
+    block->tier = tier;
+    block->map_entry = MapEntry(pc);
+    *block->map_entry = block;
+    if (block->bank == RAM_BANK) {
+        ram_blocks[ram_block_count++] = block;
+        CountRamPages(*block, 1);
+    } else {
+        MarkRomWindows(*block);
+    }
+
+    code_ptr = emit.ptr;
+    stats.blocks_compiled++;
+    stats.compile_bytes_used = (uint32_t)(code_ptr - code_buffer);
+    DebugLog("DR: compiled block %04X-%04X (%d instr, %u bytes) at %p\n",
+             pc, ir.end_pc, ir.count, block->code_size, block->code);
+    return block;
+}
+
+void* CompileBlock(uint16_t pc) {
+    Block* block = CompileAt(pc, TIER_BASELINE);
+    return block ? block->code : nullptr;
+}
+
+// Replace a hot baseline block with an optimized one
+static Block* OptimizeBlock(Block* b) {
+    const uint16_t pc = b->pc;
+    DropBlock(b);
+    Block* opt = CompileAt(pc, TIER_OPTIMIZED);
+    if (!opt) return nullptr;
+    stats.blocks_optimized++;
+    opt->exec_count = PROMOTE_THRESHOLD;
+    return opt;
+}
+
+void* GetBlock(uint16_t pc, uint8_t* tier) {
+    Block* b = FindBlock(pc);
+    if (!b || b == &fail_block) return nullptr;
+    if (++b->exec_count == PROMOTE_THRESHOLD && b->tier == TIER_BASELINE) {
+        b = OptimizeBlock(b);
+        if (!b) return nullptr;
+    }
+    stats.blocks_executed++;
+    if (tier) *tier = b->tier;
+    return b->code;
+}
+
+void InvalidateAll() {
+    ResetBlockMaps();
+    block_pool_used = 0;
+    code_ptr = code_buffer;
+    ResetRamCode();
+    std::memset(rom_code_windows, 0, sizeof(rom_code_windows));
+    stats.blocks_invalidated += stats.blocks_compiled;
+    stats.blocks_compiled = 0;
+    stats.compile_bytes_used = 0;
+}
+
+void SetCodeBank(uint32_t bank) {
+    code_bank = bank;
+    if (!SelectBankMap(bank)) {
+        DebugLog("DR: no bank map slot for %02X, invalidating all blocks\n", bank);
+        InvalidateAll();
+    }
+}
+
+int RunBlock(void* code, CpuState* state) {
+    if (!InCodeCache(code)) {
+        DebugLog("DR: ERROR: code ptr %p outside code cache\n", code);
+        return 0;
+    }
+    typedef int (*BlockFunc)(CpuState*);
+    BlockFunc func = (BlockFunc)code;
+    const int32_t before = state->cycles_remaining;
+    func(state);
+    return before - state->cycles_remaining;
+}
+
+Stats GetStats() {
+    return stats;
+}
+
+void ResetStats() {
+    stats = {};
+    stats.compile_bytes_total = X64_CODE_SIZE;
+}
+
+} // namespace Dynarec
+
+#endif // DYNAREC_X64
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+
+// Flag representation shared by the interpreter (mos6502), the ARM asm loop
+// (mos6502_hot_arm.s) and compiled dynarec blocks, so control can move
+// between them without packing or unpacking P:
+//
+//   nz  lazy N/Z word: Z = (nz & 0xFF) == 0, N = (nz & 0x180) != 0.
+//       Any 8-bit result can be stored as is; 0x100 encodes N and Z both
+//       set, which only BIT, PLP and RTI can produce.
+//   c   carry, 0 or 1
+//   v   overflow, 0 or 1
+//   p   the remaining P bits (D, I, B, bit 5); N, Z, V and C are always
+//       clear here
+//
+// A full P byte is only built for PHP, BRK and interrupts.
+
+#define LAZY_NZ_N_MASK  0x180
+#define LAZY_NZ_N_AND_Z 0x100
+#define LAZY_P_MASK     0x3C
+
+static inline bool LazyN(uint32_t nz) { return (nz & LAZY_NZ_N_MASK) != 0; }
+static inline bool LazyZ(uint32_t nz) { return (nz & 0xFF) == 0; }
+
+static inline uint32_t LazyNZ(bool n, bool z)
+{
+	return z ? (n ? LAZY_NZ_N_AND_Z : 0) : (n ? 0x80 : 1);
+}
+
+static inline uint8_t PackStatus(uint8_t p, uint32_t nz, uint8_t c, uint8_t v)
+{
+	return (uint8_t)(p |
+		(LazyN(nz) ? 0x80 : 0) |
+		(uint8_t)(v << 6) |
+		(LazyZ(nz) ? 0x02 : 0) |
+		c);
+}
+
+static inline void UnpackStatus(uint8_t P, uint8_t& p, uint32_t& nz, uint8_t& c, uint8_t& v)
+{
+	p = P & LAZY_P_MASK;
+	nz = LazyNZ((P & 0x80) != 0, (P & 0x02) != 0);
+	c = P & 0x01;
+	v = (P >> 6) & 0x01;
+}
@@ -1,8 +1,12 @@
 
 #include "mos6502.h"
+#include "bcd.h"
 #include "SDL_inc.h"
+#include "dynarec.h"
 #if defined(NDS_BUILD) && defined(ARM9)
 #include "system_state.h"
+#endif
+#if (defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64
 #include "dynarec_cpu.h"
 #endif
 
@@ -19,16 +23,29 @@
 
 #define NDS_USE_THREADED_DISPATCH 0
 
-// Global active CPU pointer for dynarec
-mos6502* g_activeCPU = nullptr;
+// Replay decoded basic blocks (see RunMicroBlock) instead of fetching and
+// decoding every instruction through the opcode switch.
+#ifndef MOS6502_USE_UOP_CACHE
+#define MOS6502_USE_UOP_CACHE 1
+#endif
 
-#if defined(NDS_BUILD) && defined(ARM9)
-extern SystemState system_state;
-extern RomType loadedRomType;
+// Run guest code in the generated ARM asm loop (mos6502_hot_arm.s) between
+// the dynarec and the micro-op tier. Off: it has yet to pass
+// tools/mos6502_asm_difftest.sh (its check against the interpreter, under
+// qemu-arm) and to be profiled on hardware against the tiers it would
+// take work from.
+#ifndef MOS6502_USE_ASM_LOOP
+#define MOS6502_USE_ASM_LOOP 0
+#endif
+
+// Current bank pointers (gte.cpp)
 extern uint8_t* cached_ram_ptr;
-extern bool* cached_ram_init_ptr;
 extern uint8_t* cached_rom_lo_ptr;
 extern uint8_t* cached_rom_hi_ptr;
+
+#if defined(NDS_BUILD) && defined(ARM9)
+extern SystemState system_state;
+extern RomType loadedRomType;
 extern uint16_t cached_rom_linear_mask;
 extern uint32_t cached_rom_decode_epoch;
 extern uint8_t open_bus();
@@ -39,6 +56,12 @@ extern "C" uint8_t GT_AudioRamRead(uint16_t address);
 extern "C" void GT_AudioRamWrite(uint16_t address, uint8_t value);
 extern "C" uint8_t GT_JoystickReadFast(uint8_t portNum);
 
+// The asm loop stores to RAM inline, without RAM_MARK_INIT.
+#if GTE_TRACK_UNINIT_RAM
+#undef MOS6502_USE_ASM_LOOP
+#define MOS6502_USE_ASM_LOOP 0
+#endif
+
 #ifndef NDS_OPCODE_PROFILE_STRIDE
 #define NDS_OPCODE_PROFILE_STRIDE 33u
 #endif
@@ -179,7 +202,8 @@ mos6502::mos6502(BusRead r, BusWrite w, CPUEvent stp, BusRead sync)
 	Stopped = (CPUEvent)stp;
 	Sync = (BusRead)sync;
 	Instr instr;
-	irq_timer = 0;
+	irq_deadline = 0;
+	irq_scheduled = false;
 #if defined(NDS_BUILD) && defined(ARM9)
 	for (int i = 0; i < 256; ++i) {
 		opcode_exec_count[i] = 0;
@@ -1160,6 +1184,13 @@ mos6502::mos6502(BusRead r, BusWrite w, CPUEvent stp, BusRead sync)
 	return;
 }
 
+mos6502::~mos6502()
+{
+	delete[] uop_table;
+	delete[] uop_blocks;
+	delete[] uop_ops;
+}
+
 inline uint8_t mos6502::ReadBus(uint16_t address)
 {
 #if defined(NDS_BUILD) && defined(ARM9)
@@ -1202,12 +1233,26 @@ inline uint8_t mos6502::ReadBus(uint16_t address)
 	return (*Read)(address);
 }
 
+inline void mos6502::NoteRamWrite(uint16_t address)
+{
+	if (UNLIKELY(uop_ram_pages & (1u << (address >> 8)))) {
+		InvalidateRamCode();
+	}
+#if ((defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64) && DYNAREC_RAM_CODE
+	// Blocks the dynarec compiled from this page
+	if (UNLIKELY(Dynarec::ram_code_pages[address >> 8])) {
+		Dynarec::NoteCodeWrite(address);
+	}
+#endif
+}
+
 inline void mos6502::WriteBus(uint16_t address, uint8_t value)
 {
 #if defined(NDS_BUILD) && defined(ARM9)
 	if (LIKELY(Sync == NULL)) {
 	if(address < 0x2000) {
-		cached_ram_init_ptr[address] = true;
+		NoteRamWrite(address);
+		RAM_MARK_INIT(address);
 		cached_ram_ptr[address] = value;
 		return;
 	}
@@ -1232,6 +1277,11 @@ inline void mos6502::WriteBus(uint16_t address, uint8_t value)
 	}
 	}
 #endif
+	// Cartridge writes that change code (flash, save RAM) are invalidated
+	// by the cartridge itself, which knows what changed.
+	if(address < 0x2000) {
+		NoteRamWrite(address);
+	}
 	FlushRunCycles();
 	(*Write)(address, value);
 }
@@ -1264,64 +1314,102 @@ inline uint8_t mos6502::FetchByte()
 
 inline void mos6502::SetNZFast(uint8_t value)
 {
-	status = (status & (uint8_t)~(NEGATIVE | ZERO)) |
-		(uint8_t)(value & NEGATIVE) |
-		(uint8_t)((value == 0) ? ZERO : 0);
+	flag_nz = value;
 }
 
 inline void mos6502::ADCFast(uint8_t m)
 {
 	const unsigned int carryIn = IF_CARRY() ? 1u : 0u;
-	unsigned int tmp = m + A + carryIn;
-	SET_ZERO(!(tmp & 0xFF));
-	if (IF_DECIMAL())
+	if (UNLIKELY(IF_DECIMAL()))
 	{
 		opExtraCycles += 1;
-		if (((A & 0xF) + (m & 0xF) + carryIn) > 9) tmp += 6;
-		SET_NEGATIVE(tmp & 0x80);
-		SET_OVERFLOW(!((A ^ m) & 0x80) && ((A ^ tmp) & 0x80));
-		if (tmp > 0x99) {
-			tmp += 96;
-		}
-		SET_CARRY(tmp > 0x99);
-	}
-	else
-	{
-		SET_NEGATIVE(tmp & 0x80);
-		SET_OVERFLOW(!((A ^ m) & 0x80) && ((A ^ tmp) & 0x80));
-		SET_CARRY(tmp > 0xFF);
+		const uint32_t r = BCD_ADC(A, m, carryIn);
+		flag_nz = r & 0xFF;
+		flag_c = (r & BCD_RESULT_CARRY) ? 1 : 0;
+		flag_v = (r & BCD_RESULT_OVERFLOW) ? 1 : 0;
+		A = (uint8_t)r;
+		return;
 	}
+	unsigned int tmp = m + A + carryIn;
+	SetNZFast((uint8_t)tmp);
+	SET_OVERFLOW(!((A ^ m) & 0x80) && ((A ^ tmp) & 0x80));
+	SET_CARRY(tmp > 0xFF);
 	A = (uint8_t)(tmp & 0xFF);
 }
 
 inline void mos6502::SBCFast(uint8_t m)
 {
 	const unsigned int borrowIn = IF_CARRY() ? 0u : 1u;
-	unsigned int tmp = A - m - borrowIn;
-	SET_NEGATIVE(tmp & 0x80);
-	SET_ZERO(!(tmp & 0xFF));
-	SET_OVERFLOW(((A ^ tmp) & 0x80) && ((A ^ m) & 0x80));
-
-	if (IF_DECIMAL())
+	if (UNLIKELY(IF_DECIMAL()))
 	{
 		opExtraCycles += 1;
-		if (((A & 0x0F) - borrowIn) < (m & 0x0F)) tmp -= 6;
-		if (tmp > 0x99) {
-			tmp -= 0x60;
-		}
+		const uint32_t r = BCD_SBC(A, m, borrowIn ^ 1u);
+		flag_nz = r & 0xFF;
+		flag_c = (r & BCD_RESULT_CARRY) ? 1 : 0;
+		flag_v = (r & BCD_RESULT_OVERFLOW) ? 1 : 0;
+		A = (uint8_t)r;
+		return;
 	}
+	unsigned int tmp = A - m - borrowIn;
+	SetNZFast((uint8_t)tmp);
+	SET_OVERFLOW(((A ^ tmp) & 0x80) && ((A ^ m) & 0x80));
 	SET_CARRY(tmp < 0x100);
 	A = (uint8_t)(tmp & 0xFF);
 }
 
 inline void mos6502::FlushRunCycles()
 {
-	if(run_cycle_target && run_pending_cycles) {
-		*run_cycle_target += run_pending_cycles;
-		run_pending_cycles = 0;
+	if(run_cycle_target && (run_clock != run_clock_flushed)) {
+		*run_cycle_target += run_clock - run_clock_flushed;
+		run_clock_flushed = run_clock;
+	}
+}
+
+inline void mos6502::UpdateDeadline()
+{
+	next_deadline = (irq_scheduled && (irq_deadline < run_deadline)) ? irq_deadline : run_deadline;
+	// A held IRQ line (masked), WAI or a stop request need attention before
+	// the next instruction, so collapse the deadline onto the current cycle.
+	if(irq_line || waiting || illegalOpcode || freeze) {
+		next_deadline = run_clock;
 	}
 }
 
+// Called once run_clock reaches next_deadline. Fires the scheduled IRQ,
+// fast-forwards WAI and recomputes the deadline. Returns false when Run()
+// should return to the caller.
+bool mos6502::ServiceEvents()
+{
+	for(;;) {
+		if(irq_scheduled && (run_clock >= irq_deadline)) {
+			irq_scheduled = false;
+			if((irq_gate == NULL) || (*irq_gate)) {
+				irq_line = true;
+			}
+		}
+		if(irq_line) {
+			IRQ();
+			break;
+		}
+		if(!waiting) {
+			break;
+		}
+		// WAI: jump straight to the next scheduled IRQ rather than stepping
+		// towards it. With nothing scheduled (or the IRQ gated off) the rest
+		// of the slice is idle up to the vsync NMI.
+		uint32_t wake = run_deadline;
+		if(irq_scheduled && (irq_deadline < wake)) {
+			wake = irq_deadline;
+		}
+		if(run_clock >= wake) {
+			break;
+		}
+		run_clock = wake;
+	}
+	UpdateDeadline();
+	return (run_clock < run_deadline) && !waiting && !illegalOpcode && !freeze;
+}
+
 // Small helper function to test if addresses belong to the same page
 // This is useful for conditional timing as some addressing modes take additional cycles if calculated
 // addresses cross page boundaries
@@ -1542,6 +1630,8 @@ void mos6502::Reset()
 	illegalOpcode = false;
 	waiting = false;
 
+	InvalidateCode();
+
 #if defined(NDS_BUILD) && defined(ARM9)
 	ResetCacheProfile();
 #endif
@@ -1554,7 +1644,7 @@ void mos6502::StackPush(uint8_t byte)
 #if defined(NDS_BUILD) && defined(ARM9)
 	if (LIKELY(Sync == NULL)) {
 		const uint16_t addr = (uint16_t)(0x0100u + sp);
-		cached_ram_init_ptr[addr] = true;
+		RAM_MARK_INIT(addr);
 		cached_ram_ptr[addr] = byte;
 		if (sp == 0x00) sp = 0xFF;
 		else sp--;
@@ -1584,12 +1674,13 @@ void mos6502::IRQ()
 {
 	irq_line = true;
 	waiting = false;
+	ForceDeadline();
 	if(!IF_INTERRUPT())
 	{
 		SET_BREAK(0);
 		StackPush((pc >> 8) & 0xFF);
 		StackPush(pc & 0xFF);
-		StackPush(status);
+		StackPush(GetStatus());
 		SET_INTERRUPT(1);
 		pc = (ReadBus(irqVectorH) << 8) + ReadBus(irqVectorL);
 	}
@@ -1597,17 +1688,22 @@ void mos6502::IRQ()
 }
 
 void mos6502::ScheduleIRQ(uint32_t cycles, bool *gate) {
-	irq_timer = cycles;
 	irq_gate = gate;
 	if(cycles == 0) {
+		irq_scheduled = false;
 		if((irq_gate == NULL) || (*irq_gate)) 
 			IRQ();
+		return;
 	}
+	irq_deadline = run_clock + cycles;
+	irq_scheduled = true;
+	ForceDeadline();
 }
 
 void mos6502::ClearIRQ() {
 	irq_line = false;
-	irq_timer = 0;
+	irq_scheduled = false;
+	ForceDeadline();
 }
 
 void mos6502::NMI()
@@ -1616,7 +1712,7 @@ void mos6502::NMI()
 	SET_BREAK(0);
 	StackPush((pc >> 8) & 0xFF);
 	StackPush(pc & 0xFF);
-	StackPush(status);
+	StackPush(GetStatus());
 	SET_INTERRUPT(1);
 	pc = (ReadBus(nmiVectorH) << 8) + ReadBus(nmiVectorL);
 	return;
@@ -1625,6 +1721,7 @@ void mos6502::NMI()
 void mos6502::Freeze()
 {
 	freeze = true;
+	ForceDeadline();
 }
 
 #if defined(NDS_BUILD) && defined(ARM9)
@@ -1662,14 +1759,438 @@ void mos6502::ResetCacheProfile()
 }
 #endif
 
+inline uint32_t mos6502::MicroBlockBank(uint16_t address) const
+{
+	// $C000-$FFFF is the fixed window; $8000-$BFFF follows the cartridge bank.
+	if (address & 0x8000) {
+		return (address & 0x4000) ? 0 : uop_rom_bank;
+	}
+	return uop_ram_epoch;
+}
+
+void mos6502::ResetMicroBlocks()
+{
+	if (uop_table != nullptr) {
+		for (int i = 0; i < UOP_TABLE_SIZE; ++i) {
+			uop_table[i] = nullptr;
+		}
+	}
+	uop_blocks_used = 0;
+	uop_ops_used = 0;
+	uop_ram_pages = 0;
+	for (int i = 0; i < 4; ++i) {
+		uop_rom_windows[i] = 0;
+	}
+}
+
+void mos6502::EnableMicroOpCache(bool enable)
+{
+	if (!enable) InvalidateCode();
+	uop_enabled = enable;
+}
+
+void mos6502::InvalidateCode()
+{
+	if (uop_blocks_used == 0) return;
+	ResetMicroBlocks();
+	// The ops stay readable until the next build; just make sure the block
+	// currently being replayed stops after this instruction.
+	ForceDeadline();
+}
+
+void mos6502::InvalidateRamCode()
+{
+	if (uop_ram_pages == 0) return;
+	// Orphan every RAM block by moving to a new epoch; their pool slots are
+	// reclaimed the next time the pools fill up.
+	++uop_ram_epoch;
+	uop_ram_pages = 0;
+	ForceDeadline();
+}
+
+void mos6502::InvalidateRomRange(uint32_t lo, uint32_t hi)
+{
+	if (lo >= hi) return;
+
+#if defined(NDS_BUILD) && defined(ARM9)
+	// A decode entry holds the opcode at its PC and the two bytes after it,
+	// as mapped when it was filled; entries of an older epoch are dead
+	// anyway. Entries are indexed by PC, so only the ones that can hold one
+	// of the bytes are looked at.
+	const uint32_t epoch_tag = cached_rom_decode_epoch << 16;
+	const uint32_t span = hi - lo + 2;
+	const uint32_t count = (span < NDS_DECODE_CACHE_SIZE) ? span : NDS_DECODE_CACHE_SIZE;
+	for (uint32_t k = 0; k < count; ++k) {
+		const uint32_t index = (lo - 2 + k) & NDS_DECODE_CACHE_MASK;
+		NDSRomDecodeEntry& entry = g_nds_rom_decode[index];
+		if ((entry.tag ^ epoch_tag) & 0xFFFF0000u) continue;
+		const uint16_t entryPc = (uint16_t)((entry.tag & ~NDS_DECODE_CACHE_MASK) | index);
+		if (!(entryPc & 0x8000)) continue;
+		const uint32_t at = Dynarec::RomOffset(entryPc, uop_rom_bank);
+		if ((at < hi) && (at + 3 > lo)) {
+			entry.tag = 0xFFFFFFFFu;  // no PC's tag has its low bits set
+		}
+	}
+	last_ad_pc = 0xFFFF;
+#endif
+
+	if (uop_table == nullptr) return;
+	bool decoded = false;
+	for (uint32_t w = lo >> 14; (w <= ((hi - 1) >> 14)) && !decoded; ++w) {
+		decoded = (uop_rom_windows[w >> 5] >> (w & 31)) & 1;
+	}
+	if (!decoded) return;
+
+	// Unlink the ROM blocks read from the range; like orphaned RAM blocks,
+	// their pool slots come back when the pools fill up.
+	bool dropped = false;
+	for (int i = 0; i < UOP_TABLE_SIZE; ++i) {
+		MicroBlock** link = &uop_table[i];
+		while (MicroBlock* b = *link) {
+			if (b->pc & 0x8000) {
+				const uint32_t start = Dynarec::RomOffset(b->pc, b->bank);
+				const uint32_t end = start + (uint16_t)(uop_ops[b->first + b->count - 1].next_pc - b->pc);
+				if ((start < hi) && (end > lo)) {
+					*link = b->next;
+					dropped = true;
+					continue;
+				}
+			}
+			link = &b->next;
+		}
+	}
+	if (dropped) ForceDeadline();
+}
+
+mos6502::MicroBlock* mos6502::FindMicroBlock(uint16_t address)
+{
+	if (uop_table == nullptr) return nullptr;
+	const uint32_t bank = MicroBlockBank(address);
+	MicroBlock* b = uop_table[(address * 0x9E3779B9u) >> 24];
+	while (b) {
+		if ((b->pc == address) && (b->bank == bank)) return b;
+		b = b->next;
+	}
+	return nullptr;
+}
+
+mos6502::MicroBlock* mos6502::BuildMicroBlock(uint16_t address)
+{
+	// Only decode ahead from memory whose reads have no side effects: the
+	// cartridge window and RAM above the stack. Pages 0-1 are left to the
+	// interpreter because its hot paths store there without WriteBus.
+	uint32_t limit;
+	if (address & 0x8000) {
+		// Stay inside one 16K window so a block never mixes two banks.
+		limit = (uint32_t)(address | 0x3FFF) + 1;
+	} else if ((address >= 0x0200) && (address < 0x2000)) {
+		limit = 0x2000;
+	} else {
+		return nullptr;
+	}
+
+	if (uop_table == nullptr) {
+		uop_table = new MicroBlock*[UOP_TABLE_SIZE];
+		uop_blocks = new MicroBlock[UOP_MAX_BLOCKS];
+		uop_ops = new MicroOp[UOP_MAX_OPS];
+		ResetMicroBlocks();
+	}
+	if ((uop_blocks_used >= UOP_MAX_BLOCKS) || (uop_ops_used + UOP_MAX_BLOCK_OPS > UOP_MAX_OPS)) {
+		ResetMicroBlocks();
+	}
+
+	MicroOp* ops = &uop_ops[uop_ops_used];
+	uint32_t at = address;
+	int count = 0;
+	while ((count < UOP_MAX_BLOCK_OPS) && (at < limit)) {
+		const uint8_t opcode = ReadBus((uint16_t)at);
+		const Instr& instr = InstrTable[opcode];
+		// Leave illegal opcodes to the interpreter, which reports them.
+		if (instr.code == &mos6502::Op_ILLEGAL) break;
+
+		// BBRx/BBSx are implied in the table but fetch a zero page address
+		// and an offset themselves.
+		const bool bitBranch = (opcode & 0x0F) == 0x0F;
+		uint8_t length = 2;
+		if (bitBranch ||
+			(instr.addr == &mos6502::Addr_ABS) || (instr.addr == &mos6502::Addr_ABX) ||
+			(instr.addr == &mos6502::Addr_ABY) || (instr.addr == &mos6502::Addr_ABI) ||
+			(instr.addr == &mos6502::Addr_AIX)) {
+			length = 3;
+		} else if ((instr.addr == &mos6502::Addr_IMP) || (instr.addr == &mos6502::Addr_ACC)) {
+			length = 1;
+		}
+		if (at + length > limit) break;
+
+		MicroOp& op = ops[count];
+		const uint16_t operandPc = (uint16_t)(at + 1);
+		op.code = instr.code;
+		op.cycles = instr.cycles;
+		op.opcode = opcode;
+		op.length = length;
+		op.next_pc = (uint16_t)(at + length);
+		op.mode = UOP_STATIC;
+		op.operand = 0;
+		if (bitBranch) {
+			op.mode = UOP_FETCH;
+			op.operand = operandPc;
+		} else if (instr.addr == &mos6502::Addr_IMM) {
+			op.operand = operandPc;
+		} else if (instr.addr == &mos6502::Addr_ZER) {
+			op.operand = ReadBus(operandPc);
+		} else if (instr.addr == &mos6502::Addr_ZEX) {
+			op.mode = UOP_ZEX;
+			op.operand = ReadBus(operandPc);
+		} else if (instr.addr == &mos6502::Addr_ZEY) {
+			op.mode = UOP_ZEY;
+			op.operand = ReadBus(operandPc);
+		} else if (instr.addr == &mos6502::Addr_REL) {
+			op.operand = (uint16_t)(op.next_pc + (int8_t)ReadBus(operandPc));
+		} else if ((instr.addr == &mos6502::Addr_ABS) || (instr.addr == &mos6502::Addr_ABX) ||
+			(instr.addr == &mos6502::Addr_ABY)) {
+			op.operand = (uint16_t)(ReadBus(operandPc) | (ReadBus((uint16_t)(operandPc + 1)) << 8));
+			if (instr.addr == &mos6502::Addr_ABX) op.mode = UOP_ABX;
+			if (instr.addr == &mos6502::Addr_ABY) op.mode = UOP_ABY;
+		} else if (length != 1) {
+			// Indirect modes read memory for their pointer; redo the fetch at run time.
+			op.mode = UOP_FETCH;
+			op.operand = operandPc;
+		}
+		at += length;
+		++count;
+
+		if (bitBranch || (instr.addr == &mos6502::Addr_REL) ||
+			(instr.code == &mos6502::Op_JMP) || (instr.code == &mos6502::Op_JSR) ||
+			(instr.code == &mos6502::Op_RTS) || (instr.code == &mos6502::Op_RTI) ||
+			(instr.code == &mos6502::Op_BRK) || (instr.code == &mos6502::Op_WAI) ||
+			(instr.code == &mos6502::Op_STP)) {
+			break;
+		}
+	}
+	if (count == 0) return nullptr;
+
+	MicroBlock* block = &uop_blocks[uop_blocks_used++];
+	block->pc = address;
+	block->first = (uint16_t)uop_ops_used;
+	block->count = (uint8_t)count;
+	block->bank = MicroBlockBank(address);
+	uop_ops_used += count;
+
+	const uint32_t hash = (address * 0x9E3779B9u) >> 24;
+	block->next = uop_table[hash];
+	uop_table[hash] = block;
+
+	if (!(address & 0x8000)) {
+		for (uint32_t page = address >> 8; page <= ((at - 1) >> 8); ++page) {
+			uop_ram_pages |= 1u << page;
+		}
+	} else {
+		const uint32_t window = Dynarec::RomOffset(address, block->bank) >> 14;
+		uop_rom_windows[window >> 5] |= 1u << (window & 31);
+	}
+	return block;
+}
+
+// Replays one decoded block from pc, stopping early once run_clock reaches
+// the event deadline. Returns false if no block can be built here, in which
+// case the caller interprets a single instruction.
+bool mos6502::RunMicroBlock()
+{
+	MicroBlock* block = FindMicroBlock(pc);
+	if (block == nullptr) {
+		block = BuildMicroBlock(pc);
+		if (block == nullptr) return false;
+	}
+
+	const MicroOp* op = &uop_ops[block->first];
+	const MicroOp* const end = op + block->count;
+	do {
+		if (Sync != NULL) {
+			// Keep breakpoints and the JSR/RTS profiler working on the host.
+			const uint16_t opPc = (uint16_t)(op->next_pc - op->length);
+			Sync(opPc);
+			if (UNLIKELY(freeze)) {
+				pc = opPc;
+				break;
+			}
+		}
+		uint16_t src = op->operand;
+		pc = op->next_pc;
+		switch (op->mode) {
+			case UOP_STATIC:
+				break;
+			case UOP_ZEX:
+				src = (uint8_t)(src + X);
+				break;
+			case UOP_ZEY:
+				src = (uint8_t)(src + Y);
+				break;
+			case UOP_ABX: {
+				const uint16_t addr = (uint16_t)(src + X);
+				if (!addressesSamePage(addr, src)) opExtraCycles++;
+				src = addr;
+				break;
+			}
+			case UOP_ABY: {
+				const uint16_t addr = (uint16_t)(src + Y);
+				if (!addressesSamePage(addr, src)) opExtraCycles++;
+				src = addr;
+				break;
+			}
+			case UOP_FETCH:
+				pc = src;
+				src = (this->*InstrTable[op->opcode].addr)();
+				break;
+		}
+		(this->*op->code)(src);
+
+		run_clock += op->cycles + opExtraCycles;
+		opExtraCycles = 0;
+		// Also catches IRQs raised by I/O writes, stop/wait requests and
+		// writes that invalidated this block, all of which force the deadline.
+		if (UNLIKELY(run_clock >= next_deadline)) {
+			if (illegalOpcode) {
+				illegalOpcodeSrc = op->opcode;
+			}
+			break;
+		}
+	} while (++op != end);
+	return true;
+}
+
+// Compiled blocks call these for I/O. RunDynarec leaves run_clock where the
+// run began and next_deadline where it was, with cycles_remaining counting
+// down to it; elapsed is what the block has run since it last charged
+// cycles_remaining. Devices see run_clock at the start of the instruction,
+// as under the interpreter, and run_clock goes back afterwards since the
+// run is added to it as a whole.
+uint8_t mos6502::CompiledRead(uint16_t address, int32_t elapsed)
+{
+	const uint32_t entry_clock = run_clock;
+	const uint32_t deadline = next_deadline;
+	run_clock = deadline - (uint32_t)(cycles_remaining - elapsed);
+	const uint8_t value = ReadBus(address);
+	CompiledBusDone(entry_clock, deadline);
+	return value;
+}
+
+void mos6502::CompiledWrite(uint16_t address, uint8_t value, int32_t elapsed)
+{
+	const uint32_t entry_clock = run_clock;
+	const uint32_t deadline = next_deadline;
+	run_clock = deadline - (uint32_t)(cycles_remaining - elapsed);
+	WriteBus(address, value);
+	CompiledBusDone(entry_clock, deadline);
+}
+
+// The block keeps the bank pointers in registers and runs to the old
+// deadline, so an access that changed either ends the run after the
+// instruction.
+inline void mos6502::CompiledBusDone(uint32_t entry_clock, uint32_t deadline)
+{
+	if (next_deadline != deadline || ram != cached_ram_ptr ||
+		rom_lo != cached_rom_lo_ptr || rom_hi != cached_rom_hi_ptr) {
+		exit_reason = 1;
+	}
+	run_clock = entry_clock;
+}
+
+#if defined(NDS_BUILD) && defined(ARM9)
+// The asm loop calls out for every access it does not handle inline, with
+// its registers already spilled to CpuState. Bring run_clock up to the
+// start of the current instruction so time-coupled devices see the same
+// clock as under the interpreter.
+inline void mos6502::AsmBusAccess()
+{
+	run_clock = asm_deadline - (uint32_t)cycles_remaining;
+}
+
+// An access can switch banks or move the deadline (IRQ scheduled or raised,
+// stop request). The loop reloads the pointers; a deadline change ends it
+// after the current instruction.
+inline void mos6502::AsmBusDone()
+{
+	ram = cached_ram_ptr;
+	rom_lo = cached_rom_lo_ptr;
+	rom_hi = cached_rom_hi_ptr;
+	if (next_deadline != asm_deadline) {
+		asm_deadline = run_clock;
+		cycles_remaining = 0;
+	}
+}
+
+extern "C" uint8_t mos6502_asm_read(CpuState* state, uint16_t address)
+{
+	mos6502* cpu = static_cast<mos6502*>(state);
+	cpu->AsmBusAccess();
+	const uint8_t value = cpu->ReadBus(address);
+	cpu->AsmBusDone();
+	return value;
+}
+
+extern "C" void mos6502_asm_write(CpuState* state, uint16_t address, uint8_t value)
+{
+	mos6502* cpu = static_cast<mos6502*>(state);
+	cpu->AsmBusAccess();
+	cpu->WriteBus(address, value);
+	cpu->AsmBusDone();
+}
+
+// An inline RAM store hit a page in code_pages: drop the compiled blocks
+// covering the byte. A micro-op page sets uop_page_written for RunAsmLoop.
+extern "C" void mos6502_asm_code_write(uint16_t address)
+{
+	Dynarec::NoteCodeWrite(address);
+}
+
+extern "C" uint32_t mos6502_asm_adc_decimal(uint32_t a, uint32_t m, uint32_t carryIn)
+{
+	return BCD_ADC(a, m, carryIn);
+}
+
+extern "C" uint32_t mos6502_asm_sbc_decimal(uint32_t a, uint32_t m, uint32_t carryIn)
+{
+	return BCD_SBC(a, m, carryIn);
+}
+
+// Runs the asm loop up to next_deadline. It returns early, with pc on the
+// opcode, at WAI, STP and illegal opcodes so the interpreter can handle
+// them.
+void mos6502::RunAsmLoop()
+{
+	asm_deadline = next_deadline;
+	cycles_remaining = (int32_t)(next_deadline - run_clock);
+	ram = cached_ram_ptr;
+	rom_lo = cached_rom_lo_ptr;
+	rom_hi = cached_rom_hi_ptr;
+	code_pages = Dynarec::ram_code_pages;
+	Dynarec::SetUopPages(uop_ram_pages);
+	mos6502_run_asm(this, system_state.VIA_regs);
+	run_clock = asm_deadline - (uint32_t)cycles_remaining;
+	// RAM stores bypass WriteBus; the loop checks them against code_pages
+	// and has already dropped the compiled blocks they overwrote.
+	if (UNLIKELY(Dynarec::uop_page_written)) InvalidateRamCode();
+}
+#endif
+
 void mos6502::Run(
 	int32_t cyclesRemaining,
 	uint64_t& cycleCount,
 	CycleMethod cycleMethod
 ) {
-	g_activeCPU = this;
+	if (UNLIKELY(freeze)) return;
+
+	if (cycleMethod == INST_COUNT) {
+		// A one-cycle budget retires exactly one instruction.
+		while ((cyclesRemaining-- > 0) && !illegalOpcode && !freeze) {
+			Run(1, cycleCount, CYCLE_COUNT);
+		}
+		return;
+	}
+	if (cyclesRemaining <= 0) return;
+
 	run_cycle_target = &cycleCount;
-	run_pending_cycles = 0;
+	run_deadline = (uint32_t)cyclesRemaining;
 
 	uint8_t opcode;
 	uint8_t elapsedCycles;
@@ -1679,66 +2200,60 @@ void mos6502::Run(
 	Instr instr;
 #endif
 
-	if (UNLIKELY(freeze)) return;
+	UpdateDeadline();
+	bool keepRunning = (run_clock < next_deadline) || ServiceEvents();
 
-	while((cyclesRemaining > 0) && !illegalOpcode)
+	while(keepRunning)
 	{
-		if (UNLIKELY(waiting)) {
-			if (UNLIKELY(irq_line)) {
-				waiting = false;
-				IRQ();
-			} else if(irq_timer > 0) {
-				if(cyclesRemaining >= (int32_t)irq_timer) {
-					run_pending_cycles += irq_timer;
-					cyclesRemaining -= irq_timer;
-					irq_timer = 0;
-					if((irq_gate == NULL) || (*irq_gate)) {
-						irq_line = true;
-						IRQ();
+#if ((defined(NDS_BUILD) && defined(ARM9)) || DYNAREC_X64) && !GTE_TRACK_UNINIT_RAM
+		// Try dynarec up to the next event deadline so we don't overshoot IRQ.
+		// Compiled blocks store to RAM inline, without RAM_MARK_INIT, so
+		// uninitialized-RAM tracking keeps to the tiers below.
+		if (LIKELY(Sync == NULL) && (next_deadline > run_clock)) {
+			if (Dynarec::CanUseDynarec(this)) {
+#if DYNAREC_RAM_CODE
+				Dynarec::SetUopPages(uop_ram_pages);
+#endif
+				int32_t dynarecCycles = Dynarec::RunDynarec(this, (int32_t)(next_deadline - run_clock));
+				if (dynarecCycles > 0) {
+					run_clock += dynarecCycles;
+#if DYNAREC_RAM_CODE
+					// Compiled stores bypass WriteBus; one that hit a page
+					// of decoded RAM code was flagged by NoteCodeWrite.
+					if (UNLIKELY(Dynarec::uop_page_written)) InvalidateRamCode();
+#else
+					// Compiled stores bypass WriteBus unchecked, so any
+					// decoded RAM code may be stale now.
+					InvalidateRamCode();
+#endif
+					if (run_clock >= next_deadline) {
+						keepRunning = ServiceEvents();
+						continue;
 					}
-				} else {
-					irq_timer -= cyclesRemaining;
-					run_pending_cycles += (uint32_t)cyclesRemaining;
-					cyclesRemaining = 0;
-					break;
-
 				}
-			} else {
-				break;
 			}
-		} else if (UNLIKELY(irq_line)) {
-			IRQ();
 		}
-
+#endif
 #if defined(NDS_BUILD) && defined(ARM9)
-		// Try dynarec — allow running even with irq_timer pending
-		if (LIKELY(Sync == NULL && !waiting && !freeze && !irq_line)) {
-			if (Dynarec::CanUseDynarec()) {
-				// Limit dynarec to min(cyclesRemaining, irq_timer) so we don't overshoot IRQ
-				int32_t dynarecBudget = cyclesRemaining;
-				if (irq_timer > 0 && (int32_t)irq_timer < dynarecBudget) {
-					dynarecBudget = (int32_t)irq_timer;
-				}
-				int32_t dynarecCycles = Dynarec::RunDynarec(dynarecBudget);
-				if (dynarecCycles > 0) {
-					cyclesRemaining -= dynarecCycles;
-					run_pending_cycles += dynarecCycles;
-					// Tick down irq_timer
-					if (irq_timer > 0) {
-						if ((uint32_t)dynarecCycles >= irq_timer) {
-							irq_timer = 0;
-							if ((irq_gate == NULL) || (*irq_gate)) {
-								irq_line = true;
-							}
-						} else {
-							irq_timer -= dynarecCycles;
-						}
-					}
-					if (cyclesRemaining <= 0 || freeze || waiting) {
-						continue;
-					}
-				}
+#if MOS6502_USE_ASM_LOOP
+		if (LIKELY(Sync == NULL) && (next_deadline > run_clock) &&
+			((loadedRomType == RomType::FLASH2M) || (loadedRomType == RomType::FLASH2M_RAM32K))) {
+			RunAsmLoop();
+			if (run_clock >= next_deadline) {
+				keepRunning = ServiceEvents();
+				continue;
+			}
+			// Otherwise it stopped at an opcode left to the interpreter.
+		}
+#endif
+#endif
+
+#if MOS6502_USE_UOP_CACHE
+		if (uop_enabled && RunMicroBlock()) {
+			if (UNLIKELY(run_clock >= next_deadline)) {
+				keepRunning = ServiceEvents();
 			}
+			continue;
 		}
 #endif
 
@@ -1767,7 +2282,6 @@ void mos6502::Run(
 		}
 		if (UNLIKELY(freeze)) {
 			--pc;
-			cyclesRemaining = 0;
 			break;
 		}
 
@@ -1935,7 +2449,7 @@ td_op_slow:
 						cache_hit_d0++;
 					}
 					pc = (uint16_t)(opPc + 2);
-					if ((status & ZERO) == 0) {
+					if (!IF_ZERO()) {
 						pc = entry.rel_target;
 						elapsedCycles = entry.rel_taken_cycles;
 					} else {
@@ -1978,7 +2492,8 @@ td_op_slow:
 					}
 					const uint16_t addr = entry.abs;
 					if (LIKELY(addr < 0x2000)) {
-						cached_ram_init_ptr[addr] = true;
+						NoteRamWrite(addr);
+						RAM_MARK_INIT(addr);
 						cached_ram_ptr[addr] = A;
 					} else if (addr & 0x4000) {
 						FlushRunCycles();
@@ -2044,11 +2559,11 @@ td_op_slow:
 					pc = (uint16_t)(opPc + 3);
 					const uint16_t ret = (uint16_t)(pc - 1);
 					uint16_t saddr = (uint16_t)(0x0100u + sp);
-					cached_ram_init_ptr[saddr] = true;
+					RAM_MARK_INIT(saddr);
 					cached_ram_ptr[saddr] = (uint8_t)(ret >> 8);
 					sp = (sp == 0x00) ? 0xFF : (uint8_t)(sp - 1);
 					saddr = (uint16_t)(0x0100u + sp);
-					cached_ram_init_ptr[saddr] = true;
+					RAM_MARK_INIT(saddr);
 					cached_ram_ptr[saddr] = (uint8_t)(ret & 0xFF);
 					sp = (sp == 0x00) ? 0xFF : (uint8_t)(sp - 1);
 					pc = entry.abs;
@@ -2094,7 +2609,7 @@ td_op_slow:
 						entry.rel_target = 0;
 						entry.rel_taken_cycles = 0;
 					}
-					cached_ram_init_ptr[entry.op1] = true;
+					RAM_MARK_INIT(entry.op1);
 					cached_ram_ptr[entry.op1] = A;
 					pc = (uint16_t)(pc + 1);
 					elapsedCycles = 3;
@@ -2134,7 +2649,7 @@ td_op_slow:
 						}
 					}
 					pc = (uint16_t)(opPc + 2);
-					if (status & ZERO) {
+					if (IF_ZERO()) {
 						pc = entry.rel_target;
 						elapsedCycles = entry.rel_taken_cycles;
 					} else {
@@ -2266,7 +2781,7 @@ td_op_slow:
 				}
 				case 0x85: { // STA ZER
 					const uint16_t addr = FetchByte();
-					cached_ram_init_ptr[addr] = true;
+					RAM_MARK_INIT(addr);
 					cached_ram_ptr[addr] = A;
 					elapsedCycles = 3;
 					break;
@@ -2515,7 +3030,7 @@ td_op_slow:
 				}
 				case 0xD0: { // BNE REL
 					const int16_t rel = (int16_t)(int8_t)FetchByte();
-					if ((status & ZERO) == 0) {
+					if (!IF_ZERO()) {
 						const uint16_t oldPc = pc;
 						pc = (uint16_t)(pc + rel);
 						elapsedCycles = (uint8_t)(3 + (((oldPc ^ pc) & 0xFF00) ? 1 : 0));
@@ -2540,11 +3055,11 @@ td_op_slow:
 #if defined(NDS_BUILD) && defined(ARM9)
 					if (LIKELY(Sync == NULL)) {
 						uint16_t saddr = (uint16_t)(0x0100u + sp);
-						cached_ram_init_ptr[saddr] = true;
+						RAM_MARK_INIT(saddr);
 						cached_ram_ptr[saddr] = (uint8_t)(ret >> 8);
 						sp = (sp == 0x00) ? 0xFF : (uint8_t)(sp - 1);
 						saddr = (uint16_t)(0x0100u + sp);
-						cached_ram_init_ptr[saddr] = true;
+						RAM_MARK_INIT(saddr);
 						cached_ram_ptr[saddr] = (uint8_t)(ret & 0xFF);
 						sp = (sp == 0x00) ? 0xFF : (uint8_t)(sp - 1);
 					} else
@@ -2595,7 +3110,8 @@ td_op_slow:
 					const uint16_t addr = (uint16_t)(lo | (hi << 8));
 					if (LIKELY(addr < 0x2000)) {
 						uint8_t m = (uint8_t)(cached_ram_ptr[addr] + 1);
-						cached_ram_init_ptr[addr] = true;
+						NoteRamWrite(addr);
+						RAM_MARK_INIT(addr);
 						cached_ram_ptr[addr] = m;
 						SetNZFast(m);
 					} else {
@@ -2614,7 +3130,7 @@ td_op_slow:
 					break;
 				}
 			case 0x28: { // PLP
-				status = StackPop();
+				SetStatus(StackPop());
 				status |= CONSTANT;
 				status &= ~BREAK;
 				elapsedCycles = 4;
@@ -2655,26 +3171,19 @@ td_op_done:
 			}
 #endif
 
-		run_pending_cycles += elapsedCycles;
-		cyclesRemaining -=
-			(cycleMethod == CYCLE_COUNT )       ? elapsedCycles
-			/* cycleMethod == INST_COUNT */   : 1;
-		if(irq_timer > 0) {
-			if(irq_timer < elapsedCycles) {
-				irq_timer = 0;
-			} else {
-				irq_timer -= elapsedCycles;
-			}
-			if(irq_timer == 0) {
-				if((irq_gate == NULL) || (*irq_gate)) {
-					IRQ();
-					irq_line = true;
-				}
-			}
+		run_clock += elapsedCycles;
+		if (UNLIKELY(run_clock >= next_deadline)) {
+			keepRunning = ServiceEvents();
 		}
 	}
 	FlushRunCycles();
 	run_cycle_target = nullptr;
+	// Rebase so the next Run() starts its clock at 0.
+	if (irq_scheduled) {
+		irq_deadline = (irq_deadline > run_clock) ? (irq_deadline - run_clock) : 0;
+	}
+	run_clock = 0;
+	run_clock_flushed = 0;
 }
 
 void mos6502::RunOptimized(
@@ -2693,6 +3202,7 @@ void mos6502::Exec(Instr i)
 void mos6502::Op_ILLEGAL(uint16_t src)
 {
 	illegalOpcode = true;
+	ForceDeadline();
 }
 
 
@@ -2707,8 +3217,7 @@ void mos6502::Op_AND(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
 	uint8_t res = m & A;
-	SET_NEGATIVE(res & 0x80);
-	SET_ZERO(!res);
+	SetNZFast(res);
 	A = res;
 	return;
 }
@@ -2720,8 +3229,7 @@ void mos6502::Op_ASL(uint16_t src)
 	SET_CARRY(m & 0x80);
 	m <<= 1;
 	m &= 0xFF;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	WriteBus(src, m);
 	return;
 }
@@ -2732,8 +3240,7 @@ void mos6502::Op_ASL_ACC(uint16_t src)
 	SET_CARRY(m & 0x80);
 	m <<= 1;
 	m &= 0xFF;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 	return;
 }
@@ -2782,9 +3289,9 @@ void mos6502::Op_BIT(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
 	uint8_t res = m & A;
-	SET_NEGATIVE(res & 0x80);
-	status = (status & 0x3F) | (uint8_t)(m & 0xC0);
-	SET_ZERO(!res);
+	// N and V come from the operand, Z from the AND result.
+	flag_nz = LazyNZ((m & 0x80) != 0, res == 0);
+	flag_v = (m >> 6) & 1;
 	return;
 }
 
@@ -2832,7 +3339,7 @@ void mos6502::Op_BRK(uint16_t src)
 	pc++;
 	StackPush((pc >> 8) & 0xFF);
 	StackPush(pc & 0xFF);
-	StackPush(status | BREAK);
+	StackPush(GetStatus() | BREAK);
 	SET_INTERRUPT(1);
 	pc = (ReadBus(irqVectorH) << 8) + ReadBus(irqVectorL);
 	return;
@@ -2841,11 +3348,13 @@ void mos6502::Op_BRK(uint16_t src)
 void mos6502::Op_WAI(uint16_t src)
 {
 	waiting = true;
+	ForceDeadline();
 }
 
 void mos6502::Op_STP(uint16_t src)
 {
 	illegalOpcode = true;
+	ForceDeadline();
 	Stopped();
 }
 
@@ -2903,8 +3412,7 @@ void mos6502::Op_CMP(uint16_t src)
 {
 	unsigned int tmp = A - ReadBus(src);
 	SET_CARRY(tmp < 0x100);
-	SET_NEGATIVE(tmp & 0x80);
-	SET_ZERO(!(tmp & 0xFF));
+	SetNZFast((uint8_t)tmp);
 	return;
 }
 
@@ -2912,8 +3420,7 @@ void mos6502::Op_CPX(uint16_t src)
 {
 	unsigned int tmp = X - ReadBus(src);
 	SET_CARRY(tmp < 0x100);
-	SET_NEGATIVE(tmp & 0x80);
-	SET_ZERO(!(tmp & 0xFF));
+	SetNZFast((uint8_t)tmp);
 	return;
 }
 
@@ -2921,8 +3428,7 @@ void mos6502::Op_CPY(uint16_t src)
 {
 	unsigned int tmp = Y - ReadBus(src);
 	SET_CARRY(tmp < 0x100);
-	SET_NEGATIVE(tmp & 0x80);
-	SET_ZERO(!(tmp & 0xFF));
+	SetNZFast((uint8_t)tmp);
 	return;
 }
 
@@ -2930,8 +3436,7 @@ void mos6502::Op_DEC(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
 	m = (m - 1) % 256;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	WriteBus(src, m);
 	return;
 }
@@ -2940,8 +3445,7 @@ void mos6502::Op_DEC_ACC(uint16_t src)
 {
 	uint8_t m = A;
 	m = (m - 1) % 256;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 	return;
 }
@@ -2950,8 +3454,7 @@ void mos6502::Op_DEX(uint16_t src)
 {
 	uint8_t m = X;
 	m = (m - 1) % 256;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	X = m;
 	return;
 }
@@ -2960,8 +3463,7 @@ void mos6502::Op_DEY(uint16_t src)
 {
 	uint8_t m = Y;
 	m = (m - 1) % 256;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	Y = m;
 	return;
 }
@@ -2970,8 +3472,7 @@ void mos6502::Op_EOR(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
 	m = A ^ m;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 }
 
@@ -2979,8 +3480,7 @@ void mos6502::Op_INC(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
 	m = (m + 1) % 256;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	WriteBus(src, m);
 }
 
@@ -2988,8 +3488,7 @@ void mos6502::Op_INC_ACC(uint16_t src)
 {
 	uint8_t m = A;
 	m = (m + 1) % 256;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 }
 
@@ -2997,8 +3496,7 @@ void mos6502::Op_INX(uint16_t src)
 {
 	uint8_t m = X;
 	m = (m + 1) % 256;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	X = m;
 }
 
@@ -3006,8 +3504,7 @@ void mos6502::Op_INY(uint16_t src)
 {
 	uint8_t m = Y;
 	m = (m + 1) % 256;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	Y = m;
 }
 
@@ -3027,24 +3524,21 @@ void mos6502::Op_JSR(uint16_t src)
 void mos6502::Op_LDA(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 }
 
 void mos6502::Op_LDX(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	X = m;
 }
 
 void mos6502::Op_LDY(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	Y = m;
 }
 
@@ -3053,8 +3547,7 @@ void mos6502::Op_LSR(uint16_t src)
 	uint8_t m = ReadBus(src);
 	SET_CARRY(m & 0x01);
 	m >>= 1;
-	SET_NEGATIVE(0);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	WriteBus(src, m);
 }
 
@@ -3063,8 +3556,7 @@ void mos6502::Op_LSR_ACC(uint16_t src)
 	uint8_t m = A;
 	SET_CARRY(m & 0x01);
 	m >>= 1;
-	SET_NEGATIVE(0);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 }
 
@@ -3077,8 +3569,7 @@ void mos6502::Op_ORA(uint16_t src)
 {
 	uint8_t m = ReadBus(src);
 	m = A | m;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 }
 
@@ -3090,7 +3581,7 @@ void mos6502::Op_PHA(uint16_t src)
 
 void mos6502::Op_PHP(uint16_t src)
 {
-	StackPush(status | BREAK);
+	StackPush(GetStatus() | BREAK);
 	return;
 }
 
@@ -3109,14 +3600,13 @@ void mos6502::Op_PHY(uint16_t src)
 void mos6502::Op_PLA(uint16_t src)
 {
 	A = StackPop();
-	SET_NEGATIVE(A & 0x80);
-	SET_ZERO(!A);
+	SetNZFast(A);
 	return;
 }
 
 void mos6502::Op_PLP(uint16_t src)
 {
-	status = StackPop();
+	SetStatus(StackPop());
 	SET_CONSTANT(1);
 	return;
 }
@@ -3124,16 +3614,14 @@ void mos6502::Op_PLP(uint16_t src)
 void mos6502::Op_PLX(uint16_t src)
 {
 	X = StackPop();
-	SET_NEGATIVE(X & 0x80);
-	SET_ZERO(!X);
+	SetNZFast(X);
 	return;
 }
 
 void mos6502::Op_PLY(uint16_t src)
 {
 	Y = StackPop();
-	SET_NEGATIVE(Y & 0x80);
-	SET_ZERO(!Y);
+	SetNZFast(Y);
 	return;
 }
 
@@ -3144,8 +3632,7 @@ void mos6502::Op_ROL(uint16_t src)
 	if (IF_CARRY()) m |= 0x01;
 	SET_CARRY(m > 0xFF);
 	m &= 0xFF;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	WriteBus(src, m);
 	return;
 }
@@ -3157,8 +3644,7 @@ void mos6502::Op_ROL_ACC(uint16_t src)
 	if (IF_CARRY()) m |= 0x01;
 	SET_CARRY(m > 0xFF);
 	m &= 0xFF;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 	return;
 }
@@ -3170,8 +3656,7 @@ void mos6502::Op_ROR(uint16_t src)
 	SET_CARRY(m & 0x01);
 	m >>= 1;
 	m &= 0xFF;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	WriteBus(src, m);
 	return;
 }
@@ -3183,8 +3668,7 @@ void mos6502::Op_ROR_ACC(uint16_t src)
 	SET_CARRY(m & 0x01);
 	m >>= 1;
 	m &= 0xFF;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 	return;
 }
@@ -3193,7 +3677,7 @@ void mos6502::Op_RTI(uint16_t src)
 {
 	uint8_t lo, hi;
 
-	status = StackPop();
+	SetStatus(StackPop());
 
 	lo = StackPop();
 	hi = StackPop();
@@ -3263,8 +3747,7 @@ void mos6502::Op_STY(uint16_t src)
 void mos6502::Op_TAX(uint16_t src)
 {
 	uint8_t m = A;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	X = m;
 	return;
 }
@@ -3272,8 +3755,7 @@ void mos6502::Op_TAX(uint16_t src)
 void mos6502::Op_TAY(uint16_t src)
 {
 	uint8_t m = A;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	Y = m;
 	return;
 }
@@ -3281,8 +3763,7 @@ void mos6502::Op_TAY(uint16_t src)
 void mos6502::Op_TSX(uint16_t src)
 {
 	uint8_t m = sp;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	X = m;
 	return;
 }
@@ -3290,8 +3771,7 @@ void mos6502::Op_TSX(uint16_t src)
 void mos6502::Op_TXA(uint16_t src)
 {
 	uint8_t m = X;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 	return;
 }
@@ -3305,8 +3785,7 @@ void mos6502::Op_TXS(uint16_t src)
 void mos6502::Op_TYA(uint16_t src)
 {
 	uint8_t m = Y;
-	SET_NEGATIVE(m & 0x80);
-	SET_ZERO(!m);
+	SetNZFast(m);
 	A = m;
 	return;
 }
@@ -8,6 +8,8 @@
 #pragma once
 #include <iostream>
 #include <stdint.h>
+#include "lazy_flags.h"
+#include "cpu_state.h"
 #if defined(NDS_BUILD) && defined(ARM9)
 #include "nds_asm_cpu.h"
 #endif
@@ -22,27 +24,29 @@ using namespace std;
 #define ZERO      0x02
 #define CARRY     0x01
 
-#define SET_NEGATIVE(x) (x ? (status |= NEGATIVE) : (status &= (~NEGATIVE)) )
-#define SET_OVERFLOW(x) (x ? (status |= OVERFLOW) : (status &= (~OVERFLOW)) )
+// N, Z, C and V live in the lazy flag fields (see lazy_flags.h); the other
+// bits stay in status.
+#define SET_NEGATIVE(x) (flag_nz = LazyNZ((x) != 0, LazyZ(flag_nz)))
+#define SET_OVERFLOW(x) (flag_v = (x) ? 1 : 0)
 #define SET_CONSTANT(x) (x ? (status |= CONSTANT) : (status &= (~CONSTANT)) )
 #define SET_BREAK(x) (x ? (status |= BREAK) : (status &= (~BREAK)) )
 #define SET_DECIMAL(x) (x ? (status |= DECIMAL) : (status &= (~DECIMAL)) )
 #define SET_INTERRUPT(x) (x ? (status |= INTERRUPT) : (status &= (~INTERRUPT)) )
-#define SET_ZERO(x) (x ? (status |= ZERO) : (status &= (~ZERO)) )
-#define SET_CARRY(x) (x ? (status |= CARRY) : (status &= (~CARRY)) )
+#define SET_ZERO(x) (flag_nz = LazyNZ(LazyN(flag_nz), (x) != 0))
+#define SET_CARRY(x) (flag_c = (x) ? 1 : 0)
 
-#define IF_NEGATIVE() ((status & NEGATIVE) ? true : false)
-#define IF_OVERFLOW() ((status & OVERFLOW) ? true : false)
+#define IF_NEGATIVE() LazyN(flag_nz)
+#define IF_OVERFLOW() (flag_v != 0)
 #define IF_CONSTANT() ((status & CONSTANT) ? true : false)
 #define IF_BREAK() ((status & BREAK) ? true : false)
 #define IF_DECIMAL() ((status & DECIMAL) ? true : false)
 #define IF_INTERRUPT() ((status & INTERRUPT) ? true : false)
-#define IF_ZERO() ((status & ZERO) ? true : false)
-#define IF_CARRY() ((status & CARRY) ? true : false)
+#define IF_ZERO() LazyZ(flag_nz)
+#define IF_CARRY() (flag_c != 0)
 
 
 
-class mos6502
+class mos6502 : public CpuState
 {
 private:
 	
@@ -223,7 +227,16 @@ private:
 	BusRead Sync;
 
 	uint64_t* run_cycle_target = nullptr;
-	uint32_t run_pending_cycles = 0;
+
+	// Event-deadline cycle accounting. run_clock counts cycles since the
+	// current Run() began and is rebased to 0 when it returns. Everything
+	// that has to happen on a cycle boundary (end of the slice, scheduled
+	// IRQ, stop/wait requests) is folded into next_deadline, so the
+	// dispatch loop does a single compare per instruction or block.
+	uint32_t run_clock = 0;
+	uint32_t run_clock_flushed = 0;
+	uint32_t run_deadline = 0;
+	uint32_t next_deadline = 0;
 
 	inline uint8_t ReadBus(uint16_t address);
 	inline void WriteBus(uint16_t address, uint8_t value);
@@ -232,12 +245,18 @@ private:
 	inline void ADCFast(uint8_t m);
 	inline void SBCFast(uint8_t m);
 	inline void FlushRunCycles();
+	inline void UpdateDeadline();
+	// Forces the dispatch loop into ServiceEvents() after the current instruction.
+	inline void ForceDeadline() { next_deadline = 0; }
+	bool ServiceEvents();
 
 	// stack operations
 	inline void StackPush(uint8_t byte);
 	inline uint8_t StackPop();
 
-	uint32_t irq_timer;
+	// run_clock value at which the scheduled IRQ fires (valid if irq_scheduled)
+	uint32_t irq_deadline;
+	bool irq_scheduled = false;
 	bool irq_line = false;
 
 	//Specific hack for the GameTank's Blit IRQ enable
@@ -248,6 +267,78 @@ private:
 	// Record the extra cycles into this value during execution
 	uint8_t opExtraCycles = 0;
 
+	// Micro-op block cache: the tier between the dynarec and the opcode
+	// switch. A basic block is decoded once into an array of MicroOps and
+	// replayed without re-fetching or re-decoding. Portable C++, so it also
+	// runs on the host build and for RAM code the dynarec refuses.
+	enum MicroOpMode : uint8_t {
+		UOP_STATIC,  // src = operand (IMP/ACC/IMM/ZER/ABS/REL)
+		UOP_ZEX,     // src = (operand + X) & 0xFF
+		UOP_ZEY,     // src = (operand + Y) & 0xFF
+		UOP_ABX,     // src = operand + X, +1 cycle on page cross
+		UOP_ABY,     // src = operand + Y, +1 cycle on page cross
+		UOP_FETCH,   // indirect modes and BBRx/BBSx: run the Addr_* fetch from pc = operand
+	};
+
+	struct MicroOp
+	{
+		CodeExec code;
+		uint16_t operand;
+		uint16_t next_pc;  // PC after this instruction
+		uint8_t mode;
+		uint8_t cycles;
+		uint8_t opcode;
+		uint8_t length;
+	};
+
+	struct MicroBlock
+	{
+		uint16_t pc;
+		uint16_t first;    // index of the first op in uop_ops
+		uint32_t bank;     // code bank (ROM) or RAM epoch the block was decoded from
+		uint8_t count;
+		MicroBlock* next;  // hash collision chain
+	};
+
+	static const int UOP_TABLE_SIZE = 256;
+	static const int UOP_MAX_BLOCKS = 512;
+	static const int UOP_MAX_OPS = 2048;
+	static const int UOP_MAX_BLOCK_OPS = 32;
+
+	// Off unless EnableMicroOpCache(); allocated on first use.
+	bool uop_enabled = false;
+	MicroBlock** uop_table = nullptr;
+	MicroBlock* uop_blocks = nullptr;
+	MicroOp* uop_ops = nullptr;
+	int uop_blocks_used = 0;
+	int uop_ops_used = 0;
+	uint32_t uop_rom_bank = 0;
+	uint32_t uop_ram_epoch = 0;
+	// One bit per 256-byte RAM page that holds decoded code; a write there
+	// drops the RAM blocks.
+	uint32_t uop_ram_pages = 0;
+	// One bit per 16KB window of the Flash2M image blocks were decoded from
+	uint32_t uop_rom_windows[4] = {};
+
+	inline uint32_t MicroBlockBank(uint16_t address) const;
+	MicroBlock* FindMicroBlock(uint16_t address);
+	MicroBlock* BuildMicroBlock(uint16_t address);
+	void ResetMicroBlocks();
+	bool RunMicroBlock();
+	inline void NoteRamWrite(uint16_t address);
+
+#if defined(NDS_BUILD) && defined(ARM9)
+	// ARM asm loop (mos6502_hot_arm.s). asm_deadline is the run_clock value
+	// its cycles_remaining counts down to.
+	uint32_t asm_deadline = 0;
+	void RunAsmLoop();
+	inline void AsmBusAccess();
+	inline void AsmBusDone();
+	friend uint8_t mos6502_asm_read(CpuState* state, uint16_t address);
+	friend void mos6502_asm_write(CpuState* state, uint16_t address, uint8_t value);
+#endif
+	inline void CompiledBusDone(uint32_t entry_clock, uint32_t deadline);
+
 public:
 	bool freeze = false;
 	bool illegalOpcode = false;
@@ -268,25 +359,17 @@ public:
 	uint32_t last_entry_hits = 0;
 #endif
 
-	// registers
-	uint8_t A; // accumulator
-	uint8_t X; // X-index
-	uint8_t Y; // Y-index
+	// Registers, pc and flags (A, X, Y, sp, pc, status, flag_*) are
+	// inherited from CpuState so the dynarec and asm loop can work on them
+	// in place. status holds D, I, B and bit 5 only; use
+	// GetStatus()/SetStatus() for the full P byte.
 
-	// stack pointer
-	uint8_t sp;
-
-	// program counter
-	uint16_t pc;
-
-	// status register
-	uint8_t status;
-	
 	enum CycleMethod {
 		INST_COUNT,
 		CYCLE_COUNT,
 	};
 	mos6502(BusRead r, BusWrite w, CPUEvent stp, BusRead sync = NULL);
+	~mos6502();
 	void NMI();
 	void IRQ();
 	void ScheduleIRQ(uint32_t cycles, bool *gate);
@@ -306,6 +389,23 @@ public:
 	void ResetCacheProfile();
 #endif
 	void Freeze();
+	// Parked in WAI with no IRQ pending or scheduled: nothing but an NMI
+	// can wake the CPU, so the caller may account the slice without Run().
+	bool IsIdle() const { return waiting && !irq_line && !irq_scheduled; }
+
+	// Micro-op cache control. The cache is off until enabled, and only a CPU
+	// whose code changes through its own bus writes or the calls below may
+	// enable it (not the ACP, whose RAM its host rewrites directly). Blocks
+	// decoded from $8000-$BFFF are tagged with the bank passed to
+	// SetCodeBank(), so switching back to a bank reuses them. InvalidateRamCode() drops blocks decoded from RAM (RAM bank
+	// switch); InvalidateRomRange() drops what was decoded from the given
+	// bytes of the Flash2M image (flash programming and erases);
+	// InvalidateCode() drops everything (ROM reload, cartridge save RAM).
+	void EnableMicroOpCache(bool enable);
+	void SetCodeBank(uint32_t bank) { uop_rom_bank = bank; }
+	void InvalidateCode();
+	void InvalidateRamCode();
+	void InvalidateRomRange(uint32_t lo, uint32_t hi);
 
 	// Accessor methods for dynarec
 	uint8_t GetA() const { return A; }
@@ -313,12 +413,21 @@ public:
 	uint8_t GetY() const { return Y; }
 	uint8_t GetSP() const { return sp; }
 	uint16_t GetPC() const { return pc; }
-	uint8_t GetStatus() const { return status; }
+	uint8_t GetStatus() const { return PackStatus(status, flag_nz, flag_c, flag_v); }
 
 	void SetA(uint8_t val) { A = val; }
 	void SetX(uint8_t val) { X = val; }
 	void SetY(uint8_t val) { Y = val; }
 	void SetSP(uint8_t val) { sp = val; }
 	void SetPC(uint16_t val) { pc = val; }
-	void SetStatus(uint8_t val) { status = val; }
+	void SetStatus(uint8_t val) { UnpackStatus(val, status, flag_nz, flag_c, flag_v); }
+
+	// Opcode fetch hook (debugger, profiler). While one is set Run() keeps
+	// to the interpreter tiers, so install it only when something needs it.
+	void SetSync(BusRead sync) { Sync = sync; }
+
+	// Bus accesses from compiled blocks, elapsed cycles into the block.
+	// One that moves the deadline or switches banks sets exit_reason.
+	uint8_t CompiledRead(uint16_t address, int32_t elapsed);
+	void CompiledWrite(uint16_t address, uint8_t value, int32_t elapsed);
 };
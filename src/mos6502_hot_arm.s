@@ -1,209 +1,3439 @@
-.syntax unified
-.arm
-
-.section .itcm, "ax", %progbits
-.align 2
-
 /*
  * ARM assembly 6502 dispatch loop for GameTank NDS emulator.
  *
+ * GENERATED by tools/gen_mos6502_hot_arm.py from the InstrTable in
+ * src/mos6502/mos6502.cpp -- edit the generator, not this file.
+ *
  * Register allocation:
  *   r4  = A (accumulator, 8-bit value in low byte)
  *   r5  = X (X index register)
  *   r6  = Y (Y index register)
- *   r7  = status (P register)
+ *   r7  = lazy N/Z word (see mos6502/lazy_flags.h)
  *   r8  = PC (16-bit program counter)
- *   r9  = cached_ram_ptr
- *   r10 = sp_6502 (stack pointer, 8-bit)
- *   r11 = cycles_remaining
+ *   r9  = RAM pointer (current bank)
+ *   r10 = carry (0 or 1)
+ *   r11 = cycles_remaining (distance to the caller's next event deadline;
+ *         IRQ/NMI bookkeeping stays in C++ and only runs once it hits 0)
  *   r0-r3, r12, lr = scratch
  *
- * Stack frame (after push {r4-r11, lr} + sub sp, #24):
- *   [sp, #0]  = AsmCpuState*
- *   [sp, #4]  = cached_rom_lo_ptr
- *   [sp, #8]  = cached_rom_hi_ptr
- *   [sp, #12] = cached_ram_init_ptr (bool*)
- *   [sp, #16] = VIA_regs pointer
- *   [sp, #20] = scratch
+ * Flags use the same lazy form as the interpreter and compiled blocks, so
+ * nothing is packed or unpacked on entry or exit. The 6502 stack pointer
+ * and the remaining P bits (D/I/B/V) stay in CpuState.
+ *
+ * RAM and ROM are accessed inline and VIA registers are read inline. A RAM
+ * store from $0200 up looks up its page in code_pages (dynarec.h) and, on
+ * a page holding compiled or decoded code, calls mos6502_asm_code_write to
+ * drop what covers the byte. Every other access calls mos6502_asm_read or
+ * mos6502_asm_write in mos6502.cpp with the CpuState, which is the running
+ * CPU, and the registers spilled to it, so the bus sees the same state and
+ * cycle count it would under the interpreter, and the registers are
+ * reloaded afterwards (an access can raise an IRQ or switch banks).
+ * Decimal ADC/SBC call the bcd.h routines the same way.
+ *
+ * Each handler charges the table's base cycles once the instruction is
+ * done; page-crossing penalties are charged when the address is formed.
+ *
+ * Stack frame (after push {r4-r11, lr} + sub sp, #44):
+ *   [sp, #0]  = CpuState*
+ *   [sp, #4]  = rom_lo - $8000 (indexed by the 6502 address)
+ *   [sp, #8]  = rom_hi - $C000
+ *   [sp, #12] = VIA_regs pointer
+ *   [sp, #16] = r0-r3, lr saved around bus helper calls
+ *   [sp, #36] = bus helper result
+ *   [sp, #40] = lr of the operand fetch and decimal subroutines
  *
- * AsmCpuState layout:
+ * CpuState layout (mos6502/cpu_state.h, checked there by static_assert):
  *   +0: A, +1: X, +2: Y, +3: sp
- *   +4: status, +5: exit_reason, +6: exit_opcode, +7: pad
- *   +8: pc (u16), +10: exit_addr (u16)
- *   +12: cycles_remaining (i32)
- *   +16: exit_value, +17: exit_is_write
+ *   +4: status (D/I/B/bit 5), +5: carry, +6: v, +7: exit_reason
+ *   +8: pc (u16), +10: exit_opcode, +12: nz (u32)
+ *   +16: cycles_remaining (i32), +20: ram, +24: rom_lo, +28: rom_hi
+ *   +32: code_pages
  */
 
+.syntax unified
+.arm
+
+.section .text.mos6502_run_asm, "ax", %progbits
+.align 2
+
 .global mos6502_run_asm
 .type mos6502_run_asm, %function
 
+.equ CS_A,              0
+.equ CS_X,              1
+.equ CS_Y,              2
+.equ CS_SP,             3
+.equ CS_STATUS,         4
+.equ CS_CARRY,          5
+.equ CS_V,              6
+.equ CS_EXIT_REASON,    7
+.equ CS_PC,             8
+.equ CS_EXIT_OPCODE,    10
+.equ CS_NZ,             12
+.equ CS_CYCLES_REM,     16
+.equ CS_RAM,            20
+.equ CS_ROM_LO,         24
+.equ CS_ROM_HI,         28
+.equ CS_CODE_PAGES,     32
+
+.equ FR_STATE,          0
+.equ FR_ROM_LO,         4
+.equ FR_ROM_HI,         8
+.equ FR_VIA,            12
+.equ FR_SAVE,           16
+.equ FR_RESULT,         36
+.equ FR_LINK,           40
+.equ FR_SIZE,           44
+
 /* ========== Macros ========== */
 
-/* Set N and Z flags in r7 from 8-bit value in \reg */
-.macro SET_NZ reg
-    bic     r7, r7, #0x82
-    tst     \reg, #0x80
-    orrne   r7, r7, #0x80
-    tst     \reg, #0xFF
-    orreq   r7, r7, #0x02
+/* Store the 6502 registers held in ARM registers back to CpuState */
+.macro SPILL
+    ldr     r12, [sp, #FR_STATE]
+    strb    r4, [r12, #CS_A]
+    strb    r5, [r12, #CS_X]
+    strb    r6, [r12, #CS_Y]
+    str     r7, [r12, #CS_NZ]
+    strb    r10, [r12, #CS_CARRY]
+    strh    r8, [r12, #CS_PC]
+    str     r11, [r12, #CS_CYCLES_REM]
+.endm
+
+/* Load the 6502 registers and memory pointers from CpuState. Clobbers r0 */
+.macro RELOAD
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r4, [r12, #CS_A]
+    ldrb    r5, [r12, #CS_X]
+    ldrb    r6, [r12, #CS_Y]
+    ldr     r7, [r12, #CS_NZ]
+    ldrb    r10, [r12, #CS_CARRY]
+    ldrh    r8, [r12, #CS_PC]
+    ldr     r11, [r12, #CS_CYCLES_REM]
+    ldr     r9, [r12, #CS_RAM]
+    ldr     r0, [r12, #CS_ROM_LO]
+    sub     r0, r0, #0x8000
+    str     r0, [sp, #FR_ROM_LO]
+    ldr     r0, [r12, #CS_ROM_HI]
+    sub     r0, r0, #0xC000
+    str     r0, [sp, #FR_ROM_HI]
 .endm
 
 /*
- * Fetch a byte from PC. PC must be >= 0x8000 (ROM).
- * Result in \dst. Clobbers \tmp.
- * If PC < 0x8000, exits to C++.
+ * Fetch the byte at PC into \dst and advance PC. ROM is read inline; RAM
+ * and I/O go through .Lio_fetch. Clobbers r12.
  */
-.macro FETCH_PC dst, tmp
-    /* Check PC is in ROM range */
+.macro FETCH dst
     tst     r8, #0x8000
-    beq     .Lexit_unhandled_fetch
+    beq     90f
     tst     r8, #0x4000
-    /* hi bank: $C000-$FFFF */
-    ldrne   \tmp, [sp, #8]       /* rom_hi_ptr */
-    /* lo bank: $8000-$BFFF */
-    ldreq   \tmp, [sp, #4]       /* rom_lo_ptr */
-    bic     \dst, r8, #0xC000    /* addr & 0x3FFF */
-    ldrb    \dst, [\tmp, \dst]
+    ldreq   r12, [sp, #FR_ROM_LO]
+    ldrne   r12, [sp, #FR_ROM_HI]
+    ldrb    \dst, [r12, r8]
+    b       91f
+90:
+    bl      .Lio_fetch
+    mov     \dst, r12
+91:
     add     r8, r8, #1
-    bic     r8, r8, #0x10000     /* keep 16-bit */
+    bic     r8, r8, #0x10000
+.endm
+
+/*
+ * Read the byte at address r0 into \dst (not r0). RAM is read inline,
+ * everything else through .Lread_high. Clobbers r12, lr.
+ */
+.macro READ dst
+    cmp     r0, #0x2000
+    ldrblo  \dst, [r9, r0]
+    blo     93f
+    bl      .Lread_high
+    mov     \dst, r12
+93:
 .endm
 
 /*
- * Read a byte from address in \addr (16-bit).
- * Result in \dst. Clobbers r0, r1, r2, r3, r12.
- * For addresses that can't be resolved inline, exits to C++.
+ * Write r1 to address r0. RAM is written inline, then checked against
+ * code_pages unless it is zero page or the stack. Clobbers r12
  */
-.macro READ_BYTE addr, dst
-    /* RAM: $0000-$1FFF */
-    cmp     \addr, #0x2000
-    ldrltb  \dst, [r9, \addr]
-    blt     991f
-    /* ROM hi: $C000-$FFFF */
-    cmp     \addr, #0xC000
-    blt     990f
-    ldr     r12, [sp, #8]        /* rom_hi_ptr */
-    bic     \dst, \addr, #0xC000
-    ldrb    \dst, [r12, \dst]
-    b       991f
-990:
-    /* ROM lo: $8000-$BFFF */
-    tst     \addr, #0x8000
-    beq     992f
-    ldr     r12, [sp, #4]        /* rom_lo_ptr */
-    bic     \dst, \addr, #0xC000
-    ldrb    \dst, [r12, \dst]
-    b       991f
-992:
-    /* VIA: $2800-$2FFF */
-    cmp     \addr, #0x2800
-    blt     993f
-    cmp     \addr, #0x3000
-    bge     993f
-    ldr     r12, [sp, #16]       /* VIA_regs pointer */
-    and     r0, \addr, #0xF
-    ldrb    \dst, [r12, r0]
-    b       991f
-993:
-    /* Unhandled address - exit to C++ for I/O */
-    b       .Lexit_io_read
-991:
+.macro WRITE
+    cmp     r0, #0x2000
+    bhs     94f
+    strb    r1, [r9, r0]
+    cmp     r0, #0x200
+    blo     95f
+    ldr     r12, [sp, #FR_STATE]
+    ldr     r12, [r12, #CS_CODE_PAGES]
+    ldrb    r12, [r12, r0, lsr #8]
+    cmp     r12, #0
+    blne    .Lcode_write
+    b       95f
+94:
+    bl      .Lio_write
+95:
+.endm
+
+/* Push \reg (not r2, r3) onto the 6502 stack. Clobbers r2, r3, r12 */
+.macro PUSH reg
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_SP]
+    add     r3, r9, #0x100
+    strb    \reg, [r3, r2]
+    sub     r2, r2, #1
+    and     r2, r2, #0xFF
+    strb    r2, [r12, #CS_SP]
+.endm
+
+/* Pop the 6502 stack into \dst (not r2, r3). Clobbers r2, r3, r12 */
+.macro POP dst
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_SP]
+    add     r2, r2, #1
+    and     r2, r2, #0xFF
+    strb    r2, [r12, #CS_SP]
+    add     r3, r9, #0x100
+    ldrb    \dst, [r3, r2]
+.endm
+
+/* Charge \cycles and continue with the next instruction */
+.macro NEXT cycles
+    subs    r11, r11, #\cycles
+    bgt     .Ldispatch_fetch
+    b       .Lexit_cycles_done
 .endm
 
 /* ========== Function Entry ========== */
 
+/*
+ * void mos6502_run_asm(CpuState* state, const uint8_t* via_regs)
+ *
+ * Runs until cycles_remaining reaches 0 (exit_reason 0) or an opcode the
+ * loop leaves to the interpreter (exit_reason 1, pc at that opcode).
+ */
 mos6502_run_asm:
-    /* Save callee-saved registers */
     push    {r4-r11, lr}
-    sub     sp, sp, #24
+    sub     sp, sp, #FR_SIZE
+    str     r0, [sp, #FR_STATE]
+    str     r1, [sp, #FR_VIA]
+    RELOAD
 
-    /* Store AsmCpuState pointer */
-    str     r0, [sp, #0]
+/* ========== Main Dispatch Loop ========== */
 
-    /* Store ROM pointers */
-    str     r2, [sp, #4]         /* rom_lo_ptr */
-    str     r3, [sp, #8]         /* rom_hi_ptr */
+.Ldispatch:
+    cmp     r11, #0
+    ble     .Lexit_cycles_done
+.Ldispatch_fetch:
+    FETCH   r0
+    ldr     pc, [pc, r0, lsl #2]
+    nop
+.Lop_table:
+    .word   .Lop_00
+    .word   .Lop_01
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_04
+    .word   .Lop_05
+    .word   .Lop_06
+    .word   .Lop_07
+    .word   .Lop_08
+    .word   .Lop_09
+    .word   .Lop_0A
+    .word   .Lop_unhandled
+    .word   .Lop_0C
+    .word   .Lop_0D
+    .word   .Lop_0E
+    .word   .Lop_0F
+    .word   .Lop_10
+    .word   .Lop_11
+    .word   .Lop_12
+    .word   .Lop_unhandled
+    .word   .Lop_14
+    .word   .Lop_15
+    .word   .Lop_16
+    .word   .Lop_17
+    .word   .Lop_18
+    .word   .Lop_19
+    .word   .Lop_1A
+    .word   .Lop_unhandled
+    .word   .Lop_1C
+    .word   .Lop_1D
+    .word   .Lop_1E
+    .word   .Lop_1F
+    .word   .Lop_20
+    .word   .Lop_21
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_24
+    .word   .Lop_25
+    .word   .Lop_26
+    .word   .Lop_27
+    .word   .Lop_28
+    .word   .Lop_29
+    .word   .Lop_2A
+    .word   .Lop_unhandled
+    .word   .Lop_2C
+    .word   .Lop_2D
+    .word   .Lop_2E
+    .word   .Lop_2F
+    .word   .Lop_30
+    .word   .Lop_31
+    .word   .Lop_32
+    .word   .Lop_unhandled
+    .word   .Lop_34
+    .word   .Lop_35
+    .word   .Lop_36
+    .word   .Lop_37
+    .word   .Lop_38
+    .word   .Lop_39
+    .word   .Lop_3A
+    .word   .Lop_unhandled
+    .word   .Lop_3C
+    .word   .Lop_3D
+    .word   .Lop_3E
+    .word   .Lop_3F
+    .word   .Lop_40
+    .word   .Lop_41
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_45
+    .word   .Lop_46
+    .word   .Lop_47
+    .word   .Lop_48
+    .word   .Lop_49
+    .word   .Lop_4A
+    .word   .Lop_unhandled
+    .word   .Lop_4C
+    .word   .Lop_4D
+    .word   .Lop_4E
+    .word   .Lop_4F
+    .word   .Lop_50
+    .word   .Lop_51
+    .word   .Lop_52
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_55
+    .word   .Lop_56
+    .word   .Lop_57
+    .word   .Lop_58
+    .word   .Lop_59
+    .word   .Lop_5A
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_5D
+    .word   .Lop_5E
+    .word   .Lop_5F
+    .word   .Lop_60
+    .word   .Lop_61
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_64
+    .word   .Lop_65
+    .word   .Lop_66
+    .word   .Lop_67
+    .word   .Lop_68
+    .word   .Lop_69
+    .word   .Lop_6A
+    .word   .Lop_unhandled
+    .word   .Lop_6C
+    .word   .Lop_6D
+    .word   .Lop_6E
+    .word   .Lop_6F
+    .word   .Lop_70
+    .word   .Lop_71
+    .word   .Lop_72
+    .word   .Lop_unhandled
+    .word   .Lop_74
+    .word   .Lop_75
+    .word   .Lop_76
+    .word   .Lop_77
+    .word   .Lop_78
+    .word   .Lop_79
+    .word   .Lop_7A
+    .word   .Lop_unhandled
+    .word   .Lop_7C
+    .word   .Lop_7D
+    .word   .Lop_7E
+    .word   .Lop_7F
+    .word   .Lop_80
+    .word   .Lop_81
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_84
+    .word   .Lop_85
+    .word   .Lop_86
+    .word   .Lop_87
+    .word   .Lop_88
+    .word   .Lop_89
+    .word   .Lop_8A
+    .word   .Lop_unhandled
+    .word   .Lop_8C
+    .word   .Lop_8D
+    .word   .Lop_8E
+    .word   .Lop_8F
+    .word   .Lop_90
+    .word   .Lop_91
+    .word   .Lop_92
+    .word   .Lop_unhandled
+    .word   .Lop_94
+    .word   .Lop_95
+    .word   .Lop_96
+    .word   .Lop_97
+    .word   .Lop_98
+    .word   .Lop_99
+    .word   .Lop_9A
+    .word   .Lop_unhandled
+    .word   .Lop_9C
+    .word   .Lop_9D
+    .word   .Lop_9E
+    .word   .Lop_9F
+    .word   .Lop_A0
+    .word   .Lop_A1
+    .word   .Lop_A2
+    .word   .Lop_unhandled
+    .word   .Lop_A4
+    .word   .Lop_A5
+    .word   .Lop_A6
+    .word   .Lop_A7
+    .word   .Lop_A8
+    .word   .Lop_A9
+    .word   .Lop_AA
+    .word   .Lop_unhandled
+    .word   .Lop_AC
+    .word   .Lop_AD
+    .word   .Lop_AE
+    .word   .Lop_AF
+    .word   .Lop_B0
+    .word   .Lop_B1
+    .word   .Lop_B2
+    .word   .Lop_unhandled
+    .word   .Lop_B4
+    .word   .Lop_B5
+    .word   .Lop_B6
+    .word   .Lop_B7
+    .word   .Lop_B8
+    .word   .Lop_B9
+    .word   .Lop_BA
+    .word   .Lop_unhandled
+    .word   .Lop_BC
+    .word   .Lop_BD
+    .word   .Lop_BE
+    .word   .Lop_BF
+    .word   .Lop_C0
+    .word   .Lop_C1
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_C4
+    .word   .Lop_C5
+    .word   .Lop_C6
+    .word   .Lop_C7
+    .word   .Lop_C8
+    .word   .Lop_C9
+    .word   .Lop_CA
+    .word   .Lop_unhandled
+    .word   .Lop_CC
+    .word   .Lop_CD
+    .word   .Lop_CE
+    .word   .Lop_CF
+    .word   .Lop_D0
+    .word   .Lop_D1
+    .word   .Lop_D2
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_D5
+    .word   .Lop_D6
+    .word   .Lop_D7
+    .word   .Lop_D8
+    .word   .Lop_D9
+    .word   .Lop_DA
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_DD
+    .word   .Lop_DE
+    .word   .Lop_DF
+    .word   .Lop_E0
+    .word   .Lop_E1
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_E4
+    .word   .Lop_E5
+    .word   .Lop_E6
+    .word   .Lop_E7
+    .word   .Lop_E8
+    .word   .Lop_E9
+    .word   .Lop_EA
+    .word   .Lop_unhandled
+    .word   .Lop_EC
+    .word   .Lop_ED
+    .word   .Lop_EE
+    .word   .Lop_EF
+    .word   .Lop_F0
+    .word   .Lop_F1
+    .word   .Lop_F2
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_F5
+    .word   .Lop_F6
+    .word   .Lop_F7
+    .word   .Lop_F8
+    .word   .Lop_F9
+    .word   .Lop_FA
+    .word   .Lop_unhandled
+    .word   .Lop_unhandled
+    .word   .Lop_FD
+    .word   .Lop_FE
+    .word   .Lop_FF
 
-    /* Load stack arguments (5th and 6th args passed on stack) */
-    ldr     r12, [sp, #48]       /* ram_init_ptr */
-    str     r12, [sp, #12]
-    ldr     r12, [sp, #52]       /* VIA_regs pointer */
-    str     r12, [sp, #16]
+/* ========== Opcode handlers ========== */
 
-    /* Load CPU state from AsmCpuState */
-    ldrb    r4, [r0, #0]         /* A */
-    ldrb    r5, [r0, #1]         /* X */
-    ldrb    r6, [r0, #2]         /* Y */
-    ldrb    r10, [r0, #3]        /* sp */
-    ldrb    r7, [r0, #4]         /* status */
-    ldrh    r8, [r0, #8]         /* PC */
-    ldr     r11, [r0, #12]       /* cycles_remaining */
+/* $00: BRK, 7 cycles */
+.Lop_00:
+    add     r8, r8, #1
+    bic     r8, r8, #0x10000
+    mov     r1, r8, lsr #8
+    PUSH    r1
+    and     r1, r8, #0xFF
+    PUSH    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r1, [r12, #CS_STATUS]
+    ldrb    r2, [r12, #CS_V]
+    orr     r1, r1, r2, lsl #6
+    orr     r1, r1, r10
+    tst     r7, #0xFF
+    orreq   r1, r1, #0x02
+    tst     r7, #0x180
+    orrne   r1, r1, #0x80
+    orr     r1, r1, #0x10
+    PUSH    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    orr     r2, r2, #0x04
+    strb    r2, [r12, #CS_STATUS]
+    mov     r0, #0xFF00
+    orr     r0, r0, #0xFF
+    READ    r1
+    sub     r0, r0, #1
+    READ    r2
+    orr     r8, r2, r1, lsl #8
+    NEXT    7
 
-    /* r9 = cached_ram_ptr (from arg1) */
-    mov     r9, r1
+/* $01: ORA (zp,X), 6 cycles */
+.Lop_01:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    6
 
-/* ========== Main Dispatch Loop ========== */
+/* $04: TSB zp, 5 cycles */
+.Lop_04:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    tst     r7, #0x180
+    movne   r2, #0x80
+    moveq   r2, #0
+    tst     r1, r4
+    movne   r7, r2, lsl #1
+    bne     1f
+    cmp     r2, #0
+    moveq   r2, #1
+    mov     r7, r2
+1:
+    orr     r1, r1, r4
+    strb    r1, [r9, r0]
+    NEXT    5
 
-.Ldispatch_loop:
-    /* Check cycles_remaining */
-    cmp     r11, #0
-    ble     .Lexit_cycles_done
+/* $05: ORA zp, 3 cycles */
+.Lop_05:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    3
 
-    /* Fetch opcode */
-    FETCH_PC r0, r12             /* r0 = opcode */
+/* $06: ASL zp, 5 cycles */
+.Lop_06:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    mov     r1, r1, lsl #1
+    mov     r10, r1, lsr #8
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    5
 
-    /* Dispatch via jump table - simplified for common opcodes */
-    /* This is a placeholder - the actual implementation would have */
-    /* a full 256-entry jump table */
+/* $07: RMB0 zp, 5 cycles */
+.Lop_07:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    bic     r1, r1, #0x01
+    strb    r1, [r9, r0]
+    NEXT    5
 
-    /* For now, exit to C++ for all opcodes */
-    b       .Lexit_unhandled
+/* $08: PHP, 3 cycles */
+.Lop_08:
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r1, [r12, #CS_STATUS]
+    ldrb    r2, [r12, #CS_V]
+    orr     r1, r1, r2, lsl #6
+    orr     r1, r1, r10
+    tst     r7, #0xFF
+    orreq   r1, r1, #0x02
+    tst     r7, #0x180
+    orrne   r1, r1, #0x80
+    orr     r1, r1, #0x10
+    PUSH    r1
+    NEXT    3
 
-/* ========== Exit Handlers ========== */
+/* $09: ORA #imm, 2 cycles */
+.Lop_09:
+    bl      .Lfetch8
+    mov     r1, r0
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    2
 
-.Lexit_cycles_done:
-    mov     r0, #0               /* exit_reason = 0 (cycles done) */
-    b       .Lwrite_back
+/* $0A: ASL A, 2 cycles */
+.Lop_0A:
+    mov     r4, r4, lsl #1
+    mov     r10, r4, lsr #8
+    and     r4, r4, #0xFF
+    mov     r7, r4
+    NEXT    2
 
-.Lexit_unhandled_fetch:
-    sub     r8, r8, #1           /* roll back PC */
+/* $0C: TSB abs, 6 cycles */
+.Lop_0C:
+    bl      .Lfetch16
+    READ    r1
+    tst     r7, #0x180
+    movne   r2, #0x80
+    moveq   r2, #0
+    tst     r1, r4
+    movne   r7, r2, lsl #1
+    bne     1f
+    cmp     r2, #0
+    moveq   r2, #1
+    mov     r7, r2
+1:
+    orr     r1, r1, r4
+    WRITE
+    NEXT    6
 
-.Lexit_unhandled:
-    mov     r0, #1               /* exit_reason = 1 (unhandled opcode) */
-    b       .Lwrite_back
+/* $0D: ORA abs, 4 cycles */
+.Lop_0D:
+    bl      .Lfetch16
+    READ    r1
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
 
-.Lexit_io_read:
-    /* Store exit info for I/O read */
-    ldr     r12, [sp, #0]        /* AsmCpuState* */
-    strh    r2, [r12, #10]       /* exit_addr */
-    mov     r3, #0
-    strb    r3, [r12, #17]       /* exit_is_write = 0 */
-    mov     r0, #2               /* exit_reason = 2 (I/O) */
-    b       .Lwrite_back
+/* $0E: ASL abs, 6 cycles */
+.Lop_0E:
+    bl      .Lfetch16
+    READ    r1
+    mov     r1, r1, lsl #1
+    mov     r10, r1, lsr #8
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $0F: BBR0, 5 cycles */
+.Lop_0F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x01
+    bne     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $10: BPL rel, 2 cycles */
+.Lop_10:
+    bl      .Lfetch8
+    tst     r7, #0x180
+    bne     2f
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    sub     r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    2
+
+/* $11: ORA (zp),Y, 5 cycles */
+.Lop_11:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    5
+
+/* $12: ORA (zp), 5 cycles */
+.Lop_12:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    5
+
+/* $14: TRB zp, 5 cycles */
+.Lop_14:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    tst     r7, #0x180
+    movne   r2, #0x80
+    moveq   r2, #0
+    tst     r1, r4
+    movne   r7, r2, lsl #1
+    bne     1f
+    cmp     r2, #0
+    moveq   r2, #1
+    mov     r7, r2
+1:
+    bic     r1, r1, r4
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $15: ORA zp,X, 4 cycles */
+.Lop_15:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $16: ASL zp,X, 6 cycles */
+.Lop_16:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    mov     r1, r1, lsl #1
+    mov     r10, r1, lsr #8
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    6
+
+/* $17: RMB1 zp, 5 cycles */
+.Lop_17:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    bic     r1, r1, #0x02
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $18: CLC, 2 cycles */
+.Lop_18:
+    mov     r10, #0
+    NEXT    2
+
+/* $19: ORA abs,Y, 4 cycles */
+.Lop_19:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $1A: INC, 2 cycles */
+.Lop_1A:
+    add     r4, r4, #1
+    and     r4, r4, #0xFF
+    mov     r7, r4
+    NEXT    2
+
+/* $1C: TRB abs, 6 cycles */
+.Lop_1C:
+    bl      .Lfetch16
+    READ    r1
+    tst     r7, #0x180
+    movne   r2, #0x80
+    moveq   r2, #0
+    tst     r1, r4
+    movne   r7, r2, lsl #1
+    bne     1f
+    cmp     r2, #0
+    moveq   r2, #1
+    mov     r7, r2
+1:
+    bic     r1, r1, r4
+    WRITE
+    NEXT    6
+
+/* $1D: ORA abs,X, 4 cycles */
+.Lop_1D:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    orr     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $1E: ASL abs,X, 6 cycles */
+.Lop_1E:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    mov     r1, r1, lsl #1
+    mov     r10, r1, lsr #8
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $1F: BBR1, 5 cycles */
+.Lop_1F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x02
+    bne     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $20: JSR abs, 6 cycles */
+.Lop_20:
+    bl      .Lfetch16
+    sub     r8, r8, #1
+    mov     r8, r8, lsl #16
+    mov     r8, r8, lsr #16
+    mov     r1, r8, lsr #8
+    PUSH    r1
+    and     r1, r8, #0xFF
+    PUSH    r1
+    mov     r8, r0
+    NEXT    6
+
+/* $21: AND (zp,X), 6 cycles */
+.Lop_21:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    6
+
+/* $24: BIT zp, 3 cycles */
+.Lop_24:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    ldr     r12, [sp, #FR_STATE]
+    mov     r3, r1, lsr #6
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    tst     r4, r1
+    and     r7, r1, #0x80
+    moveq   r7, r7, lsl #1
+    beq     1f
+    cmp     r7, #0
+    moveq   r7, #1
+1:
+    NEXT    3
+
+/* $25: AND zp, 3 cycles */
+.Lop_25:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    3
+
+/* $26: ROL zp, 5 cycles */
+.Lop_26:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    mov     r1, r1, lsl #1
+    orr     r1, r1, r10
+    mov     r10, r1, lsr #8
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $27: RMB2 zp, 5 cycles */
+.Lop_27:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    bic     r1, r1, #0x04
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $28: PLP, 4 cycles */
+.Lop_28:
+    POP     r1
+    ldr     r12, [sp, #FR_STATE]
+    and     r2, r1, #0x3C
+    strb    r2, [r12, #CS_STATUS]
+    mov     r2, r1, lsr #6
+    and     r2, r2, #1
+    strb    r2, [r12, #CS_V]
+    and     r10, r1, #1
+    tst     r1, #0x02
+    and     r7, r1, #0x80
+    movne   r7, r7, lsl #1
+    bne     1f
+    cmp     r7, #0
+    moveq   r7, #1
+1:
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    orr     r2, r2, #0x20
+    strb    r2, [r12, #CS_STATUS]
+    NEXT    4
+
+/* $29: AND #imm, 2 cycles */
+.Lop_29:
+    bl      .Lfetch8
+    mov     r1, r0
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    2
+
+/* $2A: ROL A, 2 cycles */
+.Lop_2A:
+    mov     r4, r4, lsl #1
+    orr     r4, r4, r10
+    mov     r10, r4, lsr #8
+    and     r4, r4, #0xFF
+    mov     r7, r4
+    NEXT    2
+
+/* $2C: BIT abs, 4 cycles */
+.Lop_2C:
+    bl      .Lfetch16
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    mov     r3, r1, lsr #6
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    tst     r4, r1
+    and     r7, r1, #0x80
+    moveq   r7, r7, lsl #1
+    beq     1f
+    cmp     r7, #0
+    moveq   r7, #1
+1:
+    NEXT    4
+
+/* $2D: AND abs, 4 cycles */
+.Lop_2D:
+    bl      .Lfetch16
+    READ    r1
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $2E: ROL abs, 6 cycles */
+.Lop_2E:
+    bl      .Lfetch16
+    READ    r1
+    mov     r1, r1, lsl #1
+    orr     r1, r1, r10
+    mov     r10, r1, lsr #8
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $2F: BBR2, 5 cycles */
+.Lop_2F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x04
+    bne     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $30: BMI rel, 2 cycles */
+.Lop_30:
+    bl      .Lfetch8
+    tst     r7, #0x180
+    beq     2f
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    sub     r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    2
+
+/* $31: AND (zp),Y, 5 cycles */
+.Lop_31:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    5
+
+/* $32: AND (zp), 5 cycles */
+.Lop_32:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    5
+
+/* $34: BIT zp,X, 4 cycles */
+.Lop_34:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    ldr     r12, [sp, #FR_STATE]
+    mov     r3, r1, lsr #6
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    tst     r4, r1
+    and     r7, r1, #0x80
+    moveq   r7, r7, lsl #1
+    beq     1f
+    cmp     r7, #0
+    moveq   r7, #1
+1:
+    NEXT    4
+
+/* $35: AND zp,X, 4 cycles */
+.Lop_35:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $36: ROL zp,X, 6 cycles */
+.Lop_36:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    mov     r1, r1, lsl #1
+    orr     r1, r1, r10
+    mov     r10, r1, lsr #8
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    6
+
+/* $37: RMB3 zp, 5 cycles */
+.Lop_37:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    bic     r1, r1, #0x08
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $38: SEC, 2 cycles */
+.Lop_38:
+    mov     r10, #1
+    NEXT    2
+
+/* $39: AND abs,Y, 4 cycles */
+.Lop_39:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $3A: DEC, 2 cycles */
+.Lop_3A:
+    sub     r4, r4, #1
+    and     r4, r4, #0xFF
+    mov     r7, r4
+    NEXT    2
+
+/* $3C: BIT abs,X, 4 cycles */
+.Lop_3C:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    mov     r3, r1, lsr #6
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    tst     r4, r1
+    and     r7, r1, #0x80
+    moveq   r7, r7, lsl #1
+    beq     1f
+    cmp     r7, #0
+    moveq   r7, #1
+1:
+    NEXT    4
+
+/* $3D: AND abs,X, 4 cycles */
+.Lop_3D:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    and     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $3E: ROL abs,X, 6 cycles */
+.Lop_3E:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    mov     r1, r1, lsl #1
+    orr     r1, r1, r10
+    mov     r10, r1, lsr #8
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $3F: BBR3, 5 cycles */
+.Lop_3F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x08
+    bne     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $40: RTI, 6 cycles */
+.Lop_40:
+    POP     r1
+    ldr     r12, [sp, #FR_STATE]
+    and     r2, r1, #0x3C
+    strb    r2, [r12, #CS_STATUS]
+    mov     r2, r1, lsr #6
+    and     r2, r2, #1
+    strb    r2, [r12, #CS_V]
+    and     r10, r1, #1
+    tst     r1, #0x02
+    and     r7, r1, #0x80
+    movne   r7, r7, lsl #1
+    bne     1f
+    cmp     r7, #0
+    moveq   r7, #1
+1:
+    POP     r1
+    POP     r0
+    orr     r8, r1, r0, lsl #8
+    NEXT    6
+
+/* $41: EOR (zp,X), 6 cycles */
+.Lop_41:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    6
+
+/* $45: EOR zp, 3 cycles */
+.Lop_45:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    3
+
+/* $46: LSR zp, 5 cycles */
+.Lop_46:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    and     r10, r1, #1
+    mov     r1, r1, lsr #1
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $47: RMB4 zp, 5 cycles */
+.Lop_47:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    bic     r1, r1, #0x10
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $48: PHA, 3 cycles */
+.Lop_48:
+    PUSH    r4
+    NEXT    3
+
+/* $49: EOR #imm, 2 cycles */
+.Lop_49:
+    bl      .Lfetch8
+    mov     r1, r0
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    2
+
+/* $4A: LSR A, 2 cycles */
+.Lop_4A:
+    and     r10, r4, #1
+    mov     r4, r4, lsr #1
+    mov     r7, r4
+    NEXT    2
+
+/* $4C: JMP abs, 3 cycles */
+.Lop_4C:
+    bl      .Lfetch16
+    mov     r8, r0
+    NEXT    3
+
+/* $4D: EOR abs, 4 cycles */
+.Lop_4D:
+    bl      .Lfetch16
+    READ    r1
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $4E: LSR abs, 6 cycles */
+.Lop_4E:
+    bl      .Lfetch16
+    READ    r1
+    and     r10, r1, #1
+    mov     r1, r1, lsr #1
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $4F: BBR4, 5 cycles */
+.Lop_4F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x10
+    bne     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $50: BVC rel, 2 cycles */
+.Lop_50:
+    bl      .Lfetch8
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_V]
+    cmp     r2, #0
+    bne     2f
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    sub     r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    2
+
+/* $51: EOR (zp),Y, 5 cycles */
+.Lop_51:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    5
+
+/* $52: EOR (zp), 5 cycles */
+.Lop_52:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    5
+
+/* $55: EOR zp,X, 4 cycles */
+.Lop_55:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $56: LSR zp,X, 6 cycles */
+.Lop_56:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    and     r10, r1, #1
+    mov     r1, r1, lsr #1
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    6
+
+/* $57: RMB5 zp, 5 cycles */
+.Lop_57:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    bic     r1, r1, #0x20
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $58: CLI, 2 cycles */
+.Lop_58:
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    bic     r2, r2, #0x04
+    strb    r2, [r12, #CS_STATUS]
+    NEXT    2
+
+/* $59: EOR abs,Y, 4 cycles */
+.Lop_59:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $5A: PHY, 3 cycles */
+.Lop_5A:
+    PUSH    r6
+    NEXT    3
+
+/* $5D: EOR abs,X, 4 cycles */
+.Lop_5D:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    eor     r4, r4, r1
+    mov     r7, r4
+    NEXT    4
+
+/* $5E: LSR abs,X, 6 cycles */
+.Lop_5E:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    and     r10, r1, #1
+    mov     r1, r1, lsr #1
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $5F: BBR5, 5 cycles */
+.Lop_5F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x20
+    bne     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $60: RTS, 6 cycles */
+.Lop_60:
+    POP     r1
+    POP     r0
+    orr     r8, r1, r0, lsl #8
+    add     r8, r8, #1
+    bic     r8, r8, #0x10000
+    NEXT    6
+
+/* $61: ADC (zp,X), 6 cycles */
+.Lop_61:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    6
+
+/* $64: STZ zp, 3 cycles */
+.Lop_64:
+    bl      .Lfetch8
+    mov     r1, #0
+    strb    r1, [r9, r0]
+    NEXT    3
+
+/* $65: ADC zp, 3 cycles */
+.Lop_65:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    3
+
+/* $66: ROR zp, 5 cycles */
+.Lop_66:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, r10, lsl #8
+    and     r10, r1, #1
+    mov     r1, r1, lsr #1
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $67: RMB6 zp, 5 cycles */
+.Lop_67:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    bic     r1, r1, #0x40
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $68: PLA, 4 cycles */
+.Lop_68:
+    POP     r4
+    mov     r7, r4
+    NEXT    4
+
+/* $69: ADC #imm, 2 cycles */
+.Lop_69:
+    bl      .Lfetch8
+    mov     r1, r0
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    2
+
+/* $6A: ROR A, 2 cycles */
+.Lop_6A:
+    orr     r4, r4, r10, lsl #8
+    and     r10, r4, #1
+    mov     r4, r4, lsr #1
+    mov     r7, r4
+    NEXT    2
+
+/* $6C: JMP (abs), 5 cycles */
+.Lop_6C:
+    bl      .Lfetch16
+    READ    r2
+    add     r0, r0, #1
+    bic     r0, r0, #0x10000
+    READ    r3
+    orr     r0, r2, r3, lsl #8
+    mov     r8, r0
+    NEXT    5
+
+/* $6D: ADC abs, 4 cycles */
+.Lop_6D:
+    bl      .Lfetch16
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    4
+
+/* $6E: ROR abs, 6 cycles */
+.Lop_6E:
+    bl      .Lfetch16
+    READ    r1
+    orr     r1, r1, r10, lsl #8
+    and     r10, r1, #1
+    mov     r1, r1, lsr #1
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $6F: BBR6, 5 cycles */
+.Lop_6F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x40
+    bne     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $70: BVS rel, 2 cycles */
+.Lop_70:
+    bl      .Lfetch8
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_V]
+    cmp     r2, #0
+    beq     2f
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    sub     r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    2
+
+/* $71: ADC (zp),Y, 6 cycles */
+.Lop_71:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    6
+
+/* $72: ADC (zp), 6 cycles */
+.Lop_72:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    6
+
+/* $74: STZ zp,X, 4 cycles */
+.Lop_74:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    mov     r1, #0
+    strb    r1, [r9, r0]
+    NEXT    4
+
+/* $75: ADC zp,X, 4 cycles */
+.Lop_75:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    4
+
+/* $76: ROR zp,X, 6 cycles */
+.Lop_76:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, r10, lsl #8
+    and     r10, r1, #1
+    mov     r1, r1, lsr #1
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    6
+
+/* $77: RMB7 zp, 5 cycles */
+.Lop_77:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    bic     r1, r1, #0x80
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $78: SEI, 2 cycles */
+.Lop_78:
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    orr     r2, r2, #0x04
+    strb    r2, [r12, #CS_STATUS]
+    NEXT    2
+
+/* $79: ADC abs,Y, 4 cycles */
+.Lop_79:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    4
+
+/* $7A: PLY, 4 cycles */
+.Lop_7A:
+    POP     r6
+    mov     r7, r6
+    NEXT    4
+
+/* $7C: JMP (abs,X), 6 cycles */
+.Lop_7C:
+    bl      .Lfetch16
+    add     r0, r0, r5
+    bic     r0, r0, #0x10000
+    READ    r2
+    add     r0, r0, #1
+    bic     r0, r0, #0x10000
+    READ    r3
+    orr     r0, r2, r3, lsl #8
+    mov     r8, r0
+    NEXT    6
 
-.Lexit_io_write:
-    /* Store exit info for I/O write */
-    ldr     r12, [sp, #0]        /* AsmCpuState* */
-    strh    r2, [r12, #10]       /* exit_addr */
-    strb    r3, [r12, #16]       /* exit_value */
-    mov     r3, #1
-    strb    r3, [r12, #17]       /* exit_is_write = 1 */
-    mov     r0, #2               /* exit_reason = 2 (I/O) */
+/* $7D: ADC abs,X, 4 cycles */
+.Lop_7D:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Ladc_decimal
+    b       3f
+4:
+    add     r2, r4, r1
+    add     r2, r2, r10
+    eor     r3, r4, r2
+    eor     r0, r1, r2
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    mov     r10, r2, lsr #8
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    4
+
+/* $7E: ROR abs,X, 6 cycles */
+.Lop_7E:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    orr     r1, r1, r10, lsl #8
+    and     r10, r1, #1
+    mov     r1, r1, lsr #1
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $7F: BBR7, 5 cycles */
+.Lop_7F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x80
+    bne     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $80: BRA rel, 3 cycles */
+.Lop_80:
+    bl      .Lfetch8
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    3
+
+/* $81: STA (zp,X), 6 cycles */
+.Lop_81:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    mov     r1, r4
+    WRITE
+    NEXT    6
+
+/* $84: STY zp, 3 cycles */
+.Lop_84:
+    bl      .Lfetch8
+    mov     r1, r6
+    strb    r1, [r9, r0]
+    NEXT    3
+
+/* $85: STA zp, 3 cycles */
+.Lop_85:
+    bl      .Lfetch8
+    mov     r1, r4
+    strb    r1, [r9, r0]
+    NEXT    3
+
+/* $86: STX zp, 3 cycles */
+.Lop_86:
+    bl      .Lfetch8
+    mov     r1, r5
+    strb    r1, [r9, r0]
+    NEXT    3
+
+/* $87: SMB0 zp, 5 cycles */
+.Lop_87:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, #0x01
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $88: DEY, 2 cycles */
+.Lop_88:
+    sub     r6, r6, #1
+    and     r6, r6, #0xFF
+    mov     r7, r6
+    NEXT    2
+
+/* $89: BIT #imm, 2 cycles */
+.Lop_89:
+    bl      .Lfetch8
+    mov     r1, r0
+    ldr     r12, [sp, #FR_STATE]
+    mov     r3, r1, lsr #6
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    tst     r4, r1
+    and     r7, r1, #0x80
+    moveq   r7, r7, lsl #1
+    beq     1f
+    cmp     r7, #0
+    moveq   r7, #1
+1:
+    NEXT    2
+
+/* $8A: TXA, 2 cycles */
+.Lop_8A:
+    mov     r4, r5
+    mov     r7, r4
+    NEXT    2
+
+/* $8C: STY abs, 4 cycles */
+.Lop_8C:
+    bl      .Lfetch16
+    mov     r1, r6
+    WRITE
+    NEXT    4
+
+/* $8D: STA abs, 4 cycles */
+.Lop_8D:
+    bl      .Lfetch16
+    mov     r1, r4
+    WRITE
+    NEXT    4
+
+/* $8E: STX abs, 4 cycles */
+.Lop_8E:
+    bl      .Lfetch16
+    mov     r1, r5
+    WRITE
+    NEXT    4
+
+/* $8F: BBS0, 5 cycles */
+.Lop_8F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x01
+    beq     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $90: BCC rel, 2 cycles */
+.Lop_90:
+    bl      .Lfetch8
+    cmp     r10, #0
+    bne     2f
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    sub     r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    2
+
+/* $91: STA (zp),Y, 6 cycles */
+.Lop_91:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    mov     r1, r4
+    WRITE
+    NEXT    6
+
+/* $92: STA (zp), 5 cycles */
+.Lop_92:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    mov     r1, r4
+    WRITE
+    NEXT    5
+
+/* $94: STY zp,X, 4 cycles */
+.Lop_94:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    mov     r1, r6
+    strb    r1, [r9, r0]
+    NEXT    4
+
+/* $95: STA zp,X, 4 cycles */
+.Lop_95:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    mov     r1, r4
+    strb    r1, [r9, r0]
+    NEXT    4
+
+/* $96: STX zp,Y, 4 cycles */
+.Lop_96:
+    bl      .Lfetch8
+    add     r0, r0, r6
+    and     r0, r0, #0xFF
+    mov     r1, r5
+    strb    r1, [r9, r0]
+    NEXT    4
+
+/* $97: SMB1 zp, 5 cycles */
+.Lop_97:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, #0x02
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $98: TYA, 2 cycles */
+.Lop_98:
+    mov     r4, r6
+    mov     r7, r4
+    NEXT    2
+
+/* $99: STA abs,Y, 5 cycles */
+.Lop_99:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    mov     r1, r4
+    WRITE
+    NEXT    5
+
+/* $9A: TXS, 2 cycles */
+.Lop_9A:
+    ldr     r12, [sp, #FR_STATE]
+    strb    r5, [r12, #CS_SP]
+    NEXT    2
+
+/* $9C: STZ abs, 4 cycles */
+.Lop_9C:
+    bl      .Lfetch16
+    mov     r1, #0
+    WRITE
+    NEXT    4
+
+/* $9D: STA abs,X, 5 cycles */
+.Lop_9D:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    mov     r1, r4
+    WRITE
+    NEXT    5
+
+/* $9E: STZ abs,X, 5 cycles */
+.Lop_9E:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    mov     r1, #0
+    WRITE
+    NEXT    5
+
+/* $9F: BBS1, 5 cycles */
+.Lop_9F:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x02
+    beq     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $A0: LDY #imm, 2 cycles */
+.Lop_A0:
+    bl      .Lfetch8
+    mov     r6, r0
+    mov     r7, r6
+    NEXT    2
+
+/* $A1: LDA (zp,X), 6 cycles */
+.Lop_A1:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r4
+    mov     r7, r4
+    NEXT    6
+
+/* $A2: LDX #imm, 2 cycles */
+.Lop_A2:
+    bl      .Lfetch8
+    mov     r5, r0
+    mov     r7, r5
+    NEXT    2
+
+/* $A4: LDY zp, 3 cycles */
+.Lop_A4:
+    bl      .Lfetch8
+    ldrb    r6, [r9, r0]
+    mov     r7, r6
+    NEXT    3
+
+/* $A5: LDA zp, 3 cycles */
+.Lop_A5:
+    bl      .Lfetch8
+    ldrb    r4, [r9, r0]
+    mov     r7, r4
+    NEXT    3
+
+/* $A6: LDX zp, 3 cycles */
+.Lop_A6:
+    bl      .Lfetch8
+    ldrb    r5, [r9, r0]
+    mov     r7, r5
+    NEXT    3
+
+/* $A7: SMB2 zp, 5 cycles */
+.Lop_A7:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, #0x04
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $A8: TAY, 2 cycles */
+.Lop_A8:
+    mov     r6, r4
+    mov     r7, r6
+    NEXT    2
+
+/* $A9: LDA #imm, 2 cycles */
+.Lop_A9:
+    bl      .Lfetch8
+    mov     r4, r0
+    mov     r7, r4
+    NEXT    2
+
+/* $AA: TAX, 2 cycles */
+.Lop_AA:
+    mov     r5, r4
+    mov     r7, r5
+    NEXT    2
+
+/* $AC: LDY abs, 4 cycles */
+.Lop_AC:
+    bl      .Lfetch16
+    READ    r6
+    mov     r7, r6
+    NEXT    4
+
+/* $AD: LDA abs, 4 cycles */
+.Lop_AD:
+    bl      .Lfetch16
+    READ    r4
+    mov     r7, r4
+    NEXT    4
+
+/* $AE: LDX abs, 4 cycles */
+.Lop_AE:
+    bl      .Lfetch16
+    READ    r5
+    mov     r7, r5
+    NEXT    4
+
+/* $AF: BBS2, 5 cycles */
+.Lop_AF:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x04
+    beq     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $B0: BCS rel, 2 cycles */
+.Lop_B0:
+    bl      .Lfetch8
+    cmp     r10, #0
+    beq     2f
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    sub     r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    2
+
+/* $B1: LDA (zp),Y, 5 cycles */
+.Lop_B1:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r4
+    mov     r7, r4
+    NEXT    5
+
+/* $B2: LDA (zp), 5 cycles */
+.Lop_B2:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r4
+    mov     r7, r4
+    NEXT    5
+
+/* $B4: LDY zp,X, 4 cycles */
+.Lop_B4:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r6, [r9, r0]
+    mov     r7, r6
+    NEXT    4
+
+/* $B5: LDA zp,X, 4 cycles */
+.Lop_B5:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r4, [r9, r0]
+    mov     r7, r4
+    NEXT    4
+
+/* $B6: LDX zp,Y, 4 cycles */
+.Lop_B6:
+    bl      .Lfetch8
+    add     r0, r0, r6
+    and     r0, r0, #0xFF
+    ldrb    r5, [r9, r0]
+    mov     r7, r5
+    NEXT    4
+
+/* $B7: SMB3 zp, 5 cycles */
+.Lop_B7:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, #0x08
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $B8: CLV, 2 cycles */
+.Lop_B8:
+    ldr     r12, [sp, #FR_STATE]
+    mov     r2, #0
+    strb    r2, [r12, #CS_V]
+    NEXT    2
+
+/* $B9: LDA abs,Y, 4 cycles */
+.Lop_B9:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r4
+    mov     r7, r4
+    NEXT    4
+
+/* $BA: TSX, 2 cycles */
+.Lop_BA:
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r5, [r12, #CS_SP]
+    mov     r7, r5
+    NEXT    2
+
+/* $BC: LDY abs,X, 4 cycles */
+.Lop_BC:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r6
+    mov     r7, r6
+    NEXT    4
+
+/* $BD: LDA abs,X, 4 cycles */
+.Lop_BD:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r4
+    mov     r7, r4
+    NEXT    4
+
+/* $BE: LDX abs,Y, 4 cycles */
+.Lop_BE:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r5
+    mov     r7, r5
+    NEXT    4
+
+/* $BF: BBS3, 5 cycles */
+.Lop_BF:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x08
+    beq     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $C0: CPY #imm, 2 cycles */
+.Lop_C0:
+    bl      .Lfetch8
+    mov     r1, r0
+    subs    r2, r6, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    2
+
+/* $C1: CMP (zp,X), 6 cycles */
+.Lop_C1:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    6
+
+/* $C4: CPY zp, 3 cycles */
+.Lop_C4:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    subs    r2, r6, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    3
+
+/* $C5: CMP zp, 3 cycles */
+.Lop_C5:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    3
+
+/* $C6: DEC zp, 5 cycles */
+.Lop_C6:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    sub     r1, r1, #1
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $C7: SMB4 zp, 5 cycles */
+.Lop_C7:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, #0x10
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $C8: INY, 2 cycles */
+.Lop_C8:
+    add     r6, r6, #1
+    and     r6, r6, #0xFF
+    mov     r7, r6
+    NEXT    2
+
+/* $C9: CMP #imm, 2 cycles */
+.Lop_C9:
+    bl      .Lfetch8
+    mov     r1, r0
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    2
+
+/* $CA: DEX, 2 cycles */
+.Lop_CA:
+    sub     r5, r5, #1
+    and     r5, r5, #0xFF
+    mov     r7, r5
+    NEXT    2
+
+/* $CC: CPY abs, 4 cycles */
+.Lop_CC:
+    bl      .Lfetch16
+    READ    r1
+    subs    r2, r6, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    4
+
+/* $CD: CMP abs, 4 cycles */
+.Lop_CD:
+    bl      .Lfetch16
+    READ    r1
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    4
+
+/* $CE: DEC abs, 6 cycles */
+.Lop_CE:
+    bl      .Lfetch16
+    READ    r1
+    sub     r1, r1, #1
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $CF: BBS4, 5 cycles */
+.Lop_CF:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x10
+    beq     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $D0: BNE rel, 2 cycles */
+.Lop_D0:
+    bl      .Lfetch8
+    tst     r7, #0xFF
+    beq     2f
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    sub     r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    2
+
+/* $D1: CMP (zp),Y, 3 cycles */
+.Lop_D1:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    3
+
+/* $D2: CMP (zp), 5 cycles */
+.Lop_D2:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    5
+
+/* $D5: CMP zp,X, 4 cycles */
+.Lop_D5:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    4
+
+/* $D6: DEC zp,X, 6 cycles */
+.Lop_D6:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    sub     r1, r1, #1
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    6
+
+/* $D7: SMB5 zp, 5 cycles */
+.Lop_D7:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, #0x20
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $D8: CLD, 2 cycles */
+.Lop_D8:
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    bic     r2, r2, #0x08
+    strb    r2, [r12, #CS_STATUS]
+    NEXT    2
+
+/* $D9: CMP abs,Y, 4 cycles */
+.Lop_D9:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    4
+
+/* $DA: PHX, 3 cycles */
+.Lop_DA:
+    PUSH    r5
+    NEXT    3
+
+/* $DD: CMP abs,X, 4 cycles */
+.Lop_DD:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    subs    r2, r4, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    4
+
+/* $DE: DEC abs,X, 7 cycles */
+.Lop_DE:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    sub     r1, r1, #1
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    WRITE
+    NEXT    7
+
+/* $DF: BBS5, 5 cycles */
+.Lop_DF:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x20
+    beq     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $E0: CPX #imm, 2 cycles */
+.Lop_E0:
+    bl      .Lfetch8
+    mov     r1, r0
+    subs    r2, r5, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    2
+
+/* $E1: SBC (zp,X), 6 cycles */
+.Lop_E1:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    6
+
+/* $E4: CPX zp, 3 cycles */
+.Lop_E4:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    subs    r2, r5, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    3
+
+/* $E5: SBC zp, 3 cycles */
+.Lop_E5:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    3
+
+/* $E6: INC zp, 5 cycles */
+.Lop_E6:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    add     r1, r1, #1
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $E7: SMB6 zp, 5 cycles */
+.Lop_E7:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, #0x40
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $E8: INX, 2 cycles */
+.Lop_E8:
+    add     r5, r5, #1
+    and     r5, r5, #0xFF
+    mov     r7, r5
+    NEXT    2
+
+/* $E9: SBC #imm, 2 cycles */
+.Lop_E9:
+    bl      .Lfetch8
+    mov     r1, r0
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    2
+
+/* $EA: NOP, 2 cycles */
+.Lop_EA:
+    NEXT    2
+
+/* $EC: CPX abs, 4 cycles */
+.Lop_EC:
+    bl      .Lfetch16
+    READ    r1
+    subs    r2, r5, r1
+    movhs   r10, #1
+    movlo   r10, #0
+    and     r7, r2, #0xFF
+    NEXT    4
+
+/* $ED: SBC abs, 4 cycles */
+.Lop_ED:
+    bl      .Lfetch16
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    4
+
+/* $EE: INC abs, 6 cycles */
+.Lop_EE:
+    bl      .Lfetch16
+    READ    r1
+    add     r1, r1, #1
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    WRITE
+    NEXT    6
+
+/* $EF: BBS6, 5 cycles */
+.Lop_EF:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x40
+    beq     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* $F0: BEQ rel, 2 cycles */
+.Lop_F0:
+    bl      .Lfetch8
+    tst     r7, #0xFF
+    bne     2f
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    sub     r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    2
+
+/* $F1: SBC (zp),Y, 5 cycles */
+.Lop_F1:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    5
+
+/* $F2: SBC (zp), 5 cycles */
+.Lop_F2:
+    bl      .Lfetch8
+    ldrb    r2, [r9, r0]
+    add     r0, r0, #1
+    and     r0, r0, #0xFF
+    ldrb    r3, [r9, r0]
+    orr     r0, r2, r3, lsl #8
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    5
+
+/* $F5: SBC zp,X, 4 cycles */
+.Lop_F5:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    4
+
+/* $F6: INC zp,X, 6 cycles */
+.Lop_F6:
+    bl      .Lfetch8
+    add     r0, r0, r5
+    and     r0, r0, #0xFF
+    ldrb    r1, [r9, r0]
+    add     r1, r1, #1
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    strb    r1, [r9, r0]
+    NEXT    6
+
+/* $F7: SMB7 zp, 5 cycles */
+.Lop_F7:
+    bl      .Lfetch8
+    ldrb    r1, [r9, r0]
+    orr     r1, r1, #0x80
+    strb    r1, [r9, r0]
+    NEXT    5
+
+/* $F8: SED, 2 cycles */
+.Lop_F8:
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    orr     r2, r2, #0x08
+    strb    r2, [r12, #CS_STATUS]
+    NEXT    2
+
+/* $F9: SBC abs,Y, 4 cycles */
+.Lop_F9:
+    bl      .Lfetch16
+    add     r3, r0, r6
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    4
+
+/* $FA: PLX, 4 cycles */
+.Lop_FA:
+    POP     r5
+    mov     r7, r5
+    NEXT    4
+
+/* $FD: SBC abs,X, 4 cycles */
+.Lop_FD:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_STATUS]
+    tst     r2, #0x08
+    beq     4f
+    bl      .Lsbc_decimal
+    b       3f
+4:
+    rsb     r3, r10, #1
+    sub     r2, r4, r1
+    sub     r2, r2, r3
+    eor     r3, r4, r2
+    eor     r0, r4, r1
+    and     r3, r3, r0
+    mov     r3, r3, lsr #7
+    and     r3, r3, #1
+    strb    r3, [r12, #CS_V]
+    cmp     r2, #0x100
+    movlo   r10, #1
+    movhs   r10, #0
+    and     r4, r2, #0xFF
+    mov     r7, r4
+3:
+    NEXT    4
+
+/* $FE: INC abs,X, 7 cycles */
+.Lop_FE:
+    bl      .Lfetch16
+    add     r3, r0, r5
+    eor     r12, r3, r0
+    tst     r12, #0xFF00
+    subne   r11, r11, #1
+    bic     r0, r3, #0x10000
+    READ    r1
+    add     r1, r1, #1
+    and     r1, r1, #0xFF
+    mov     r7, r1
+    WRITE
+    NEXT    7
+
+/* $FF: BBS7, 5 cycles */
+.Lop_FF:
+    bl      .Lfetch8
+    ldrb    r3, [r9, r0]
+    bl      .Lfetch8
+    tst     r3, #0x80
+    beq     2f
+    sub     r11, r11, #1
+    mov     r1, r0, lsl #24
+    add     r0, r8, r1, asr #24
+    mov     r0, r0, lsl #16
+    mov     r0, r0, lsr #16
+    eor     r12, r0, r8
+    tst     r12, #0xFF00
+    subeq   r11, r11, #1
+    mov     r8, r0
+2:
+    NEXT    5
+
+/* ========== Operand fetch ========== */
+
+/* r0 = byte at PC, PC += 1. Clobbers r12, lr */
+.Lfetch8:
+    tst     r8, #0x8000
+    beq     1f
+    tst     r8, #0x4000
+    ldreq   r12, [sp, #FR_ROM_LO]
+    ldrne   r12, [sp, #FR_ROM_HI]
+    ldrb    r0, [r12, r8]
+    add     r8, r8, #1
+    bic     r8, r8, #0x10000
+    bx      lr
+1:
+    str     lr, [sp, #FR_LINK]
+    FETCH   r0
+    ldr     pc, [sp, #FR_LINK]
+
+/*
+ * r0 = 16-bit little-endian word at PC, PC += 2. Clobbers r2, r12, lr.
+ * Both bytes are read in one go unless they straddle a ROM window.
+ */
+.Lfetch16:
+    tst     r8, #0x8000
+    beq     1f
+    mov     r12, r8, lsl #18
+    cmn     r12, #0x40000
+    beq     1f
+    tst     r8, #0x4000
+    ldreq   r12, [sp, #FR_ROM_LO]
+    ldrne   r12, [sp, #FR_ROM_HI]
+    add     r12, r12, r8
+    ldrb    r0, [r12]
+    ldrb    r2, [r12, #1]
+    orr     r0, r0, r2, lsl #8
+    add     r8, r8, #2
+    bic     r8, r8, #0x10000
+    bx      lr
+1:
+    str     lr, [sp, #FR_LINK]
+    FETCH   r0
+    FETCH   r2
+    orr     r0, r0, r2, lsl #8
+    ldr     pc, [sp, #FR_LINK]
+
+/* ========== Bus helpers ========== */
+
+/* READ for r0 >= $2000: ROM inline, the rest via .Lio_read. Value in r12 */
+.Lread_high:
+    tst     r0, #0x8000
+    beq     .Lio_read
+    tst     r0, #0x4000
+    ldreq   r12, [sp, #FR_ROM_LO]
+    ldrne   r12, [sp, #FR_ROM_HI]
+    ldrb    r12, [r12, r0]
+    bx      lr
+
+/*
+ * Called with bl from FETCH, READ and WRITE. r0-r3 and lr survive; a read
+ * returns its value in r12.
+ */
+.Lio_fetch:
+    cmp     r8, #0x2000
+    ldrblo  r12, [r9, r8]
+    bxlo    lr
+    add     r12, sp, #FR_SAVE
+    stmia   r12, {r0-r3, lr}
+    mov     r0, r8
+    b       .Lio_read_call
+
+.Lio_read:
+    add     r12, sp, #FR_SAVE
+    stmia   r12, {r0-r3, lr}
+    /* VIA: $2800-$2FFF, no read side effects */
+    sub     r1, r0, #0x2800
+    cmp     r1, #0x800
+    bhs     .Lio_read_call
+    ldr     r12, [sp, #FR_VIA]
+    and     r1, r0, #0xF
+    ldrb    r12, [r12, r1]
+    ldr     r1, [sp, #FR_SAVE + 4]
+    bx      lr
+.Lio_read_call:
+    SPILL
+    mov     r1, r0
+    mov     r0, r12
+    bl      mos6502_asm_read
+    str     r0, [sp, #FR_RESULT]
+    RELOAD
+    add     r12, sp, #FR_SAVE
+    ldmia   r12, {r0-r3, lr}
+    ldr     r12, [sp, #FR_RESULT]
+    bx      lr
+
+.Lio_write:
+    add     r12, sp, #FR_SAVE
+    stmia   r12, {r0-r3, lr}
+    SPILL
+    mov     r2, r1
+    mov     r1, r0
+    mov     r0, r12
+    bl      mos6502_asm_write
+    RELOAD
+    add     r12, sp, #FR_SAVE
+    ldmia   r12, {r0-r3, lr}
+    bx      lr
+
+/* RAM store (r0) to a page in code_pages. r0-r3 and lr survive */
+.Lcode_write:
+    add     r12, sp, #FR_SAVE
+    stmia   r12, {r0-r3, lr}
+    bl      mos6502_asm_code_write
+    add     r12, sp, #FR_SAVE
+    ldmia   r12, {r0-r3, lr}
+    bx      lr
+
+/*
+ * Decimal-mode ADC/SBC with the operand in r1: calls the bcd.h routine
+ * and charges the extra decimal cycle.
+ */
+.Ladc_decimal:
+    str     lr, [sp, #FR_LINK]
+    mov     r0, r4
+    mov     r2, r10
+    bl      mos6502_asm_adc_decimal
+    b       .Ldecimal_result
+.Lsbc_decimal:
+    str     lr, [sp, #FR_LINK]
+    mov     r0, r4
+    mov     r2, r10
+    bl      mos6502_asm_sbc_decimal
+.Ldecimal_result:
+    /* bits 0-7 = result, bit 8 = carry, bit 9 = overflow */
+    and     r4, r0, #0xFF
+    mov     r7, r4
+    mov     r10, r0, lsr #8
+    and     r10, r10, #1
+    mov     r0, r0, lsr #9
+    ldr     r12, [sp, #FR_STATE]
+    strb    r0, [r12, #CS_V]
+    sub     r11, r11, #1
+    ldr     pc, [sp, #FR_LINK]
+
+/* ========== Exit Handlers ========== */
+
+.Lexit_cycles_done:
+    mov     r0, #0
     b       .Lwrite_back
 
+/* Opcode left to the interpreter (r0 = opcode): rewind PC onto it */
+.Lop_unhandled:
+    ldr     r12, [sp, #FR_STATE]
+    strb    r0, [r12, #CS_EXIT_OPCODE]
+    sub     r8, r8, #1
+    mov     r8, r8, lsl #16
+    mov     r8, r8, lsr #16
+    mov     r0, #1
+
 .Lwrite_back:
-    /* Write back CPU state */
-    ldr     r12, [sp, #0]        /* AsmCpuState* */
-    strb    r4, [r12, #0]        /* A */
-    strb    r5, [r12, #1]        /* X */
-    strb    r6, [r12, #2]        /* Y */
-    strb    r10, [r12, #3]       /* sp */
-    strb    r7, [r12, #4]        /* status */
-    strh    r8, [r12, #8]        /* PC */
-    str     r11, [r12, #12]      /* cycles_remaining */
-    strb    r0, [r12, #5]        /* exit_reason */
-
-    /* Restore and return */
-    add     sp, sp, #24
+    SPILL
+    strb    r0, [r12, #CS_EXIT_REASON]
+    add     sp, sp, #FR_SIZE
     pop     {r4-r11, pc}
 
 .size mos6502_run_asm, .-mos6502_run_asm
@@ -1,31 +1,22 @@
 #pragma once
 #include <cstdint>
+#include "mos6502/cpu_state.h"
 
-// Interface struct for ARM assembly 6502 dispatch loop.
-// Layout must match the assembly code in mos6502_hot_arm.s exactly.
-struct AsmCpuState {
-    uint8_t A;              // offset 0
-    uint8_t X;              // offset 1
-    uint8_t Y;              // offset 2
-    uint8_t sp;             // offset 3
-    uint8_t status;         // offset 4
-    uint8_t exit_reason;    // offset 5: 0=done, 1=unhandled, 2=io
-    uint8_t exit_opcode;    // offset 6
-    uint8_t pad;            // offset 7
-    uint16_t pc;            // offset 8
-    uint16_t exit_addr;     // offset 10
-    int32_t cycles_remaining; // offset 12
-    uint8_t exit_value;     // offset 16 (for io write value)
-    uint8_t exit_is_write;  // offset 17
-    uint8_t pad2[2];        // offset 18-19
-};
-
+// ARM assembly 6502 dispatch loop (mos6502_hot_arm.s, generated by
+// tools/gen_mos6502_hot_arm.py). It runs directly on the CPU's CpuState;
+// the offsets it uses are checked by the static_asserts in cpu_state.h.
+//
+// Runs until cycles_remaining reaches 0 (exit_reason 0) or it meets an
+// opcode it leaves to the interpreter (exit_reason 1: WAI, STP, illegal),
+// with pc on that opcode. ram/rom_lo/rom_hi must be set on entry.
 extern "C" void mos6502_run_asm(
-    AsmCpuState* state,      // r0
-    uint8_t* ram_ptr,         // r1
-    uint8_t* rom_lo_ptr,      // r2
-    uint8_t* rom_hi_ptr,      // r3
-    // on stack:
-    bool* ram_init_ptr,
-    uint8_t* via_regs_ptr
+    CpuState* state,          // r0
+    const uint8_t* via_regs   // r1
 );
+
+// Called from the asm loop with its registers spilled to state, the
+// mos6502 it runs; defined in mos6502.cpp.
+extern "C" uint8_t mos6502_asm_read(CpuState* state, uint16_t address);
+extern "C" void mos6502_asm_write(CpuState* state, uint16_t address, uint8_t value);
+extern "C" uint32_t mos6502_asm_adc_decimal(uint32_t a, uint32_t m, uint32_t carryIn);
+extern "C" uint32_t mos6502_asm_sbc_decimal(uint32_t a, uint32_t m, uint32_t carryIn);
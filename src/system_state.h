@@ -11,6 +11,14 @@ const int FRAME_BUFFER_SIZE = 16384;
 // NDS: Pre-converted RGB15 buffer for DMA transfer (128x128 * 2 pages)
 #define VRAM_RGB15_SIZE (128 * 128 * 2)
 
+// Uninitialized-RAM read detection, off by default. When enabled, CPU RAM
+// writes set a bit in a 4KB bitset and stateful reads of bytes that were
+// never written print a warning. Production builds carry no shadow state
+// and no extra store per write.
+#ifndef GTE_TRACK_UNINIT_RAM
+#define GTE_TRACK_UNINIT_RAM 0
+#endif
+
 #define BANK_GRAM_MASK  0b00000111
 #define BANK_VRAM_MASK  0b00001000
 #define BANK_WRAPX_MASK 0b00010000
@@ -25,21 +33,45 @@ enum RomType {
 	FLASH2M_RAM32K,
 };
 
-struct SystemState {
-    uint8_t dma_control;
-    bool dma_control_irq;
-    uint8_t banking;
-
+// Bulk memories, kept out of SystemState so the control registers below do
+// not sit between 32KB+ arrays.
+struct SystemBuffers {
     uint8_t ram[RAMSIZE];
-    bool ram_initialized[RAMSIZE];
-
+#if GTE_TRACK_UNINIT_RAM
+    uint32_t ram_init_bits[RAMSIZE / 32];
+#endif
     uint8_t vram[VRAM_BUFFER_SIZE];
     uint16_t vram_rgb15[VRAM_RGB15_SIZE];  // NDS: Pre-converted for DMA
     uint8_t gram[GRAM_BUFFER_SIZE];
-    
+};
+
+// Hot control block: the registers the CPU and blitter read on nearly every
+// access, packed together at the start of one 32-byte (ARM9 D-cache) line
+// and placed in DTCM on NDS. The buffer pointers are filled in from
+// SystemBuffers at startup, so system_state.ram[...] etc. read as before.
+struct alignas(32) SystemState {
+    uint8_t dma_control;
+    bool dma_control_irq;
+    uint8_t banking;
     uint8_t VIA_regs[16];
+
+    uint8_t* ram;
+    uint8_t* vram;
+    uint16_t* vram_rgb15;
+    uint8_t* gram;
+#if GTE_TRACK_UNINIT_RAM
+    uint32_t* ram_init_bits;
+#endif
 };
 
+#if GTE_TRACK_UNINIT_RAM
+// address is a CPU address below $2000 in the current RAM bank
+void GT_MarkRamInit(uint16_t address);
+#define RAM_MARK_INIT(address) GT_MarkRamInit(address)
+#else
+#define RAM_MARK_INIT(address) ((void)0)
+#endif
+
 struct CartridgeState
 {
     int size = 8192;
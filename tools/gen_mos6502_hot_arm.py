@@ -0,0 +1,887 @@
+#!/usr/bin/env python3
+"""Generate src/mos6502_hot_arm.s from the interpreter's opcode table.
+
+The addressing mode, operation and base cycle count of every opcode are read
+from the InstrTable set up in the mos6502 constructor (src/mos6502/mos6502.cpp),
+so the asm loop covers exactly the opcodes the interpreter does and charges
+the same cycles. Each opcode gets a handler built from an addressing-mode
+fragment and an operation fragment; opcodes the table marks Op_ILLEGAL, plus
+WAI and STP, exit to C++ with exit_reason 1.
+
+Usage:
+    python3 tools/gen_mos6502_hot_arm.py > src/mos6502_hot_arm.s
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+CPU_SOURCE = os.path.join(ROOT, "src", "mos6502", "mos6502.cpp")
+
+# The NDS Makefile builds the interpreter with -DCMOS_INDIRECT_JMP_FIX, so
+# JMP (abs) reads its high byte from abs + 1 without wrapping in the page.
+CMOS_INDIRECT_JMP_FIX = True
+
+
+def parse_instr_table(path):
+    """Returns {opcode: (mode, op, cycles)} for every non-illegal opcode."""
+    with open(path) as f:
+        text = f.read()
+    start = text.index("// insert opcodes")
+    end = text.index("Reset();", start)
+    table = {}
+    mode = op = cycles = None
+    for line in text[start:end].splitlines():
+        line = line.strip()
+        m = re.match(r"instr\.addr = &mos6502::Addr_(\w+);", line)
+        if m:
+            mode = m.group(1)
+            continue
+        m = re.match(r"instr\.code = &mos6502::Op_(\w+);", line)
+        if m:
+            op = m.group(1)
+            continue
+        m = re.match(r"instr\.cycles = (\d+);", line)
+        if m:
+            cycles = int(m.group(1))
+            continue
+        m = re.match(r"InstrTable\[0x([0-9A-Fa-f]{2})\] = instr;", line)
+        if m:
+            table[int(m.group(1), 16)] = (mode, op, cycles)
+    return {k: v for k, v in table.items() if v[1] != "ILLEGAL"}
+
+
+PRELUDE = r"""/*
+ * ARM assembly 6502 dispatch loop for GameTank NDS emulator.
+ *
+ * GENERATED by tools/gen_mos6502_hot_arm.py from the InstrTable in
+ * src/mos6502/mos6502.cpp -- edit the generator, not this file.
+ *
+ * Register allocation:
+ *   r4  = A (accumulator, 8-bit value in low byte)
+ *   r5  = X (X index register)
+ *   r6  = Y (Y index register)
+ *   r7  = lazy N/Z word (see mos6502/lazy_flags.h)
+ *   r8  = PC (16-bit program counter)
+ *   r9  = RAM pointer (current bank)
+ *   r10 = carry (0 or 1)
+ *   r11 = cycles_remaining (distance to the caller's next event deadline;
+ *         IRQ/NMI bookkeeping stays in C++ and only runs once it hits 0)
+ *   r0-r3, r12, lr = scratch
+ *
+ * Flags use the same lazy form as the interpreter and compiled blocks, so
+ * nothing is packed or unpacked on entry or exit. The 6502 stack pointer
+ * and the remaining P bits (D/I/B/V) stay in CpuState.
+ *
+ * RAM and ROM are accessed inline and VIA registers are read inline. A RAM
+ * store from $0200 up looks up its page in code_pages (dynarec.h) and, on
+ * a page holding compiled or decoded code, calls mos6502_asm_code_write to
+ * drop what covers the byte. Every other access calls mos6502_asm_read or
+ * mos6502_asm_write in mos6502.cpp with the CpuState, which is the running
+ * CPU, and the registers spilled to it, so the bus sees the same state and
+ * cycle count it would under the interpreter, and the registers are
+ * reloaded afterwards (an access can raise an IRQ or switch banks).
+ * Decimal ADC/SBC call the bcd.h routines the same way.
+ *
+ * Each handler charges the table's base cycles once the instruction is
+ * done; page-crossing penalties are charged when the address is formed.
+ *
+ * Stack frame (after push {r4-r11, lr} + sub sp, #44):
+ *   [sp, #0]  = CpuState*
+ *   [sp, #4]  = rom_lo - $8000 (indexed by the 6502 address)
+ *   [sp, #8]  = rom_hi - $C000
+ *   [sp, #12] = VIA_regs pointer
+ *   [sp, #16] = r0-r3, lr saved around bus helper calls
+ *   [sp, #36] = bus helper result
+ *   [sp, #40] = lr of the operand fetch and decimal subroutines
+ *
+ * CpuState layout (mos6502/cpu_state.h, checked there by static_assert):
+ *   +0: A, +1: X, +2: Y, +3: sp
+ *   +4: status (D/I/B/bit 5), +5: carry, +6: v, +7: exit_reason
+ *   +8: pc (u16), +10: exit_opcode, +12: nz (u32)
+ *   +16: cycles_remaining (i32), +20: ram, +24: rom_lo, +28: rom_hi
+ *   +32: code_pages
+ */
+
+.syntax unified
+.arm
+
+.section .text.mos6502_run_asm, "ax", %progbits
+.align 2
+
+.global mos6502_run_asm
+.type mos6502_run_asm, %function
+
+.equ CS_A,              0
+.equ CS_X,              1
+.equ CS_Y,              2
+.equ CS_SP,             3
+.equ CS_STATUS,         4
+.equ CS_CARRY,          5
+.equ CS_V,              6
+.equ CS_EXIT_REASON,    7
+.equ CS_PC,             8
+.equ CS_EXIT_OPCODE,    10
+.equ CS_NZ,             12
+.equ CS_CYCLES_REM,     16
+.equ CS_RAM,            20
+.equ CS_ROM_LO,         24
+.equ CS_ROM_HI,         28
+.equ CS_CODE_PAGES,     32
+
+.equ FR_STATE,          0
+.equ FR_ROM_LO,         4
+.equ FR_ROM_HI,         8
+.equ FR_VIA,            12
+.equ FR_SAVE,           16
+.equ FR_RESULT,         36
+.equ FR_LINK,           40
+.equ FR_SIZE,           44
+
+/* ========== Macros ========== */
+
+/* Store the 6502 registers held in ARM registers back to CpuState */
+.macro SPILL
+    ldr     r12, [sp, #FR_STATE]
+    strb    r4, [r12, #CS_A]
+    strb    r5, [r12, #CS_X]
+    strb    r6, [r12, #CS_Y]
+    str     r7, [r12, #CS_NZ]
+    strb    r10, [r12, #CS_CARRY]
+    strh    r8, [r12, #CS_PC]
+    str     r11, [r12, #CS_CYCLES_REM]
+.endm
+
+/* Load the 6502 registers and memory pointers from CpuState. Clobbers r0 */
+.macro RELOAD
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r4, [r12, #CS_A]
+    ldrb    r5, [r12, #CS_X]
+    ldrb    r6, [r12, #CS_Y]
+    ldr     r7, [r12, #CS_NZ]
+    ldrb    r10, [r12, #CS_CARRY]
+    ldrh    r8, [r12, #CS_PC]
+    ldr     r11, [r12, #CS_CYCLES_REM]
+    ldr     r9, [r12, #CS_RAM]
+    ldr     r0, [r12, #CS_ROM_LO]
+    sub     r0, r0, #0x8000
+    str     r0, [sp, #FR_ROM_LO]
+    ldr     r0, [r12, #CS_ROM_HI]
+    sub     r0, r0, #0xC000
+    str     r0, [sp, #FR_ROM_HI]
+.endm
+
+/*
+ * Fetch the byte at PC into \dst and advance PC. ROM is read inline; RAM
+ * and I/O go through .Lio_fetch. Clobbers r12.
+ */
+.macro FETCH dst
+    tst     r8, #0x8000
+    beq     90f
+    tst     r8, #0x4000
+    ldreq   r12, [sp, #FR_ROM_LO]
+    ldrne   r12, [sp, #FR_ROM_HI]
+    ldrb    \dst, [r12, r8]
+    b       91f
+90:
+    bl      .Lio_fetch
+    mov     \dst, r12
+91:
+    add     r8, r8, #1
+    bic     r8, r8, #0x10000
+.endm
+
+/*
+ * Read the byte at address r0 into \dst (not r0). RAM is read inline,
+ * everything else through .Lread_high. Clobbers r12, lr.
+ */
+.macro READ dst
+    cmp     r0, #0x2000
+    ldrblo  \dst, [r9, r0]
+    blo     93f
+    bl      .Lread_high
+    mov     \dst, r12
+93:
+.endm
+
+/*
+ * Write r1 to address r0. RAM is written inline, then checked against
+ * code_pages unless it is zero page or the stack. Clobbers r12
+ */
+.macro WRITE
+    cmp     r0, #0x2000
+    bhs     94f
+    strb    r1, [r9, r0]
+    cmp     r0, #0x200
+    blo     95f
+    ldr     r12, [sp, #FR_STATE]
+    ldr     r12, [r12, #CS_CODE_PAGES]
+    ldrb    r12, [r12, r0, lsr #8]
+    cmp     r12, #0
+    blne    .Lcode_write
+    b       95f
+94:
+    bl      .Lio_write
+95:
+.endm
+
+/* Push \reg (not r2, r3) onto the 6502 stack. Clobbers r2, r3, r12 */
+.macro PUSH reg
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_SP]
+    add     r3, r9, #0x100
+    strb    \reg, [r3, r2]
+    sub     r2, r2, #1
+    and     r2, r2, #0xFF
+    strb    r2, [r12, #CS_SP]
+.endm
+
+/* Pop the 6502 stack into \dst (not r2, r3). Clobbers r2, r3, r12 */
+.macro POP dst
+    ldr     r12, [sp, #FR_STATE]
+    ldrb    r2, [r12, #CS_SP]
+    add     r2, r2, #1
+    and     r2, r2, #0xFF
+    strb    r2, [r12, #CS_SP]
+    add     r3, r9, #0x100
+    ldrb    \dst, [r3, r2]
+.endm
+
+/* Charge \cycles and continue with the next instruction */
+.macro NEXT cycles
+    subs    r11, r11, #\cycles
+    bgt     .Ldispatch_fetch
+    b       .Lexit_cycles_done
+.endm
+
+/* ========== Function Entry ========== */
+
+/*
+ * void mos6502_run_asm(CpuState* state, const uint8_t* via_regs)
+ *
+ * Runs until cycles_remaining reaches 0 (exit_reason 0) or an opcode the
+ * loop leaves to the interpreter (exit_reason 1, pc at that opcode).
+ */
+mos6502_run_asm:
+    push    {r4-r11, lr}
+    sub     sp, sp, #FR_SIZE
+    str     r0, [sp, #FR_STATE]
+    str     r1, [sp, #FR_VIA]
+    RELOAD
+
+/* ========== Main Dispatch Loop ========== */
+
+.Ldispatch:
+    cmp     r11, #0
+    ble     .Lexit_cycles_done
+.Ldispatch_fetch:
+    FETCH   r0
+    ldr     pc, [pc, r0, lsl #2]
+    nop
+.Lop_table:
+"""
+
+SUBROUTINES = r"""
+/* ========== Operand fetch ========== */
+
+/* r0 = byte at PC, PC += 1. Clobbers r12, lr */
+.Lfetch8:
+    tst     r8, #0x8000
+    beq     1f
+    tst     r8, #0x4000
+    ldreq   r12, [sp, #FR_ROM_LO]
+    ldrne   r12, [sp, #FR_ROM_HI]
+    ldrb    r0, [r12, r8]
+    add     r8, r8, #1
+    bic     r8, r8, #0x10000
+    bx      lr
+1:
+    str     lr, [sp, #FR_LINK]
+    FETCH   r0
+    ldr     pc, [sp, #FR_LINK]
+
+/*
+ * r0 = 16-bit little-endian word at PC, PC += 2. Clobbers r2, r12, lr.
+ * Both bytes are read in one go unless they straddle a ROM window.
+ */
+.Lfetch16:
+    tst     r8, #0x8000
+    beq     1f
+    mov     r12, r8, lsl #18
+    cmn     r12, #0x40000
+    beq     1f
+    tst     r8, #0x4000
+    ldreq   r12, [sp, #FR_ROM_LO]
+    ldrne   r12, [sp, #FR_ROM_HI]
+    add     r12, r12, r8
+    ldrb    r0, [r12]
+    ldrb    r2, [r12, #1]
+    orr     r0, r0, r2, lsl #8
+    add     r8, r8, #2
+    bic     r8, r8, #0x10000
+    bx      lr
+1:
+    str     lr, [sp, #FR_LINK]
+    FETCH   r0
+    FETCH   r2
+    orr     r0, r0, r2, lsl #8
+    ldr     pc, [sp, #FR_LINK]
+
+/* ========== Bus helpers ========== */
+
+/* READ for r0 >= $2000: ROM inline, the rest via .Lio_read. Value in r12 */
+.Lread_high:
+    tst     r0, #0x8000
+    beq     .Lio_read
+    tst     r0, #0x4000
+    ldreq   r12, [sp, #FR_ROM_LO]
+    ldrne   r12, [sp, #FR_ROM_HI]
+    ldrb    r12, [r12, r0]
+    bx      lr
+
+/*
+ * Called with bl from FETCH, READ and WRITE. r0-r3 and lr survive; a read
+ * returns its value in r12.
+ */
+.Lio_fetch:
+    cmp     r8, #0x2000
+    ldrblo  r12, [r9, r8]
+    bxlo    lr
+    add     r12, sp, #FR_SAVE
+    stmia   r12, {r0-r3, lr}
+    mov     r0, r8
+    b       .Lio_read_call
+
+.Lio_read:
+    add     r12, sp, #FR_SAVE
+    stmia   r12, {r0-r3, lr}
+    /* VIA: $2800-$2FFF, no read side effects */
+    sub     r1, r0, #0x2800
+    cmp     r1, #0x800
+    bhs     .Lio_read_call
+    ldr     r12, [sp, #FR_VIA]
+    and     r1, r0, #0xF
+    ldrb    r12, [r12, r1]
+    ldr     r1, [sp, #FR_SAVE + 4]
+    bx      lr
+.Lio_read_call:
+    SPILL
+    mov     r1, r0
+    mov     r0, r12
+    bl      mos6502_asm_read
+    str     r0, [sp, #FR_RESULT]
+    RELOAD
+    add     r12, sp, #FR_SAVE
+    ldmia   r12, {r0-r3, lr}
+    ldr     r12, [sp, #FR_RESULT]
+    bx      lr
+
+.Lio_write:
+    add     r12, sp, #FR_SAVE
+    stmia   r12, {r0-r3, lr}
+    SPILL
+    mov     r2, r1
+    mov     r1, r0
+    mov     r0, r12
+    bl      mos6502_asm_write
+    RELOAD
+    add     r12, sp, #FR_SAVE
+    ldmia   r12, {r0-r3, lr}
+    bx      lr
+
+/* RAM store (r0) to a page in code_pages. r0-r3 and lr survive */
+.Lcode_write:
+    add     r12, sp, #FR_SAVE
+    stmia   r12, {r0-r3, lr}
+    bl      mos6502_asm_code_write
+    add     r12, sp, #FR_SAVE
+    ldmia   r12, {r0-r3, lr}
+    bx      lr
+
+/*
+ * Decimal-mode ADC/SBC with the operand in r1: calls the bcd.h routine
+ * and charges the extra decimal cycle.
+ */
+.Ladc_decimal:
+    str     lr, [sp, #FR_LINK]
+    mov     r0, r4
+    mov     r2, r10
+    bl      mos6502_asm_adc_decimal
+    b       .Ldecimal_result
+.Lsbc_decimal:
+    str     lr, [sp, #FR_LINK]
+    mov     r0, r4
+    mov     r2, r10
+    bl      mos6502_asm_sbc_decimal
+.Ldecimal_result:
+    /* bits 0-7 = result, bit 8 = carry, bit 9 = overflow */
+    and     r4, r0, #0xFF
+    mov     r7, r4
+    mov     r10, r0, lsr #8
+    and     r10, r10, #1
+    mov     r0, r0, lsr #9
+    ldr     r12, [sp, #FR_STATE]
+    strb    r0, [r12, #CS_V]
+    sub     r11, r11, #1
+    ldr     pc, [sp, #FR_LINK]
+
+/* ========== Exit Handlers ========== */
+
+.Lexit_cycles_done:
+    mov     r0, #0
+    b       .Lwrite_back
+
+/* Opcode left to the interpreter (r0 = opcode): rewind PC onto it */
+.Lop_unhandled:
+    ldr     r12, [sp, #FR_STATE]
+    strb    r0, [r12, #CS_EXIT_OPCODE]
+    sub     r8, r8, #1
+    mov     r8, r8, lsl #16
+    mov     r8, r8, lsr #16
+    mov     r0, #1
+
+.Lwrite_back:
+    SPILL
+    strb    r0, [r12, #CS_EXIT_REASON]
+    add     sp, sp, #FR_SIZE
+    pop     {r4-r11, pc}
+
+.size mos6502_run_asm, .-mos6502_run_asm
+"""
+
+MODE_NAMES = {
+    "ACC": "A", "IMM": "#imm", "ABS": "abs", "ZER": "zp", "ZEX": "zp,X",
+    "ZEY": "zp,Y", "ABX": "abs,X", "ABY": "abs,Y", "IMP": "", "REL": "rel",
+    "INX": "(zp,X)", "INY": "(zp),Y", "ABI": "(abs)", "ZPI": "(zp)",
+    "AIX": "(abs,X)",
+}
+
+
+def page_cross_penalty(base, addr):
+    """+1 cycle if \addr and \base differ in bits 8-15."""
+    return [
+        f"eor     r12, {addr}, {base}",
+        "tst     r12, #0xFF00",
+        "subne   r11, r11, #1",
+    ]
+
+
+def mode_fragment(mode):
+    """Leaves the effective address in r0 (memory modes only)."""
+    if mode in ("IMP", "ACC", "IMM", "REL"):
+        return []
+    if mode == "ZER":
+        return ["bl      .Lfetch8"]
+    if mode in ("ZEX", "ZEY"):
+        index = "r5" if mode == "ZEX" else "r6"
+        return ["bl      .Lfetch8", f"add     r0, r0, {index}", "and     r0, r0, #0xFF"]
+    if mode in ("ABS", "ABX", "ABY", "ABI", "AIX"):
+        lines = ["bl      .Lfetch16"]
+        if mode in ("ABX", "ABY"):
+            index = "r5" if mode == "ABX" else "r6"
+            lines += [f"add     r3, r0, {index}"]
+            lines += page_cross_penalty("r0", "r3")
+            lines += ["bic     r0, r3, #0x10000"]
+        if mode == "AIX":
+            lines += ["add     r0, r0, r5", "bic     r0, r0, #0x10000"]
+        if mode in ("ABI", "AIX"):
+            lines += ["READ    r2"]
+            if CMOS_INDIRECT_JMP_FIX:
+                lines += ["add     r0, r0, #1", "bic     r0, r0, #0x10000"]
+            else:
+                lines += ["add     r3, r0, #1", "and     r3, r3, #0xFF",
+                          "bic     r0, r0, #0xFF", "orr     r0, r0, r3"]
+            lines += ["READ    r3", "orr     r0, r2, r3, lsl #8"]
+        return lines
+    if mode in ("INX", "INY", "ZPI"):
+        lines = ["bl      .Lfetch8"]
+        if mode == "INX":
+            lines += ["add     r0, r0, r5", "and     r0, r0, #0xFF"]
+        # The pointer is in zero page, which is always RAM.
+        lines += ["ldrb    r2, [r9, r0]", "add     r0, r0, #1", "and     r0, r0, #0xFF",
+                  "ldrb    r3, [r9, r0]", "orr     r0, r2, r3, lsl #8"]
+        if mode == "INY":
+            lines += ["add     r3, r0, r6"]
+            lines += page_cross_penalty("r0", "r3")
+            lines += ["bic     r0, r3, #0x10000"]
+        return lines
+    raise ValueError(f"unknown addressing mode {mode}")
+
+
+# Zero page addresses are always below $2000, so these modes read and write
+# RAM directly.
+ZERO_PAGE_MODES = ("ZER", "ZEX", "ZEY")
+
+
+def operand(mode, dst="r1"):
+    """Loads the instruction's operand byte into \dst."""
+    if mode == "IMM":
+        return ["bl      .Lfetch8", f"mov     {dst}, r0"]
+    if mode in ZERO_PAGE_MODES:
+        return [f"ldrb    {dst}, [r9, r0]"]
+    return [f"READ    {dst}"]
+
+
+def store(mode):
+    """Writes r1 to the operand address r0."""
+    if mode in ZERO_PAGE_MODES:
+        return ["strb    r1, [r9, r0]"]
+    return ["WRITE"]
+
+
+def lazy_nz_from_bit7(src, z_cond):
+    """r7 = LazyNZ(src & 0x80, z) where z is flag condition \z_cond."""
+    return [
+        f"and     r7, {src}, #0x80",
+        f"mov{z_cond}   r7, r7, lsl #1",
+        f"b{z_cond}     1f",
+        "cmp     r7, #0",
+        "moveq   r7, #1",
+        "1:",
+    ]
+
+
+def get_status(dst):
+    """\dst = full P byte (PackStatus). Clobbers r2, r12."""
+    return [
+        "ldr     r12, [sp, #FR_STATE]",
+        f"ldrb    {dst}, [r12, #CS_STATUS]",
+        "ldrb    r2, [r12, #CS_V]",
+        f"orr     {dst}, {dst}, r2, lsl #6",
+        f"orr     {dst}, {dst}, r10",
+        "tst     r7, #0xFF",
+        f"orreq   {dst}, {dst}, #0x02",
+        "tst     r7, #0x180",
+        f"orrne   {dst}, {dst}, #0x80",
+    ]
+
+
+def set_status(src):
+    """UnpackStatus from \src. Clobbers r2, r12."""
+    return [
+        "ldr     r12, [sp, #FR_STATE]",
+        f"and     r2, {src}, #0x3C",
+        "strb    r2, [r12, #CS_STATUS]",
+        f"mov     r2, {src}, lsr #6",
+        "and     r2, r2, #1",
+        "strb    r2, [r12, #CS_V]",
+        f"and     r10, {src}, #1",
+        f"tst     {src}, #0x02",
+    ] + lazy_nz_from_bit7(src, "ne")
+
+
+def set_status_bit(mask, on):
+    insn = "orr" if on else "bic"
+    return [
+        "ldr     r12, [sp, #FR_STATE]",
+        "ldrb    r2, [r12, #CS_STATUS]",
+        f"{insn}     r2, r2, #{mask:#04x}",
+        "strb    r2, [r12, #CS_STATUS]",
+    ]
+
+
+def branch(cond_lines, taken, extra):
+    """
+    Relative branch. \cond_lines set the flags, \taken is the condition
+    under which the branch is taken (None = always). \extra is the cycle
+    charge for a taken branch before the page-cross penalty.
+    """
+    lines = ["bl      .Lfetch8"] + cond_lines
+    if taken is not None:
+        inverse = {"eq": "ne", "ne": "eq"}[taken]
+        lines += [f"b{inverse}     2f"]
+    lines += [
+        "mov     r1, r0, lsl #24",
+        "add     r0, r8, r1, asr #24",
+        "mov     r0, r0, lsl #16",
+        "mov     r0, r0, lsr #16",
+    ]
+    lines += page_cross_penalty("r8", "r0")
+    if extra:
+        lines += [f"sub     r11, r11, #{extra}"]
+    lines += ["mov     r8, r0", "2:"]
+    return lines
+
+
+def bit_branch(bit, on_set):
+    """BBRx/BBSx: zp operand, then offset; taken +1, same page +1."""
+    lines = [
+        "bl      .Lfetch8",
+        "ldrb    r3, [r9, r0]",
+        "bl      .Lfetch8",
+        f"tst     r3, #{1 << bit:#04x}",
+        f"b{'eq' if on_set else 'ne'}     2f",
+        "sub     r11, r11, #1",
+        "mov     r1, r0, lsl #24",
+        "add     r0, r8, r1, asr #24",
+        "mov     r0, r0, lsl #16",
+        "mov     r0, r0, lsr #16",
+        "eor     r12, r0, r8",
+        "tst     r12, #0xFF00",
+        "subeq   r11, r11, #1",
+        "mov     r8, r0",
+        "2:",
+    ]
+    return lines
+
+
+REG = {"A": "r4", "X": "r5", "Y": "r6"}
+
+
+def op_fragment(op, mode):
+    """Operation body; memory operands are at address r0."""
+    m = re.match(r"(BBR|BBS|RMB|SMB)(\d)$", op)
+    if m:
+        kind, bit = m.group(1), int(m.group(2))
+        if kind in ("BBR", "BBS"):
+            return bit_branch(bit, kind == "BBS")
+        insn = "bic" if kind == "RMB" else "orr"
+        return operand(mode) + [f"{insn}     r1, r1, #{1 << bit:#04x}"] + store(mode)
+
+    if op in ("LDA", "LDX", "LDY"):
+        reg = REG[op[2]]
+        return operand(mode, reg) + [f"mov     r7, {reg}"]
+    if op in ("STA", "STX", "STY"):
+        return [f"mov     r1, {REG[op[2]]}"] + store(mode)
+    if op == "STZ":
+        return ["mov     r1, #0"] + store(mode)
+    if op in ("AND", "ORA", "EOR"):
+        insn = {"AND": "and", "ORA": "orr", "EOR": "eor"}[op]
+        return operand(mode) + [f"{insn}     r4, r4, r1", "mov     r7, r4"]
+    if op == "ADC":
+        return operand(mode) + [
+            "ldr     r12, [sp, #FR_STATE]",
+            "ldrb    r2, [r12, #CS_STATUS]",
+            "tst     r2, #0x08",
+            "beq     4f",
+            "bl      .Ladc_decimal",
+            "b       3f",
+            "4:",
+            "add     r2, r4, r1",
+            "add     r2, r2, r10",
+            "eor     r3, r4, r2",
+            "eor     r0, r1, r2",
+            "and     r3, r3, r0",
+            "mov     r3, r3, lsr #7",
+            "and     r3, r3, #1",
+            "strb    r3, [r12, #CS_V]",
+            "mov     r10, r2, lsr #8",
+            "and     r4, r2, #0xFF",
+            "mov     r7, r4",
+            "3:",
+        ]
+    if op == "SBC":
+        return operand(mode) + [
+            "ldr     r12, [sp, #FR_STATE]",
+            "ldrb    r2, [r12, #CS_STATUS]",
+            "tst     r2, #0x08",
+            "beq     4f",
+            "bl      .Lsbc_decimal",
+            "b       3f",
+            "4:",
+            "rsb     r3, r10, #1",
+            "sub     r2, r4, r1",
+            "sub     r2, r2, r3",
+            "eor     r3, r4, r2",
+            "eor     r0, r4, r1",
+            "and     r3, r3, r0",
+            "mov     r3, r3, lsr #7",
+            "and     r3, r3, #1",
+            "strb    r3, [r12, #CS_V]",
+            "cmp     r2, #0x100",
+            "movlo   r10, #1",
+            "movhs   r10, #0",
+            "and     r4, r2, #0xFF",
+            "mov     r7, r4",
+            "3:",
+        ]
+    if op in ("CMP", "CPX", "CPY"):
+        reg = {"CMP": "r4", "CPX": "r5", "CPY": "r6"}[op]
+        return operand(mode) + [
+            f"subs    r2, {reg}, r1",
+            "movhs   r10, #1",
+            "movlo   r10, #0",
+            "and     r7, r2, #0xFF",
+        ]
+    if op == "BIT":
+        return operand(mode) + [
+            "ldr     r12, [sp, #FR_STATE]",
+            "mov     r3, r1, lsr #6",
+            "and     r3, r3, #1",
+            "strb    r3, [r12, #CS_V]",
+            "tst     r4, r1",
+        ] + lazy_nz_from_bit7("r1", "eq")
+    if op in ("TRB", "TSB"):
+        # Z is set when (m & A) != 0, as SET_ZERO(m & A) in the interpreter.
+        insn = "bic" if op == "TRB" else "orr"
+        return operand(mode) + [
+            "tst     r7, #0x180",
+            "movne   r2, #0x80",
+            "moveq   r2, #0",
+            "tst     r1, r4",
+            "movne   r7, r2, lsl #1",
+            "bne     1f",
+            "cmp     r2, #0",
+            "moveq   r2, #1",
+            "mov     r7, r2",
+            "1:",
+            f"{insn}     r1, r1, r4",
+        ] + store(mode)
+
+    shifts = {
+        "ASL": ["mov     {r}, {r}, lsl #1", "mov     r10, {r}, lsr #8", "and     {r}, {r}, #0xFF"],
+        "LSR": ["and     r10, {r}, #1", "mov     {r}, {r}, lsr #1"],
+        "ROL": ["mov     {r}, {r}, lsl #1", "orr     {r}, {r}, r10", "mov     r10, {r}, lsr #8",
+                "and     {r}, {r}, #0xFF"],
+        "ROR": ["orr     {r}, {r}, r10, lsl #8", "and     r10, {r}, #1", "mov     {r}, {r}, lsr #1"],
+        "INC": ["add     {r}, {r}, #1", "and     {r}, {r}, #0xFF"],
+        "DEC": ["sub     {r}, {r}, #1", "and     {r}, {r}, #0xFF"],
+    }
+    base = op[:-4] if op.endswith("_ACC") else op
+    if base in shifts:
+        if op.endswith("_ACC"):
+            return [l.format(r="r4") for l in shifts[base]] + ["mov     r7, r4"]
+        return operand(mode) + [l.format(r="r1") for l in shifts[base]] + ["mov     r7, r1"] + store(mode)
+
+    if op in ("INX", "INY", "DEX", "DEY"):
+        reg = REG[op[2]]
+        insn = "add" if op[0] == "I" else "sub"
+        return [f"{insn}     {reg}, {reg}, #1", f"and     {reg}, {reg}, #0xFF", f"mov     r7, {reg}"]
+    transfers = {"TAX": ("r4", "r5"), "TAY": ("r4", "r6"), "TXA": ("r5", "r4"), "TYA": ("r6", "r4")}
+    if op in transfers:
+        src, dst = transfers[op]
+        return [f"mov     {dst}, {src}", f"mov     r7, {dst}"]
+    if op == "TSX":
+        return ["ldr     r12, [sp, #FR_STATE]", "ldrb    r5, [r12, #CS_SP]", "mov     r7, r5"]
+    if op == "TXS":
+        return ["ldr     r12, [sp, #FR_STATE]", "strb    r5, [r12, #CS_SP]"]
+
+    if op == "CLC":
+        return ["mov     r10, #0"]
+    if op == "SEC":
+        return ["mov     r10, #1"]
+    if op == "CLV":
+        return ["ldr     r12, [sp, #FR_STATE]", "mov     r2, #0", "strb    r2, [r12, #CS_V]"]
+    if op in ("CLD", "SED"):
+        return set_status_bit(0x08, op == "SED")
+    if op in ("CLI", "SEI"):
+        return set_status_bit(0x04, op == "SEI")
+
+    if op in ("PHA", "PHX", "PHY"):
+        return [f"PUSH    {REG[op[2]]}"]
+    if op in ("PLA", "PLX", "PLY"):
+        reg = REG[op[2]]
+        return [f"POP     {reg}", f"mov     r7, {reg}"]
+    if op == "PHP":
+        return get_status("r1") + ["orr     r1, r1, #0x10", "PUSH    r1"]
+    if op == "PLP":
+        return ["POP     r1"] + set_status("r1") + set_status_bit(0x20, True)
+
+    if op == "JMP":
+        return ["mov     r8, r0"]
+    if op == "JSR":
+        return [
+            "sub     r8, r8, #1",
+            "mov     r8, r8, lsl #16",
+            "mov     r8, r8, lsr #16",
+            "mov     r1, r8, lsr #8",
+            "PUSH    r1",
+            "and     r1, r8, #0xFF",
+            "PUSH    r1",
+            "mov     r8, r0",
+        ]
+    if op == "RTS":
+        return [
+            "POP     r1",
+            "POP     r0",
+            "orr     r8, r1, r0, lsl #8",
+            "add     r8, r8, #1",
+            "bic     r8, r8, #0x10000",
+        ]
+    if op == "RTI":
+        return ["POP     r1"] + set_status("r1") + [
+            "POP     r1",
+            "POP     r0",
+            "orr     r8, r1, r0, lsl #8",
+        ]
+    if op == "BRK":
+        return [
+            "add     r8, r8, #1",
+            "bic     r8, r8, #0x10000",
+            "mov     r1, r8, lsr #8",
+            "PUSH    r1",
+            "and     r1, r8, #0xFF",
+            "PUSH    r1",
+        ] + get_status("r1") + [
+            "orr     r1, r1, #0x10",
+            "PUSH    r1",
+        ] + set_status_bit(0x04, True) + [
+            "mov     r0, #0xFF00",
+            "orr     r0, r0, #0xFF",
+            "READ    r1",
+            "sub     r0, r0, #1",
+            "READ    r2",
+            "orr     r8, r2, r1, lsl #8",
+        ]
+
+    branches = {
+        "BCC": (["cmp     r10, #0"], "eq"),
+        "BCS": (["cmp     r10, #0"], "ne"),
+        "BEQ": (["tst     r7, #0xFF"], "eq"),
+        "BNE": (["tst     r7, #0xFF"], "ne"),
+        "BMI": (["tst     r7, #0x180"], "ne"),
+        "BPL": (["tst     r7, #0x180"], "eq"),
+        "BVC": (["ldr     r12, [sp, #FR_STATE]", "ldrb    r2, [r12, #CS_V]", "cmp     r2, #0"], "eq"),
+        "BVS": (["ldr     r12, [sp, #FR_STATE]", "ldrb    r2, [r12, #CS_V]", "cmp     r2, #0"], "ne"),
+    }
+    if op in branches:
+        cond_lines, taken = branches[op]
+        return branch(cond_lines, taken, 1)
+    if op == "BRA":
+        return branch([], None, 0)
+
+    if op == "NOP":
+        return []
+    raise ValueError(f"no asm fragment for Op_{op}")
+
+
+# Left to the interpreter: they change waiting/illegalOpcode and call back
+# into the frontend.
+UNHANDLED_OPS = ("WAI", "STP")
+
+
+def emit(out, table):
+    out.write(PRELUDE)
+    for opcode in range(256):
+        entry = table.get(opcode)
+        if entry is None or entry[1] in UNHANDLED_OPS:
+            out.write("    .word   .Lop_unhandled\n")
+        else:
+            out.write(f"    .word   .Lop_{opcode:02X}\n")
+
+    out.write("\n/* ========== Opcode handlers ========== */\n")
+    for opcode in range(256):
+        entry = table.get(opcode)
+        if entry is None or entry[1] in UNHANDLED_OPS:
+            continue
+        mode, op, cycles = entry
+        desc = f"{op.replace('_ACC', '')} {MODE_NAMES[mode]}".strip()
+        out.write(f"\n/* ${opcode:02X}: {desc}, {cycles} cycles */\n")
+        out.write(f".Lop_{opcode:02X}:\n")
+        for line in mode_fragment(mode) + op_fragment(op, mode):
+            if line.endswith(":"):
+                out.write(line + "\n")
+            else:
+                out.write("    " + line + "\n")
+        out.write(f"    NEXT    {cycles}\n")
+    out.write(SUBROUTINES)
+
+
+def main():
+    table = parse_instr_table(CPU_SOURCE)
+    emit(sys.stdout, table)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,221 @@
+// Differential test of the generated ARM asm loop (src/mos6502_hot_arm.s)
+// against the interpreter, run under qemu-arm.
+//
+// Both run from copies of the same random memory image and registers for a
+// random budget of cycles: the interpreter one instruction at a time until
+// the budget is spent, the asm loop in a single mos6502_run_asm() call.
+// They must stop on the same instruction with the same registers, P,
+// cycle count, RAM, I/O log (address, value and the cycle each happened
+// on) and list of RAM stores to pages marked in code_pages.
+//
+// The asm loop's bus helpers (mos6502_asm_read, mos6502_asm_write,
+// mos6502_asm_code_write and the decimal ADC/SBC) are defined here, in
+// place of the ones in mos6502.cpp, which are only built for the DS. The
+// interpreter is the host build of mos6502.cpp.
+//
+// Build and run with tools/mos6502_asm_difftest.sh.
+
+#include "mos6502.h"
+#include "bcd.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if !defined(__arm__)
+#error "mos6502_asm_difftest runs the ARM asm loop; build it for ARM (tools/mos6502_asm_difftest.sh)"
+#endif
+
+// Memory the CPU core's tiers read through (gte.cpp in the emulator)
+uint8_t* cached_ram_ptr;
+uint8_t* cached_rom_lo_ptr;
+uint8_t* cached_rom_hi_ptr;
+uint16_t cached_rom_linear_mask = 0x7FFF;
+uint8_t loadedRomType = 3;
+
+extern "C" void mos6502_run_asm(CpuState* state, const uint8_t* via_regs);
+
+struct BusEvent {
+    uint64_t cycle;
+    uint16_t addr;
+    uint8_t value;
+    bool write;
+
+    bool operator==(const BusEvent& o) const {
+        return cycle == o.cycle && addr == o.addr && value == o.value && write == o.write;
+    }
+};
+
+// Memory image of each side: [0] interpreter, [1] asm loop. $2800-$2FFF is
+// the VIA, whose 16 registers repeat; other I/O reads back what was
+// written. ROM writes are only logged: the interpreter's decode caches
+// assume ROM changes only through the cartridge's invalidation calls.
+static uint8_t mem[2][0x10000];
+static std::vector<BusEvent> io_log[2];
+static std::vector<uint16_t> code_writes[2];
+static uint8_t code_pages[32];
+static uint64_t ref_cycles;
+
+// The asm loop's clock: its budget less what is left of it
+static CpuState asm_state;
+static int32_t asm_budget;
+
+static bool IsIo(uint16_t addr) { return addr >= 0x2000 && addr < 0x8000; }
+static bool IsVia(uint16_t addr) { return addr >= 0x2800 && addr < 0x3000; }
+static uint16_t IoAddress(uint16_t addr) { return IsVia(addr) ? (uint16_t)(0x2800 | (addr & 0xF)) : addr; }
+
+static uint8_t Read(int side, uint16_t addr, uint64_t cycle) {
+    if (!IsIo(addr)) return mem[side][addr];
+    const uint8_t value = mem[side][IoAddress(addr)];
+    if (!IsVia(addr)) io_log[side].push_back({ cycle, addr, value, false });
+    return value;
+}
+
+static void Write(int side, uint16_t addr, uint8_t value, uint64_t cycle) {
+    if (addr < 0x2000) {
+        if (addr >= 0x200 && code_pages[addr >> 8]) code_writes[side].push_back(addr);
+        mem[side][addr] = value;
+        return;
+    }
+    io_log[side].push_back({ cycle, addr, value, true });
+    if (addr < 0x8000) mem[side][IoAddress(addr)] = value;
+}
+
+static uint8_t RefRead(uint16_t addr) { return Read(0, addr, ref_cycles); }
+static void RefWrite(uint16_t addr, uint8_t value) { Write(0, addr, value, ref_cycles); }
+static void Stopped() {}
+
+static uint64_t AsmCycles() { return (uint64_t)(asm_budget - asm_state.cycles_remaining); }
+
+extern "C" uint8_t mos6502_asm_read(CpuState*, uint16_t address) {
+    return Read(1, address, AsmCycles());
+}
+
+extern "C" void mos6502_asm_write(CpuState*, uint16_t address, uint8_t value) {
+    Write(1, address, value, AsmCycles());
+}
+
+// The loop has already stored the byte; only record it
+extern "C" void mos6502_asm_code_write(uint16_t address) {
+    code_writes[1].push_back(address);
+}
+
+extern "C" uint32_t mos6502_asm_adc_decimal(uint32_t a, uint32_t m, uint32_t carryIn) {
+    return BCD_ADC(a, m, carryIn);
+}
+
+extern "C" uint32_t mos6502_asm_sbc_decimal(uint32_t a, uint32_t m, uint32_t carryIn) {
+    return BCD_SBC(a, m, carryIn);
+}
+
+static uint32_t rng;
+static uint32_t Random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// Opcodes the loop hands back to the interpreter (illegal ones, WAI and
+// STP); the test stops there too
+static bool stops_loop[256];
+
+static void FindStoppingOpcodes() {
+    for (int opcode = 0; opcode < 256; opcode++) {
+        mos6502 probe(RefRead, RefWrite, Stopped);
+        mem[0][0x0200] = (uint8_t)opcode;
+        probe.pc = 0x0200;
+        uint64_t cycles = 0;
+        probe.Run(1, cycles, mos6502::CYCLE_COUNT);
+        stops_loop[opcode] = probe.illegalOpcode || opcode == 0xCB || opcode == 0xDB;
+    }
+}
+
+// Run one seed; returns false if the two sides differ
+static bool RunSeed(int seed, uint64_t& instructions) {
+    rng = (uint32_t)seed * 2654435761u + 7;
+    for (int i = 0; i < 0x10000; i++) mem[0][i] = (uint8_t)Random();
+    // Odd seeds: fully random memory. Even ones: most illegal, WAI and STP
+    // opcodes become NOPs, so runs last longer.
+    if (!(seed & 1)) {
+        for (int i = 0; i < 0x10000; i++) {
+            if ((Random() & 3) && stops_loop[mem[0][i]]) mem[0][i] = 0xEA;
+        }
+    }
+    for (uint8_t& page : code_pages) page = (Random() & 3) ? 0 : (uint8_t)(1 + (Random() & 0x80));
+    memcpy(mem[1], mem[0], sizeof mem[1]);
+    for (int side = 0; side < 2; side++) {
+        io_log[side].clear();
+        code_writes[side].clear();
+    }
+
+    const uint16_t start = (seed & 2) ? (uint16_t)(0x8000 | (Random() & 0x7FFF)) : (uint16_t)(Random() & 0x1FFF);
+    uint8_t p = (uint8_t)Random() | 0x20;
+    if (seed % 4) p &= ~0x08;  // Mostly binary mode
+    const uint8_t a = (uint8_t)Random(), x = (uint8_t)Random(), y = (uint8_t)Random(), sp = (uint8_t)Random();
+    const int32_t budget = 200 + (int32_t)(Random() % 3000);
+
+    mos6502 cpu(RefRead, RefWrite, Stopped);
+    cpu.A = a;
+    cpu.X = x;
+    cpu.Y = y;
+    cpu.sp = sp;
+    cpu.pc = start;
+    cpu.SetStatus(p);
+    ref_cycles = 0;
+    while ((int64_t)ref_cycles < budget) {
+        if (stops_loop[mem[0][IoAddress(cpu.pc)]]) break;
+        cpu.Run(1, ref_cycles, mos6502::CYCLE_COUNT);
+        instructions++;
+    }
+
+    asm_state = CpuState();
+    asm_state.A = a;
+    asm_state.X = x;
+    asm_state.Y = y;
+    asm_state.sp = sp;
+    asm_state.pc = start;
+    UnpackStatus(p, asm_state.status, asm_state.flag_nz, asm_state.flag_c, asm_state.flag_v);
+    asm_state.cycles_remaining = asm_budget = budget;
+    asm_state.ram = mem[1];
+    asm_state.rom_lo = mem[1] + 0x8000;
+    asm_state.rom_hi = mem[1] + 0xC000;
+    asm_state.code_pages = code_pages;
+    mos6502_run_asm(&asm_state, &mem[1][0x2800]);
+    // Stopping at an opcode in I/O space fetched it through the bus once
+    // more than the interpreter did
+    std::vector<BusEvent>& log = io_log[1];
+    if (asm_state.exit_reason == 1 && !log.empty() && !log.back().write && log.back().addr == asm_state.pc) {
+        log.pop_back();
+    }
+
+    const uint8_t asm_p = PackStatus(asm_state.status, asm_state.flag_nz, asm_state.flag_c, asm_state.flag_v);
+    const bool same = cpu.A == asm_state.A && cpu.X == asm_state.X && cpu.Y == asm_state.Y &&
+                      cpu.sp == asm_state.sp && cpu.pc == asm_state.pc && cpu.GetStatus() == asm_p &&
+                      ref_cycles == AsmCycles() && !memcmp(mem[0], mem[1], sizeof mem[0]) &&
+                      io_log[0] == io_log[1] && code_writes[0] == code_writes[1];
+    if (!same) {
+        printf("seed %d: start %04X, budget %d\n", seed, start, budget);
+        printf("  interpreter: A=%02X X=%02X Y=%02X S=%02X P=%02X PC=%04X cyc=%llu io=%zu code writes=%zu\n",
+               cpu.A, cpu.X, cpu.Y, cpu.sp, cpu.GetStatus(), cpu.pc, (unsigned long long)ref_cycles,
+               io_log[0].size(), code_writes[0].size());
+        printf("  asm loop   : A=%02X X=%02X Y=%02X S=%02X P=%02X PC=%04X cyc=%llu io=%zu code writes=%zu\n",
+               asm_state.A, asm_state.X, asm_state.Y, asm_state.sp, asm_p, asm_state.pc,
+               (unsigned long long)AsmCycles(), io_log[1].size(), code_writes[1].size());
+    }
+    return same;
+}
+
+int main(int argc, char** argv) {
+    const int first = argc > 1 ? atoi(argv[1]) : 0;
+    const int last = argc > 2 ? atoi(argv[2]) : 2000;
+    int failures = 0;
+    uint64_t instructions = 0;
+    FindStoppingOpcodes();
+    for (int seed = first; seed < last; seed++) {
+        if (!RunSeed(seed, instructions)) failures++;
+    }
+    printf("seeds %d-%d: %d failed; %llu instructions\n", first, last - 1, failures,
+           (unsigned long long)instructions);
+    return failures ? 1 : 0;
+}
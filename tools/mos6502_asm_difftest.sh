@@ -0,0 +1,35 @@
+#!/bin/bash
+# Cross-compile tools/mos6502_asm_difftest.cpp with the generated asm loop
+# (src/mos6502_hot_arm.s) for ARM Linux and run it under qemu-arm.
+# Arguments are passed on (first seed, end seed).
+#
+# Needs an ARM Linux g++ (CROSS, default arm-linux-gnueabi-) and qemu-arm
+# (QEMU). The binary is linked statically so no ARM sysroot is needed at
+# run time. Regenerate the asm first if the generator changed:
+#   python3 tools/gen_mos6502_hot_arm.py > src/mos6502_hot_arm.s
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+out=${OUT:-/tmp/mos6502_asm_difftest}
+cross=${CROSS:-arm-linux-gnueabi-}
+qemu=${QEMU:-qemu-arm}
+mkdir -p "$out"
+
+sdl_flags=$(sdl2-config --cflags 2>/dev/null || true)
+if [ -z "$sdl_flags" ]; then
+	mkdir -p "$out/sdl/SDL2"
+	cat > "$out/sdl/SDL2/SDL.h" <<'SDL'
+#pragma once
+#include <cstdint>
+typedef uint8_t Uint8;
+typedef uint16_t Uint16;
+typedef uint32_t Uint32;
+SDL
+	sdl_flags="-I$out/sdl"
+fi
+
+src=$root/src/mos6502
+# The asm loop is ARMv5TE code called from ARM state, as on the DS's ARM9
+${cross}g++ -O2 -g -std=c++17 -static -marm -march=armv5te -DCMOS_INDIRECT_JMP_FIX $sdl_flags \
+	-I"$src" -I"$root/src" "$root/tools/mos6502_asm_difftest.cpp" "$src/mos6502.cpp" \
+	"$root/src/mos6502_hot_arm.s" -o "$out/mos6502_asm_difftest"
+$qemu "$out/mos6502_asm_difftest" "$@"
@@ -0,0 +1,411 @@
+// Differential test of the host dynarec (DYNAREC_X64) against the
+// interpreter.
+//
+// Two mos6502 cores run the same program from the same memory image, in
+// frames of a few thousand cycles through Run(), the way gte.cpp drives
+// the CPU. The reference core has a Sync callback, which keeps it off the
+// dynarec; the other has none, so Run() hands its time to compiled blocks.
+// After every frame the registers, P, RAM, the cycle count and the log of
+// I/O accesses (address, value and the cycle each happened on) must match
+// exactly.
+//
+// $2000-$7FFF is a small device standing in for the blitter: writing 0 to
+// $4000 raises an IRQ at once (ScheduleIRQ(0), as Blitter::SetParam does
+// for an empty blit) and any write to $4001 acknowledges it. A write to
+// $4002 runs a coprocessor, a second mos6502 set up like the ACP, for a
+// few cycles there and then, as a write to the ACP's NMI register does. A
+// write to $4003 patches the coprocessor's code straight in its RAM, as
+// the ACP's host does; every store the coprocessor makes must come from
+// the code as patched. Reads return a value made from the address and the
+// number of reads so far.
+//
+// Each seed runs a generated program: loads and stores in every mode the
+// dynarec compiles, indexed ones crossing pages into RAM, ROM and I/O,
+// decimal ADC/SBC, in-block loops, leaf subroutines, a RAM routine the
+// program patches between calls, IRQs raised from compiled stores and
+// coprocessor runs nested in them. Seed 0 is the IRQ regression: a CLI
+// loop of LDA #0 / STA $4000, whose handler has to run for every store.
+//
+// Build and run with tools/mos6502_difftest.sh.
+
+#include "mos6502.h"
+#include "dynarec.h"
+#include "dynarec_cpu.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if !DYNAREC_X64
+#error "mos6502_difftest needs the x86-64 dynarec (DYNAREC_X64)"
+#endif
+
+// Memory the dynarec reads code and RAM through (gte.cpp in the emulator)
+uint8_t* cached_ram_ptr;
+uint8_t* cached_rom_lo_ptr;
+uint8_t* cached_rom_hi_ptr;
+uint16_t cached_rom_linear_mask = 0x7FFF;
+uint8_t loadedRomType = 3;  // Flash2M: $8000-$BFFF and $C000-$FFFF windows
+
+static constexpr int FRAMES = 40;
+static constexpr uint16_t IRQ_COUNT = 0x00F0;  // The handler counts IRQs here
+static constexpr uint16_t RAM_ROUTINE = 0x1800;  // Patched by the program as it runs
+static constexpr uint16_t MAIN = 0x8000;
+static constexpr uint16_t LEAVES = 0xE000;
+static constexpr uint16_t HANDLER = 0xF000;
+static constexpr uint16_t COPROCESSOR_CODE = 0x8200;  // RAM $0200, mirrored
+static constexpr uint16_t COPROCESSOR_PATCHED = 0x0204;  // STA $10 or STX $10
+
+struct IoEvent {
+    uint64_t cycle;
+    uint16_t addr;
+    uint8_t value;
+    bool write;
+
+    bool operator==(const IoEvent& o) const {
+        return cycle == o.cycle && addr == o.addr && value == o.value && write == o.write;
+    }
+};
+
+struct Machine {
+    uint8_t mem[0x10000];
+    mos6502* cpu;
+    uint64_t cycles;
+    uint32_t reads;
+    std::vector<IoEvent> log;
+    // 4KB mirrored over its whole address space, like the ACP's RAM
+    uint8_t coprocessor_mem[0x1000];
+    mos6502* coprocessor;
+    uint64_t coprocessor_cycles;
+    uint32_t coprocessor_stale;  // Stores made by code since patched
+};
+
+static Machine machines[2];  // [0]: reference, [1]: dynarec
+
+template <int M>
+static uint8_t BusRead(uint16_t addr) {
+    Machine& m = machines[M];
+    if (addr < 0x2000 || addr >= 0x8000) return m.mem[addr];
+    const uint8_t value = (uint8_t)((addr * 7) ^ (m.reads++ * 13));
+    m.log.push_back({ m.cycles, addr, value, false });
+    return value;
+}
+
+template <int M>
+static void BusWrite(uint16_t addr, uint8_t value) {
+    Machine& m = machines[M];
+    if (addr < 0x2000) {
+        m.mem[addr] = value;
+        return;
+    }
+    if (addr >= 0x8000) return;
+    m.log.push_back({ m.cycles, addr, value, true });
+    if (addr == 0x4000 && value == 0) m.cpu->ScheduleIRQ(0, nullptr);
+    if (addr == 0x4001) m.cpu->ClearIRQ();
+    if (addr == 0x4002) m.coprocessor->Run(1 + (value & 0x1F), m.coprocessor_cycles, mos6502::CYCLE_COUNT);
+    if (addr == 0x4003) m.coprocessor_mem[COPROCESSOR_PATCHED] = (value & 1) ? 0x86 : 0x85;
+}
+
+template <int M>
+static uint8_t CoprocessorRead(uint16_t addr) {
+    return machines[M].coprocessor_mem[addr & 0xFFF];
+}
+
+template <int M>
+static void CoprocessorWrite(uint16_t addr, uint8_t value) {
+    Machine& m = machines[M];
+    const uint8_t expected = m.coprocessor_mem[COPROCESSOR_PATCHED] == 0x85 ? 0x11 : 0xEE;
+    if ((addr & 0xFFF) == 0x10 && value != expected) m.coprocessor_stale++;
+    m.coprocessor_mem[addr & 0xFFF] = value;
+}
+
+static void Stopped() {}
+
+static uint32_t rng;
+static uint32_t Random() {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+static uint32_t Random(uint32_t n) { return Random() % n; }
+
+// ===== PROGRAMS =====
+
+struct Assembler {
+    uint8_t* mem;
+    uint16_t pc;
+
+    void Byte(uint8_t b) { mem[pc++] = b; }
+    void Op(uint8_t op) { Byte(op); }
+    void Op(uint8_t op, uint8_t operand) { Byte(op); Byte(operand); }
+    void OpWord(uint8_t op, uint16_t operand) { Byte(op); Byte(operand & 0xFF); Byte(operand >> 8); }
+};
+
+// Base of an abs,X / abs,Y access: RAM, ROM or I/O, with a random low byte
+// so the index crosses a page about half the time
+static uint16_t IndexedBase(bool store) {
+    const uint8_t lo = (uint8_t)Random();
+    switch (Random(store ? 2 : 3)) {
+    case 0:  return (uint16_t)(0x0300 + Random(0x0C00) / 0x100 * 0x100 + lo);
+    case 1:  return (uint16_t)(0x4000 + lo);
+    default: return (uint16_t)(0x9000 + lo);
+    }
+}
+
+// One instruction (or a short self-contained group) that leaves X alone
+static void EmitSimple(Assembler& a) {
+    static const uint8_t alu_imm[] = { 0x09, 0x29, 0x49, 0x69, 0xC9, 0xE9 };
+    static const uint8_t alu_zp[] = { 0x05, 0x25, 0x45, 0x65, 0xC5, 0xE5, 0xA5, 0x85, 0x06, 0x26, 0x46, 0x66, 0xE6, 0xC6 };
+    static const uint8_t alu_abs[] = { 0x0D, 0x2D, 0x4D, 0x6D, 0xCD, 0xED, 0xAD, 0x8D, 0xEE, 0xCE };
+    static const uint8_t implied[] = { 0x0A, 0x2A, 0x4A, 0x6A, 0xA8, 0x98, 0xC8, 0x88, 0x18, 0x38, 0xB8, 0xEA };
+    switch (Random(13)) {
+    case 0: a.Op(0xA9, (uint8_t)(Random(4) ? Random(8) : Random())); break;             // LDA #
+    case 1: a.Op(alu_imm[Random(sizeof alu_imm)], (uint8_t)Random()); break;
+    case 2: a.Op(alu_zp[Random(sizeof alu_zp)], (uint8_t)(0x20 + Random(0x20))); break;
+    case 3: a.OpWord(alu_abs[Random(sizeof alu_abs)], (uint16_t)(0x0300 + Random(0x100))); break;
+    case 4: a.Op(implied[Random(sizeof implied)]); break;
+    case 5: a.OpWord(Random(2) ? 0xBD : 0xB9, IndexedBase(false)); break;               // LDA abs,X / abs,Y
+    case 6: a.OpWord(Random(2) ? 0x9D : 0x99, IndexedBase(true)); break;                // STA abs,X / abs,Y
+    case 7: a.Op(Random(2) ? 0xB1 : 0x91, Random(2) ? 0x10 : 0x12); break;              // LDA/STA (zp),Y
+    case 8: a.Op(0xA0, (uint8_t)Random()); break;                                       // LDY #
+    case 9:                                                                             // Maybe raise an IRQ
+        if (Random(2)) a.Op(0xA9, 0x00);
+        a.OpWord(0x8D, 0x4000);
+        break;
+    case 10: a.Op(Random(2) ? 0x48 : 0x08); a.Op(Random(2) ? 0x68 : 0x28); break;       // PHA/PHP, PLA/PLP
+    case 11: a.OpWord(Random(2) ? 0x8D : 0x8E, (uint16_t)(0x4002 + Random(2))); break;  // Run/patch the coprocessor
+    default: a.Op(Random(4) ? 0xD8 : 0xF8); break;                                      // CLD, sometimes SED
+    }
+}
+
+// A leaf subroutine the dynarec can inline: a few simple instructions, RTS
+static uint16_t EmitLeaf(Assembler& a) {
+    const uint16_t at = a.pc;
+    for (int n = 1 + Random(4); n > 0; n--) {
+        switch (Random(3)) {
+        case 0: a.Op(0xA9, (uint8_t)Random(8)); break;
+        case 1: a.Op(0x65, (uint8_t)(0x20 + Random(0x20))); break;
+        default: a.Op(0x85, (uint8_t)(0x20 + Random(0x20))); break;
+        }
+    }
+    a.Op(0x60);
+    return at;
+}
+
+// The coprocessor's loop, run from its RAM through the $8000 mirror:
+// LDX #$EE; loop: LDA #$11; STA $10 (or STX $10); JMP loop
+static void GenerateCoprocessorProgram(uint8_t* mem) {
+    memset(mem, 0, 0x1000);
+    Assembler a = { mem, COPROCESSOR_CODE & 0xFFF };
+    a.Op(0xA2, 0xEE);
+    const uint16_t loop = a.pc | (COPROCESSOR_CODE & 0xF000);
+    a.Op(0xA9, 0x11);
+    a.Op(0x85, 0x10);
+    a.OpWord(0x4C, loop);
+    mem[0xFFC] = COPROCESSOR_CODE & 0xFF;
+    mem[0xFFD] = COPROCESSOR_CODE >> 8;
+}
+
+static void GenerateProgram(uint8_t* mem, int seed) {
+    for (int i = 0; i < 0x10000; i++) mem[i] = (uint8_t)Random();
+    // (zp),Y pointers: $10 into RAM, $12 into I/O
+    mem[0x10] = (uint8_t)Random();
+    mem[0x11] = 0x03;
+    mem[0x12] = (uint8_t)Random();
+    mem[0x13] = 0x40;
+    mem[IRQ_COUNT] = mem[IRQ_COUNT + 1] = 0;
+
+    Assembler a = { mem, HANDLER };
+    a.Op(0x48);                         // PHA
+    a.OpWord(0x8D, 0x4001);             // STA $4001: acknowledge
+    a.OpWord(0xEE, IRQ_COUNT);          // INC count
+    a.Op(0xD0, 3);                      // BNE +3
+    a.OpWord(0xEE, IRQ_COUNT + 1);
+    a.Op(0x68);                         // PLA
+    a.Op(0x40);                         // RTI
+    mem[0xFFFA] = mem[0xFFFE] = HANDLER & 0xFF;
+    mem[0xFFFB] = mem[0xFFFF] = HANDLER >> 8;
+    mem[0xFFFC] = MAIN & 0xFF;
+    mem[0xFFFD] = MAIN >> 8;
+
+    a.pc = RAM_ROUTINE;
+    a.Op(0xA9, 0x00);                   // LDA #n, n patched
+    a.Op(0x18);                         // CLC
+    a.Op(0x65, 0x20);                   // ADC $20, opcode patched to ORA, AND or EOR
+    a.Op(0x85, 0x20);                   // STA $20
+    a.Op(0x60);                         // RTS
+
+    a.pc = MAIN;
+    a.Op(0xA2, 0xFF);                   // LDX #$FF
+    a.Op(0x9A);                         // TXS
+    a.Op(0xD8);                         // CLD
+    a.Op(0x58);                         // CLI
+    const uint16_t loop = a.pc;
+    if (seed == 0) {
+        a.Op(0xA9, 0x00);               // LDA #0
+        a.OpWord(0x8D, 0x4000);         // STA $4000
+        a.OpWord(0x4C, loop);           // JMP loop
+        return;
+    }
+
+    Assembler leaves = { mem, LEAVES };
+    for (int n = 20 + Random(40); n > 0; n--) {
+        switch (Random(10)) {
+        case 0: {
+            // In-block loop: LDX #n; body; DEX; BNE
+            a.Op(0xA2, (uint8_t)(1 + Random(20)));
+            const uint16_t head = a.pc;
+            for (int k = 1 + Random(4); k > 0; k--) EmitSimple(a);
+            a.Op(0xCA);
+            a.Op(0xD0, (uint8_t)(head - (a.pc + 2)));
+            break;
+        }
+        case 1:
+            a.Op(0xA2, (uint8_t)Random());  // LDX #
+            break;
+        case 2:
+            // Forward branch over a two-byte instruction
+            a.Op((uint8_t)(0x10 + 0x20 * Random(8)), 2);
+            a.Op(0xA9, (uint8_t)Random(8));
+            break;
+        case 3:
+            a.OpWord(0x20, EmitLeaf(leaves));  // JSR leaf
+            break;
+        case 4:
+            // Patch the RAM routine's immediate or its ALU opcode
+            if (Random(2)) {
+                a.Op(0xA9, (uint8_t)Random());
+                a.OpWord(0x8D, RAM_ROUTINE + 1);
+            } else {
+                a.Op(0xA9, (uint8_t)(0x05 + 0x20 * Random(4)));
+                a.OpWord(0x8D, RAM_ROUTINE + 3);
+            }
+            break;
+        case 5:
+            a.OpWord(0x20, RAM_ROUTINE);
+            break;
+        default:
+            EmitSimple(a);
+            break;
+        }
+    }
+    a.Op(0xD8);                         // CLD
+    a.OpWord(0x4C, loop);               // JMP loop
+}
+
+// ===== COMPARISON =====
+
+static bool SameState(const Machine& r, const Machine& d) {
+    const mos6502& rc = *r.cpu;
+    const mos6502& dc = *d.cpu;
+    return rc.A == dc.A && rc.X == dc.X && rc.Y == dc.Y && rc.sp == dc.sp && rc.pc == dc.pc &&
+           rc.GetStatus() == dc.GetStatus() && r.cycles == d.cycles && !memcmp(r.mem, d.mem, 0x2000) &&
+           r.log == d.log && r.coprocessor_cycles == d.coprocessor_cycles &&
+           !memcmp(r.coprocessor_mem, d.coprocessor_mem, sizeof r.coprocessor_mem);
+}
+
+static void PrintState(const char* name, const Machine& m) {
+    const mos6502& c = *m.cpu;
+    printf("  %s: A=%02X X=%02X Y=%02X S=%02X P=%02X PC=%04X cyc=%llu irqs=%u io=%zu\n", name, c.A, c.X, c.Y,
+           c.sp, c.GetStatus(), c.pc, (unsigned long long)m.cycles,
+           m.mem[IRQ_COUNT] | (m.mem[IRQ_COUNT + 1] << 8), m.log.size());
+}
+
+static void PrintDifference(const Machine& r, const Machine& d) {
+    PrintState("interpreter", r);
+    PrintState("dynarec    ", d);
+    for (int i = 0; i < 0x2000; i++) {
+        if (r.mem[i] != d.mem[i]) {
+            printf("  first RAM difference at %04X: %02X vs %02X\n", i, r.mem[i], d.mem[i]);
+            break;
+        }
+    }
+    for (size_t i = 0; i < r.log.size() || i < d.log.size(); i++) {
+        if (i < r.log.size() && i < d.log.size() && r.log[i] == d.log[i]) continue;
+        for (int k = 0; k < 2; k++) {
+            const std::vector<IoEvent>& log = k ? d.log : r.log;
+            if (i >= log.size()) continue;
+            printf("  io %zu %s: %s %04X=%02X at %llu\n", i, k ? "dyn" : "ref", log[i].write ? "write" : "read",
+                   log[i].addr, log[i].value, (unsigned long long)log[i].cycle);
+        }
+        break;
+    }
+}
+
+// Run one seed; returns false on the first frame the cores differ
+static bool RunSeed(int seed, uint64_t& irqs) {
+    rng = (uint32_t)seed * 2654435761u + 17;
+    GenerateProgram(machines[0].mem, seed);
+    memcpy(machines[1].mem, machines[0].mem, sizeof machines[1].mem);
+    cached_ram_ptr = machines[1].mem;
+    cached_rom_lo_ptr = machines[1].mem + 0x8000;
+    cached_rom_hi_ptr = machines[1].mem + 0xC000;
+    Dynarec::InvalidateAll();
+
+    mos6502 ref(BusRead<0>, BusWrite<0>, Stopped, BusRead<0>);
+    mos6502 dyn(BusRead<1>, BusWrite<1>, Stopped);
+    ref.EnableMicroOpCache(true);
+    dyn.EnableMicroOpCache(true);
+    // The coprocessors keep to the interpreter tiers, as the host ACP does
+    mos6502 ref_coprocessor(CoprocessorRead<0>, CoprocessorWrite<0>, Stopped, CoprocessorRead<0>);
+    mos6502 dyn_coprocessor(CoprocessorRead<1>, CoprocessorWrite<1>, Stopped, CoprocessorRead<1>);
+    machines[0].cpu = &ref;
+    machines[1].cpu = &dyn;
+    machines[0].coprocessor = &ref_coprocessor;
+    machines[1].coprocessor = &dyn_coprocessor;
+    for (Machine& m : machines) {
+        m.cycles = 0;
+        m.reads = 0;
+        m.log.clear();
+        m.cpu->Reset();
+        GenerateCoprocessorProgram(m.coprocessor_mem);
+        m.coprocessor_cycles = 0;
+        m.coprocessor_stale = 0;
+        m.coprocessor->Reset();
+    }
+
+    for (int frame = 0; frame < FRAMES; frame++) {
+        const int32_t cycles = 500 + (int32_t)Random(4000);
+        for (Machine& m : machines) m.cpu->Run(cycles, m.cycles, mos6502::CYCLE_COUNT);
+        if (!SameState(machines[0], machines[1])) {
+            printf("seed %d: differs after frame %d (%d cycles)\n", seed, frame, cycles);
+            PrintDifference(machines[0], machines[1]);
+            return false;
+        }
+    }
+    for (const Machine& m : machines) {
+        if (m.coprocessor_stale) {
+            printf("seed %d: the coprocessor ran stale code %u times\n", seed, m.coprocessor_stale);
+            return false;
+        }
+    }
+    irqs += machines[1].mem[IRQ_COUNT] | (machines[1].mem[IRQ_COUNT + 1] << 8);
+    if (seed == 0 && (machines[1].mem[IRQ_COUNT] == 0 || dyn.sp < 0xFC)) {
+        printf("seed 0: IRQs from compiled stores not taken\n");
+        PrintState("dynarec", machines[1]);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const int first = argc > 1 ? atoi(argv[1]) : 0;
+    const int last = argc > 2 ? atoi(argv[2]) : 200;
+    int failures = 0;
+    uint64_t irqs = 0;
+    for (int seed = first; seed < last; seed++) {
+        if (!RunSeed(seed, irqs)) failures++;
+    }
+
+    uint64_t baseline, optimized;
+    Dynarec::GetTierCycles(baseline, optimized);
+    printf("seeds %d-%d: %d failed; %llu IRQs; compiled cycles %llu baseline, %llu optimized\n",
+           first, last - 1, failures, (unsigned long long)irqs, (unsigned long long)baseline,
+           (unsigned long long)optimized);
+    if (baseline + optimized == 0) {
+        printf("the dynarec never ran\n");
+        return 1;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+#!/bin/bash
+# Build and run tools/mos6502_difftest.cpp: the host dynarec against the
+# interpreter. Arguments are passed on (first seed, end seed).
+#
+# The CPU core only needs SDL's integer typedefs; without SDL2 installed a
+# stand-in header is generated.
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+out=${OUT:-/tmp/mos6502_difftest}
+mkdir -p "$out"
+
+sdl_flags=$(sdl2-config --cflags 2>/dev/null || true)
+if [ -z "$sdl_flags" ]; then
+	mkdir -p "$out/sdl/SDL2"
+	cat > "$out/sdl/SDL2/SDL.h" <<'SDL'
+#pragma once
+#include <cstdint>
+typedef uint8_t Uint8;
+typedef uint16_t Uint16;
+typedef uint32_t Uint32;
+SDL
+	sdl_flags="-I$out/sdl"
+fi
+
+src=$root/src/mos6502
+${CXX:-g++} -O2 -g -std=c++17 -DCMOS_INDIRECT_JMP_FIX $sdl_flags -I"$src" -I"$root/src" \
+	"$root/tools/mos6502_difftest.cpp" "$src/mos6502.cpp" "$src/dynarec_cpu.cpp" "$src/dynarec_ir.cpp" \
+	"$src/dynarec_x64.cpp" "$src/dynarec_emitter_x64.cpp" -o "$out/mos6502_difftest"
+"$out/mos6502_difftest" "$@"